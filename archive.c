@@ -19,6 +19,7 @@
 #include "main.h"
 #include "browser.h"
 #include "archive.h"
+#include "archive_cache.h"
 #include "psarc.h"
 #include "file.h"
 #include "utils.h"
@@ -39,11 +40,21 @@ void waitpid() {}
 void __archive_create_child() {}
 void __archive_check_child() {}
 
+enum ArchiveSources {
+  ARCHIVE_SOURCE_FILE,   // Archive file on storage
+  ARCHIVE_SOURCE_ENTRY,  // Entry streamed from an enclosing archive
+  ARCHIVE_SOURCE_MEMORY, // Entry spooled from an enclosing archive
+};
+
 struct archive_data {
   char *filename;
   SceUID fd;
   void *buffer;
   int block_size;
+  int source;
+  struct archive *parent;
+  int64_t offset;
+  int64_t size;
 };
 
 static const char *file_passphrase(struct archive *a, void *client_data) {
@@ -53,6 +64,10 @@ static const char *file_passphrase(struct archive *a, void *client_data) {
 static int file_open(struct archive *a, void *client_data) {
   struct archive_data *archive_data = client_data;
   
+  // Nested archives are already positioned on their entry
+  if (archive_data->source != ARCHIVE_SOURCE_FILE)
+    return ARCHIVE_OK;
+  
   archive_data->fd = sceIoOpen(archive_data->filename, SCE_O_RDONLY, 0);
   if (archive_data->fd < 0)
     return ARCHIVE_FATAL;
@@ -65,14 +80,60 @@ static int file_open(struct archive *a, void *client_data) {
 
 static ssize_t file_read(struct archive *a, void *client_data, const void **buff) {
   struct archive_data *archive_data = client_data;
+  
+  if (archive_data->source == ARCHIVE_SOURCE_MEMORY) {
+    int64_t read = MIN(archive_data->block_size, archive_data->size - archive_data->offset);
+    *buff = (char *)archive_data->buffer + archive_data->offset;
+    archive_data->offset += read;
+    return read;
+  }
+  
   *buff = archive_data->buffer;
+  
+  if (archive_data->source == ARCHIVE_SOURCE_ENTRY)
+    return archive_read_data(archive_data->parent, archive_data->buffer, archive_data->block_size);
+  
   return sceIoRead(archive_data->fd, archive_data->buffer, archive_data->block_size);
 }
 
+static int64_t memory_seek(struct archive_data *archive_data, int64_t request, int whence) {
+  int64_t offset;
+  
+  switch (whence) {
+    case SCE_SEEK_SET:
+      offset = request;
+      break;
+    case SCE_SEEK_CUR:
+      offset = archive_data->offset + request;
+      break;
+    case SCE_SEEK_END:
+      offset = archive_data->size + request;
+      break;
+    default:
+      return -1;
+  }
+  
+  if (offset < 0)
+    return -1;
+  
+  archive_data->offset = MIN(offset, archive_data->size);
+  return archive_data->offset;
+}
+
 static int64_t file_skip(struct archive *a, void *client_data, int64_t request) {
   struct archive_data *archive_data = client_data;
   int64_t old_offset, new_offset;
 
+  // A streamed entry can't skip, libarchive reads over it instead
+  if (archive_data->source == ARCHIVE_SOURCE_ENTRY)
+    return 0;
+
+  if (archive_data->source == ARCHIVE_SOURCE_MEMORY) {
+    old_offset = archive_data->offset;
+    new_offset = memory_seek(archive_data, request, SCE_SEEK_CUR);
+    return (new_offset >= 0) ? (new_offset - old_offset) : -1;
+  }
+
   if ((old_offset = sceIoLseek(archive_data->fd, 0, SCE_SEEK_CUR)) >= 0 &&
       (new_offset = sceIoLseek(archive_data->fd, request, SCE_SEEK_CUR)) >= 0)
     return new_offset - old_offset;
@@ -84,7 +145,14 @@ static int64_t file_seek(struct archive *a, void *client_data, int64_t request,
   struct archive_data *archive_data = client_data;
   int64_t r;
 
-  r = sceIoLseek(archive_data->fd, request, whence);
+  if (archive_data->source == ARCHIVE_SOURCE_ENTRY)
+    return ARCHIVE_FATAL;
+
+  if (archive_data->source == ARCHIVE_SOURCE_MEMORY)
+    r = memory_seek(archive_data, request, whence);
+  else
+    r = sceIoLseek(archive_data->fd, request, whence);
+
   if (r >= 0)
     return r;
 
@@ -99,6 +167,11 @@ static int file_close2(struct archive *a, void *client_data) {
     archive_data->fd = -1;
   }
 
+  if (archive_data->parent) {
+    archive_read_free(archive_data->parent);
+    archive_data->parent = NULL;
+  }
+
   free(archive_data->buffer);
   archive_data->buffer = NULL;
 
@@ -121,6 +194,9 @@ static int file_switch(struct archive *a, void *client_data1, void *client_data2
 int append_archive(struct archive *a, const char *filename) {
   struct archive_data *archive_data = malloc(sizeof(struct archive_data));
   if (archive_data) {
+    memset(archive_data, 0, sizeof(struct archive_data));
+    archive_data->fd = -1;
+    archive_data->source = ARCHIVE_SOURCE_FILE;
     archive_data->filename = malloc(strlen(filename) + 1);
     strcpy(archive_data->filename, filename);
     if (archive_read_append_callback_data(a, archive_data) != ARCHIVE_OK) {
@@ -133,7 +209,7 @@ int append_archive(struct archive *a, const char *filename) {
   return ARCHIVE_OK;
 }
 
-struct archive *open_archive(const char *filename) {
+static struct archive *new_archive() {
   struct archive *a = archive_read_new();
   if (!a)
     return NULL;
@@ -149,6 +225,161 @@ struct archive *open_archive(const char *filename) {
   archive_read_set_switch_callback(a, file_switch);
   archive_read_set_seek_callback(a, file_seek);
   
+  return a;
+}
+
+// Opens an archive whose data is the current entry of the parent archive
+static struct archive *open_archive_entry(struct archive *parent, const char *name, int64_t size) {
+  struct archive_data *archive_data = malloc(sizeof(struct archive_data));
+  if (!archive_data) {
+    archive_read_free(parent);
+    return NULL;
+  }
+  
+  memset(archive_data, 0, sizeof(struct archive_data));
+  archive_data->fd = -1;
+  archive_data->filename = malloc(strlen(name) + 1);
+  if (archive_data->filename)
+    strcpy(archive_data->filename, name);
+  
+  // Spool small entries so that seekable formats like 7z and zip can be read
+  if (size >= 0 && size <= NESTED_ARCHIVE_SPOOL_SIZE)
+    archive_data->buffer = malloc(size > 0 ? size : 1);
+  
+  if (archive_data->buffer) {
+    int64_t offset = 0;
+    
+    while (offset < size) {
+      ssize_t read = archive_read_data(parent, (char *)archive_data->buffer + offset, MIN(size - offset, TRANSFER_SIZE));
+      if (read <= 0)
+        break;
+      
+      offset += read;
+    }
+    
+    archive_read_free(parent);
+    
+    if (offset != size) {
+      free(archive_data->buffer);
+      free(archive_data->filename);
+      free(archive_data);
+      return NULL;
+    }
+    
+    archive_data->source = ARCHIVE_SOURCE_MEMORY;
+    archive_data->block_size = TRANSFER_SIZE;
+    archive_data->size = size;
+  } else {
+    archive_data->buffer = memalign(4096, TRANSFER_SIZE);
+    if (!archive_data->buffer) {
+      archive_read_free(parent);
+      free(archive_data->filename);
+      free(archive_data);
+      return NULL;
+    }
+    
+    archive_data->source = ARCHIVE_SOURCE_ENTRY;
+    archive_data->block_size = TRANSFER_SIZE;
+    archive_data->parent = parent;
+  }
+  
+  struct archive *a = new_archive();
+  if (!a) {
+    file_close(NULL, archive_data);
+    return NULL;
+  }
+  
+  // Streamed entries are not seekable
+  if (archive_data->source == ARCHIVE_SOURCE_ENTRY)
+    archive_read_set_seek_callback(a, NULL);
+  
+  if (archive_read_append_callback_data(a, archive_data) != ARCHIVE_OK) {
+    file_close(NULL, archive_data);
+    archive_read_free(a);
+    return NULL;
+  }
+  
+  if (archive_read_open1(a)) {
+    archive_read_free(a);
+    return NULL;
+  }
+  
+  return a;
+}
+
+// Opens an archive located inside other archives, e.g. ux0:outer.7z/dir/inner.zip
+static struct archive *open_nested_archive(const char *filename) {
+  char path[MAX_PATH_LENGTH];
+  strncpy(path, filename, MAX_PATH_LENGTH - 1);
+  path[MAX_PATH_LENGTH - 1] = '\0';
+  
+  // Find the outermost archive on storage
+  char *p = strchr(path, '/');
+  while (p) {
+    *p = '\0';
+    int exist = checkFileExist(path);
+    *p = '/';
+    
+    if (exist)
+      break;
+    
+    p = strchr(p + 1, '/');
+  }
+  
+  if (!p)
+    return NULL;
+  
+  *p = '\0';
+  struct archive *a = open_archive(path);
+  if (!a)
+    return NULL;
+  
+  // Walk down the chain of archives
+  const char *rest = p + 1;
+  int depth = 0;
+  
+  while (1) {
+    struct archive_entry *archive_entry;
+    int res = archive_read_next_header(a, &archive_entry);
+    if (res != ARCHIVE_OK) {
+      archive_read_free(a);
+      return NULL;
+    }
+    
+    if (archive_entry_filetype(archive_entry) != AE_IFREG)
+      continue;
+    
+    const char *name = archive_entry_pathname(archive_entry);
+    int len = strlen(name);
+    if (strncasecmp(name, rest, len) != 0 || (rest[len] != '\0' && rest[len] != '/'))
+      continue;
+    
+    if (++depth > MAX_NESTED_ARCHIVES) {
+      archive_read_free(a);
+      return NULL;
+    }
+    
+    a = open_archive_entry(a, name, archive_entry_size_is_set(archive_entry) ? archive_entry_size(archive_entry) : -1);
+    if (!a)
+      return NULL;
+    
+    if (rest[len] == '\0')
+      break;
+    
+    rest += len + 1;
+  }
+  
+  return a;
+}
+
+struct archive *open_archive(const char *filename) {
+  if (!checkFileExist(filename))
+    return open_nested_archive(filename);
+  
+  struct archive *a = new_archive();
+  if (!a)
+    return NULL;
+  
   // Get path and name of filename
   int type = 0;
   
@@ -845,12 +1076,26 @@ int archiveFileClose(SceUID fd) {
 }
 
 int ReadArchiveFile(const char *file, void *buf, int size) {
+  // Recently decompressed entry
+  int read = archiveCacheGet(file, buf, size);
+  if (read >= 0)
+    return read;
+
   SceUID fd = archiveFileOpen(file, SCE_O_RDONLY, 0);
   if (fd < 0)
     return fd;
 
-  int read = archiveFileRead(fd, buf, size);
+  read = archiveFileRead(fd, buf, size);
   archiveFileClose(fd);
+
+  // Only cache complete entries
+  if (read > 0) {
+    SceIoStat stat;
+    memset(&stat, 0, sizeof(SceIoStat));
+    if (archiveFileGetstat(file, &stat) >= 0 && stat.st_size == read)
+      archiveCachePut(file, buf, read);
+  }
+
   return read;
 }
 
@@ -872,6 +1117,7 @@ int archiveClose() {
     return psarcClose();
   
   freeArchiveNodes(archive_root);
+  archive_root = NULL;
   return 0;
 }
 
@@ -885,11 +1131,16 @@ SceMode convert_stat_mode(mode_t mode) {
 }
 
 int archiveOpen(const char *file) {
-  // Read magic
-  uint32_t magic;
-  int read = ReadFile(file, &magic, sizeof(uint32_t));
-  if (read < 0)
-    return read;
+  // Read magic, archives inside archives can't be PSARC
+  uint32_t magic = 0;
+  if (checkFileExist(file)) {
+    int read = ReadFile(file, &magic, sizeof(uint32_t));
+    if (read < 0)
+      return read;
+  }
+  
+  // Identify archive for the entry cache
+  archiveCacheSetArchive(file);
   
   // PSARC file
   is_psarc = 0;
@@ -23,6 +23,10 @@
 
 #define ARCHIVE_FD 0x12345678
 
+// Inner archives up to this size are decompressed to memory so they can be seeked
+#define NESTED_ARCHIVE_SPOOL_SIZE (32 * 1024 * 1024)
+#define MAX_NESTED_ARCHIVES 8
+
 int fileListGetArchiveEntries(FileList *list, const char *path, int sort);
 
 int getArchivePathInfo(const char *path, uint64_t *size, uint32_t *folders, uint32_t *files, int (* handler)(const char *path));
@@ -43,4 +47,7 @@ void archiveSetPassword(char *string);
 
 int archiveCheckFilesForUnsafeFself();
 
+// Reader for the archive, also for archives inside of archives
+struct archive *open_archive(const char *filename);
+
 #endif
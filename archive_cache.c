@@ -0,0 +1,231 @@
+/*
+  VitaShell
+  Copyright (C) 2015-2018, TheFloW
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "main.h"
+#include "archive_cache.h"
+
+static SceKernelLwMutexWork cache_mutex;
+
+// Most recently used entry at head
+static ArchiveCacheEntry *cache_head = NULL;
+static ArchiveCacheEntry *cache_tail = NULL;
+
+static uint64_t cache_budget = 0;
+static uint64_t cache_used = 0;
+
+// Identity of the currently opened archive
+static char current_path[MAX_PATH_LENGTH];
+static SceOff current_size = 0;
+static SceDateTime current_mtime;
+static int current_valid = 0;
+
+static void cacheUnlink(ArchiveCacheEntry *entry) {
+  if (entry->previous)
+    entry->previous->next = entry->next;
+  else
+    cache_head = entry->next;
+
+  if (entry->next)
+    entry->next->previous = entry->previous;
+  else
+    cache_tail = entry->previous;
+
+  entry->next = NULL;
+  entry->previous = NULL;
+}
+
+static void cacheLinkHead(ArchiveCacheEntry *entry) {
+  entry->previous = NULL;
+  entry->next = cache_head;
+
+  if (cache_head)
+    cache_head->previous = entry;
+  else
+    cache_tail = entry;
+
+  cache_head = entry;
+}
+
+static void cacheFreeEntry(ArchiveCacheEntry *entry) {
+  cache_used -= entry->size;
+  free(entry->archive_path);
+  free(entry->entry_path);
+  free(entry->data);
+  free(entry);
+}
+
+static void cacheEvict(int needed) {
+  while (cache_tail && (cache_used + needed) > cache_budget) {
+    ArchiveCacheEntry *entry = cache_tail;
+    cacheUnlink(entry);
+    cacheFreeEntry(entry);
+  }
+}
+
+static ArchiveCacheEntry *cacheFind(const char *entry_path) {
+  ArchiveCacheEntry *entry = cache_head;
+
+  while (entry) {
+    if (entry->archive_size == current_size &&
+        memcmp(&entry->archive_mtime, &current_mtime, sizeof(SceDateTime)) == 0 &&
+        strcmp(entry->entry_path, entry_path) == 0 &&
+        strcmp(entry->archive_path, current_path) == 0)
+      return entry;
+
+    entry = entry->next;
+  }
+
+  return NULL;
+}
+
+void initArchiveCache(int budget_mb) {
+  sceKernelCreateLwMutex(&cache_mutex, "archive_cache_mutex", 2, 0, NULL);
+
+  if (budget_mb < 0)
+    budget_mb = 0;
+
+  cache_budget = (uint64_t)budget_mb << 20;
+  cache_used = 0;
+  current_valid = 0;
+}
+
+void archiveCacheClear() {
+  sceKernelLockLwMutex(&cache_mutex, 1, NULL);
+
+  while (cache_head) {
+    ArchiveCacheEntry *entry = cache_head;
+    cacheUnlink(entry);
+    cacheFreeEntry(entry);
+  }
+
+  sceKernelUnlockLwMutex(&cache_mutex, 1);
+}
+
+int archiveCacheSetArchive(const char *archive_path) {
+  SceIoStat stat;
+  memset(&stat, 0, sizeof(SceIoStat));
+
+  sceKernelLockLwMutex(&cache_mutex, 1, NULL);
+
+  current_valid = 0;
+
+  // Archives inside archives are identified by the outermost archive file
+  char path[MAX_PATH_LENGTH];
+  strncpy(path, archive_path, MAX_PATH_LENGTH - 1);
+  path[MAX_PATH_LENGTH - 1] = '\0';
+
+  int res = sceIoGetstat(path, &stat);
+  while (res < 0) {
+    char *p = strrchr(path, '/');
+    if (!p)
+      break;
+
+    *p = '\0';
+    res = sceIoGetstat(path, &stat);
+  }
+
+  if (res >= 0) {
+    strncpy(current_path, archive_path, MAX_PATH_LENGTH - 1);
+    current_path[MAX_PATH_LENGTH - 1] = '\0';
+    current_size = stat.st_size;
+    memcpy(&current_mtime, &stat.st_mtime, sizeof(SceDateTime));
+    current_valid = 1;
+  }
+
+  sceKernelUnlockLwMutex(&cache_mutex, 1);
+
+  return res;
+}
+
+int archiveCacheGet(const char *entry_path, void *buf, int size) {
+  sceKernelLockLwMutex(&cache_mutex, 1, NULL);
+
+  if (cache_budget == 0 || !current_valid) {
+    sceKernelUnlockLwMutex(&cache_mutex, 1);
+    return VITASHELL_ERROR_NOT_FOUND;
+  }
+
+  ArchiveCacheEntry *entry = cacheFind(entry_path);
+  if (!entry) {
+    sceKernelUnlockLwMutex(&cache_mutex, 1);
+    return VITASHELL_ERROR_NOT_FOUND;
+  }
+
+  // Move to head
+  cacheUnlink(entry);
+  cacheLinkHead(entry);
+
+  int read = MIN(size, entry->size);
+  memcpy(buf, entry->data, read);
+
+  sceKernelUnlockLwMutex(&cache_mutex, 1);
+
+  return read;
+}
+
+int archiveCachePut(const char *entry_path, const void *data, int size) {
+  sceKernelLockLwMutex(&cache_mutex, 1, NULL);
+
+  // Entries that would evict everything else are not worth keeping
+  if (!current_valid || size <= 0 || (uint64_t)size > cache_budget / 2) {
+    sceKernelUnlockLwMutex(&cache_mutex, 1);
+    return VITASHELL_ERROR_INVALID_ARGUMENT;
+  }
+
+  ArchiveCacheEntry *entry = malloc(sizeof(ArchiveCacheEntry));
+  if (!entry) {
+    sceKernelUnlockLwMutex(&cache_mutex, 1);
+    return VITASHELL_ERROR_NO_MEMORY;
+  }
+
+  memset(entry, 0, sizeof(ArchiveCacheEntry));
+
+  entry->data = malloc(size);
+  entry->entry_path = malloc(strlen(entry_path) + 1);
+  entry->archive_path = malloc(strlen(current_path) + 1);
+  if (!entry->data || !entry->entry_path || !entry->archive_path) {
+    free(entry->data);
+    free(entry->entry_path);
+    free(entry->archive_path);
+    free(entry);
+    sceKernelUnlockLwMutex(&cache_mutex, 1);
+    return VITASHELL_ERROR_NO_MEMORY;
+  }
+
+  memcpy(entry->data, data, size);
+  entry->size = size;
+  strcpy(entry->entry_path, entry_path);
+  strcpy(entry->archive_path, current_path);
+  entry->archive_size = current_size;
+  memcpy(&entry->archive_mtime, &current_mtime, sizeof(SceDateTime));
+
+  // Replace stale copy
+  ArchiveCacheEntry *old = cacheFind(entry_path);
+  if (old) {
+    cacheUnlink(old);
+    cacheFreeEntry(old);
+  }
+
+  cacheEvict(size);
+  cacheLinkHead(entry);
+  cache_used += size;
+
+  sceKernelUnlockLwMutex(&cache_mutex, 1);
+
+  return 0;
+}
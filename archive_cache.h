@@ -0,0 +1,44 @@
+/*
+  VitaShell
+  Copyright (C) 2015-2018, TheFloW
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __ARCHIVE_CACHE_H__
+#define __ARCHIVE_CACHE_H__
+
+// Default memory budget in MB, overridable with ARCHIVE_CACHE_SIZE in settings.txt
+#define ARCHIVE_CACHE_DEFAULT_SIZE 8
+
+typedef struct ArchiveCacheEntry {
+  struct ArchiveCacheEntry *next;
+  struct ArchiveCacheEntry *previous;
+  char *archive_path;
+  SceOff archive_size;
+  SceDateTime archive_mtime;
+  char *entry_path;
+  void *data;
+  int size;
+} ArchiveCacheEntry;
+
+void initArchiveCache(int budget_mb);
+void archiveCacheClear();
+
+int archiveCacheSetArchive(const char *archive_path);
+
+int archiveCacheGet(const char *entry_path, void *buf, int size);
+int archiveCachePut(const char *entry_path, const void *data, int size);
+
+#endif
@@ -0,0 +1,490 @@
+/*
+	VitaShell
+	Copyright (C) 2015-2018, TheFloW
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <psp2/io/fcntl.h>
+#include <psp2/io/stat.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "mp3xing.h"
+#include "mp3index.h"
+
+typedef struct {
+    unsigned int magic;
+    unsigned int version;
+    uint64_t path_hash;
+    SceOff size;
+    SceDateTime mtime;
+} Mp3IndexCacheHeader;
+
+// Windowed reads of the file, refilled only when a request leaves the window
+typedef struct {
+    SceUID fd;
+    unsigned int size;
+    unsigned char *buffer;
+    unsigned int capacity;
+    unsigned int offset;
+    unsigned int length;
+} Mp3Reader;
+
+static const unsigned short bitrates[2][3][16] = {
+    { // MPEG 1
+        { 0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416, 448, 0 },
+        { 0, 32, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384, 0 },
+        { 0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 0 },
+    },
+    { // MPEG 2 and 2.5
+        { 0, 32, 48, 56, 64, 80, 96, 112, 128, 144, 160, 176, 192, 224, 256, 0 },
+        { 0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160, 0 },
+        { 0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160, 0 },
+    },
+};
+
+static const unsigned int samplerates[3] = { 44100, 48000, 32000 };
+
+// Returns 1 if data starts with a valid frame header. Free format is not supported.
+int mp3ParseHeader(const unsigned char *data, struct mp3FrameHeader *header) {
+    if (data[0] != 0xFF || (data[1] & 0xE0) != 0xE0)
+        return 0;
+
+    int version = (data[1] >> 3) & 0x3;
+    int layer = 4 - ((data[1] >> 1) & 0x3);
+    int bitrate_index = data[2] >> 4;
+    int samplerate_index = (data[2] >> 2) & 0x3;
+    int padding = (data[2] >> 1) & 0x1;
+
+    if (version == 1 || layer == 4 || bitrate_index == 0 || bitrate_index == 15 || samplerate_index == 3)
+        return 0;
+
+    int lsf = version != 3;
+    header->version = version;
+    header->layer = layer;
+    header->channels = (data[3] >> 6) == 3 ? 1 : 2;
+    header->hz = samplerates[samplerate_index] >> (version == 3 ? 0 : (version == 2 ? 1 : 2));
+    header->kbit = bitrates[lsf][layer - 1][bitrate_index];
+
+    if (layer == 1) {
+        header->samples = 384;
+        header->length = (12000 * header->kbit / header->hz + padding) * 4;
+    } else if (layer == 2) {
+        header->samples = 1152;
+        header->length = 144000 * header->kbit / header->hz + padding;
+    } else {
+        header->samples = lsf ? 576 : 1152;
+        header->length = (lsf ? 72000 : 144000) * header->kbit / header->hz + padding;
+    }
+
+    return 1;
+}
+
+static int same_stream(struct mp3FrameHeader *a, struct mp3FrameHeader *b) {
+    return a->version == b->version && a->layer == b->layer && a->hz == b->hz;
+}
+
+static const unsigned char *reader_get(Mp3Reader *reader, unsigned int offset, unsigned int length) {
+    if (offset >= reader->offset && offset + length <= reader->offset + reader->length)
+        return reader->buffer + (offset - reader->offset);
+
+    if (offset + length > reader->size || length > reader->capacity)
+        return NULL;
+
+    int res = sceIoPread(reader->fd, reader->buffer, reader->capacity, offset);
+    if (res < (int)length)
+        return NULL;
+
+    reader->offset = offset;
+    reader->length = res;
+    return reader->buffer;
+}
+
+// Finds a frame header followed by another one of the same stream, so
+// that a stray 0xFF in tags or audio data is not taken for a frame.
+static int find_sync(Mp3Reader *reader, unsigned int offset, struct mp3FrameHeader *reference, struct mp3FrameHeader *header) {
+    while (offset + 4 <= reader->size) {
+        const unsigned char *data = reader_get(reader, offset, 4);
+        if (!data)
+            return -1;
+
+        if (mp3ParseHeader(data, header) && (!reference || same_stream(header, reference))) {
+            unsigned int next = offset + header->length;
+            struct mp3FrameHeader next_header;
+
+            if (next == reader->size)
+                return offset;
+
+            data = reader_get(reader, next, 4);
+            if (data && mp3ParseHeader(data, &next_header) && same_stream(header, &next_header))
+                return offset;
+        }
+
+        offset++;
+    }
+
+    return -1;
+}
+
+int mp3IndexSync(SceUID fd, unsigned int offset, unsigned int end) {
+    unsigned char buffer[4096];
+    struct mp3FrameHeader header;
+
+    Mp3Reader reader;
+    memset(&reader, 0, sizeof(Mp3Reader));
+    reader.fd = fd;
+    reader.size = end;
+    reader.buffer = buffer;
+    reader.capacity = sizeof(buffer);
+
+    return find_sync(&reader, offset, NULL, &header);
+}
+
+static void add_point(struct mp3Index *index, unsigned int *stride, unsigned int frame, unsigned int offset) {
+    if (frame % *stride)
+        return;
+
+    // Full, keep every other point and double the distance between them
+    if (index->count == MP3_INDEX_MAX_POINTS) {
+        unsigned int i, count = 0;
+
+        *stride *= 2;
+        for (i = 0; i < index->count; i++) {
+            if ((index->points[i].frame % *stride) == 0)
+                index->points[count++] = index->points[i];
+        }
+        index->count = count;
+
+        if (frame % *stride)
+            return;
+    }
+
+    index->points[index->count].frame = frame;
+    index->points[index->count].offset = offset;
+    index->count++;
+}
+
+static void xing_points(struct mp3Index *index, struct xing *xing, unsigned int start) {
+    int i;
+
+    index->points[0].frame = 0;
+    index->points[0].offset = index->firstFrame;
+    index->count = 1;
+
+    // The TOC maps percent of the track to 1/256 of the bytes from the Xing frame
+    for (i = 1; i < 100; i++) {
+        unsigned int frame = (unsigned long long)i * index->frames / 100;
+        unsigned int offset = start + (unsigned long long)xing->toc[i] * xing->bytes / 256;
+
+        if (offset <= index->points[index->count - 1].offset)
+            continue;
+
+        index->points[index->count].frame = frame;
+        index->points[index->count].offset = offset;
+        index->count++;
+    }
+}
+
+static void vbri_points(struct mp3Index *index, struct vbri *vbri, const unsigned char *toc, unsigned int start) {
+    unsigned int frame = 0, offset = start;
+    int i, j;
+
+    index->points[0].frame = 0;
+    index->points[0].offset = index->firstFrame;
+    index->count = 1;
+
+    for (i = 0; i < vbri->tocEntries && index->count < MP3_INDEX_MAX_POINTS; i++) {
+        unsigned int size = 0;
+        for (j = 0; j < vbri->tocEntrySize; j++)
+            size = (size << 8) | *toc++;
+
+        offset += size * vbri->tocScale;
+        frame += vbri->tocFramesPerEntry;
+        if (frame >= index->frames)
+            break;
+
+        index->points[index->count].frame = frame;
+        index->points[index->count].offset = offset;
+        index->count++;
+    }
+}
+
+static int build_index(struct mp3Index *index, Mp3Reader *reader, unsigned int start) {
+    struct mp3FrameHeader first, header;
+
+    int offset = find_sync(reader, start, NULL, &first);
+    if (offset < 0)
+        return -1;
+
+    index->source = MP3_INDEX_SCAN;
+    index->firstFrame = offset;
+    index->frames = 0;
+    index->samplesPerFrame = first.samples;
+    index->hz = first.hz;
+    index->encoderDelay = -1;
+    index->encoderPadding = -1;
+    index->count = 0;
+
+    // A Xing/Info or VBRI header takes the place of the side info of the first frame
+    const unsigned char *data = reader_get(reader, offset, XING_BUFFER_SIZE);
+    if (data) {
+        int xing_offset = 4 + (first.version == 3 ? (first.channels == 1 ? 17 : 32) : (first.channels == 1 ? 9 : 17));
+        struct xing xing;
+        struct vbri vbri;
+
+        memset(&xing, 0, sizeof(struct xing));
+
+        if ((!memcmp(data + xing_offset, XING_GUID, 4) || !memcmp(data + xing_offset, INFO_GUID, 4)) &&
+            parse_xing((unsigned char *)data, xing_offset, &xing)) {
+            index->firstFrame = offset + first.length;
+            index->encoderDelay = xing.encoderDelay;
+            index->encoderPadding = xing.encoderPadding;
+
+            if ((xing.flags & XING_FRAMES) && (xing.flags & XING_BYTES) && (xing.flags & XING_TOC) &&
+                xing.frames > 0 && xing.bytes > 0) {
+                index->source = MP3_INDEX_XING;
+                index->frames = xing.frames;
+                xing_points(index, &xing, offset);
+                return 0;
+            }
+        } else if (parse_vbri((unsigned char *)data, &vbri) && vbri.frames > 0 &&
+                   vbri.tocEntrySize >= 1 && vbri.tocEntrySize <= 4) {
+            unsigned int toc_size = VBRI_OFFSET + VBRI_HEADER_SIZE + vbri.tocEntries * vbri.tocEntrySize;
+            const unsigned char *toc = reader_get(reader, offset, toc_size);
+
+            index->firstFrame = offset + first.length;
+
+            if (toc) {
+                index->source = MP3_INDEX_VBRI;
+                index->frames = vbri.frames;
+                vbri_points(index, &vbri, toc + VBRI_OFFSET + VBRI_HEADER_SIZE, offset);
+                return 0;
+            }
+        }
+    }
+
+    // No usable TOC, walk the frame headers
+    unsigned int stride = 1;
+    unsigned int frame = 0;
+    unsigned int position = index->firstFrame;
+
+    while (1) {
+        data = reader_get(reader, position, 4);
+        if (!data)
+            break;
+
+        if (mp3ParseHeader(data, &header) && same_stream(&header, &first)) {
+            if (position + header.length > reader->size)
+                break;
+
+            add_point(index, &stride, frame, position);
+            frame++;
+            position += header.length;
+            continue;
+        }
+
+        int next = find_sync(reader, position + 1, &first, &header);
+        if (next < 0)
+            break;
+        position = next;
+    }
+
+    index->frames = frame;
+    return frame > 0 ? 0 : -1;
+}
+
+static uint64_t hash_path(const char *path) {
+    uint64_t hash = 0xCBF29CE484222325ULL;
+
+    while (*path) {
+        hash ^= (uint8_t)*path++;
+        hash *= 0x100000001B3ULL;
+    }
+
+    return hash;
+}
+
+static void cache_path(char *path, int size, uint64_t hash) {
+    snprintf(path, size, "%s/%08X%08X.bin", MP3_INDEX_CACHE_DIR, (unsigned int)(hash >> 32), (unsigned int)hash);
+}
+
+static int load_cache(struct mp3Index *index, const char *path, Mp3IndexCacheHeader *key) {
+    Mp3IndexCacheHeader header;
+    int res = -1;
+
+    SceUID fd = sceIoOpen(path, SCE_O_RDONLY, 0);
+    if (fd < 0)
+        return fd;
+
+    if (sceIoRead(fd, &header, sizeof(Mp3IndexCacheHeader)) != sizeof(Mp3IndexCacheHeader) ||
+        memcmp(&header, key, sizeof(Mp3IndexCacheHeader)) != 0)
+        goto EXIT;
+
+    if (sceIoRead(fd, index, offsetof(struct mp3Index, points)) != offsetof(struct mp3Index, points) ||
+        index->count == 0 || index->count > MP3_INDEX_MAX_POINTS)
+        goto EXIT;
+
+    int size = index->count * sizeof(struct mp3IndexPoint);
+    if (sceIoRead(fd, index->points, size) != size)
+        goto EXIT;
+
+    res = 0;
+
+EXIT:
+    sceIoClose(fd);
+    return res;
+}
+
+static void save_cache(struct mp3Index *index, const char *path, Mp3IndexCacheHeader *key) {
+    sceIoMkdir(MP3_INDEX_CACHE_DIR, 0777);
+
+    SceUID fd = sceIoOpen(path, SCE_O_WRONLY | SCE_O_CREAT | SCE_O_TRUNC, 0777);
+    if (fd < 0)
+        return;
+
+    int size = index->count * sizeof(struct mp3IndexPoint);
+    if (sceIoWrite(fd, key, sizeof(Mp3IndexCacheHeader)) != sizeof(Mp3IndexCacheHeader) ||
+        sceIoWrite(fd, index, offsetof(struct mp3Index, points)) != offsetof(struct mp3Index, points) ||
+        sceIoWrite(fd, index->points, size) != size) {
+        sceIoClose(fd);
+        sceIoRemove(path);
+        return;
+    }
+
+    sceIoClose(fd);
+}
+
+// Fills index from the cache, or from the file starting the search for
+// the first frame at start. Cached indexes are dropped when the file changes.
+int mp3IndexLoad(struct mp3Index *index, const char *filename, unsigned int start) {
+    SceIoStat stat;
+    char path[128];
+
+    memset(&stat, 0, sizeof(SceIoStat));
+    if (sceIoGetstat(filename, &stat) < 0)
+        return -1;
+
+    Mp3IndexCacheHeader key;
+    memset(&key, 0, sizeof(Mp3IndexCacheHeader));
+    key.magic = MP3_INDEX_MAGIC;
+    key.version = MP3_INDEX_VERSION;
+    key.path_hash = hash_path(filename);
+    key.size = stat.st_size;
+    key.mtime = stat.st_mtime;
+
+    cache_path(path, sizeof(path), key.path_hash);
+    if (load_cache(index, path, &key) == 0)
+        return 0;
+
+    Mp3Reader reader;
+    memset(&reader, 0, sizeof(Mp3Reader));
+    reader.fd = sceIoOpen(filename, SCE_O_RDONLY, 0);
+    if (reader.fd < 0)
+        return reader.fd;
+
+    reader.size = stat.st_size;
+    reader.capacity = MP3_INDEX_SCAN_SIZE;
+    reader.buffer = malloc(MP3_INDEX_SCAN_SIZE);
+    if (!reader.buffer) {
+        sceIoClose(reader.fd);
+        return -1;
+    }
+
+    int res = build_index(index, &reader, start);
+
+    free(reader.buffer);
+    sceIoClose(reader.fd);
+
+    if (res >= 0)
+        save_cache(index, path, &key);
+
+    return res;
+}
+
+// Last point at or before frame
+const struct mp3IndexPoint *mp3IndexFind(struct mp3Index *index, unsigned int frame) {
+    unsigned int low = 0, high = index->count;
+
+    while (high - low > 1) {
+        unsigned int middle = (low + high) / 2;
+        if (index->points[middle].frame <= frame)
+            low = middle;
+        else
+            high = middle;
+    }
+
+    return &index->points[low];
+}
+
+// Frame at a file offset, interpolated between the points around it
+unsigned int mp3IndexFrameAt(struct mp3Index *index, unsigned int offset) {
+    unsigned int low = 0, high = index->count;
+    unsigned int frame;
+
+    while (high - low > 1) {
+        unsigned int middle = (low + high) / 2;
+        if (index->points[middle].offset <= offset)
+            low = middle;
+        else
+            high = middle;
+    }
+
+    const struct mp3IndexPoint *point = &index->points[low];
+    if (offset <= point->offset)
+        return point->frame;
+
+    if (low + 1 < index->count) {
+        const struct mp3IndexPoint *next = point + 1;
+        frame = point->frame + (unsigned long long)(offset - point->offset) * (next->frame - point->frame) / (next->offset - point->offset);
+    } else if (point->frame > 0) {
+        frame = point->frame + (unsigned long long)(offset - point->offset) * point->frame / (point->offset - index->points[0].offset);
+    } else {
+        frame = point->frame;
+    }
+
+    return frame < index->frames ? frame : index->frames;
+}
+
+// Playable samples, without the encoder delay and padding
+unsigned int mp3IndexSamples(struct mp3Index *index) {
+    unsigned long long samples = (unsigned long long)index->frames * index->samplesPerFrame;
+    unsigned int trim = (index->encoderDelay > 0 ? index->encoderDelay : 0) + (index->encoderPadding > 0 ? index->encoderPadding : 0);
+
+    return samples > trim ? (unsigned int)(samples - trim) : 0;
+}
+
+// Narrows [*start, *length) of a decoded frame to the samples that are
+// played: the encoder and decoder delay are dropped at the start, the
+// padding less the decoder delay at the end. Returns 0 if none are.
+int mp3IndexTrim(struct mp3Index *index, unsigned int frame, unsigned int *start, unsigned int *length) {
+    if (index->encoderDelay < 0)
+        return 1;
+
+    unsigned long long first = (unsigned long long)frame * index->samplesPerFrame;
+    unsigned long long begin = index->encoderDelay + MP3_DECODER_DELAY;
+    unsigned long long end = begin + mp3IndexSamples(index);
+
+    if (first + *length <= begin || first >= end)
+        return 0;
+    if (first < begin)
+        *start = begin - first;
+    if (first + *length > end)
+        *length = end - first;
+
+    return 1;
+}
@@ -0,0 +1,80 @@
+/*
+	VitaShell
+	Copyright (C) 2015-2018, TheFloW
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __MP3INDEX_H__
+#define __MP3INDEX_H__
+
+#include <psp2/types.h>
+
+#define MP3_INDEX_CACHE_DIR "ux0:VitaShell/internal/mp3index"
+#define MP3_INDEX_MAGIC 0x5844494D // "MIDX"
+#define MP3_INDEX_VERSION 1
+
+// Seek points kept per file. Longer files keep every 2nd, 4th, ... frame.
+#define MP3_INDEX_MAX_POINTS 8192
+
+// Frame headers are scanned through a buffer of this size
+#define MP3_INDEX_SCAN_SIZE (256 * 1024)
+
+// libmad output lags the input by this many samples, LAME's delay does not include it
+#define MP3_DECODER_DELAY 529
+
+enum Mp3IndexSources {
+    MP3_INDEX_SCAN, // Every frame header was read, points are exact
+    MP3_INDEX_XING, // 100 points from the Xing/Info TOC
+    MP3_INDEX_VBRI, // Points from the Fraunhofer VBRI TOC
+};
+
+struct mp3IndexPoint {
+    unsigned int frame;
+    unsigned int offset;
+};
+
+struct mp3FrameHeader {
+    int version;        // 0 = MPEG 2.5, 2 = MPEG 2, 3 = MPEG 1
+    int layer;          // 1, 2 or 3
+    int channels;
+    unsigned int hz;
+    unsigned int kbit;
+    unsigned int samples;
+    unsigned int length; // In bytes, including the header
+};
+
+struct mp3Index {
+    int source;
+    unsigned int firstFrame;      // Offset of the first audio frame, after any Xing/VBRI frame
+    unsigned int frames;          // Number of audio frames
+    unsigned int samplesPerFrame;
+    unsigned int hz;
+    int encoderDelay;             // Samples, -1 if unknown
+    int encoderPadding;
+    unsigned int count;
+    struct mp3IndexPoint points[MP3_INDEX_MAX_POINTS];
+};
+
+int mp3ParseHeader(const unsigned char *data, struct mp3FrameHeader *header);
+
+int mp3IndexLoad(struct mp3Index *index, const char *filename, unsigned int start);
+int mp3IndexSync(SceUID fd, unsigned int offset, unsigned int end);
+
+const struct mp3IndexPoint *mp3IndexFind(struct mp3Index *index, unsigned int frame);
+unsigned int mp3IndexFrameAt(struct mp3Index *index, unsigned int offset);
+unsigned int mp3IndexSamples(struct mp3Index *index);
+int mp3IndexTrim(struct mp3Index *index, unsigned int frame, unsigned int *start, unsigned int *length);
+
+#endif
@@ -26,7 +26,9 @@
 
 #include "id3.h"
 #include "mp3xing.h"
+#include "mp3index.h"
 #include "player.h"
+#include "pcmring.h"
 #include "mp3player.h"
 
 #define FALSE 0
@@ -52,7 +54,6 @@ static struct mad_header Header;
 static struct mad_frame Frame;
 static struct mad_synth Synth;
 static mad_timer_t Timer;
-static int MP3_outputInProgress = 0;
 static int MP3_channels = 0;
 static int MP3_tagRead = 0;
 
@@ -86,13 +87,47 @@ static int MP3_playingSpeed = 0; // 0 = normal
 int MP3_defaultCPUClock = 70;
 static int MP3_fd = -1;
 
-#define INPUT_BUFFER_SIZE 2048
-static unsigned char fileBuffer[INPUT_BUFFER_SIZE];
-static unsigned int samplesRead;
+// The file is read in large chunks so slow storage is hit rarely
+#define INPUT_BUFFER_SIZE (64 * 1024)
+static unsigned char fileBuffer[INPUT_BUFFER_SIZE + MAD_BUFFER_GUARD];
+static int MP3_inputGuard = 0;
 static unsigned int MP3_filePos;
-static double MP3_newFilePos = -1;
+static volatile unsigned int MP3_decodedPos;
 static double fileSize = 0;
-static double tagsize = 0;
+
+// Frame positions of the playing file, seeks go through it. The other
+// one belongs to the track queued to follow.
+static struct mp3Index MP3_indexes[2];
+static struct mp3Index *MP3_index = &MP3_indexes[0];
+static volatile unsigned int MP3_frame = 0;   // Number of the next frame to decode
+static unsigned int MP3_skipUntil = 0;        // Frames before this are decoded but not played
+static volatile long MP3_newFrame = -1;
+
+// Layer III frames may use bits of the previous ones, decode these first
+#define SEEK_PREROLL_FRAMES 2
+
+// Frames skipped per decoded frame and unit of playing speed
+#define SPEED_SKIP_FRAMES 10
+
+// The track queued to follow the playing one without a gap
+static char MP3_nextFileName[264];
+static SceUID MP3_nextFd = -1;
+static double MP3_nextFileSize = 0;
+static struct fileInfo MP3_nextInfo;
+static int MP3_nextChannels = 2;
+static volatile int MP3_nextReady = 0;
+
+// Set when the decoder moved on to the queued track, until it is heard
+static volatile int MP3_trackPending = 0;
+static volatile unsigned int MP3_trackBoundary = 0; // Ring position of its first sample
+static mad_timer_t MP3_endTimer;                    // Length of the previous track
+
+// Decoded PCM waits here for the audio callback
+static PcmRing MP3_ring;
+static short MP3_ringSamples[PCM_RING_FRAMES * 2] __attribute__ ((aligned(64)));
+static Sample MP3_frameSamples[1152];
+static SceUID MP3_decoderThid = -1;
+static volatile int MP3_decoderTerminate = 0;
 
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -140,14 +175,15 @@ short convertSample(mad_fixed_t sample) {
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 //Streaming functions (adapted from Ghoti's MusiceEngine.c):
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-int fillFileBuffer() {
-    // Find out how much to keep and how much to fill.
-    const unsigned int   bytesToKeep   = Stream.bufend - Stream.next_frame;
-    unsigned int         bytesToFill   = sizeof(fileBuffer) - bytesToKeep;
+// Moves the partial frame left in the buffer to its start and fills the rest.
+// Returns the number of bytes in the buffer, 0 once the file is exhausted.
+static int fillFileBuffer() {
+    unsigned int bytesToKeep = Stream.next_frame ? Stream.bufend - Stream.next_frame : 0;
+    unsigned int bytesToFill = INPUT_BUFFER_SIZE - bytesToKeep;
 
     // Want to keep any bytes?
     if (bytesToKeep)
-        memmove(fileBuffer, fileBuffer + sizeof(fileBuffer) - bytesToKeep, bytesToKeep);
+        memmove(fileBuffer, Stream.next_frame, bytesToKeep);
 
     // Read into the rest of the file buffer.
     unsigned char* bufferPos = fileBuffer + bytesToKeep;
@@ -165,30 +201,51 @@ int fillFileBuffer() {
 
         // EOF?
         if (bytesRead <= 0)
-            return 2;
+            break;
 
         // Adjust where we're writing to.
         bytesToFill -= bytesRead;
         bufferPos += bytesRead;
         MP3_filePos += bytesRead;
     }
-    return 0;
+
+    // libmad needs MAD_BUFFER_GUARD zero bytes after the last frame to decode it
+    if (bufferPos == fileBuffer + bytesToKeep){
+        if (MP3_inputGuard)
+            return 0;
+        memset(bufferPos, 0, MAD_BUFFER_GUARD);
+        bufferPos += MAD_BUFFER_GUARD;
+        MP3_inputGuard = 1;
+    }
+
+    return bufferPos - fileBuffer;
 }
 
-void decode() {
-    while ((mad_frame_decode(&Frame, &Stream) == -1) && ((Stream.error == MAD_ERROR_BUFLEN) || (Stream.error == MAD_ERROR_BUFPTR))){
-        int tmp;
-        tmp = fillFileBuffer();
-        if (tmp==2)
-            eos = 1;
-        mad_stream_buffer(&Stream, fileBuffer, sizeof(fileBuffer));
+// Decodes the next frame into Synth, returns -1 at the end of the stream
+static int decode() {
+    while (mad_frame_decode(&Frame, &Stream) == -1){
+        if (Stream.error == MAD_ERROR_BUFLEN || Stream.error == MAD_ERROR_BUFPTR){
+            int length = fillFileBuffer();
+            if (length <= 0)
+                return -1;
+            mad_stream_buffer(&Stream, fileBuffer, length);
+        }else if (!MAD_RECOVERABLE(Stream.error)){
+            return -1;
+        }else if (Stream.error != MAD_ERROR_LOSTSYNC){
+            //The frame was there but could not be decoded, still count it
+            MP3_frame++;
+        }
     }
+    MP3_frame++;
     //Equalizers and volume boost (NEW METHOD):
     if (DoFilter || MP3_volume_boost)
         ApplyFilter(&Frame);
 
     mad_timer_add(&Timer, Frame.header.duration);
     mad_synth_frame(&Synth, &Frame);
+
+    MP3_decodedPos = MP3_filePos - (Stream.bufend - Stream.next_frame);
+    return 0;
 }
 
 void convertLeftSamples(Sample* first, Sample* last, const mad_fixed_t* src) {
@@ -212,87 +269,188 @@ void convertRightSamples(Sample* first, Sample* last, const mad_fixed_t* src) {
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-//MP3 Callback for audio:
+//Seek to a file position, dropping the input buffer and the decoder state:
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-static void MP3Callback(void *buffer, unsigned int samplesToWrite, void *pdata){
-    Sample *destination = (Sample*)buffer;
+static void seekFilePosition(unsigned int position){
+    int res = sceIoLseek32(MP3_fd, position, SCE_SEEK_SET);
+    if (res == 0x80010013) {
+        MP3_fd = sceIoOpen(MP3_fileName, SCE_O_RDONLY, 0777);
+        res = sceIoLseek32(MP3_fd, position, SCE_SEEK_SET);
+    }
+    if (res < 0)
+        return;
+
+    MP3_filePos = position;
+    MP3_decodedPos = position;
+    MP3_inputGuard = 0;
+    mad_stream_buffer(&Stream, fileBuffer, 0);
+    mad_frame_mute(&Frame);
+    mad_synth_mute(&Synth);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//Seek to a frame using the index, exact decodes from the previous seek point
+//and drops the frames before the requested one:
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+static void seekFrame(unsigned int frame, int exact){
+    if (frame >= MP3_index->frames)
+        frame = MP3_index->frames ? MP3_index->frames - 1 : 0;
+
+    unsigned int from = frame;
+    if (exact)
+        from = frame > SEEK_PREROLL_FRAMES ? frame - SEEK_PREROLL_FRAMES : 0;
 
-    if (MP3_isPlaying == TRUE) {    //  Playing , so mix up a buffer
-        MP3_outputInProgress = 1;
-        while (samplesToWrite > 0)     {
-            const unsigned int samplesAvailable = Synth.pcm.length - samplesRead;
-            if (samplesAvailable > samplesToWrite) {
-                convertLeftSamples(destination, destination + samplesToWrite, &Synth.pcm.samples[0][samplesRead]);
-                if (MP3_channels == 2)
-                    convertRightSamples(destination, destination + samplesToWrite, &Synth.pcm.samples[1][samplesRead]);
-                else
-                    convertRightSamples(destination, destination + samplesToWrite, &Synth.pcm.samples[0][samplesRead]);
-
-                samplesRead += samplesToWrite;
-                samplesToWrite = 0;
-
-                if (MP3_newFilePos >= 0)
-                {
-                    if (!MP3_newFilePos)
-                        MP3_newFilePos = ID3v2TagSize(MP3_fileName);
-
-                    int res = sceIoLseek32(MP3_fd, MP3_newFilePos, SCE_SEEK_SET);
-                    if (res == 0x80010013) {
-                        MP3_fd = sceIoOpen(MP3_fileName, SCE_O_RDONLY, 0777);
-                        if (MP3_fd >= 0) {
-                            sceIoLseek32(MP3_fd, MP3_filePos, SCE_SEEK_SET);
-                        }
-
-                        res = sceIoLseek32(MP3_fd, MP3_newFilePos, SCE_SEEK_SET);
-                    }
-
-                    if (res != MP3_filePos){
-                        MP3_filePos = MP3_newFilePos;
-                        mad_timer_set(&Timer, (int)((float)MP3_info.length / 100.0 * MP3_GetPercentage()), 1, 1);
-                    }
-                    MP3_newFilePos = -1;
-                }
-
-                //Check for playing speed:
-                if (MP3_playingSpeed){
-                    int res = sceIoLseek32(MP3_fd, 2 * INPUT_BUFFER_SIZE * MP3_playingSpeed, SCE_SEEK_CUR);
-                    if (res == 0x80010013) {
-                        MP3_fd = sceIoOpen(MP3_fileName, SCE_O_RDONLY, 0777);
-                        if (MP3_fd >= 0) {
-                            sceIoLseek32(MP3_fd, MP3_filePos, SCE_SEEK_SET);
-                        }
-
-                        res = sceIoLseek32(MP3_fd, 2 * INPUT_BUFFER_SIZE * MP3_playingSpeed, SCE_SEEK_CUR);
-                    }
-
-                    if (res != MP3_filePos){
-                        MP3_filePos += 2 * INPUT_BUFFER_SIZE * MP3_playingSpeed;
-                        mad_timer_set(&Timer, (int)((float)MP3_info.length / 100.0 * MP3_GetPercentage()), 1, 1);
-                    }else
-                        MP3_setPlayingSpeed(0);
-                }
-            }else{
-                convertLeftSamples(destination, destination + samplesAvailable, &Synth.pcm.samples[0][samplesRead]);
-                if     (MP3_channels == 2)
-                    convertRightSamples(destination, destination + samplesAvailable, &Synth.pcm.samples[1][samplesRead]);
-                else
-                    convertRightSamples(destination, destination + samplesAvailable, &Synth.pcm.samples[0][samplesRead]);
-
-                samplesRead = 0;
-                decode();
-
-                destination += samplesAvailable;
-                samplesToWrite -= samplesAvailable;
+    const struct mp3IndexPoint *point = mp3IndexFind(MP3_index, from);
+
+    //Moving forward must not land back before the current frame
+    if (!exact && frame > MP3_frame && point->frame <= MP3_frame && point + 1 < MP3_index->points + MP3_index->count)
+        point++;
+
+    //Points from a TOC are only close to a frame, find the header
+    int offset = point->offset;
+    if (MP3_index->source != MP3_INDEX_SCAN && point != MP3_index->points)
+        offset = mp3IndexSync(MP3_fd, point->offset, (unsigned int)fileSize);
+    if (offset < 0)
+        return;
+
+    seekFilePosition(offset);
+    MP3_frame = point->frame;
+    MP3_skipUntil = exact ? frame : point->frame;
+
+    unsigned long long samples = (unsigned long long)point->frame * MP3_index->samplesPerFrame;
+    mad_timer_set(&Timer, samples / MP3_info.hz, samples % MP3_info.hz, MP3_info.hz);
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//Continue decoding with the queued track, the ring keeps the end of this one:
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+static void switchToNextTrack(){
+    sceIoClose(MP3_fd);
+    MP3_fd = MP3_nextFd;
+    MP3_nextFd = -1;
+    strcpy(MP3_fileName, MP3_nextFileName);
+    fileSize = MP3_nextFileSize;
+    MP3_channels = MP3_nextChannels;
+    MP3_index = MP3_index == &MP3_indexes[0] ? &MP3_indexes[1] : &MP3_indexes[0];
+
+    MP3_endTimer = Timer;
+    MP3_trackBoundary = MP3_ring.write;
+    MP3_trackPending = 1;
+    MP3_nextReady = 0;
+
+    seekFilePosition(MP3_index->firstFrame);
+    MP3_frame = 0;
+    MP3_skipUntil = 0;
+    mad_timer_reset(&Timer);
+}
+
+static void MP3_dropNext(){
+    MP3_nextReady = 0;
+    if (MP3_nextFd >= 0)
+        sceIoClose(MP3_nextFd);
+    MP3_nextFd = -1;
+    MP3_trackPending = 0;
+}
+
+// Whether the audio being heard still belongs to the previous track
+static int trackBoundaryAhead(){
+    return MP3_trackPending && (int)(MP3_ring.read - MP3_trackBoundary) < 0;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//Decoder thread, keeps the ring filled ahead of the audio callback:
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+static int MP3_decoderThread(SceSize args, void *argp){
+    while (!MP3_decoderTerminate){
+        if (MP3_newFrame >= 0){
+            unsigned int frame = MP3_newFrame;
+            MP3_newFrame = -1;
+
+            eos = 0;
+            seekFrame(frame, 1);
+            pcmRingFlush(&MP3_ring, &MP3_decoderTerminate);
+            continue;
+        }
+
+        if (eos || pcmRingSpace(&MP3_ring) < 1152){
+            sceKernelDelayThread(5000);
+            continue;
+        }
+
+        if (decode() < 0){
+            if (MP3_nextReady && !MP3_trackPending){
+                switchToNextTrack();
+                continue;
             }
+            eos = 1;
+            pcmRingSetEos(&MP3_ring, 1);
+            continue;
         }
-        MP3_outputInProgress = 0;
-    } else {            //  Not Playing , so clear buffer
-        int count;
-        for (count = 0; count < samplesToWrite; count++){
-            destination[count].left    = 0;
-            destination[count].right = 0;
+
+        //Still running up to a seek target:
+        if (MP3_frame <= MP3_skipUntil)
+            continue;
+
+        unsigned int start = 0, length = Synth.pcm.length;
+
+        //Drop the encoder delay and padding, so tracks join sample-accurately:
+        if (!mp3IndexTrim(MP3_index, MP3_frame - 1, &start, &length))
+            continue;
+
+        convertLeftSamples(MP3_frameSamples, MP3_frameSamples + length, Synth.pcm.samples[0]);
+        if (MP3_channels == 2)
+            convertRightSamples(MP3_frameSamples, MP3_frameSamples + length, Synth.pcm.samples[1]);
+        else
+            convertRightSamples(MP3_frameSamples, MP3_frameSamples + length, Synth.pcm.samples[0]);
+
+        pcmRingWrite(&MP3_ring, (short *)(MP3_frameSamples + start), length - start);
+
+        //Check for playing speed:
+        if (MP3_playingSpeed){
+            int frame = (int)MP3_frame + SPEED_SKIP_FRAMES * MP3_playingSpeed;
+            if (frame > 0 && frame < (int)MP3_index->frames)
+                seekFrame(frame, 0);
+            else
+                MP3_setPlayingSpeed(0);
         }
     }
+
+    return sceKernelExitDeleteThread(0);
+}
+
+static void MP3_startDecoder(){
+    pcmRingReset(&MP3_ring);
+    MP3_trackBoundary = 0;
+    MP3_decoderTerminate = 0;
+    MP3_decoderThid = sceKernelCreateThread("mp3_decoder_thread", MP3_decoderThread, 0x48, 0x10000, 0, 0, NULL);
+    if (MP3_decoderThid >= 0)
+        sceKernelStartThread(MP3_decoderThid, 0, NULL);
+}
+
+static void MP3_stopDecoder(){
+    if (MP3_decoderThid < 0)
+        return;
+
+    MP3_decoderTerminate = 1;
+    sceKernelWaitThreadEnd(MP3_decoderThid, NULL, NULL);
+    MP3_decoderThid = -1;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//MP3 Callback for audio, only copies what the decoder thread left in the ring:
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+static void MP3Callback(void *buffer, unsigned int samplesToWrite, void *pdata){
+    Sample *destination = (Sample*)buffer;
+    unsigned int samplesRead = 0;
+
+    if (MP3_isPlaying == TRUE)
+        samplesRead = pcmRingRead(&MP3_ring, (short *)destination, samplesToWrite);
+    else
+        pcmRingRead(&MP3_ring, NULL, 0);
+
+    //  Underrun or not playing, so clear the rest
+    if (samplesRead < samplesToWrite)
+        memset(destination + samplesRead, 0, (samplesToWrite - samplesRead) * sizeof(Sample));
 }
 
 
@@ -310,6 +468,7 @@ void MP3_Init(int channel){
     initFileInfo(&MP3_info);
     MP3_tagRead = 0;
 
+    pcmRingInit(&MP3_ring, MP3_ringSamples, PCM_RING_FRAMES);
     vitaAudioSetChannelCallback(myChannel, MP3Callback,0);
 
     MIN_PLAYING_SPEED=-119;
@@ -328,8 +487,10 @@ void MP3_Init(int channel){
 //Free tune
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 void MP3_FreeTune(){
+    MP3_stopDecoder();
     sceIoClose(MP3_fd);
     MP3_fd = -1;
+    MP3_dropNext();
     /* Mad is no longer used, the structures that were initialized must
      * now be cleared.
      */
@@ -343,10 +504,9 @@ void MP3_FreeTune(){
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 //Recupero le informazioni sul file:
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-void getMP3TagInfo(char *filename, struct fileInfo *targetInfo){
+static void readMP3Tag(char *filename, struct fileInfo *targetInfo){
     //ID3:
     struct ID3Tag ID3;
-    strcpy(MP3_fileName, filename);
     ParseID3(filename, &ID3);
     strcpy(targetInfo->title, ID3.ID3Title);
     strcpy(targetInfo->artist, ID3.ID3Artist);
@@ -358,205 +518,190 @@ void getMP3TagInfo(char *filename, struct fileInfo *targetInfo){
     targetInfo->encapsulatedPictureType = ID3.ID3EncapsulatedPictureType;
     targetInfo->encapsulatedPictureOffset = ID3.ID3EncapsulatedPictureOffset;
     targetInfo->encapsulatedPictureLength = ID3.ID3EncapsulatedPictureLength;
+}
+
+void getMP3TagInfo(char *filename, struct fileInfo *targetInfo){
+    strcpy(MP3_fileName, filename);
+    readMP3Tag(filename, targetInfo);
 
     MP3_info = *targetInfo;
     MP3_tagRead = 1;
-
 }
 
-int MP3getInfo(){
-    unsigned long FrameCount = 0;
+static int readMP3Info(char *fileName, struct fileInfo *info, struct mp3Index *index, int *channels){
     int fd;
-    int bufferSize = 1024*496;
-    uint8_t *localBuffer;
-
-    int has_xing = 0;
-    struct xing xing;
-    memset(&xing, 0, sizeof xing);
-
-    long singleDataRed = 0;
+    unsigned char localBuffer[4096];
     struct mad_stream stream;
     struct mad_header header;
-    int timeFromID3 = 0;
-    float mediumBitrate = 0.0f;
 
-    if (!MP3_tagRead)
-        getMP3TagInfo(MP3_fileName, &MP3_info);
-
-    mad_stream_init (&stream);
-    mad_header_init (&header);
-
-    fd = sceIoOpen(MP3_fileName, SCE_O_RDONLY, 0777);
+    fd = sceIoOpen(fileName, SCE_O_RDONLY, 0777);
     if (fd < 0)
         return -1;
 
     long size = sceIoLseek(fd, 0, SCE_SEEK_END);
     sceIoLseek(fd, 0, SCE_SEEK_SET);
 
-    double startPos = ID3v2TagSize(MP3_fileName);
-    //Check for xing frame:
-    unsigned char *xing_buffer;
-    xing_buffer = (unsigned char *)malloc(XING_BUFFER_SIZE);
-    if (xing_buffer != NULL)
-    {
-        sceIoRead(fd, xing_buffer, XING_BUFFER_SIZE);
-        if(parse_xing(xing_buffer, 0, &xing))
-        {
-            if (xing.flags & XING_FRAMES && xing.frames){
-                has_xing = 1;
-                bufferSize = 50 * 1024;
-            }
-        }
-        free(xing_buffer);
-    }
-
+    double startPos = ID3v2TagSize(fileName);
     sceIoLseek32(fd, startPos, SCE_SEEK_SET);
     startPos = SeekNextFrameMP3(fd);
-    size -= startPos;
-
-    if (size < bufferSize * 3)
-        bufferSize = size;
-    localBuffer = (unsigned char *) malloc(sizeof(unsigned char) * bufferSize);
-    unsigned char *buff = localBuffer;
-
-    MP3_channels = 2;
-    MP3_info.fileType = MP3_TYPE;
-    MP3_info.defaultCPUClock = MP3_defaultCPUClock;
-    MP3_info.needsME = 0;
-    MP3_info.fileSize = size;
-    MP3_info.framesDecoded = 0;
-
-    double totalBitrate = 0;
-    int i = 0;
-
-    for (i=0; i<3; i++){
-        memset(localBuffer, 0, bufferSize);
-        singleDataRed = sceIoRead(fd, localBuffer, bufferSize);
-        mad_stream_buffer (&stream, localBuffer, singleDataRed);
-
-        while (1){
-            if (mad_header_decode (&header, &stream) == -1){
-                if (stream.buffer == NULL || stream.error == MAD_ERROR_BUFLEN)
-                    break;
-                else if (MAD_RECOVERABLE(stream.error)){
-                    continue;
-                }else{
-                    break;
-                }
-            }
-            //Informazioni solo dal primo frame:
-            if (FrameCount++ == 0){
-                switch (header.layer) {
-                case MAD_LAYER_I:
-                    strcpy(MP3_info.layer,"I");
-                    break;
-                case MAD_LAYER_II:
-                    strcpy(MP3_info.layer,"II");
-                    break;
-                case MAD_LAYER_III:
-                    strcpy(MP3_info.layer,"III");
-                    break;
-                default:
-                    strcpy(MP3_info.layer,"unknown");
-                    break;
-                }
-
-                MP3_info.kbit = header.bitrate / 1000;
-                MP3_info.instantBitrate = header.bitrate;
-                MP3_info.hz = header.samplerate;
-                switch (header.mode) {
-                case MAD_MODE_SINGLE_CHANNEL:
-                    strcpy(MP3_info.mode, "single channel");
-                    MP3_channels = 1;
-                    break;
-                case MAD_MODE_DUAL_CHANNEL:
-                    strcpy(MP3_info.mode, "dual channel");
-                    MP3_channels = 2;
-                    break;
-                case MAD_MODE_JOINT_STEREO:
-                    strcpy(MP3_info.mode, "joint (MS/intensity) stereo");
-                    MP3_channels = 2;
-                    break;
-                case MAD_MODE_STEREO:
-                    strcpy(MP3_info.mode, "normal LR stereo");
-                    MP3_channels = 2;
-                    break;
-                default:
-                    strcpy(MP3_info.mode, "unknown");
-                    MP3_channels = 2;
-                    break;
-                }
-
-                switch (header.emphasis) {
-                case MAD_EMPHASIS_NONE:
-                    strcpy(MP3_info.emphasis,"no");
-                    break;
-                case MAD_EMPHASIS_50_15_US:
-                    strcpy(MP3_info.emphasis,"50/15 us");
-                    break;
-                case MAD_EMPHASIS_CCITT_J_17:
-                    strcpy(MP3_info.emphasis,"CCITT J.17");
-                    break;
-                case MAD_EMPHASIS_RESERVED:
-                    strcpy(MP3_info.emphasis,"reserved(!)");
-                    break;
-                default:
-                    strcpy(MP3_info.emphasis,"unknown");
-                    break;
-                }
-
-                //Check if lenght found in tag info:
-                if (MP3_info.length > 0){
-                    timeFromID3 = 1;
-                    break;
-                }
-                if (has_xing)
-                    break;
-            }
 
-            totalBitrate += header.bitrate;
+    //Frame count and seek points, from the cache, a VBR header or a scan:
+    if (mp3IndexLoad(index, fileName, startPos >= 0 ? startPos : 0) < 0){
+        sceIoClose(fd);
+        return -1;
+    }
+
+    *channels = 2;
+    info->fileType = MP3_TYPE;
+    info->defaultCPUClock = MP3_defaultCPUClock;
+    info->needsME = 0;
+    info->fileSize = size - index->firstFrame;
+    info->frames = index->frames;
+    info->framesDecoded = 0;
+
+    //Informazioni solo dal primo frame:
+    int length = sceIoPread(fd, localBuffer, sizeof(localBuffer), index->firstFrame);
+    sceIoClose(fd);
+    if (length <= 0)
+        return -1;
+
+    mad_stream_init (&stream);
+    mad_header_init (&header);
+    mad_stream_buffer (&stream, localBuffer, length);
+
+    while (mad_header_decode (&header, &stream) == -1){
+        if (!MAD_RECOVERABLE(stream.error)){
+            mad_header_finish (&header);
+            mad_stream_finish (&stream);
+            return -1;
         }
-        if (size == bufferSize)
-            break;
-        else if (i==0)
-            sceIoLseek(fd, startPos + size/3, SCE_SEEK_SET);
-        else if (i==1)
-            sceIoLseek(fd, startPos + 2 * size/3, SCE_SEEK_SET);
+    }
 
-        if (timeFromID3 || has_xing)
-            break;
+    switch (header.layer) {
+    case MAD_LAYER_I:
+        strcpy(info->layer,"I");
+        break;
+    case MAD_LAYER_II:
+        strcpy(info->layer,"II");
+        break;
+    case MAD_LAYER_III:
+        strcpy(info->layer,"III");
+        break;
+    default:
+        strcpy(info->layer,"unknown");
+        break;
     }
-    mad_header_finish (&header);
-    mad_stream_finish (&stream);
-    if (buff)
-        free(buff);
-    sceIoClose(fd);
 
-    int secs = 0;
-    if (has_xing)
-    {
-        /* modify header.duration since we don't need it anymore */
-        mad_timer_multiply(&header.duration, xing.frames);
-        secs = mad_timer_count(header.duration, MAD_UNITS_SECONDS);
-        MP3_info.length = secs;
+    info->kbit = header.bitrate / 1000;
+    info->instantBitrate = header.bitrate;
+    info->hz = header.samplerate;
+    switch (header.mode) {
+    case MAD_MODE_SINGLE_CHANNEL:
+        strcpy(info->mode, "single channel");
+        *channels = 1;
+        break;
+    case MAD_MODE_DUAL_CHANNEL:
+        strcpy(info->mode, "dual channel");
+        *channels = 2;
+        break;
+    case MAD_MODE_JOINT_STEREO:
+        strcpy(info->mode, "joint (MS/intensity) stereo");
+        *channels = 2;
+        break;
+    case MAD_MODE_STEREO:
+        strcpy(info->mode, "normal LR stereo");
+        *channels = 2;
+        break;
+    default:
+        strcpy(info->mode, "unknown");
+        *channels = 2;
+        break;
     }
-    else if (!MP3_info.length){
-        mediumBitrate = totalBitrate / (float)FrameCount;
-        secs = size * 8 / mediumBitrate;
-        MP3_info.length = secs;
-    }else{
-        secs = MP3_info.length;
+
+    switch (header.emphasis) {
+    case MAD_EMPHASIS_NONE:
+        strcpy(info->emphasis,"no");
+        break;
+    case MAD_EMPHASIS_50_15_US:
+        strcpy(info->emphasis,"50/15 us");
+        break;
+    case MAD_EMPHASIS_CCITT_J_17:
+        strcpy(info->emphasis,"CCITT J.17");
+        break;
+    case MAD_EMPHASIS_RESERVED:
+        strcpy(info->emphasis,"reserved(!)");
+        break;
+    default:
+        strcpy(info->emphasis,"unknown");
+        break;
     }
 
+    mad_header_finish (&header);
+    mad_stream_finish (&stream);
+
+    //Exact length from the number of frames:
+    int secs = mp3IndexSamples(index) / index->hz;
+    info->length = secs;
+
     //Formatto in stringa la durata totale:
     int h = secs / 3600;
     int m = (secs - h * 3600) / 60;
     int s = secs - h * 3600 - m * 60;
-    snprintf(MP3_info.strLength, sizeof(MP3_info.strLength), "%2.2i:%2.2i:%2.2i", h, m, s);
+    snprintf(info->strLength, sizeof(info->strLength), "%2.2i:%2.2i:%2.2i", h, m, s);
 
     return 0;
 }
 
+int MP3getInfo(){
+    if (!MP3_tagRead)
+        getMP3TagInfo(MP3_fileName, &MP3_info);
+
+    return readMP3Info(MP3_fileName, &MP3_info, MP3_index, &MP3_channels);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//Queue the track to play after this one without a gap. Opens it and reads
+//its tag and index, so it is meant to run on a thread other than the UI.
+//Returns its info, or NULL if it cannot follow (other sample rate).
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+struct fileInfo *MP3_setNext(char *filename){
+    if (MP3_fd < 0 || MP3_nextReady || MP3_trackPending)
+        return NULL;
+
+    struct mp3Index *index = MP3_index == &MP3_indexes[0] ? &MP3_indexes[1] : &MP3_indexes[0];
+
+    initFileInfo(&MP3_nextInfo);
+    readMP3Tag(filename, &MP3_nextInfo);
+    if (readMP3Info(filename, &MP3_nextInfo, index, &MP3_nextChannels) != 0 || MP3_nextInfo.hz != MP3_info.hz)
+        return NULL;
+
+    SceUID fd = sceIoOpen(filename, SCE_O_RDONLY, 0777);
+    if (fd < 0)
+        return NULL;
+
+    MP3_nextFileSize = sceIoLseek32(fd, 0, SCE_SEEK_END);
+    strcpy(MP3_nextFileName, filename);
+    MP3_nextFd = fd;
+    __sync_synchronize();
+    MP3_nextReady = 1;
+
+    return &MP3_nextInfo;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//Returns 1 once the queued track is being heard, its info is then current:
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+int MP3_trackChanged(){
+    if (!MP3_trackPending || trackBoundaryAhead())
+        return 0;
+
+    MP3_info = MP3_nextInfo;
+    MP3_trackPending = 0;
+    return 1;
+}
+
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 //MP3_End
@@ -574,18 +719,18 @@ void MP3_End(){
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 int MP3_Load(char *filename){
     eos = 0;
-    MP3_outputInProgress = 0;
     MP3_filePos = 0;
+    MP3_decodedPos = 0;
+    MP3_inputGuard = 0;
+    MP3_frame = 0;
+    MP3_skipUntil = 0;
+    MP3_newFrame = -1;
     fileSize = 0;
-    samplesRead = 0;
     MP3_fd = sceIoOpen(filename, SCE_O_RDONLY, 0777);
     if (MP3_fd < 0)
         return ERROR_OPENING;
     fileSize = sceIoLseek32(MP3_fd, 0, SCE_SEEK_END);
     sceIoLseek32(MP3_fd, 0, SCE_SEEK_SET);
-    tagsize = ID3v2TagSize(filename);
-    sceIoLseek32(MP3_fd, tagsize, SCE_SEEK_SET);
-    SeekNextFrameMP3(MP3_fd);
 
     MP3_isPlaying = FALSE;
 
@@ -597,9 +742,16 @@ int MP3_Load(char *filename){
         return ERROR_OPENING;
     }
 
+    //Decoding starts at the first audio frame, after any Xing/VBRI frame:
+    MP3_filePos = MP3_index->firstFrame;
+    MP3_decodedPos = MP3_filePos;
+    sceIoLseek32(MP3_fd, MP3_filePos, SCE_SEEK_SET);
+
     //Controllo il sample rate:
     if (vitaAudioSetFrequency(myChannel, MP3_info.hz) < 0)
         return ERROR_INVALID_SAMPLE_RATE;
+
+    MP3_startDecoder();
     return OPENING_OK;
 }
 
@@ -640,8 +792,6 @@ void MP3_Pause(){
 int MP3_Stop(){
     //stop playing
     MP3_isPlaying = FALSE;
-    while (MP3_outputInProgress == 1)
-        sceKernelDelayThread(100000);
 
     return TRUE;
 }
@@ -651,7 +801,25 @@ int MP3_Stop(){
 //Get time string
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 void MP3_GetTimeString(char *dest){
-    mad_timer_string(Timer, dest, "%02lu:%02u:%02u", MAD_UNITS_HOURS, MAD_UNITS_MILLISECONDS, 0);
+    //Timer runs ahead by what is still waiting in the ring:
+    mad_timer_t played = Timer;
+    unsigned int buffered_samples = pcmRingAvailable(&MP3_ring);
+
+    //Still hearing the end of the previous track:
+    if (trackBoundaryAhead()){
+        played = MP3_endTimer;
+        buffered_samples = MP3_trackBoundary - MP3_ring.read;
+    }
+
+    if (MP3_info.hz > 0){
+        mad_timer_t buffered;
+        mad_timer_set(&buffered, 0, buffered_samples, MP3_info.hz);
+        mad_timer_negate(&buffered);
+        mad_timer_add(&played, buffered);
+        if (mad_timer_sign(played) < 0)
+            played = mad_timer_zero;
+    }
+    mad_timer_string(played, dest, "%02lu:%02u:%02u", MAD_UNITS_HOURS, MAD_UNITS_MILLISECONDS, 0);
 }
 
 
@@ -662,10 +830,17 @@ float MP3_GetPercentage(){
     //Calcolo posizione in %:
     float perc = 0.0f;
 
-    if (fileSize > 0){
-        perc = ((float)MP3_filePos) / ((float)fileSize - (float)tagsize) * 100.0;
+    unsigned int total = MP3_index->frames * MP3_index->samplesPerFrame;
+    if (trackBoundaryAhead()){
+        perc = 99.9f;
+    }else if (total > 0){
+        int played = (int)(MP3_frame * MP3_index->samplesPerFrame) - (int)pcmRingAvailable(&MP3_ring);
+        perc = played > 0 ? (float)played / (float)total * 100.0 : 0.0f;
         if (perc > 100)
             perc = 100;
+        //The end of the track may still be in the ring:
+        if (perc == 100 && !MP3_EndOfStream())
+            perc = 99.9f;
     }
     return(perc);
 }
@@ -675,12 +850,20 @@ float MP3_GetPercentage(){
 //Check EOS
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 int MP3_EndOfStream(){
-    if (eos == 1)
+    if (eos == 1 && pcmRingAvailable(&MP3_ring) == 0)
         return 1;
     return 0;
 }
 
 
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//Number of times the audio callback found the ring empty:
+///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+unsigned int MP3_getUnderruns(){
+    return MP3_ring.underruns;
+}
+
+
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 //Get info on file:
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -844,12 +1027,20 @@ void MP3_fadeOut(float seconds){
 //Manage suspend:
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 int MP3_suspend(){
-    MP3_suspendPosition = MP3_filePos;
+    //Resume at the frame being heard, not the one being decoded:
+    MP3_suspendPosition = (long)MP3_frame - (long)(pcmRingAvailable(&MP3_ring) / MP3_index->samplesPerFrame);
+    if (MP3_suspendPosition < 0)
+        MP3_suspendPosition = 0;
     MP3_suspendIsPlaying = MP3_isPlaying;
     /*MP3_Stop();
     MP3_FreeTune();*/
 
     MP3_isPlaying = FALSE;
+    MP3_stopDecoder();
+    MP3_nextReady = 0;
+    if (MP3_nextFd >= 0)
+        sceIoClose(MP3_nextFd);
+    MP3_nextFd = -1;
     mad_synth_finish(&Synth);
     mad_header_finish(&Header);
     mad_frame_finish(&Frame);
@@ -869,10 +1060,10 @@ int MP3_resume(){
         mad_timer_reset(&Timer);
         MP3_fd = sceIoOpen(MP3_fileName, SCE_O_RDONLY, 0777);
         if (MP3_fd >= 0){
-            MP3_filePos = MP3_suspendPosition;
-            sceIoLseek32(MP3_fd, MP3_filePos, SCE_SEEK_SET);
-            mad_timer_set(&Timer, (int)((float)MP3_info.length / 100.0 * MP3_GetPercentage()), 1, 1);
+            // The seek must be queued before the decoder reads its first frame
+            MP3_newFrame = MP3_suspendPosition;
             MP3_isPlaying = MP3_suspendIsPlaying;
+            MP3_startDecoder();
         }
     }
     MP3_suspendPosition = -1;
@@ -881,10 +1072,13 @@ int MP3_resume(){
 
 double MP3_getFilePosition()
 {
-    return MP3_filePos;
+    return MP3_decodedPos;
 }
 
 void MP3_setFilePosition(double position)
 {
-    MP3_newFilePos = position;
+    if (position <= MP3_index->firstFrame)
+        MP3_newFrame = 0;
+    else
+        MP3_newFrame = mp3IndexFrameAt(MP3_index, (unsigned int)position);
 }
@@ -30,6 +30,9 @@ void MP3_FreeTune();
 int MP3_Load(char *filename);
 void MP3_GetTimeString(char *dest);
 int MP3_EndOfStream();
+unsigned int MP3_getUnderruns();
+struct fileInfo *MP3_setNext(char *filename);
+int MP3_trackChanged();
 struct fileInfo *MP3_GetInfo();
 struct fileInfo MP3_GetTagInfoOnly(char *filename);
 int MP3_GetStatus();
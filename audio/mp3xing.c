@@ -60,9 +60,11 @@ If you want to trim VBR file you should also reconstruct Frames, Bytes and TOC p
 int xingSearchFrame(unsigned char *buffer, int startPos, int maxSearch)
 {
     int i = 0;
+    buffer += startPos;
     for (i=0; i<maxSearch; i++)
     {
-        if(!memcmp(buffer, XING_GUID, 4))
+        //LAME writes "Info" instead of "Xing" for CBR files
+        if(!memcmp(buffer, XING_GUID, 4) || !memcmp(buffer, INFO_GUID, 4))
             return startPos;
         startPos++;
         buffer++;
@@ -70,42 +72,84 @@ int xingSearchFrame(unsigned char *buffer, int startPos, int maxSearch)
     return -1;
 }
 
-int xingGetFlags(unsigned char *buffer, int startPos)
+static unsigned long xingGetLong(unsigned char *buffer)
 {
-    buffer += startPos + 4;
-    return buffer[0] + buffer[1] + buffer[2] + buffer[3];
+    return ((unsigned long)buffer[0] << 24) | (buffer[1] << 16) | (buffer[2] << 8) | buffer[3];
 }
 
-int xingGetFrameNumber(unsigned char *buffer, int startPos)
+int parse_xing(unsigned char *buffer, int startPos, struct xing *xing)
 {
-    buffer += startPos + 8;
-    char hexStr[9] = "";
-    sprintf(hexStr, "%2.2X%2.2X%2.2X%2.2X", buffer[0], buffer[1], buffer[2], buffer[3]);
-    return strtol(hexStr, NULL, 16);
-}
+    int  pos = xingSearchFrame(buffer, startPos, XING_BUFFER_SIZE - startPos - 8);
+    if (pos < 0)
+        return 0;
 
-int xingGetFileSize(unsigned char *buffer, int startPos)
-{
-    buffer += startPos + 12;
-    char hexStr[9] = "";
-    sprintf(hexStr, "%2.2X%2.2X%2.2X%2.2X", buffer[0], buffer[1], buffer[2], buffer[3]);
-    return strtol(hexStr, NULL, 16);
-}
+    xing->flags = xingGetLong(buffer + pos + 4);
+    xing->encoderDelay = -1;
+    xing->encoderPadding = -1;
+
+    int offset = pos + 8;
+    if (xing->flags & XING_FRAMES){
+        if (offset + 4 > XING_BUFFER_SIZE)
+            return 0;
+        xing->frames = xingGetLong(buffer + offset);
+        offset += 4;
+    }
+    if (xing->flags & XING_BYTES){
+        if (offset + 4 > XING_BUFFER_SIZE)
+            return 0;
+        xing->bytes = xingGetLong(buffer + offset);
+        offset += 4;
+    }
+    if (xing->flags & XING_TOC){
+        if (offset + 100 > XING_BUFFER_SIZE)
+            return 0;
+        memcpy(xing->toc, buffer + offset, 100);
+        offset += 100;
+    }
+    if (xing->flags & XING_SCALE){
+        if (offset + 4 > XING_BUFFER_SIZE)
+            return 0;
+        xing->scale = xingGetLong(buffer + offset);
+        offset += 4;
+    }
 
+    //LAME tag (also written by libavcodec), delay and padding are 12 bits each at 21-23
+    if (offset + 24 <= XING_BUFFER_SIZE &&
+        (!memcmp(buffer + offset, "LAME", 4) || !memcmp(buffer + offset, "Lavc", 4) || !memcmp(buffer + offset, "Lavf", 4)))
+    {
+        unsigned char *lame = buffer + offset;
+        xing->encoderDelay = (lame[21] << 4) | (lame[22] >> 4);
+        xing->encoderPadding = ((lame[22] & 0x0F) << 8) | lame[23];
+    }
+    return 1;
+}
 
-int parse_xing(unsigned char *buffer, int startPos, struct xing *xing)
+/*
+Fraunhofer VBRI header, buffer points to the start of the frame:
+36-39   "VBRI"
+40-41   Version
+42-43   Delay
+44-45   Quality
+46-49   Bytes
+50-53   Frames
+54-55   TOC entries
+56-57   TOC scale factor
+58-59   TOC entry size in bytes (1 to 4)
+60-61   Frames per TOC entry
+62-     TOC, size of each block of frames divided by the scale factor
+*/
+int parse_vbri(unsigned char *buffer, struct vbri *vbri)
 {
-    int  pos = xingSearchFrame(buffer, startPos, XING_BUFFER_SIZE - 4);
-    if (pos < 0)
+    unsigned char *header = buffer + VBRI_OFFSET;
+    if (memcmp(header, VBRI_GUID, 4))
         return 0;
 
-    xing->flags = xingGetFlags(buffer, pos);
-    if (xing->flags & 1)
-        xing->frames = xingGetFrameNumber(buffer, pos);
-    if (xing->flags & 2)
-        xing->bytes = xingGetFileSize(buffer, pos);
-
-    /*if (xing->flags & 4)
-    if (xing->flags & 8)*/
+    vbri->delay = (header[6] << 8) | header[7];
+    vbri->bytes = xingGetLong(header + 10);
+    vbri->frames = xingGetLong(header + 14);
+    vbri->tocEntries = (header[18] << 8) | header[19];
+    vbri->tocScale = (header[20] << 8) | header[21];
+    vbri->tocEntrySize = (header[22] << 8) | header[23];
+    vbri->tocFramesPerEntry = (header[24] << 8) | header[25];
     return 1;
 }
@@ -23,6 +23,14 @@
 #define XING_BUFFER_SIZE 300
 #define XING_GUID	(unsigned char [4]) \
 		      {	0x58, 0x69, 0x6E, 0x67 }
+#define INFO_GUID	(unsigned char [4]) \
+		      {	0x49, 0x6E, 0x66, 0x6F }
+#define VBRI_GUID	(unsigned char [4]) \
+		      {	0x56, 0x42, 0x52, 0x49 }
+
+//The VBRI header is always 32 bytes after the frame header
+#define VBRI_OFFSET 36
+#define VBRI_HEADER_SIZE 26
 
 struct xing {
   int flags;
@@ -30,6 +38,18 @@ struct xing {
   unsigned long bytes;
   unsigned char toc[100];
   long scale;
+  int encoderDelay;   //From the LAME tag, -1 if there is none
+  int encoderPadding;
+};
+
+struct vbri {
+  int delay;
+  unsigned long bytes;
+  unsigned long frames;
+  int tocEntries;
+  int tocScale;
+  int tocEntrySize;
+  int tocFramesPerEntry;
 };
 
 enum {
@@ -40,5 +60,6 @@ enum {
 };
 
 int parse_xing(unsigned char *buffer, int startPos, struct xing *xing);
+int parse_vbri(unsigned char *buffer, struct vbri *vbri);
 
 #endif
@@ -24,6 +24,7 @@
 #include <vorbis/codec.h>      //ogg-vorbis
 #include <vorbis/vorbisfile.h> //ogg-vorbis
 #include "player.h"
+#include "pcmring.h"
 #include "oggplayer.h"
 
 /////////////////////////////////////////////////////////////////////////////////////////
@@ -32,100 +33,308 @@
 static int OGG_audio_channel;
 static int OGG_channels = 0;
 static char OGG_fileName[264];
-static int OGG_file = -1;
-static OggVorbis_File OGG_VorbisFile;
-static int OGG_eos = 0;
+static volatile int OGG_eos = 0;
 static struct fileInfo OGG_info;
 static int OGG_isPlaying = 0;
 static unsigned int OGG_volume_boost = 0.0;
-static double OGG_milliSeconds = 0.0;
+static volatile double OGG_milliSeconds = 0.0;
+static volatile ogg_int64_t OGG_decodedSamples = 0;
+static volatile ogg_int64_t OGG_decodedRawPos = 0;
 static int OGG_playingSpeed = 0; // 0 = normal
 static int OGG_playingDelta = 0;
-static int outputInProgress = 0;
 static long OGG_suspendPosition = -1;
 static long OGG_suspendIsPlaying = 0;
 int OGG_defaultCPUClock = 50;
-static short OGG_mixBuffer[VITA_NUM_AUDIO_SAMPLES * 2 * 2]__attribute__ ((aligned(64)));
-static unsigned long OGG_tempmixleft = 0;
-static double OGG_newFilePos = -1;
+static volatile double OGG_newFilePos = -1;
 static int OGG_tagRead = 0;
 
+// Decoded PCM waits here for the audio callback
+#define OGG_DECODE_FRAMES 1024
+static PcmRing OGG_ring;
+static short OGG_ringSamples[PCM_RING_FRAMES * 2] __attribute__ ((aligned(64)));
+static short OGG_decodeBuffer[OGG_DECODE_FRAMES * 2];
+static SceUID OGG_decoderThid = -1;
+static volatile int OGG_decoderTerminate = 0;
+
+// vorbisfile reads a few KB at a time, the files go through this
+#define OGG_READ_SIZE (64 * 1024)
+typedef struct {
+    SceUID fd;
+    char fileName[264];
+    SceOff size;
+    SceOff position;
+    SceOff bufferOffset; // File offset of buffer[0]
+    int bufferLength;
+    unsigned char buffer[OGG_READ_SIZE];
+} OggReader;
+
+// The playing file and the one queued to follow it without a gap
+static OggReader OGG_readers[2] = { { .fd = -1 }, { .fd = -1 } };
+static OggVorbis_File OGG_vorbisFiles[2];
+static OggReader *OGG_reader = &OGG_readers[0];
+static OggVorbis_File *OGG_VorbisFile = &OGG_vorbisFiles[0];
+
+static struct fileInfo OGG_nextInfo;
+static int OGG_nextChannels = 2;
+static volatile int OGG_nextReady = 0;
+
+// Set when the decoder moved on to the queued track, until it is heard
+static volatile int OGG_trackPending = 0;
+static volatile unsigned int OGG_trackBoundary = 0; // Ring position of its first sample
+static double OGG_endMilliSeconds = 0.0;            // Length of the previous track
+
 /////////////////////////////////////////////////////////////////////////////////////////
-//Audio callback
+//Continue decoding with the queued track, the ring keeps the end of this one
 /////////////////////////////////////////////////////////////////////////////////////////
-static void oggDecodeThread(void *_buf2, unsigned int numSamples, void *pdata){
-    short *_buf = (short *)_buf2;
-    //static short OGG_mixBuffer[VITA_NUM_AUDIO_SAMPLES * 2 * 2]__attribute__ ((aligned(64)));
-    //static unsigned long OGG_tempmixleft = 0;
+static void switchToNextTrack(){
+    ov_clear(OGG_VorbisFile);
+    sceIoClose(OGG_reader->fd);
+    OGG_reader->fd = -1;
+
+    OGG_reader = OGG_reader == &OGG_readers[0] ? &OGG_readers[1] : &OGG_readers[0];
+    OGG_VorbisFile = OGG_VorbisFile == &OGG_vorbisFiles[0] ? &OGG_vorbisFiles[1] : &OGG_vorbisFiles[0];
+    strcpy(OGG_fileName, OGG_reader->fileName);
+    OGG_channels = OGG_nextChannels;
+
+    OGG_endMilliSeconds = (double)OGG_decodedSamples * 1000.0 / OGG_info.hz;
+    OGG_trackBoundary = OGG_ring.write;
+    OGG_trackPending = 1;
+    OGG_nextReady = 0;
+
+    OGG_decodedSamples = 0;
+    OGG_decodedRawPos = ov_raw_tell(OGG_VorbisFile);
+}
+
+static void OGG_dropNext(){
+    if (OGG_nextReady){
+        OggReader *reader = OGG_reader == &OGG_readers[0] ? &OGG_readers[1] : &OGG_readers[0];
+        OggVorbis_File *vf = OGG_VorbisFile == &OGG_vorbisFiles[0] ? &OGG_vorbisFiles[1] : &OGG_vorbisFiles[0];
+        ov_clear(vf);
+        sceIoClose(reader->fd);
+        reader->fd = -1;
+    }
+    OGG_nextReady = 0;
+    OGG_trackPending = 0;
+}
+
+// Whether the audio being heard still belongs to the previous track
+static int trackBoundaryAhead(){
+    return OGG_trackPending && (int)(OGG_ring.read - OGG_trackBoundary) < 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////
+//Decoder thread, keeps the ring filled ahead of the audio callback
+/////////////////////////////////////////////////////////////////////////////////////////
+static int oggDecodeThread(SceSize args, void *argp){
     int current_section;
 
-    if (OGG_isPlaying) {    // Playing , so mix up a buffer
-        outputInProgress = 1;
-        while (OGG_tempmixleft < numSamples) {    //  Not enough in buffer, so we must mix more
-            unsigned long bytesRequired = (numSamples - OGG_tempmixleft) * 4;    // 2channels, 16bit = 4 bytes per sample
-            //unsigned long ret = ov_read(&OGG_VorbisFile, (char *) &OGG_mixBuffer[OGG_tempmixleft * 2], bytesRequired, &current_section); //libtremor
-            unsigned long ret = ov_read(&OGG_VorbisFile, (char *) &OGG_mixBuffer[OGG_tempmixleft * 2], bytesRequired, 0, 2, 1, &current_section); //ogg-vorbis
-            if (!ret) {    //EOF
-                OGG_isPlaying = 0;
-                OGG_eos = 1;
-                outputInProgress = 0;
-                return;
-            } else if (ret < 0) {
-                if (ret == OV_HOLE)
-                    continue;
-                OGG_isPlaying = 0;
-                OGG_eos = 1;
-                outputInProgress = 0;
-                return;
+    while (!OGG_decoderTerminate) {
+        if (OGG_newFilePos >= 0) {
+            double position = OGG_newFilePos;
+            OGG_newFilePos = -1;
+
+            OGG_eos = 0;
+            ov_raw_seek(OGG_VorbisFile, (ogg_int64_t)position);
+            OGG_decodedSamples = ov_pcm_tell(OGG_VorbisFile);
+            OGG_decodedRawPos = ov_raw_tell(OGG_VorbisFile);
+            pcmRingFlush(&OGG_ring, &OGG_decoderTerminate);
+            continue;
+        }
+
+        if (OGG_eos || pcmRingSpace(&OGG_ring) < OGG_DECODE_FRAMES) {
+            sceKernelDelayThread(5000);
+            continue;
+        }
+
+        long ret = ov_read(OGG_VorbisFile, (char *)OGG_decodeBuffer, OGG_DECODE_FRAMES * 2 * OGG_channels, 0, 2, 1, &current_section); //ogg-vorbis
+        if (ret == OV_HOLE)
+            continue;
+
+        //vorbisfile trims the first and last packets by their granule positions,
+        //so the next track can follow sample-accurately
+        if (ret == 0 && OGG_nextReady && !OGG_trackPending) {
+            switchToNextTrack();
+            continue;
+        }
+
+        if (ret <= 0) {    //EOF or error
+            OGG_eos = 1;
+            pcmRingSetEos(&OGG_ring, 1);
+            continue;
+        }
+
+        int frames = ret / (2 * OGG_channels);
+        int count;
+
+        //Mono goes to both channels, backwards so it can be done in place:
+        if (OGG_channels == 1) {
+            for (count = frames - 1; count >= 0; count--) {
+                OGG_decodeBuffer[count * 2 + 1] = OGG_decodeBuffer[count];
+                OGG_decodeBuffer[count * 2] = OGG_decodeBuffer[count];
             }
-            OGG_tempmixleft += ret / 4;    // back down to sample num
         }
-        OGG_info.instantBitrate = ov_bitrate_instant(&OGG_VorbisFile);
-        OGG_milliSeconds = ov_time_tell(&OGG_VorbisFile);
 
-        if (OGG_newFilePos >= 0)
-        {
-            ov_raw_seek(&OGG_VorbisFile, (ogg_int64_t)OGG_newFilePos);
-            OGG_newFilePos = -1;
+        //Volume boost:
+        if (OGG_volume_boost) {
+            for (count = 0; count < frames * 2; count++)
+                OGG_decodeBuffer[count] = volume_boost(&OGG_decodeBuffer[count], &OGG_volume_boost);
         }
 
+        pcmRingWrite(&OGG_ring, OGG_decodeBuffer, frames);
+
+        OGG_info.instantBitrate = ov_bitrate_instant(OGG_VorbisFile);
+        OGG_decodedSamples = ov_pcm_tell(OGG_VorbisFile);
+        OGG_decodedRawPos = ov_raw_tell(OGG_VorbisFile);
+
         //Check for playing speed:
         if (OGG_playingSpeed){
-            if (ov_raw_seek(&OGG_VorbisFile, ov_raw_tell(&OGG_VorbisFile) + OGG_playingDelta) != 0)
+            if (ov_raw_seek(OGG_VorbisFile, ov_raw_tell(OGG_VorbisFile) + OGG_playingDelta) != 0)
                 OGG_setPlayingSpeed(0);
         }
+    }
 
-        if (OGG_tempmixleft >= numSamples) {    //  Buffer has enough, so copy across
-            int count, count2;
-            short *_buf2;
-            //Volume boost:
-            if (!OGG_volume_boost){
-                for (count = 0; count < VITA_NUM_AUDIO_SAMPLES; count++) {
-                    count2 = count + count;
-                    _buf2 = _buf + count2;
-                    *(_buf2) = OGG_mixBuffer[count2];
-                    *(_buf2 + 1) = OGG_mixBuffer[count2 + 1];
-                }
-            }else{
-                for (count = 0; count < VITA_NUM_AUDIO_SAMPLES; count++) {
-                    count2 = count + count;
-                    _buf2 = _buf + count2;
-                    *(_buf2) = volume_boost(&OGG_mixBuffer[count2], &OGG_volume_boost);
-                    *(_buf2 + 1) = volume_boost(&OGG_mixBuffer[count2 + 1], &OGG_volume_boost);
-                }
-            }
-            //  Move the pointers
-            OGG_tempmixleft -= numSamples;
-            //  Now shuffle the buffer along
-            for (count = 0; count < OGG_tempmixleft * 2; count++)
-                OGG_mixBuffer[count] = OGG_mixBuffer[numSamples * 2 + count];
+    return sceKernelExitDeleteThread(0);
+}
+
+static void OGG_startDecoder(){
+    pcmRingReset(&OGG_ring);
+    OGG_trackBoundary = 0;
+    OGG_decoderTerminate = 0;
+    OGG_decoderThid = sceKernelCreateThread("ogg_decoder_thread", oggDecodeThread, 0x48, 0x10000, 0, 0, NULL);
+    if (OGG_decoderThid >= 0)
+        sceKernelStartThread(OGG_decoderThid, 0, NULL);
+}
+
+static void OGG_stopDecoder(){
+    if (OGG_decoderThid < 0)
+        return;
+
+    OGG_decoderTerminate = 1;
+    sceKernelWaitThreadEnd(OGG_decoderThid, NULL, NULL);
+    OGG_decoderThid = -1;
+}
+
+/////////////////////////////////////////////////////////////////////////////////////////
+//Audio callback, only copies what the decoder thread left in the ring
+/////////////////////////////////////////////////////////////////////////////////////////
+static void oggAudioCallback(void *_buf2, unsigned int numSamples, void *pdata){
+    short *_buf = (short *)_buf2;
+    unsigned int samplesRead = 0;
+
+    if (OGG_isPlaying)
+        samplesRead = pcmRingRead(&OGG_ring, _buf, numSamples);
+    else
+        pcmRingRead(&OGG_ring, NULL, 0);
+
+    //  Underrun or not playing, so clear the rest
+    if (samplesRead < numSamples)
+        memset(_buf + samplesRead * 2, 0, (numSamples - samplesRead) * 4);
+}
+
+
+/////////////////////////////////////////////////////////////////////////////////////////
+//Buffered callbacks for the playing file
+/////////////////////////////////////////////////////////////////////////////////////////
+static int ogg_buffered_pread(OggReader *reader, void *ptr, int size, SceOff offset)
+{
+    int res = sceIoPread(reader->fd, ptr, size, offset);
+    if (res == 0x80010013) {
+        reader->fd = sceIoOpen(reader->fileName, SCE_O_RDONLY, 0777);
+        res = sceIoPread(reader->fd, ptr, size, offset);
+    }
+    return res;
+}
+
+static size_t ogg_buffered_read(void *ptr, size_t size, size_t nmemb, void *datasource)
+{
+    OggReader *reader = (OggReader *)datasource;
+    size_t length = size * nmemb;
+    size_t done = 0;
+
+    while (done < length) {
+        //Inside the buffer?
+        if (reader->position >= reader->bufferOffset && reader->position < reader->bufferOffset + reader->bufferLength) {
+            int start = (int)(reader->position - reader->bufferOffset);
+            int n = reader->bufferLength - start;
+            if ((size_t)n > length - done)
+                n = length - done;
+
+            memcpy((char *)ptr + done, reader->buffer + start, n);
+            done += n;
+            reader->position += n;
+            continue;
         }
-        outputInProgress = 0;
-    } else {            //  Not Playing , so clear buffer
-        int count;
-        for (count = 0; count < numSamples * 2; count++)
-            *(_buf + count) = 0;
+
+        int res = ogg_buffered_pread(reader, reader->buffer, OGG_READ_SIZE, reader->position);
+        if (res <= 0)
+            break;
+
+        reader->bufferOffset = reader->position;
+        reader->bufferLength = res;
     }
+
+    return done;
+}
+
+static int ogg_buffered_seek(void *datasource, ogg_int64_t offset, int whence)
+{
+    OggReader *reader = (OggReader *)datasource;
+
+    switch (whence) {
+        case SEEK_SET:
+            break;
+        case SEEK_CUR:
+            offset += reader->position;
+            break;
+        case SEEK_END:
+            offset += reader->size;
+            break;
+        default:
+            return -1;
+    }
+
+    if (offset < 0 || offset > reader->size)
+        return -1;
+
+    reader->position = offset;
+    return 0;
+}
+
+static long ogg_buffered_tell(void *datasource)
+{
+    return (long)((OggReader *)datasource)->position;
+}
+
+static int ogg_buffered_close(void *datasource)
+{
+    return 0;
+}
+
+static int openOGGFile(OggReader *reader, OggVorbis_File *vf, const char *filename)
+{
+    reader->fd = sceIoOpen(filename, SCE_O_RDONLY, 0777);
+    if (reader->fd < 0)
+        return reader->fd;
+
+    strcpy(reader->fileName, filename);
+    reader->size = sceIoLseek(reader->fd, 0, SCE_SEEK_END);
+    reader->position = 0;
+    reader->bufferOffset = 0;
+    reader->bufferLength = 0;
+
+    ov_callbacks ogg_callbacks;
+
+    ogg_callbacks.read_func = ogg_buffered_read;
+    ogg_callbacks.seek_func = ogg_buffered_seek;
+    ogg_callbacks.close_func = ogg_buffered_close;
+    ogg_callbacks.tell_func = ogg_buffered_tell;
+    if (ov_open_callbacks(reader, vf, NULL, 0, ogg_callbacks) < 0){
+        sceIoClose(reader->fd);
+        reader->fd = -1;
+        return -1;
+    }
+
+    return 0;
 }
 
 
@@ -136,9 +345,9 @@ size_t ogg_callback_read(void *ptr, size_t size, size_t nmemb, void *datasource)
 {
     int res = sceIoRead(*(int *) datasource, ptr, size * nmemb);
     if (res == 0x80010013) {
-        OGG_file = sceIoOpen(OGG_fileName, SCE_O_RDONLY, 0777);
-        if (OGG_file >= 0) {
-            sceIoLseek32(OGG_file, (uint32_t)OGG_getFilePosition(), SCE_SEEK_SET);
+        OGG_reader->fd = sceIoOpen(OGG_fileName, SCE_O_RDONLY, 0777);
+        if (OGG_reader->fd >= 0) {
+            sceIoLseek32(OGG_reader->fd, (uint32_t)OGG_getFilePosition(), SCE_SEEK_SET);
         }
 
         res = sceIoRead(*(int *) datasource, ptr, size * nmemb);
@@ -149,9 +358,9 @@ int ogg_callback_seek(void *datasource, ogg_int64_t offset, int whence)
 {
     int res = sceIoLseek32(*(int *) datasource, (unsigned int) offset, whence);
     if (res == 0x80010013) {
-        OGG_file = sceIoOpen(OGG_fileName, SCE_O_RDONLY, 0777);
-        if (OGG_file >= 0) {
-            sceIoLseek32(OGG_file, (uint32_t)OGG_getFilePosition(), SCE_SEEK_SET);
+        OGG_reader->fd = sceIoOpen(OGG_fileName, SCE_O_RDONLY, 0777);
+        if (OGG_reader->fd >= 0) {
+            sceIoLseek32(OGG_reader->fd, (uint32_t)OGG_getFilePosition(), SCE_SEEK_SET);
         }
 
         res = sceIoLseek32(*(int *) datasource, (unsigned int) offset, whence);
@@ -162,9 +371,9 @@ long ogg_callback_tell(void *datasource)
 {
     int res = sceIoLseek32(*(int *) datasource, 0, SEEK_CUR);
     if (res == 0x80010013) {
-        OGG_file = sceIoOpen(OGG_fileName, SCE_O_RDONLY, 0777);
-        if (OGG_file >= 0) {
-            sceIoLseek32(OGG_file, (uint32_t)OGG_getFilePosition(), SCE_SEEK_SET);
+        OGG_reader->fd = sceIoOpen(OGG_fileName, SCE_O_RDONLY, 0777);
+        if (OGG_reader->fd >= 0) {
+            sceIoLseek32(OGG_reader->fd, (uint32_t)OGG_getFilePosition(), SCE_SEEK_SET);
         }
 
         res = sceIoLseek32(*(int *) datasource, 0, SEEK_CUR);
@@ -175,9 +384,9 @@ int ogg_callback_close(void *datasource)
 {
     int res = sceIoClose(*(int *) datasource);
     if (res == 0x80010013) {
-        OGG_file = sceIoOpen(OGG_fileName, SCE_O_RDONLY, 0777);
-        if (OGG_file >= 0) {
-            sceIoLseek32(OGG_file, (uint32_t)OGG_getFilePosition(), SCE_SEEK_SET);
+        OGG_reader->fd = sceIoOpen(OGG_fileName, SCE_O_RDONLY, 0777);
+        if (OGG_reader->fd >= 0) {
+            sceIoLseek32(OGG_reader->fd, (uint32_t)OGG_getFilePosition(), SCE_SEEK_SET);
         }
 
         res = sceIoClose(*(int *) datasource);
@@ -223,7 +432,7 @@ void splitComment(char *comment, char *name, char *value){
     }
 }
 
-void getOGGTagInfo(OggVorbis_File *inVorbisFile, struct fileInfo *targetInfo){
+static void readOGGTags(OggVorbis_File *inVorbisFile, struct fileInfo *targetInfo){
     int i;
     char name[31];
     char value[257];
@@ -257,42 +466,50 @@ void getOGGTagInfo(OggVorbis_File *inVorbisFile, struct fileInfo *targetInfo){
             fclose(out);
         }*/
     }
+}
+
+void getOGGTagInfo(OggVorbis_File *inVorbisFile, struct fileInfo *targetInfo){
+    readOGGTags(inVorbisFile, targetInfo);
 
     OGG_info = *targetInfo;
     OGG_tagRead = 1;
 }
 
-void OGGgetInfo(){
+static void readOGGInfo(OggVorbis_File *vf, struct fileInfo *info, int *channels){
     //Estraggo le informazioni:
-    OGG_info.fileType = OGG_TYPE;
-    OGG_info.defaultCPUClock = OGG_defaultCPUClock;
-    OGG_info.needsME = 0;
-
-    vorbis_info *vi = ov_info(&OGG_VorbisFile, -1);
-    OGG_info.kbit = vi->bitrate_nominal/1000;
-    OGG_info.instantBitrate = vi->bitrate_nominal;
-    OGG_info.hz = vi->rate;
-    OGG_info.length = (long)ov_time_total(&OGG_VorbisFile, -1)/1000;
+    info->fileType = OGG_TYPE;
+    info->defaultCPUClock = OGG_defaultCPUClock;
+    info->needsME = 0;
+
+    vorbis_info *vi = ov_info(vf, -1);
+    info->kbit = vi->bitrate_nominal/1000;
+    info->instantBitrate = vi->bitrate_nominal;
+    info->hz = vi->rate;
+    info->length = vi->rate > 0 ? (long)(ov_pcm_total(vf, -1) / vi->rate) : 0;
     if (vi->channels == 1){
-        strcpy(OGG_info.mode, "single channel");
-        OGG_channels = 1;
+        strcpy(info->mode, "single channel");
+        *channels = 1;
     }else if (vi->channels == 2){
-        strcpy(OGG_info.mode, "normal LR stereo");
-        OGG_channels = 2;
+        strcpy(info->mode, "normal LR stereo");
+        *channels = 2;
     }
-    strcpy(OGG_info.emphasis, "no");
+    strcpy(info->emphasis, "no");
 
     int h = 0;
     int m = 0;
     int s = 0;
-    long secs = OGG_info.length;
+    long secs = info->length;
     h = secs / 3600;
     m = (secs - h * 3600) / 60;
     s = secs - h * 3600 - m * 60;
-    snprintf(OGG_info.strLength, sizeof(OGG_info.strLength), "%2.2i:%2.2i:%2.2i", h, m, s);
+    snprintf(info->strLength, sizeof(info->strLength), "%2.2i:%2.2i:%2.2i", h, m, s);
+}
+
+void OGGgetInfo(){
+    readOGGInfo(OGG_VorbisFile, &OGG_info, &OGG_channels);
 
     if (!OGG_tagRead)
-        getOGGTagInfo(&OGG_VorbisFile, &OGG_info);
+        getOGGTagInfo(OGG_VorbisFile, &OGG_info);
 }
 
 
@@ -304,49 +521,43 @@ void OGG_Init(int channel){
     OGG_tagRead = 0;
     OGG_audio_channel = channel;
     OGG_milliSeconds = 0.0;
-    OGG_tempmixleft = 0;
-    memset(OGG_mixBuffer, 0, sizeof(OGG_mixBuffer));
-    vitaAudioSetChannelCallback(OGG_audio_channel, oggDecodeThread, NULL);
+    pcmRingInit(&OGG_ring, OGG_ringSamples, PCM_RING_FRAMES);
+    vitaAudioSetChannelCallback(OGG_audio_channel, oggAudioCallback, NULL);
 }
 
 
-int OGG_Load(char *filename){
-    outputInProgress = 0;
+static int OGG_open(char *filename){
     OGG_isPlaying = 0;
     OGG_milliSeconds = 0;
+    OGG_decodedSamples = 0;
+    OGG_decodedRawPos = 0;
+    OGG_newFilePos = -1;
     OGG_eos = 0;
     OGG_playingSpeed = 0;
     OGG_playingDelta = 0;
     strcpy(OGG_fileName, filename);
     //Apro il file OGG:
-    OGG_file = sceIoOpen(OGG_fileName, SCE_O_RDONLY, 0777);
-    if (OGG_file >= 0) {
-        OGG_info.fileSize = sceIoLseek(OGG_file, 0, SCE_SEEK_END);
-        sceIoLseek(OGG_file, 0, SCE_SEEK_SET);
-        ov_callbacks ogg_callbacks;
-
-        ogg_callbacks.read_func = ogg_callback_read;
-        ogg_callbacks.seek_func = ogg_callback_seek;
-        ogg_callbacks.close_func = ogg_callback_close;
-        ogg_callbacks.tell_func = ogg_callback_tell;
-        if (ov_open_callbacks(&OGG_file, &OGG_VorbisFile, NULL, 0, ogg_callbacks) < 0){
-            sceIoClose(OGG_file);
-            OGG_file = -1;
-            return ERROR_OPENING;
-        }
-    }else{
+    if (openOGGFile(OGG_reader, OGG_VorbisFile, filename) < 0)
         return ERROR_OPENING;
-    }
 
+    OGG_info.fileSize = OGG_reader->size;
     OGGgetInfo();
     //Controllo il sample rate:
     if (vitaAudioSetFrequency(OGG_audio_channel, OGG_info.hz) < 0){
         OGG_FreeTune();
         return ERROR_INVALID_SAMPLE_RATE;
     }
+
     return OPENING_OK;
 }
 
+int OGG_Load(char *filename){
+    int res = OGG_open(filename);
+    if (res == OPENING_OK)
+        OGG_startDecoder();
+    return res;
+}
+
 int OGG_IsPlaying() {
     return OGG_isPlaying;
 }
@@ -362,23 +573,38 @@ void OGG_Pause(){
 
 int OGG_Stop(){
     OGG_isPlaying = 0;
-    //This is to be sure that oggDecodeThread isn't messing with &OGG_VorbisFile
-    while (outputInProgress == 1)
-        sceKernelDelayThread(100000);
     return 0;
 }
 
 void OGG_FreeTune(){
-    ov_clear(&OGG_VorbisFile);
-    if (OGG_file >= 0)
-        sceIoClose(OGG_file);
-    OGG_file = -1;
-    OGG_tempmixleft = 0;
-    memset(OGG_mixBuffer, 0, sizeof(OGG_mixBuffer));
+    //This is to be sure that oggDecodeThread isn't messing with OGG_VorbisFile
+    OGG_stopDecoder();
+    if (OGG_reader->fd >= 0){
+        ov_clear(OGG_VorbisFile);
+        sceIoClose(OGG_reader->fd);
+    }
+    OGG_reader->fd = -1;
+
+    OGG_dropNext();
+}
+
+//Position of what is being heard, the ring holds audio decoded ahead of it
+static void OGG_updatePlayedTime(){
+    //Still hearing the end of the previous track:
+    if (trackBoundaryAhead()){
+        OGG_milliSeconds = OGG_endMilliSeconds - (double)(OGG_trackBoundary - OGG_ring.read) * 1000.0 / OGG_info.hz;
+        return;
+    }
+
+    if (OGG_info.hz > 0){
+        ogg_int64_t samples = OGG_decodedSamples - pcmRingAvailable(&OGG_ring);
+        OGG_milliSeconds = samples > 0 ? (double)samples * 1000.0 / OGG_info.hz : 0.0;
+    }
 }
 
 void OGG_GetTimeString(char *dest){
     char timeString[9];
+    OGG_updatePlayedTime();
     long secs = (long)OGG_milliSeconds/1000;
     int h = secs / 3600;
     int m = (secs - h * 3600) / 60;
@@ -389,7 +615,51 @@ void OGG_GetTimeString(char *dest){
 
 
 int OGG_EndOfStream(){
-    return OGG_eos;
+    return OGG_eos && pcmRingAvailable(&OGG_ring) == 0;
+}
+
+unsigned int OGG_getUnderruns(){
+    return OGG_ring.underruns;
+}
+
+//Queue the track to play after this one without a gap. Opens it and reads its
+//headers, so it is meant to run on a thread other than the UI.
+//Returns its info, or NULL if it cannot follow (other sample rate).
+struct fileInfo *OGG_setNext(char *filename){
+    if (OGG_reader->fd < 0 || OGG_nextReady || OGG_trackPending)
+        return NULL;
+
+    OggReader *reader = OGG_reader == &OGG_readers[0] ? &OGG_readers[1] : &OGG_readers[0];
+    OggVorbis_File *vf = OGG_VorbisFile == &OGG_vorbisFiles[0] ? &OGG_vorbisFiles[1] : &OGG_vorbisFiles[0];
+
+    if (openOGGFile(reader, vf, filename) < 0)
+        return NULL;
+
+    initFileInfo(&OGG_nextInfo);
+    OGG_nextInfo.fileSize = reader->size;
+    readOGGInfo(vf, &OGG_nextInfo, &OGG_nextChannels);
+    readOGGTags(vf, &OGG_nextInfo);
+
+    if (OGG_nextInfo.hz != OGG_info.hz){
+        ov_clear(vf);
+        sceIoClose(reader->fd);
+        reader->fd = -1;
+        return NULL;
+    }
+
+    __sync_synchronize();
+    OGG_nextReady = 1;
+    return &OGG_nextInfo;
+}
+
+//Returns 1 once the queued track is being heard, its info is then current
+int OGG_trackChanged(){
+    if (!OGG_trackPending || trackBoundaryAhead())
+        return 0;
+
+    OGG_info = OGG_nextInfo;
+    OGG_trackPending = 0;
+    return 1;
 }
 
 struct fileInfo *OGG_GetInfo(){
@@ -431,9 +701,15 @@ struct fileInfo OGG_GetTagInfoOnly(char *filename){
 
 float OGG_GetPercentage(){
     float perc = 0.0f;
-    if (OGG_info.length){
+    OGG_updatePlayedTime();
+    if (trackBoundaryAhead()){
+        perc = 99.9f;
+    }else if (OGG_info.length){
         perc = (float)(OGG_milliSeconds/1000.0/(double)OGG_info.length*100.0);
-        if (perc > 100)
+        //100% means the track is over, so wait for the ring to drain
+        if (!OGG_EndOfStream() && perc > 99.9f)
+            perc = 99.9f;
+        else if (perc > 100)
             perc = 100;
     }
     return perc;
@@ -517,7 +793,9 @@ int OGG_isFilterEnabled(){
 //Manage suspend:
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 int OGG_suspend(){
-    OGG_suspendPosition = ov_raw_tell(&OGG_VorbisFile);
+    OGG_stopDecoder();
+    OGG_dropNext();
+    OGG_suspendPosition = ov_raw_tell(OGG_VorbisFile);
     OGG_suspendIsPlaying = OGG_isPlaying;
     //OGG_Stop();
     //OGG_FreeTune();
@@ -528,9 +806,11 @@ int OGG_suspend(){
 int OGG_resume(){
     OGG_Init(OGG_audio_channel);
     if (OGG_suspendPosition >= 0){
-       if (OGG_Load(OGG_fileName) == OPENING_OK){
-           if (ov_raw_seek(&OGG_VorbisFile, OGG_suspendPosition))
-              OGG_isPlaying = OGG_suspendIsPlaying;
+       if (OGG_open(OGG_fileName) == OPENING_OK){
+           // The seek must be queued before the decoder reads its first packet
+           OGG_newFilePos = OGG_suspendPosition;
+           OGG_isPlaying = OGG_suspendIsPlaying;
+           OGG_startDecoder();
        }
        OGG_suspendPosition = -1;
     }
@@ -539,7 +819,7 @@ int OGG_resume(){
 
 double OGG_getFilePosition()
 {
-    return (double)ov_raw_tell(&OGG_VorbisFile);
+    return (double)OGG_decodedRawPos;
 }
 
 void OGG_setFilePosition(double position)
@@ -28,6 +28,9 @@ void OGG_FreeTune();
 int OGG_Load(char *filename);
 void OGG_GetTimeString(char *dest);
 int OGG_EndOfStream();
+unsigned int OGG_getUnderruns();
+struct fileInfo *OGG_setNext(char *filename);
+int OGG_trackChanged();
 struct fileInfo *OGG_GetInfo();
 struct fileInfo OGG_GetTagInfoOnly(char *filename);
 int OGG_GetStatus();
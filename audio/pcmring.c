@@ -0,0 +1,135 @@
+/*
+	VitaShell
+	Copyright (C) 2015-2018, TheFloW
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <psp2/kernel/threadmgr.h>
+#include <string.h>
+
+#include "pcmring.h"
+
+// frames must be a power of two
+void pcmRingInit(PcmRing *ring, short *samples, unsigned int frames) {
+    ring->samples = samples;
+    ring->size = frames;
+    pcmRingReset(ring);
+}
+
+// Only while neither side is running
+void pcmRingReset(PcmRing *ring) {
+    ring->flush = 0;
+    ring->filling = 1;
+    ring->read = 0;
+    ring->write = 0;
+    ring->eos = 0;
+    ring->underruns = 0;
+}
+
+unsigned int pcmRingAvailable(PcmRing *ring) {
+    return ring->write - ring->read;
+}
+
+unsigned int pcmRingSpace(PcmRing *ring) {
+    return ring->size - (ring->write - ring->read);
+}
+
+// Producer side. Returns the number of frames written.
+unsigned int pcmRingWrite(PcmRing *ring, const short *frames, unsigned int n) {
+    unsigned int write = ring->write;
+    unsigned int space = ring->size - (write - ring->read);
+    if (n > space)
+        n = space;
+
+    unsigned int index = write & (ring->size - 1);
+    unsigned int first = ring->size - index;
+    if (first > n)
+        first = n;
+
+    memcpy(ring->samples + index * 2, frames, first * 4);
+    memcpy(ring->samples, frames + first * 2, (n - first) * 4);
+
+    // The frames must be visible before the new write position
+    __sync_synchronize();
+    ring->write = write + n;
+
+    return n;
+}
+
+// Consumer side. Returns the number of frames read, a short read before
+// the end of the stream is an underrun, unless the ring is still filling
+// up after a reset or flush. Call it with n = 0 while paused so flushes
+// are still taken.
+unsigned int pcmRingRead(PcmRing *ring, short *frames, unsigned int n) {
+    unsigned int read = ring->read;
+
+    if (ring->flush) {
+        read = ring->write;
+        __sync_synchronize();
+        ring->read = read;
+        ring->flush = 0;
+        ring->filling = 1;
+    }
+
+    if (n == 0)
+        return 0;
+
+    unsigned int available = ring->write - read;
+    __sync_synchronize();
+
+    if (n > available) {
+        if (!ring->eos && !ring->filling)
+            ring->underruns++;
+        n = available;
+    } else {
+        ring->filling = 0;
+    }
+
+    unsigned int index = read & (ring->size - 1);
+    unsigned int first = ring->size - index;
+    if (first > n)
+        first = n;
+
+    memcpy(frames, ring->samples + index * 2, first * 4);
+    memcpy(frames + first * 2, ring->samples, (n - first) * 4);
+
+    __sync_synchronize();
+    ring->read = read + n;
+
+    return n;
+}
+
+// Producer side. Drops everything queued so far and waits for the consumer
+// to take it, so frames written afterwards are kept. Returns -1 if *cancel
+// was set while waiting.
+int pcmRingFlush(PcmRing *ring, volatile int *cancel) {
+    ring->eos = 0;
+    __sync_synchronize();
+    ring->flush = 1;
+
+    while (ring->flush) {
+        if (cancel && *cancel)
+            return -1;
+
+        sceKernelDelayThread(1000);
+    }
+
+    return 0;
+}
+
+// Producer side. At the end of the stream running dry is not an underrun.
+void pcmRingSetEos(PcmRing *ring, int eos) {
+    ring->eos = eos;
+}
@@ -0,0 +1,50 @@
+/*
+	VitaShell
+	Copyright (C) 2015-2018, TheFloW
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __PCMRING_H__
+#define __PCMRING_H__
+
+// Interleaved stereo frames, a power of two (~0.75s at 44.1kHz)
+#define PCM_RING_FRAMES 32768
+
+// Single producer (the decoder thread), single consumer (the audio
+// output callback). Positions only ever grow, each side writes its own.
+typedef struct {
+    short *samples;
+    unsigned int size;
+    volatile unsigned int read;
+    volatile unsigned int write;
+    volatile int flush;
+    volatile int filling;
+    volatile int eos;
+    volatile unsigned int underruns;
+} PcmRing;
+
+void pcmRingInit(PcmRing *ring, short *samples, unsigned int frames);
+void pcmRingReset(PcmRing *ring);
+
+unsigned int pcmRingAvailable(PcmRing *ring);
+unsigned int pcmRingSpace(PcmRing *ring);
+
+unsigned int pcmRingWrite(PcmRing *ring, const short *frames, unsigned int n);
+unsigned int pcmRingRead(PcmRing *ring, short *frames, unsigned int n);
+
+int pcmRingFlush(PcmRing *ring, volatile int *cancel);
+void pcmRingSetEos(PcmRing *ring, int eos);
+
+#endif
@@ -51,6 +51,9 @@ float (* getPercentageFunct)();
 int (* getPlayingSpeedFunct)();
 int (* setPlayingSpeedFunct)(int);
 int (* endOfStreamFunct)();
+unsigned int (* getUnderrunsFunct)();
+struct fileInfo *(* setNextFunct)(char *);
+int (* trackChangedFunct)();
 
 int (* setMuteFunct)(int);
 int (* setFilterFunct)(double[32], int copyFilter);
@@ -141,6 +144,9 @@ int setAudioFunctions(int type) {
         getPlayingSpeedFunct = OGG_getPlayingSpeed;
         setPlayingSpeedFunct = OGG_setPlayingSpeed;
         endOfStreamFunct = OGG_EndOfStream;
+        getUnderrunsFunct = OGG_getUnderruns;
+        setNextFunct = OGG_setNext;
+        trackChangedFunct = OGG_trackChanged;
 
         setMuteFunct = OGG_setMute;
         setFilterFunct = OGG_setFilter;
@@ -172,6 +178,9 @@ int setAudioFunctions(int type) {
 		getPlayingSpeedFunct = MP3_getPlayingSpeed;
 		setPlayingSpeedFunct = MP3_setPlayingSpeed;
 		endOfStreamFunct = MP3_EndOfStream;
+		getUnderrunsFunct = MP3_getUnderruns;
+		setNextFunct = MP3_setNext;
+		trackChangedFunct = MP3_trackChanged;
 
 		setMuteFunct = MP3_setMute;
 		setFilterFunct = MP3_setFilter;
@@ -208,6 +217,9 @@ void unsetAudioFunctions() {
     getPlayingSpeedFunct = NULL;
     setPlayingSpeedFunct = NULL;
     endOfStreamFunct = NULL;
+    getUnderrunsFunct = NULL;
+    setNextFunct = NULL;
+    trackChangedFunct = NULL;
 
     setMuteFunct = NULL;
     setFilterFunct = NULL;
@@ -67,6 +67,9 @@ extern float (* getPercentageFunct)();
 extern int (* getPlayingSpeedFunct)();
 extern int (* setPlayingSpeedFunct)(int);
 extern int (* endOfStreamFunct)();
+extern unsigned int (* getUnderrunsFunct)();                 //Times the output ran out of decoded audio
+extern struct fileInfo *(* setNextFunct)(char *);            //Queues the track that follows without a gap
+extern int (* trackChangedFunct)();                         //1 once the queued track is being heard
 
 extern int (* setMuteFunct)(int);
 extern int (* setFilterFunct)(double[32], int copyFilter);
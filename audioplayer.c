@@ -30,6 +30,22 @@
 static struct fileInfo *fileinfo = NULL;
 static vita2d_texture *tex = NULL;
 
+// The track to play next, opened and parsed on a thread while the current
+// one plays so the player can continue into it without a gap
+typedef struct {
+  int started;
+  SceUID thid;
+  FileListEntry *entry;
+  char file[MAX_PATH_LENGTH];
+  struct fileInfo *info; // NULL if the track cannot follow without a gap
+  vita2d_texture *cover;
+  Lyrics *lyrics;
+} AudioPreload;
+
+static AudioPreload preload = { .thid = -1 };
+static char playing_file[MAX_PATH_LENGTH];
+static int playing_type = -1;
+
 
 /**
 * Calculate the x-axis position if draw text in center
@@ -155,33 +171,25 @@ vita2d_texture *getAlternativeCoverImage(const char *file) {
   return NULL;
 }
 
-void getAudioInfo(const char *file) {
-  char *buffer = NULL;
-
-  fileinfo = getInfoFunct();
-
-  if (tex) {
-    vita2d_wait_rendering_done();
-    vita2d_free_texture(tex);
-    tex = NULL;
-  }
+static vita2d_texture *loadCoverImage(const char *file, struct fileInfo *info) {
+  vita2d_texture *tex = NULL;
 
-  switch (fileinfo->encapsulatedPictureType) {
+  switch (info->encapsulatedPictureType) {
     case JPEG_IMAGE:
     case PNG_IMAGE:
     {
       SceUID fd = sceIoOpen(file, SCE_O_RDONLY, 0);
       if (fd >= 0) {
-        char *buffer = malloc(fileinfo->encapsulatedPictureLength);
+        char *buffer = malloc(info->encapsulatedPictureLength);
         if (buffer) {
-          sceIoLseek32(fd, fileinfo->encapsulatedPictureOffset, SCE_SEEK_SET);
-          sceIoRead(fd, buffer, fileinfo->encapsulatedPictureLength);
+          sceIoLseek32(fd, info->encapsulatedPictureOffset, SCE_SEEK_SET);
+          sceIoRead(fd, buffer, info->encapsulatedPictureLength);
           sceIoClose(fd);
 
-          if (fileinfo->encapsulatedPictureType == JPEG_IMAGE)
-            tex = vita2d_load_JPEG_buffer(buffer, fileinfo->encapsulatedPictureLength);
+          if (info->encapsulatedPictureType == JPEG_IMAGE)
+            tex = vita2d_load_JPEG_buffer(buffer, info->encapsulatedPictureLength);
 
-          if (fileinfo->encapsulatedPictureType == PNG_IMAGE)
+          if (info->encapsulatedPictureType == PNG_IMAGE)
             tex = vita2d_load_PNG_buffer(buffer);
 
           if (tex)
@@ -197,6 +205,128 @@ void getAudioInfo(const char *file) {
 
   if (!tex)
     tex = getAlternativeCoverImage(file);
+
+  return tex;
+}
+
+void getAudioInfo(const char *file) {
+  fileinfo = getInfoFunct();
+
+  if (tex) {
+    vita2d_wait_rendering_done();
+    vita2d_free_texture(tex);
+    tex = NULL;
+  }
+
+  tex = loadCoverImage(file, fileinfo);
+}
+
+// Fills path and returns the type if entry is a file the player can play
+static int getAudioEntryType(FileList *list, FileListEntry *entry, char *path) {
+  if (entry->is_folder)
+    return -1;
+
+  snprintf(path, MAX_PATH_LENGTH, "%s%s", list->path, entry->name);
+  int type = getFileType(path);
+  if (type == FILE_TYPE_MP3 || type == FILE_TYPE_OGG)
+    return type;
+
+  return -1;
+}
+
+static int preload_thread(SceSize args, void *argp) {
+  preload.info = setNextFunct(preload.file);
+
+  if (preload.info) {
+    uint64_t totalms = 0;
+    uint32_t lyricsIndex = 0;
+
+    preload.cover = loadCoverImage(preload.file, preload.info);
+    if (preload.cover)
+      vita2d_texture_set_filters(preload.cover, SCE_GXM_TEXTURE_FILTER_LINEAR, SCE_GXM_TEXTURE_FILTER_LINEAR);
+
+    preload.lyrics = loadLyricsFile(preload.file, &totalms, &lyricsIndex);
+  }
+
+  return sceKernelExitDeleteThread(0);
+}
+
+// Picks the track that follows entry in the given repeat mode and starts
+// preparing it. Only a track of the playing type can follow without a gap.
+static void startPreload(FileList *list, FileListEntry *entry, int repeat_mode) {
+  char path[MAX_PATH_LENGTH];
+  FileListEntry *next = NULL;
+  FileListEntry *temp_entry;
+
+  preload.started = 1;
+
+  if (repeat_mode == 1) {
+    next = entry;
+  } else if (repeat_mode == 3) {
+    int audio_files = 0;
+    for (temp_entry = list->head; temp_entry; temp_entry = temp_entry->next) {
+      if (temp_entry != entry && getAudioEntryType(list, temp_entry, path) >= 0)
+        audio_files++;
+    }
+
+    int target_index = audio_files > 0 ? rand() % audio_files : 0;
+    for (temp_entry = list->head; temp_entry; temp_entry = temp_entry->next) {
+      if (temp_entry != entry && getAudioEntryType(list, temp_entry, path) >= 0 && target_index-- == 0) {
+        next = temp_entry;
+        break;
+      }
+    }
+
+    if (!next)
+      next = entry;
+  } else {
+    for (temp_entry = entry->next; temp_entry && !next; temp_entry = temp_entry->next) {
+      if (getAudioEntryType(list, temp_entry, path) >= 0)
+        next = temp_entry;
+    }
+
+    if (!next && repeat_mode == 2) {
+      for (temp_entry = list->head; temp_entry && !next; temp_entry = temp_entry->next) {
+        if (getAudioEntryType(list, temp_entry, path) >= 0)
+          next = temp_entry;
+      }
+    }
+  }
+
+  if (!next || getAudioEntryType(list, next, path) != playing_type)
+    return;
+
+  preload.entry = next;
+  strcpy(preload.file, path);
+  preload.info = NULL;
+  preload.cover = NULL;
+  preload.lyrics = NULL;
+
+  preload.thid = sceKernelCreateThread("audio_preload_thread", preload_thread, 0x10000100, 0x10000, 0, 0, NULL);
+  if (preload.thid >= 0)
+    sceKernelStartThread(preload.thid, 0, NULL);
+}
+
+static void waitPreload() {
+  if (preload.thid >= 0) {
+    sceKernelWaitThreadEnd(preload.thid, NULL, NULL);
+    preload.thid = -1;
+  }
+}
+
+// Drops the prepared track, before the player is torn down
+static void cancelPreload() {
+  waitPreload();
+
+  if (preload.cover) {
+    vita2d_free_texture(preload.cover);
+    preload.cover = NULL;
+  }
+
+  lrcParseClose(preload.lyrics);
+  preload.lyrics = NULL;
+  preload.info = NULL;
+  preload.started = 0;
 }
 
 int audioPlayer(const char *file, int type, FileList *list, FileListEntry *entry, int *base_pos, int *rel_pos) {
@@ -211,6 +341,8 @@ int audioPlayer(const char *file, int type, FileList *list, FileListEntry *entry
 
   setAudioFunctions(type);
 
+  playing_type = type;
+
   initFunct(0);
   loadFunct((char *)file);
   playFunct();
@@ -225,6 +357,48 @@ int audioPlayer(const char *file, int type, FileList *list, FileListEntry *entry
   float scroll_x = 0.0f;
 
   while (1) {
+    // The prepared track is being heard now, show it
+    if (preload.thid >= 0 && trackChangedFunct()) {
+      waitPreload();
+
+      strcpy(playing_file, preload.file);
+      file = playing_file;
+      entry = preload.entry;
+
+      fileinfo = getInfoFunct();
+
+      if (tex) {
+        vita2d_wait_rendering_done();
+        vita2d_free_texture(tex);
+      }
+      tex = preload.cover;
+      preload.cover = NULL;
+
+      if (!tex)
+        tex = getAlternativeCoverImage(file);
+
+      lrcParseClose(lyrics);
+      lyrics = preload.lyrics;
+      preload.lyrics = NULL;
+      totalms = 0;
+      lyricsIndex = 0;
+
+      int total_pos = 0;
+      FileListEntry *pos_entry;
+      for (pos_entry = list->head; pos_entry && pos_entry != entry; pos_entry = pos_entry->next) {
+        total_pos++;
+      }
+
+      *base_pos = MAX(0, total_pos - MAX_POSITION / 2);
+      *rel_pos = total_pos - *base_pos;
+
+      scroll_count = 0;
+      cancelPreload();
+    }
+
+    if (!preload.started)
+      startPreload(list, entry, repeat_mode);
+
     char cur_time_string[12];
     getTimeStringFunct(cur_time_string);
 
@@ -286,6 +460,7 @@ int audioPlayer(const char *file, int type, FileList *list, FileListEntry *entry
       int previous = pressed_pad[PAD_LTRIGGER];
       if (previous && strcmp(cur_time_string, "00:00:00") != 0) {
         lrcParseClose(lyrics);
+        cancelPreload();
         endFunct();
         initFunct(0);
         loadFunct((char *)file);
@@ -298,6 +473,7 @@ int audioPlayer(const char *file, int type, FileList *list, FileListEntry *entry
       } else if (endOfStreamFunct() && repeat_mode == 1) {
         // Repeat one: restart same song
         lrcParseClose(lyrics);
+        cancelPreload();
         endFunct();
         initFunct(0);
         loadFunct((char *)file);
@@ -368,13 +544,17 @@ int audioPlayer(const char *file, int type, FileList *list, FileListEntry *entry
               if (type == FILE_TYPE_MP3 || type == FILE_TYPE_OGG) {
                 if (audio_idx == target_index) {
                   entry = temp_entry;
-                  file = path;
+                  strcpy(playing_file, path);
+                  file = playing_file;
 
                   lrcParseClose(lyrics);
+                  cancelPreload();
                   endFunct();
 
                   setAudioFunctions(type);
 
+                  playing_type = type;
+
                   initFunct(0);
                   loadFunct((char *)file);
                   playFunct();
@@ -402,6 +582,7 @@ int audioPlayer(const char *file, int type, FileList *list, FileListEntry *entry
         } else {
           // Only one audio file, restart it (same as Repeat One)
           lrcParseClose(lyrics);
+          cancelPreload();
           endFunct();
           initFunct(0);
           loadFunct((char *)file);
@@ -450,13 +631,17 @@ int audioPlayer(const char *file, int type, FileList *list, FileListEntry *entry
             snprintf(path, MAX_PATH_LENGTH, "%s%s", list->path, entry->name);
             int type = getFileType(path);
             if (type == FILE_TYPE_MP3 || type == FILE_TYPE_OGG) {
-              file = path;
+              strcpy(playing_file, path);
+              file = playing_file;
 
               lrcParseClose(lyrics);
+              cancelPreload();
               endFunct();
 
               setAudioFunctions(type);
 
+              playing_type = type;
+
               initFunct(0);
               loadFunct((char *)file);
               playFunct();
@@ -482,13 +667,17 @@ int audioPlayer(const char *file, int type, FileList *list, FileListEntry *entry
               snprintf(path, MAX_PATH_LENGTH, "%s%s", list->path, entry->name);
               int new_type = getFileType(path);
               if (new_type == FILE_TYPE_MP3 || new_type == FILE_TYPE_OGG) {
-                file = path;
+                strcpy(playing_file, path);
+                file = playing_file;
 
                 lrcParseClose(lyrics);
+                cancelPreload();
                 endFunct();
 
                 setAudioFunctions(new_type);
 
+                playing_type = new_type;
+
                 initFunct(0);
                 loadFunct((char *)file);
                 playFunct();
@@ -621,6 +810,7 @@ int audioPlayer(const char *file, int type, FileList *list, FileListEntry *entry
   }
 
   lrcParseClose(lyrics);
+  cancelPreload();
   endFunct();
 
   powerUnlock();
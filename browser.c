@@ -27,6 +27,7 @@
 #include "context_menu.h"
 #include "archive.h"
 #include "photo.h"
+#include "thumbnail.h"
 #include "audioplayer.h"
 #include "file.h"
 #include "text.h"
@@ -72,6 +73,11 @@ int file_type = FILE_TYPE_UNKNOWN;
 static int is_in_archive = 0;
 static char dir_level_archive = -1;
 
+// Enclosing archives of a nested archive
+static int n_parent_archives = 0;
+static char parent_dir_level_archive[MAX_NESTED_ARCHIVES];
+static char parent_archive_path[MAX_NESTED_ARCHIVES][MAX_PATH_LENGTH];
+
 // Scrolling filename
 static int scroll_count = 0;
 static float scroll_x = FILE_X;
@@ -138,11 +144,53 @@ int isInArchive() {
   return is_in_archive;
 }
 
+int canEnterArchive() {
+  return !isInArchive() || n_parent_archives < MAX_NESTED_ARCHIVES;
+}
+
+int enterArchive(const char *path) {
+  // Without room to remember the enclosing archive it could not be left
+  if (!canEnterArchive())
+    return VITASHELL_ERROR_ARCHIVE_TOO_DEEP;
+
+  // Remember the enclosing archive
+  if (isInArchive()) {
+    parent_dir_level_archive[n_parent_archives] = dir_level_archive;
+    strcpy(parent_archive_path[n_parent_archives], archive_path);
+    n_parent_archives++;
+  }
+
+  setInArchive();
+  setDirArchiveLevel();
+
+  strncpy(archive_path, path, MAX_PATH_LENGTH - 1);
+  archive_path[MAX_PATH_LENGTH - 1] = '\0';
+
+  return 0;
+}
+
+void cancelEnterArchive() {
+  // Reopen the enclosing archive which was replaced by the nested one
+  if (isInArchive()) {
+    archiveClose();
+    archiveOpen(archive_path);
+  }
+}
+
 void dirUpCloseArchive() {
   if (isInArchive() && dir_level_archive >= dir_level) {
-    is_in_archive = 0;
     archiveClose();
-    dir_level_archive = -1;
+
+    if (n_parent_archives > 0) {
+      // Back to the enclosing archive
+      n_parent_archives--;
+      dir_level_archive = parent_dir_level_archive[n_parent_archives];
+      strcpy(archive_path, parent_archive_path[n_parent_archives]);
+      archiveOpen(archive_path);
+    } else {
+      is_in_archive = 0;
+      dir_level_archive = -1;
+    }
   }
 }
 
@@ -381,7 +429,6 @@ static int handleFile(const char *file, FileListEntry *entry) {
     case FILE_TYPE_MP3:
     case FILE_TYPE_OGG:
     case FILE_TYPE_VPK:
-    case FILE_TYPE_ARCHIVE:
       if (isInArchive())
         type = FILE_TYPE_UNKNOWN;
 
@@ -425,8 +472,22 @@ static int handleFile(const char *file, FileListEntry *entry) {
       break;
       
     case FILE_TYPE_ARCHIVE:
-      archiveClearPassword();
+      if (!canEnterArchive()) {
+        res = VITASHELL_ERROR_ARCHIVE_TOO_DEEP;
+        break;
+      }
+
+      // A nested archive replaces the enclosing one until it is left
+      if (isInArchive()) {
+        archiveClose();
+      } else {
+        archiveClearPassword();
+      }
+
       res = archiveOpen(file);
+      if (res < 0 && isInArchive())
+        archiveOpen(archive_path);
+
       if (res >= 0 && archiveNeedPassword()) {
         initImeDialog(language_container[ENTER_PASSWORD], "", 128, SCE_IME_TYPE_BASIC_LATIN, 0, 1);
         setDialogStep(DIALOG_STEP_ENTER_PASSWORD);
@@ -495,14 +556,47 @@ int shortCuts() {
   return 0;
 }
 
+// Folders are shown as a thumbnail grid, 'home' and archives stay lists
+static int isGridView() {
+  return vitashell_config.thumbnail_view && dir_level > 0 && !isInArchive();
+}
+
+// In the grid base_pos is the first entry of the top row
+static void gridSetPosition(int pos) {
+  if (pos >= file_list.length)
+    pos = file_list.length - 1;
+  if (pos < 0)
+    pos = 0;
+
+  int first = base_pos - (base_pos % GRID_COLUMNS);
+  int row = pos - (pos % GRID_COLUMNS);
+
+  if (row < first)
+    first = row;
+  else if (row >= first + GRID_ENTRIES)
+    first = row - (GRID_ROWS - 1) * GRID_COLUMNS;
+
+  base_pos = first;
+  rel_pos = pos - first;
+}
+
 // Touch support functions
-static int getFileListIndexFromTouch(float touch_y) {
+static int getFileListIndexFromTouch(float touch_x, float touch_y) {
   if (touch_y < FILE_LIST_START_Y || touch_y >= FILE_LIST_END_Y)
     return -1;
 
   float relative_y = touch_y - FILE_LIST_START_Y;
   int list_index = (int)(relative_y / FONT_Y_SPACE);
 
+  if (isGridView()) {
+    int column = (int)((touch_x - SHELL_MARGIN_X) / GRID_CELL_WIDTH);
+    int row = (int)(relative_y / GRID_CELL_HEIGHT);
+    if (column < 0 || column >= GRID_COLUMNS || row >= GRID_ROWS)
+      return -1;
+
+    list_index = row * GRID_COLUMNS + column;
+  }
+
   if (list_index >= 0 && list_index < MAX_ENTRIES) {
     int actual_index = base_pos + list_index;
     if (actual_index < file_list.length) {
@@ -715,7 +809,7 @@ static int fileBrowserMenuCtrl() {
 
     // Check if touch is in file list area
     if (touch_y >= FILE_LIST_START_Y && touch_y < FILE_LIST_END_Y) {
-      int touched_index = getFileListIndexFromTouch(touch_y);
+      int touched_index = getFileListIndexFromTouch(touch_x, touch_y);
       if (touched_index >= 0 && touched_index < file_list.length) {
         // Check if touch is on the right side (for context menu)
         if (touch_x > SCREEN_HALF_WIDTH) {
@@ -861,8 +955,38 @@ static int fileBrowserMenuCtrl() {
     }
   }
 
+  // Move in the grid. D-pad left is the shortcut combo, so going
+  // back a single cell is on the analog stick only.
+  if (isGridView()) {
+    int old_pos = base_pos + rel_pos;
+    int pos = old_pos;
+
+    if (hold_pad[PAD_UP] || hold2_pad[PAD_LEFT_ANALOG_UP]) {
+      if (pos >= GRID_COLUMNS)
+        pos -= GRID_COLUMNS;
+    } else if (hold_pad[PAD_DOWN] || hold2_pad[PAD_LEFT_ANALOG_DOWN]) {
+      if ((pos - (pos % GRID_COLUMNS) + GRID_COLUMNS) < file_list.length)
+        pos = MIN(pos + GRID_COLUMNS, file_list.length - 1);
+    } else if (hold_pad[PAD_RIGHT] || hold2_pad[PAD_LEFT_ANALOG_RIGHT]) {
+      pos++;
+    } else if (hold2_pad[PAD_LEFT_ANALOG_LEFT]) {
+      pos--;
+    }
+
+    if (hold_pad[PAD_LTRIGGER]) {
+      pos -= GRID_ENTRIES;
+    } else if (hold_pad[PAD_RTRIGGER]) {
+      pos += GRID_ENTRIES;
+    }
+
+    gridSetPosition(pos);
+
+    if (old_pos != base_pos + rel_pos) {
+      scroll_count = 0;
+    }
+  }
   // Move
-  if (hold_pad[PAD_UP] || hold2_pad[PAD_LEFT_ANALOG_UP]) {
+  else if (hold_pad[PAD_UP] || hold2_pad[PAD_LEFT_ANALOG_UP]) {
     int old_pos = base_pos + rel_pos;
 
     if (rel_pos > 0) {
@@ -891,7 +1015,7 @@ static int fileBrowserMenuCtrl() {
   }
 
   // Page skip
-  if (hold_pad[PAD_LTRIGGER] || hold_pad[PAD_RTRIGGER]) {
+  if (!isGridView() && (hold_pad[PAD_LTRIGGER] || hold_pad[PAD_RTRIGGER])) {
     int old_pos = base_pos + rel_pos;
 
     if (hold_pad[PAD_LTRIGGER]) { // Skip page up
@@ -992,10 +1116,12 @@ static void fileBrowserHandleFile(FileListEntry *file_entry) {
 
   // Archive mode
   if (type == FILE_TYPE_ARCHIVE && getDialogStep() != DIALOG_STEP_ENTER_PASSWORD) {
-    is_in_archive = 1;
-    dir_level_archive = dir_level;
-
-    snprintf(archive_path, MAX_PATH_LENGTH, "%s%s", file_list.path, file_entry->name);
+    int res = enterArchive(cur_file);
+    if (res < 0) {
+      cancelEnterArchive();
+      errorDialog(res);
+      return;
+    }
 
     strcat(file_list.path, file_entry->name);
     addEndSlash(file_list.path);
@@ -1103,6 +1229,126 @@ static void fileBrowserHandleSymlink(FileListEntry *file_entry) {
     errorDialog(res);
 }
 
+static vita2d_texture *getFileEntryIcon(FileListEntry *file_entry, uint32_t *color) {
+  vita2d_texture *icon = NULL;
+  if (file_entry->is_symlink) {
+    if (file_entry->symlink->to_file) {
+      *color = FILE_SYMLINK_COLOR;
+      icon = file_symlink_icon;
+    } else {
+      *color = FOLDER_SYMLINK_COLOR;
+      icon = folder_symlink_icon;
+    }
+  }
+  // Folder
+  else if (file_entry->is_folder) {
+    *color = FOLDER_COLOR;
+    icon = folder_icon;
+  } else {
+    switch (file_entry->type) {
+      case FILE_TYPE_BMP:
+      case FILE_TYPE_PNG:
+      case FILE_TYPE_JPEG:
+        *color = IMAGE_COLOR;
+        icon = image_icon;
+        break;
+        
+      case FILE_TYPE_VPK:
+      case FILE_TYPE_ARCHIVE:
+        *color = ARCHIVE_COLOR;
+        icon = archive_icon;
+        break;
+        
+      case FILE_TYPE_MP3:
+      case FILE_TYPE_OGG:
+        *color = IMAGE_COLOR;
+        icon = audio_icon;
+        break;
+        
+      case FILE_TYPE_SFO:
+        *color = SFO_COLOR;
+        icon = sfo_icon;
+        break;
+      
+      case FILE_TYPE_INI:
+      case FILE_TYPE_TXT:
+      case FILE_TYPE_XML:
+        *color = TXT_COLOR;
+        icon = text_icon;
+        break;
+        
+      default:
+        *color = FILE_COLOR;
+        icon = file_icon;
+        break;
+    }
+  }
+
+  return icon;
+}
+
+// Images show their thumbnail once it is generated, everything else
+// and pending thumbnails show the icon, so the grid never waits on them
+static void drawGrid() {
+  FileListEntry *file_entry = fileListGetNthEntry(&file_list, base_pos);
+
+  int i;
+  for (i = 0; i < GRID_ENTRIES && file_entry; i++, file_entry = file_entry->next) {
+    uint32_t color = FILE_COLOR;
+    float x = SHELL_MARGIN_X + (i % GRID_COLUMNS) * GRID_CELL_WIDTH;
+    float y = START_Y + (i / GRID_COLUMNS) * GRID_CELL_HEIGHT;
+    float thumbnail_x = x + (GRID_CELL_WIDTH - THUMBNAIL_WIDTH) / 2.0f;
+    float thumbnail_y = y + GRID_THUMBNAIL_Y;
+
+    vita2d_texture *icon = getFileEntryIcon(file_entry, &color);
+
+    // Marked
+    if (fileListFindEntry(&mark_list, file_entry->name))
+      vita2d_draw_rectangle(x, y, GRID_CELL_WIDTH, GRID_CELL_HEIGHT, MARKED_COLOR);
+
+    // Current position
+    if (i == rel_pos) {
+      color = focus_color_options[vitashell_config.focus_color];
+      vita2d_draw_rectangle(thumbnail_x - 2.0f, thumbnail_y - 2.0f, THUMBNAIL_WIDTH + 4.0f, THUMBNAIL_HEIGHT + 4.0f, color);
+    }
+
+    vita2d_texture *thumbnail = NULL;
+    if (!file_entry->is_folder && !file_entry->is_symlink &&
+        (file_entry->type == FILE_TYPE_BMP || file_entry->type == FILE_TYPE_PNG ||
+         file_entry->type == FILE_TYPE_JPEG)) {
+      char path[MAX_PATH_LENGTH];
+      snprintf(path, MAX_PATH_LENGTH, "%s%s", file_list.path, file_entry->name);
+      thumbnail = thumbnailGet(path, file_entry->type, file_entry->size, &file_entry->mtime);
+    }
+
+    if (thumbnail) {
+      float width = vita2d_texture_get_width(thumbnail);
+      float height = vita2d_texture_get_height(thumbnail);
+      float scale = MIN(THUMBNAIL_WIDTH / width, THUMBNAIL_HEIGHT / height);
+
+      vita2d_draw_rectangle(thumbnail_x, thumbnail_y, THUMBNAIL_WIDTH, THUMBNAIL_HEIGHT, BACKGROUND_COLOR);
+      vita2d_draw_texture_scale(thumbnail, thumbnail_x + (THUMBNAIL_WIDTH - width * scale) / 2.0f,
+                                thumbnail_y + (THUMBNAIL_HEIGHT - height * scale) / 2.0f, scale, scale);
+    } else if (icon) {
+      vita2d_draw_rectangle(thumbnail_x, thumbnail_y, THUMBNAIL_WIDTH, THUMBNAIL_HEIGHT, BACKGROUND_COLOR);
+      vita2d_draw_texture(icon, thumbnail_x + (THUMBNAIL_WIDTH - vita2d_texture_get_width(icon)) / 2.0f,
+                          thumbnail_y + (THUMBNAIL_HEIGHT - vita2d_texture_get_height(icon)) / 2.0f);
+    }
+
+    // Draw file name, centered when it fits
+    float name_y = thumbnail_y + THUMBNAIL_HEIGHT + 4.0f;
+    float name_width = pgf_text_width(file_entry->name);
+    float name_x = x + 2.0f;
+    if (name_width < GRID_CELL_WIDTH - 4.0f)
+      name_x = x + (GRID_CELL_WIDTH - name_width) / 2.0f;
+
+    vita2d_enable_clipping();
+    vita2d_set_clip_rectangle(x + 2.0f, name_y, x + GRID_CELL_WIDTH - 2.0f, name_y + FONT_Y_SPACE);
+    pgf_draw_text(name_x, name_y, color, file_entry->name);
+    vita2d_disable_clipping();
+  }
+}
+
 int browserMain() {
   // Position
   memset(base_pos_list, 0, sizeof(base_pos_list));
@@ -1177,74 +1423,37 @@ int browserMain() {
         setFocusOnFilename(focus_name);
     }
 
+    // Free thumbnails evicted during the last frame
+    thumbnailBeginFrame();
+
+    int grid_view = isGridView();
+    if (grid_view)
+      gridSetPosition(base_pos + rel_pos);
+
     // Start drawing
     startDrawing(bg_browser_image);
 
     // Draw
     drawShellInfo(file_list.path);
-    drawScrollBar(base_pos, file_list.length);
+
+    // The scroll bar counts list rows, a grid page is GRID_ENTRIES entries
+    if (grid_view) {
+      drawScrollBar(base_pos * MAX_POSITION / GRID_ENTRIES, file_list.length * MAX_POSITION / GRID_ENTRIES);
+    } else {
+      drawScrollBar(base_pos, file_list.length);
+    }
 
     // Draw
     FileListEntry *file_entry = fileListGetNthEntry(&file_list, base_pos);
-    if (file_entry) {
+    if (grid_view) {
+      drawGrid();
+    } else if (file_entry) {
       int i;
       for (i = 0; i < MAX_ENTRIES && (base_pos + i) < file_list.length; i++) {
         uint32_t color = FILE_COLOR;
         float y = START_Y + (i * FONT_Y_SPACE);
 
-        vita2d_texture *icon = NULL;
-        if (file_entry->is_symlink) {
-          if (file_entry->symlink->to_file) {
-            color = FILE_SYMLINK_COLOR;
-            icon = file_symlink_icon;
-          } else {
-            color = FOLDER_SYMLINK_COLOR;
-            icon = folder_symlink_icon;
-          }
-        }
-        // Folder
-        else if (file_entry->is_folder) {
-          color = FOLDER_COLOR;
-          icon = folder_icon;
-        } else {
-          switch (file_entry->type) {
-            case FILE_TYPE_BMP:
-            case FILE_TYPE_PNG:
-            case FILE_TYPE_JPEG:
-              color = IMAGE_COLOR;
-              icon = image_icon;
-              break;
-              
-            case FILE_TYPE_VPK:
-            case FILE_TYPE_ARCHIVE:
-              color = ARCHIVE_COLOR;
-              icon = archive_icon;
-              break;
-              
-            case FILE_TYPE_MP3:
-            case FILE_TYPE_OGG:
-              color = IMAGE_COLOR;
-              icon = audio_icon;
-              break;
-              
-            case FILE_TYPE_SFO:
-              color = SFO_COLOR;
-              icon = sfo_icon;
-              break;
-            
-            case FILE_TYPE_INI:
-            case FILE_TYPE_TXT:
-            case FILE_TYPE_XML:
-              color = TXT_COLOR;
-              icon = text_icon;
-              break;
-              
-            default:
-              color = FILE_COLOR;
-              icon = file_icon;
-              break;
-          }
-        }
+        vita2d_texture *icon = getFileEntryIcon(file_entry, &color);
 
         // Draw icon
         if (icon)
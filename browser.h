@@ -46,6 +46,10 @@ void setDirArchiveLevel();
 void setInArchive();
 int isInArchive();
 
+int canEnterArchive();
+int enterArchive(const char *path);
+void cancelEnterArchive();
+
 void setFocusName(const char *name);
 void setFocusOnFilename(const char *name);
 
@@ -0,0 +1,354 @@
+/*
+  VitaShell
+  Copyright (C) 2015-2018, TheFloW
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "main.h"
+#include "compare.h"
+#include "hex.h"
+#include "io_process.h"
+#include "message_dialog.h"
+#include "language.h"
+#include "utils.h"
+
+// One block of each file
+typedef struct CompareSlot {
+  uint8_t *data[2];
+  int length[2];
+} CompareSlot;
+
+// The reader thread fills one slot while the other is being compared
+typedef struct CompareState {
+  SceUID fd[2];
+  SceOff size;
+  CompareSlot slots[2];
+  SceUID free_sema;
+  SceUID full_sema;
+  int abort;
+} CompareState;
+
+static char compare_paths[2][MAX_PATH_LENGTH];
+static SceOff compare_sizes[2];
+
+static CompareRange *differences = NULL;
+static int n_differences = 0, max_differences = 0;
+
+void compareFree() {
+  free(differences);
+  differences = NULL;
+  n_differences = 0;
+  max_differences = 0;
+}
+
+// Returns 1 if the files have the same size, 0 if not
+int compareSetFiles(const char *path, const char *other_path) {
+  const char *paths[2] = { path, other_path };
+
+  int i;
+  for (i = 0; i < 2; i++) {
+    SceIoStat stat;
+    memset(&stat, 0, sizeof(SceIoStat));
+
+    int res = sceIoGetstat(paths[i], &stat);
+    if (res < 0)
+      return res;
+
+    strcpy(compare_paths[i], paths[i]);
+    compare_sizes[i] = stat.st_size;
+  }
+
+  return compare_sizes[0] == compare_sizes[1];
+}
+
+int compareGetDifferences(const char *file, CompareRange **ranges) {
+  if (n_differences == 0 || (strcmp(file, compare_paths[0]) != 0 && strcmp(file, compare_paths[1]) != 0))
+    return 0;
+
+  *ranges = differences;
+  return n_differences;
+}
+
+// Ranges that touch are merged, the list is in order. Returns 1 when
+// the list is full.
+static int add_difference(SceOff offset, SceOff length) {
+  if (n_differences > 0) {
+    CompareRange *last = &differences[n_differences - 1];
+    if (last->offset + last->length == offset) {
+      last->length += length;
+      return 0;
+    }
+  }
+
+  if (n_differences >= COMPARE_MAX_DIFFERENCES)
+    return 1;
+
+  if (n_differences == max_differences) {
+    int n = max_differences + 256;
+    CompareRange *ranges = realloc(differences, n * sizeof(CompareRange));
+    if (!ranges)
+      return VITASHELL_ERROR_NO_MEMORY;
+
+    differences = ranges;
+    max_differences = n;
+  }
+
+  differences[n_differences].offset = offset;
+  differences[n_differences].length = length;
+  n_differences++;
+
+  return 0;
+}
+
+// Equal stretches are skipped a word at a time, the buffers are aligned
+static int compare_block(SceOff offset, const uint8_t *a, const uint8_t *b, int length) {
+  int i = 0;
+
+  while (i < length) {
+    while (i < length && (i & 3) != 0 && a[i] == b[i])
+      i++;
+
+    while (i + 4 <= length && *(const uint32_t *)(a + i) == *(const uint32_t *)(b + i))
+      i += 4;
+
+    while (i < length && a[i] == b[i])
+      i++;
+
+    if (i == length)
+      break;
+
+    int start = i;
+    while (i < length && a[i] != b[i])
+      i++;
+
+    int res = add_difference(offset + start, i - start);
+    if (res != 0)
+      return res;
+  }
+
+  return 0;
+}
+
+static int compare_read_thread(SceSize args, CompareState **argp) {
+  CompareState *state = *argp;
+
+  SceOff offset = 0;
+  int slot = 0;
+
+  while (offset < state->size) {
+    sceKernelWaitSema(state->free_sema, 1, NULL);
+    if (state->abort)
+      break;
+
+    CompareSlot *s = &state->slots[slot];
+    int length = (int)MIN((SceOff)COMPARE_READ_SIZE, state->size - offset);
+
+    int i;
+    for (i = 0; i < 2; i++)
+      s->length[i] = sceIoRead(state->fd[i], s->data[i], length);
+
+    sceKernelSignalSema(state->full_sema, 1);
+
+    // The comparison stops at a short read
+    if (s->length[0] != length || s->length[1] != length)
+      break;
+
+    offset += length;
+    slot ^= 1;
+  }
+
+  return sceKernelExitDeleteThread(0);
+}
+
+static int compare_files(CompareState *state, FileProcessParam *param) {
+  SceUID thid = -1;
+  int res = 0;
+
+  CompareState *state_ptr = state;
+
+  state->free_sema = sceKernelCreateSema("compare_free_sema", 0, 2, 2, NULL);
+  state->full_sema = sceKernelCreateSema("compare_full_sema", 0, 0, 2, NULL);
+  if (state->free_sema < 0 || state->full_sema < 0) {
+    res = VITASHELL_ERROR_INTERNAL;
+    goto EXIT;
+  }
+
+  thid = sceKernelCreateThread("compare_read_thread", (SceKernelThreadEntry)compare_read_thread, 0x40, 0x10000, 0, 0, NULL);
+  if (thid < 0) {
+    res = thid;
+    goto EXIT;
+  }
+
+  sceKernelStartThread(thid, sizeof(CompareState *), &state_ptr);
+
+  SceOff offset = 0;
+  int slot = 0;
+
+  while (offset < state->size) {
+    sceKernelWaitSema(state->full_sema, 1, NULL);
+
+    CompareSlot *s = &state->slots[slot];
+    int length = (int)MIN((SceOff)COMPARE_READ_SIZE, state->size - offset);
+
+    if (s->length[0] != length || s->length[1] != length) {
+      res = s->length[0] < 0 ? s->length[0] : (s->length[1] < 0 ? s->length[1] : VITASHELL_ERROR_INTERNAL);
+      break;
+    }
+
+    res = compare_block(offset, s->data[0], s->data[1], length);
+
+    sceKernelSignalSema(state->free_sema, 1);
+
+    // Too many differences, what is known so far is shown
+    if (res != 0) {
+      if (res > 0)
+        res = 0;
+      break;
+    }
+
+    offset += length;
+    slot ^= 1;
+
+    if (param) {
+      if (param->value)
+        (*param->value) += 2 * length;
+
+      if (param->SetProgress)
+        param->SetProgress(param->value ? *param->value : 0, param->max);
+
+      if (param->cancelHandler && param->cancelHandler()) {
+        res = 0;
+        break;
+      }
+    }
+  }
+
+  if (res >= 0 && offset >= state->size)
+    res = 1;
+
+EXIT:
+  if (thid >= 0) {
+    state->abort = 1;
+    sceKernelSignalSema(state->free_sema, 2);
+    sceKernelWaitThreadEnd(thid, NULL, NULL);
+  }
+
+  if (state->free_sema >= 0)
+    sceKernelDeleteSema(state->free_sema);
+  if (state->full_sema >= 0)
+    sceKernelDeleteSema(state->full_sema);
+
+  return res;
+}
+
+int compare_thread(SceSize args_size, void *args) {
+  SceUID thid = -1;
+  int res = 0;
+
+  CompareState state;
+  memset(&state, 0, sizeof(CompareState));
+  state.fd[0] = -1;
+  state.fd[1] = -1;
+
+  // Lock power timers
+  powerLock();
+
+  // Set progress to 0%
+  sceMsgDialogProgressBarSetValue(SCE_MSG_DIALOG_PROGRESSBAR_TARGET_BAR_DEFAULT, 0);
+  sceKernelDelayThread(DIALOG_WAIT); // Needed to see the percentage
+
+  compareFree();
+
+  // Only the common part is read, the rest of the longer file differs anyway
+  state.size = MIN(compare_sizes[0], compare_sizes[1]);
+
+  int i, j;
+  for (i = 0; i < 2; i++) {
+    state.fd[i] = sceIoOpen(compare_paths[i], SCE_O_RDONLY, 0);
+    if (state.fd[i] < 0) {
+      res = state.fd[i];
+      goto EXIT;
+    }
+
+    for (j = 0; j < 2; j++) {
+      state.slots[j].data[i] = memalign(4096, COMPARE_READ_SIZE);
+      if (!state.slots[j].data[i]) {
+        res = VITASHELL_ERROR_NO_MEMORY;
+        goto EXIT;
+      }
+    }
+  }
+
+  // Update thread
+  uint64_t total = (uint64_t)state.size * 2;
+  thid = createStartUpdateThread(total, 1);
+
+  uint64_t value = 0;
+
+  FileProcessParam param;
+  param.value = &value;
+  param.max = total;
+  param.SetProgress = SetProgress;
+  param.cancelHandler = cancelHandler;
+
+  res = compare_files(&state, &param);
+
+  if (res > 0 && compare_sizes[0] != compare_sizes[1]) {
+    SceOff size = MAX(compare_sizes[0], compare_sizes[1]);
+    add_difference(state.size, size - state.size);
+  }
+
+EXIT:
+  for (i = 0; i < 2; i++) {
+    for (j = 0; j < 2; j++)
+      free(state.slots[j].data[i]);
+
+    if (state.fd[i] >= 0)
+      sceIoClose(state.fd[i]);
+  }
+
+  if (res > 0) {
+    // Set progress to 100%
+    sceMsgDialogProgressBarSetValue(SCE_MSG_DIALOG_PROGRESSBAR_TARGET_BAR_DEFAULT, 100);
+    sceKernelDelayThread(COUNTUP_WAIT);
+  }
+
+  // Close
+  closeWaitDialog();
+
+  // Differences found until canceling are still shown
+  if (n_differences > 0 && res >= 0) {
+    setDialogStep(DIALOG_STEP_COMPARED_FILES);
+  } else if (res > 0) {
+    infoDialog(language_container[FILES_ARE_IDENTICAL]);
+  } else if (res < 0) {
+    errorDialog(res);
+  } else {
+    setDialogStep(DIALOG_STEP_CANCELED);
+  }
+
+  if (thid >= 0)
+    sceKernelWaitThreadEnd(thid, NULL, NULL);
+
+  // Unlock power timers
+  powerUnlock();
+
+  return sceKernelExitDeleteThread(0);
+}
+
+// The differences are browsed in the hex viewer of the first file
+int compareViewer() {
+  return hexViewer(compare_paths[0]);
+}
@@ -0,0 +1,40 @@
+/*
+  VitaShell
+  Copyright (C) 2015-2018, TheFloW
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __COMPARE_H__
+#define __COMPARE_H__
+
+#define COMPARE_MAX_DIFFERENCES 4096
+
+// Both files are read in blocks of this size, two blocks are in flight
+#define COMPARE_READ_SIZE (512 * 1024)
+
+// [offset, offset + length) differs between the files
+typedef struct CompareRange {
+  SceOff offset;
+  SceOff length;
+} CompareRange;
+
+int compareSetFiles(const char *path, const char *other_path);
+int compare_thread(SceSize args_size, void *args);
+
+int compareViewer();
+void compareFree();
+int compareGetDifferences(const char *file, CompareRange **differences);
+
+#endif
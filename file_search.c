@@ -0,0 +1,435 @@
+/*
+  VitaShell
+  Copyright (C) 2015-2018, TheFloW
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "main.h"
+#include "archive.h"
+#include "file.h"
+#include "file_search.h"
+#include "io_process.h"
+#include "message_dialog.h"
+#include "language.h"
+#include "text.h"
+#include "text_search.h"
+#include "theme.h"
+#include "utils.h"
+
+#define FILE_SEARCH_LOCATION_WIDTH 360.0f
+#define FILE_SEARCH_PREVIEW_X (SHELL_MARGIN_X + FILE_SEARCH_LOCATION_WIDTH + 20.0f)
+
+typedef struct {
+  FileSearchStream stream;
+  int file;       // Entry in files, -1 until the first hit
+  const char *path;
+  int in_archive;
+  int archives;
+  FileProcessParam *param;
+} FileSearchState;
+
+static char search_root[MAX_PATH_LENGTH];
+
+static FileSearchFile *files = NULL;
+static int n_files = 0, max_files = 0;
+
+static FileSearchResult *results = NULL;
+static int n_results = 0, max_results = 0;
+
+void fileSearchFree() {
+  int i;
+  for (i = 0; i < n_files; i++)
+    free(files[i].path);
+
+  free(files);
+  files = NULL;
+  n_files = max_files = 0;
+
+  free(results);
+  results = NULL;
+  n_results = max_results = 0;
+}
+
+static int add_file(const char *path, int in_archive) {
+  if (n_files == max_files) {
+    int n = max_files ? max_files * 2 : 64;
+    FileSearchFile *new_files = realloc(files, n * sizeof(FileSearchFile));
+    if (!new_files)
+      return -1;
+
+    files = new_files;
+    max_files = n;
+  }
+
+  files[n_files].path = malloc(strlen(path) + 1);
+  if (!files[n_files].path)
+    return -1;
+
+  strcpy(files[n_files].path, path);
+  files[n_files].in_archive = in_archive;
+
+  return n_files++;
+}
+
+static int add_result(FileSearchStream *stream, const char *preview) {
+  FileSearchState *state = (FileSearchState *)stream->context;
+
+  if (state->file < 0) {
+    state->file = add_file(state->path, state->in_archive);
+    if (state->file < 0)
+      return 1;
+  }
+
+  if (n_results == max_results) {
+    int n = max_results ? max_results * 2 : 256;
+    FileSearchResult *new_results = realloc(results, n * sizeof(FileSearchResult));
+    if (!new_results)
+      return 1;
+
+    results = new_results;
+    max_results = n;
+  }
+
+  FileSearchResult *result = &results[n_results++];
+  result->file = state->file;
+  result->line = stream->line;
+  result->offset = stream->line_start;
+  strcpy(result->preview, preview);
+
+  return n_results < FILE_SEARCH_MAX_RESULTS;
+}
+
+static int search_progress(FileSearchStream *stream, int read) {
+  FileSearchState *state = (FileSearchState *)stream->context;
+  FileProcessParam *param = state->param;
+
+  // Archives are accounted for as a whole
+  if (!state->in_archive) {
+    (*param->value) += read;
+    param->SetProgress(*param->value, param->max);
+  }
+
+  return !param->cancelHandler();
+}
+
+static int search_stream(FileSearchState *state, FileSearchReadFunction read, void *context) {
+  state->file = -1;
+  return fileSearchStream(&state->stream, read, context);
+}
+
+static int file_read(void *context, char *data, int size) {
+  return sceIoRead(*(SceUID *)context, data, size);
+}
+
+static int archive_read(void *context, char *data, int size) {
+  return archive_read_data((struct archive *)context, data, size);
+}
+
+static int search_archive(FileSearchState *state, const char *path) {
+  struct archive *archive = open_archive(path);
+  if (!archive)
+    return 1;
+
+  int ret = 1;
+
+  while (n_results < FILE_SEARCH_MAX_RESULTS) {
+    struct archive_entry *archive_entry;
+    int res = archive_read_next_header(archive, &archive_entry);
+    if (res != ARCHIVE_OK)
+      break;
+
+    if (archive_entry_filetype(archive_entry) != AE_IFREG || archive_entry_is_encrypted(archive_entry))
+      continue;
+
+    char entry_path[MAX_PATH_LENGTH];
+    snprintf(entry_path, MAX_PATH_LENGTH, "%s/%s", path, archive_entry_pathname(archive_entry));
+
+    state->path = entry_path;
+    state->in_archive = 1;
+
+    ret = search_stream(state, archive_read, archive);
+    if (ret <= 0)
+      break;
+  }
+
+  archive_read_free(archive);
+
+  return ret;
+}
+
+static int search_file(FileSearchState *state, const char *path, uint64_t size) {
+  FileProcessParam *param = state->param;
+  uint64_t start = *param->value;
+  int res = 1;
+
+  if (state->archives && getFileType(path) == FILE_TYPE_ARCHIVE) {
+    res = search_archive(state, path);
+  } else {
+    SceUID fd = sceIoOpen(path, SCE_O_RDONLY, 0);
+    if (fd >= 0) {
+      state->path = path;
+      state->in_archive = 0;
+
+      res = search_stream(state, file_read, &fd);
+      sceIoClose(fd);
+    }
+  }
+
+  // Account for the parts that were skipped
+  if (res > 0) {
+    (*param->value) = start + size;
+    param->SetProgress(*param->value, param->max);
+  }
+
+  return res;
+}
+
+static int search_path(FileSearchState *state, const char *path) {
+  SceUID dfd = sceIoDopen(path);
+  if (dfd < 0) {
+    SceIoStat stat;
+    memset(&stat, 0, sizeof(SceIoStat));
+    sceIoGetstat(path, &stat);
+
+    return search_file(state, path, stat.st_size);
+  }
+
+  int res = 0;
+
+  do {
+    SceIoDirent dir;
+    memset(&dir, 0, sizeof(SceIoDirent));
+
+    res = sceIoDread(dfd, &dir);
+    if (res > 0) {
+      int length = strlen(path) + strlen(dir.d_name) + 2;
+      char *new_path = malloc(length);
+      if (!new_path)
+        break;
+
+      snprintf(new_path, length, "%s%s%s", path, hasEndSlash(path) ? "" : "/", dir.d_name);
+
+      int ret;
+      if (SCE_S_ISDIR(dir.d_stat.st_mode)) {
+        ret = search_path(state, new_path);
+      } else {
+        ret = search_file(state, new_path, dir.d_stat.st_size);
+      }
+
+      free(new_path);
+
+      if (ret <= 0) {
+        sceIoDclose(dfd);
+        return ret;
+      }
+
+      if (n_results >= FILE_SEARCH_MAX_RESULTS)
+        break;
+    }
+  } while (res > 0);
+
+  sceIoDclose(dfd);
+
+  return 1;
+}
+
+int file_search_thread(SceSize args_size, FileSearchArguments *args) {
+  SceUID thid = -1;
+
+  // Lock power timers
+  powerLock();
+
+  // Set progress to 0%
+  sceMsgDialogProgressBarSetValue(SCE_MSG_DIALOG_PROGRESSBAR_TARGET_BAR_DEFAULT, 0);
+  sceKernelDelayThread(DIALOG_WAIT); // Needed to see the percentage
+
+  fileSearchFree();
+  strcpy(search_root, args->path);
+
+  FileSearchState *state = malloc(sizeof(FileSearchState));
+  if (!state) {
+    closeWaitDialog();
+    errorDialog(VITASHELL_ERROR_NO_MEMORY);
+    goto EXIT;
+  }
+
+  memset(state, 0, sizeof(FileSearchState));
+  state->archives = args->archives;
+  state->stream.result = add_result;
+  state->stream.progress = search_progress;
+  state->stream.context = state;
+
+  state->stream.buffer = memalign(4096, FILE_SEARCH_READ_SIZE);
+  if (!state->stream.buffer) {
+    free(state);
+    closeWaitDialog();
+    errorDialog(VITASHELL_ERROR_NO_MEMORY);
+    goto EXIT;
+  }
+
+  if (textSearchCompile(&state->stream.search, args->term, args->flags) < 0) {
+    free(state->stream.buffer);
+    free(state);
+    closeWaitDialog();
+    setDialogStep(DIALOG_STEP_CANCELED);
+    goto EXIT;
+  }
+
+  // Get paths info
+  uint64_t total = 0;
+  getPathInfo(args->path, &total, NULL, NULL, NULL);
+
+  // Update thread
+  thid = createStartUpdateThread(total, 1);
+
+  // Search process
+  uint64_t value = 0;
+
+  FileProcessParam param;
+  param.value = &value;
+  param.max = total;
+  param.SetProgress = SetProgress;
+  param.cancelHandler = cancelHandler;
+  state->param = &param;
+
+  int res = search_path(state, args->path);
+
+  textSearchFree(&state->stream.search);
+  free(state->stream.buffer);
+  free(state);
+
+  if (res > 0) {
+    // Set progress to 100%
+    sceMsgDialogProgressBarSetValue(SCE_MSG_DIALOG_PROGRESSBAR_TARGET_BAR_DEFAULT, 100);
+    sceKernelDelayThread(COUNTUP_WAIT);
+  }
+
+  // Close
+  closeWaitDialog();
+
+  // Results found until canceling are still shown
+  if (n_results > 0) {
+    setDialogStep(DIALOG_STEP_SEARCHED_FILES);
+  } else if (res > 0) {
+    infoDialog(language_container[NO_MATCHES_FOUND]);
+  } else {
+    setDialogStep(DIALOG_STEP_CANCELED);
+  }
+
+EXIT:
+  if (thid >= 0)
+    sceKernelWaitThreadEnd(thid, NULL, NULL);
+
+  // Unlock power timers
+  powerUnlock();
+
+  return sceKernelExitDeleteThread(0);
+}
+
+int fileSearchViewer() {
+  int base_pos = 0, rel_pos = 0;
+  int root_length = strlen(search_root);
+
+  while (1) {
+    readPad();
+
+    if (hold_pad[PAD_UP] || hold2_pad[PAD_LEFT_ANALOG_UP]) {
+      if (rel_pos > 0) {
+        rel_pos--;
+      } else if (base_pos > 0) {
+        base_pos--;
+      }
+    } else if (hold_pad[PAD_DOWN] || hold2_pad[PAD_LEFT_ANALOG_DOWN]) {
+      if ((base_pos + rel_pos + 1) < n_results) {
+        if ((rel_pos + 1) < MAX_POSITION) {
+          rel_pos++;
+        } else {
+          base_pos++;
+        }
+      }
+    }
+
+    // Page skip
+    if (hold_pad[PAD_LTRIGGER]) {
+      base_pos = MAX(base_pos - MAX_POSITION, 0);
+      if (base_pos == 0)
+        rel_pos = 0;
+    } else if (hold_pad[PAD_RTRIGGER]) {
+      base_pos = MIN(base_pos + MAX_POSITION, MAX(n_results - MAX_POSITION, 0));
+      if (base_pos + MAX_POSITION >= n_results)
+        rel_pos = MIN(MAX_POSITION - 1, n_results - 1 - base_pos);
+    }
+
+    // Open the file at the line, entries of archives are only listed
+    if (pressed_pad[PAD_ENTER] && n_results > 0) {
+      FileSearchResult *result = &results[base_pos + rel_pos];
+      if (!files[result->file].in_archive)
+        textViewerAt(files[result->file].path, result->offset);
+    }
+
+    // Cancel
+    if (pressed_pad[PAD_CANCEL]) {
+      break;
+    }
+
+    // Start drawing
+    startDrawing(bg_text_image);
+
+    // Draw shell info
+    drawShellInfo(search_root);
+
+    // Draw scroll bar
+    drawScrollBar(base_pos, n_results);
+
+    int i;
+    for (i = 0; i < MAX_ENTRIES && (base_pos + i) < n_results; i++) {
+      FileSearchResult *result = &results[base_pos + i];
+      FileSearchFile *file = &files[result->file];
+      float y = START_Y + (i * FONT_Y_SPACE);
+
+      // Show paths relative to the searched folder
+      const char *name = file->path;
+      if (strncmp(name, search_root, root_length) == 0 && name[root_length] != '\0') {
+        name += root_length;
+        if (*name == '/')
+          name++;
+      }
+
+      char location[MAX_PATH_LENGTH + 16];
+      snprintf(location, sizeof(location), "%s:%d", name, result->line);
+
+      // Keep the end of long paths visible
+      float x = SHELL_MARGIN_X;
+      float width = pgf_text_width(location);
+      if (width > FILE_SEARCH_LOCATION_WIDTH)
+        x -= width - FILE_SEARCH_LOCATION_WIDTH;
+
+      uint32_t color = file->in_archive ? FOLDER_COLOR : FILE_COLOR;
+
+      vita2d_enable_clipping();
+      vita2d_set_clip_rectangle(SHELL_MARGIN_X, y, SHELL_MARGIN_X + FILE_SEARCH_LOCATION_WIDTH, y + FONT_Y_SPACE);
+      pgf_draw_text(x, y, (i == rel_pos) ? FOCUS_COLOR : color, location);
+
+      vita2d_set_clip_rectangle(FILE_SEARCH_PREVIEW_X, y, SHELL_MARGIN_X + MAX_WIDTH, y + FONT_Y_SPACE);
+      pgf_draw_text(FILE_SEARCH_PREVIEW_X, y, (i == rel_pos) ? TEXT_FOCUS_COLOR : TEXT_COLOR, result->preview);
+      vita2d_disable_clipping();
+    }
+
+    // End drawing
+    endDrawing();
+  }
+
+  return 0;
+}
@@ -0,0 +1,50 @@
+/*
+  VitaShell
+  Copyright (C) 2015-2018, TheFloW
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __FILE_SEARCH_H__
+#define __FILE_SEARCH_H__
+
+#include "file_search_stream.h"
+
+#define FILE_SEARCH_MAX_RESULTS 4096
+
+typedef struct FileSearchFile {
+  char *path;
+  int in_archive;
+} FileSearchFile;
+
+typedef struct FileSearchResult {
+  int file;
+  int line;
+  SceOff offset;
+  char preview[FILE_SEARCH_PREVIEW_LENGTH];
+} FileSearchResult;
+
+typedef struct {
+  char *path;
+  char *term;
+  int flags;
+  int archives;
+} FileSearchArguments;
+
+int file_search_thread(SceSize args_size, FileSearchArguments *args);
+
+int fileSearchViewer();
+void fileSearchFree();
+
+#endif
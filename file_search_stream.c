@@ -0,0 +1,160 @@
+/*
+  VitaShell
+  Copyright (C) 2015-2018, TheFloW
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+
+#include "file_search_stream.h"
+
+// The line of the match, from its first non-blank character
+static void get_preview(FileSearchStream *stream, int pos, int limit, char *preview) {
+  // The line may have started in an earlier block
+  int start = (stream->line_start > stream->offset) ? (int)(stream->line_start - stream->offset) : 0;
+  while (start < pos && (stream->buffer[start] == ' ' || stream->buffer[start] == '\t'))
+    start++;
+
+  int n = 0;
+  while (start + n < limit && n < FILE_SEARCH_PREVIEW_LENGTH - 1) {
+    char c = stream->buffer[start + n];
+    if (c == '\n')
+      break;
+
+    preview[n++] = ((unsigned char)c < ' ') ? ' ' : c;
+  }
+
+  // Don't cut a character in half
+  if (start + n < limit && (stream->buffer[start + n] & 0xC0) == 0x80) {
+    while (n > 0 && (preview[n - 1] & 0xC0) == 0x80)
+      n--;
+
+    if (n > 0)
+      n--;
+  }
+
+  preview[n] = '\0';
+}
+
+static void count_lines(FileSearchStream *stream, int start, int end) {
+  char *p = stream->buffer + start;
+  char *q = stream->buffer + end;
+
+  while (p < q && (p = memchr(p, '\n', q - p)) != NULL) {
+    p++;
+    stream->line++;
+    stream->line_start = stream->offset + (p - stream->buffer);
+  }
+}
+
+// Searches the complete lines of the buffer and returns how many bytes
+// have been consumed. The incomplete last line is kept for the next read.
+static int scan_block(FileSearchStream *stream, int final) {
+  char *buffer = stream->buffer;
+  int limit = stream->length;
+  int end = stream->length;
+
+  if (!final) {
+    int last = stream->length;
+    while (last > 0 && buffer[last - 1] != '\n')
+      last--;
+
+    if (last > 0) {
+      limit = end = last;
+    } else if (stream->length < FILE_SEARCH_READ_SIZE) {
+      // Short read in the middle of a line, keep it whole until more has been read
+      end = 0;
+    } else {
+      // A line longer than the buffer, matches starting in the overlap
+      // are found by the next block
+      int overlap = (stream->search.flags & TEXT_SEARCH_REGEX) ? FILE_SEARCH_REGEX_OVERLAP : stream->search.length - 1;
+      end = (stream->length > overlap) ? stream->length - overlap : 0;
+    }
+  }
+
+  int pos = 0, counted = 0;
+
+  while (pos < end && !stream->full) {
+    int match_length = 0;
+    int match = textSearchFind(&stream->search, buffer + pos, limit - pos, &match_length);
+    if (match < 0 || pos + match >= end)
+      break;
+
+    match += pos;
+
+    count_lines(stream, counted, match);
+    counted = match;
+
+    // One result per line, also if it spans several blocks
+    if (stream->line != stream->result_line) {
+      char preview[FILE_SEARCH_PREVIEW_LENGTH];
+      get_preview(stream, match, limit, preview);
+
+      stream->result_line = stream->line;
+      if (!stream->result(stream, preview))
+        stream->full = 1;
+    }
+
+    char *newline = memchr(buffer + match, '\n', limit - match);
+    if (!newline)
+      break;
+
+    pos = newline - buffer + 1;
+  }
+
+  count_lines(stream, counted, end);
+
+  return end;
+}
+
+// Returns 1 when the stream was searched or skipped, 0 when canceled
+int fileSearchStream(FileSearchStream *stream, FileSearchReadFunction read, void *read_context) {
+  stream->length = 0;
+  stream->offset = 0;
+  stream->line = 1;
+  stream->line_start = 0;
+  stream->result_line = 0;
+  stream->full = 0;
+
+  int first = 1;
+
+  while (!stream->full) {
+    int res = read(read_context, stream->buffer + stream->length, FILE_SEARCH_READ_SIZE - stream->length);
+    if (res <= 0)
+      break;
+
+    // Skip binary files
+    if (first && memchr(stream->buffer, '\0', (res < FILE_SEARCH_BINARY_CHECK_SIZE) ? res : FILE_SEARCH_BINARY_CHECK_SIZE))
+      return 1;
+
+    first = 0;
+
+    stream->length += res;
+
+    if (!stream->progress(stream, res))
+      return 0;
+
+    int end = scan_block(stream, 0);
+
+    memmove(stream->buffer, stream->buffer + end, stream->length - end);
+    stream->offset += end;
+    stream->length -= end;
+  }
+
+  if (stream->length > 0 && !stream->full)
+    scan_block(stream, 1);
+
+  return 1;
+}
@@ -0,0 +1,65 @@
+/*
+  VitaShell
+  Copyright (C) 2015-2018, TheFloW
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __FILE_SEARCH_STREAM_H__
+#define __FILE_SEARCH_STREAM_H__
+
+#include <psp2/types.h>
+
+#include "text_search.h"
+
+#define FILE_SEARCH_PREVIEW_LENGTH 128
+
+// Files are streamed through a buffer of this size, never loaded whole
+#define FILE_SEARCH_READ_SIZE (256 * 1024)
+
+// Files with a NUL byte in their first block are not text
+#define FILE_SEARCH_BINARY_CHECK_SIZE 4096
+
+// Longest regular expression match found across two blocks of one line
+#define FILE_SEARCH_REGEX_OVERLAP (4 * 1024)
+
+typedef struct FileSearchStream FileSearchStream;
+
+// Returns the number of bytes read, 0 at the end or < 0 on errors
+typedef int (* FileSearchReadFunction)(void *context, char *data, int size);
+
+// One file or archive entry, searched line by line
+struct FileSearchStream {
+  TextSearch search;
+  char *buffer;       // FILE_SEARCH_READ_SIZE bytes
+  int length;
+  SceOff offset;      // File offset of buffer[0]
+  int line;           // Line that contains buffer[0]
+  SceOff line_start;  // File offset of that line
+  int result_line;    // Line of the last result
+  int full;
+
+  // Called for the first match of a line with line and line_start set,
+  // returns 0 when no more results are wanted
+  int (* result)(FileSearchStream *stream, const char *preview);
+
+  // Called for every block read, returns 0 to cancel
+  int (* progress)(FileSearchStream *stream, int read);
+
+  void *context;
+};
+
+int fileSearchStream(FileSearchStream *stream, FileSearchReadFunction read, void *read_context);
+
+#endif
@@ -22,76 +22,469 @@
 #include "file.h"
 #include "text.h"
 #include "hex.h"
+#include "compare.h"
 #include "message_dialog.h"
+#include "ime_dialog.h"
+#include "context_menu.h"
 #include "theme.h"
 #include "language.h"
 #include "utils.h"
 
-static void hexListAddEntry(HexList *list, HexListEntry *entry) {
-  entry->next = NULL;
-  entry->previous = NULL;
+enum HexMenuEntrys {
+  HEX_MENU_ENTRY_SEARCH_HEX_BYTES,
+  HEX_MENU_ENTRY_SEARCH_ASCII,
+  HEX_MENU_ENTRY_SEARCH_UTF16,
+  HEX_MENU_ENTRY_SEARCH_INT_LE,
+  HEX_MENU_ENTRY_SEARCH_INT_BE,
+  HEX_MENU_ENTRY_FIND_NEXT,
+  HEX_MENU_ENTRY_FIND_PREVIOUS,
+  HEX_MENU_ENTRY_NEXT_DIFFERENCE,
+  HEX_MENU_ENTRY_PREVIOUS_DIFFERENCE,
+};
+
+MenuEntry hex_menu_entries[] = {
+  { SEARCH_HEX_BYTES, 0, 0, CTX_VISIBLE },
+  { SEARCH_ASCII,     1, 0, CTX_VISIBLE },
+  { SEARCH_UTF16,     2, 0, CTX_VISIBLE },
+  { SEARCH_INT_LE,    3, 0, CTX_VISIBLE },
+  { SEARCH_INT_BE,    4, 0, CTX_VISIBLE },
+  { FIND_NEXT,        6, 0, CTX_INVISIBLE },
+  { FIND_PREVIOUS,    7, 0, CTX_INVISIBLE },
+  { NEXT_DIFFERENCE,     9, 0, CTX_INVISIBLE },
+  { PREVIOUS_DIFFERENCE, 10, 0, CTX_INVISIBLE },
+};
+
+#define N_HEX_MENU_ENTRIES (sizeof(hex_menu_entries) / sizeof(MenuEntry))
+
+static int contextMenuEnterCallback(int pos, void *context);
+
+static ContextMenu context_menu_hex = {
+  .parent = NULL,
+  .entries = hex_menu_entries,
+  .n_entries = N_HEX_MENU_ENTRIES,
+  .max_width = 0.0f,
+  .callback = contextMenuEnterCallback,
+  .sel = -1,
+};
+
+// What the context menu asked the viewer to do
+enum HexRequests {
+  HEX_REQUEST_NONE,
+  HEX_REQUEST_SEARCH,
+  HEX_REQUEST_FIND_NEXT,
+  HEX_REQUEST_FIND_PREVIOUS,
+  HEX_REQUEST_NEXT_DIFFERENCE,
+  HEX_REQUEST_PREVIOUS_DIFFERENCE,
+};
+
+typedef struct HexSearchParams {
+  HexSearch *search;
+} HexSearchParams;
+
+void initHexContextMenuWidth() {
+  int i;
+  for (i = 0; i < N_HEX_MENU_ENTRIES; i++) {
+    context_menu_hex.max_width = MAX(context_menu_hex.max_width, pgf_text_width(language_container[hex_menu_entries[i].name]));
+  }
+
+  context_menu_hex.max_width += 2.0f * CONTEXT_MENU_MARGIN;
+  context_menu_hex.max_width = MAX(context_menu_hex.max_width, CONTEXT_MENU_MIN_WIDTH);
+}
+
+static int hex_engine_open(HexEngine *engine, const char *file) {
+  memset(engine, 0, sizeof(HexEngine));
+  engine->fd = -1;
+  engine->last_page = -1;
+
+  // The search thread reads through the engine while the viewer draws
+  sceKernelCreateLwMutex(&engine->mutex, "hex_engine_mutex", 2, 0, NULL);
+
+  // Entries of archives can't be read at random, they are loaded at once
+  if (isInArchive()) {
+    engine->memory = memalign(4096, BIG_BUFFER_SIZE);
+    if (!engine->memory)
+      return VITASHELL_ERROR_NO_MEMORY;
+
+    int size = ReadArchiveFile(file, engine->memory, BIG_BUFFER_SIZE);
+    if (size <= 0) {
+      free(engine->memory);
+      engine->memory = NULL;
+      return size;
+    }
+
+    engine->size = size;
+    return 1;
+  }
+
+  SceIoStat stat;
+  memset(&stat, 0, sizeof(SceIoStat));
+
+  int res = sceIoGetstat(file, &stat);
+  if (res < 0)
+    return res;
+
+  if (stat.st_size <= 0)
+    return 0;
+
+  engine->fd = sceIoOpen(file, SCE_O_RDONLY, 0);
+  if (engine->fd < 0)
+    return engine->fd;
+
+  engine->size = stat.st_size;
+  return 1;
+}
+
+static void hex_engine_close(HexEngine *engine) {
+  int i;
+  for (i = 0; i < engine->n_pages; i++)
+    free(engine->pages[i].data);
+
+  free(engine->pages);
+  free(engine->memory);
 
-  if (list->head == NULL) {
-    list->head = entry;
-    list->tail = entry;
+  if (engine->fd >= 0)
+    sceIoClose(engine->fd);
+
+  sceKernelDeleteLwMutex(&engine->mutex);
+
+  memset(engine, 0, sizeof(HexEngine));
+  engine->fd = -1;
+}
+
+static int hex_get_page(HexEngine *engine, SceOff offset, HexPage **out) {
+  SceOff page_offset = offset - (offset % HEX_PAGE_SIZE);
+
+  // Rows mostly come from the page of the row before
+  if (engine->last_page >= 0 && engine->pages[engine->last_page].offset == page_offset) {
+    HexPage *page = &engine->pages[engine->last_page];
+    page->last_used = ++engine->clock;
+    *out = page;
+    return 0;
+  }
+
+  int i;
+  for (i = 0; i < engine->n_pages; i++) {
+    if (engine->pages[i].offset == page_offset) {
+      engine->pages[i].last_used = ++engine->clock;
+      engine->last_page = i;
+      *out = &engine->pages[i];
+      return 0;
+    }
+  }
+
+  HexPage *page = NULL;
+
+  if (engine->n_clean >= HEX_CACHE_PAGES) {
+    // Evict the least recently used clean page
+    for (i = 0; i < engine->n_pages; i++) {
+      if (!engine->pages[i].dirty && (!page || engine->pages[i].last_used < page->last_used))
+        page = &engine->pages[i];
+    }
   } else {
-    HexListEntry *tail = list->tail;
-    tail->next = entry;
-    entry->previous = tail;
-    list->tail = entry;
+    if (engine->n_pages == engine->max_pages) {
+      int n = engine->max_pages + HEX_CACHE_PAGES;
+      HexPage *pages = realloc(engine->pages, n * sizeof(HexPage));
+      if (!pages)
+        return VITASHELL_ERROR_NO_MEMORY;
+
+      engine->pages = pages;
+      engine->max_pages = n;
+    }
+
+    uint8_t *data = memalign(64, HEX_PAGE_SIZE);
+    if (!data)
+      return VITASHELL_ERROR_NO_MEMORY;
+
+    page = &engine->pages[engine->n_pages++];
+    page->data = data;
+    page->dirty = 0;
+    engine->n_clean++;
+  }
+
+  int read = sceIoPread(engine->fd, page->data, HEX_PAGE_SIZE, page_offset);
+  if (read < 0) {
+    // Leave the slot free to be used first, the read is tried again next time
+    page->offset = -1;
+    page->length = 0;
+    page->last_used = 0;
+
+    if (engine->last_page == page - engine->pages)
+      engine->last_page = -1;
+
+    return read;
+  }
+
+  page->offset = page_offset;
+  page->length = read;
+  page->last_used = ++engine->clock;
+
+  engine->last_page = page - engine->pages;
+  *out = page;
+  return 0;
+}
+
+static int hex_read_unlocked(HexEngine *engine, SceOff offset, uint8_t *data, int length) {
+  if (offset >= engine->size)
+    return 0;
+
+  length = (int)MIN((SceOff)length, engine->size - offset);
+
+  if (engine->memory) {
+    memcpy(data, engine->memory + offset, length);
+    return length;
+  }
+
+  int n = 0;
+  while (n < length) {
+    HexPage *page;
+    int res = hex_get_page(engine, offset + n, &page);
+    if (res < 0)
+      return n > 0 ? n : res;
+
+    int skip = (int)(offset + n - page->offset);
+    if (skip >= page->length)
+      break;
+
+    int copy = MIN(length - n, page->length - skip);
+    memcpy(data + n, page->data + skip, copy);
+    n += copy;
   }
 
-  list->length++;
+  return n;
+}
+
+static int hex_read(HexEngine *engine, SceOff offset, uint8_t *data, int length) {
+  sceKernelLockLwMutex(&engine->mutex, 1, NULL);
+  int res = hex_read_unlocked(engine, offset, data, length);
+  sceKernelUnlockLwMutex(&engine->mutex, 1);
+  return res;
 }
 
-static void hexListEmpty(HexList *list) {
-  HexListEntry *entry = list->head;
+static void hex_write_byte(HexEngine *engine, SceOff offset, uint8_t byte) {
+  sceKernelLockLwMutex(&engine->mutex, 1, NULL);
 
-  while (entry) {
-    HexListEntry *next = entry->next;
-    free(entry);
-    entry = next;
+  HexPage *page;
+  if (hex_get_page(engine, offset, &page) >= 0 && offset - page->offset < page->length) {
+    page->data[offset - page->offset] = byte;
+
+    if (!page->dirty) {
+      page->dirty = 1;
+      engine->n_clean--;
+    }
   }
 
-  list->head = NULL;
-  list->tail = NULL;
-  list->length = 0;
+  sceKernelUnlockLwMutex(&engine->mutex, 1);
 }
 
-static HexListEntry *hexListGetNthEntry(HexList *list, int n) {
-  HexListEntry *entry = list->head;
+// Only the modified pages are written back
+static int hex_save(HexEngine *engine, const char *file) {
+  SceUID fd = sceIoOpen(file, SCE_O_WRONLY, 0777);
+  if (fd < 0)
+    return fd;
+
+  int res = 0;
 
-  while (n > 0 && entry) {
-    n--;
-    entry = entry->next;
+  sceKernelLockLwMutex(&engine->mutex, 1, NULL);
+
+  int i;
+  for (i = 0; i < engine->n_pages; i++) {
+    HexPage *page = &engine->pages[i];
+    if (!page->dirty)
+      continue;
+
+    res = sceIoPwrite(fd, page->data, page->length, page->offset);
+    if (res >= 0 && res != page->length)
+      res = VITASHELL_ERROR_SHORT_WRITE;
+    if (res < 0)
+      break;
+
+    page->dirty = 0;
+    engine->n_clean++;
   }
 
-  if (n != 0)
-    return NULL;
+  sceKernelUnlockLwMutex(&engine->mutex, 1);
 
-  return entry;
+  sceIoClose(fd);
+
+  return res;
 }
 
-int hexViewer(const char *file) {
-  int text_viewer = 0;
+static int hex_search_read(HexSearchStream *stream, SceOff offset, uint8_t *data, int length) {
+  HexSearch *search = (HexSearch *)stream->context;
+  return hex_read(search->engine, offset, data, length);
+}
+
+static int hex_search_progress(HexSearchStream *stream, SceOff done, SceOff total) {
+  HexSearch *search = (HexSearch *)stream->context;
 
-  uint8_t *buffer = memalign(4096, BIG_BUFFER_SIZE);
-  if (!buffer)
-    return VITASHELL_ERROR_NO_MEMORY;
+  int value = total > 0 ? (int)((done * 100) / total) : 100;
+  if (value != search->percent) {
+    sceMsgDialogProgressBarSetValue(SCE_MSG_DIALOG_PROGRESSBAR_TARGET_BAR_DEFAULT, value);
+    search->percent = value;
+  }
 
-  int size = 0;
+  return search->running;
+}
 
-  if (isInArchive()) {
-    size = ReadArchiveFile(file, buffer, BIG_BUFFER_SIZE);
+static int hex_search_thread(SceSize args, HexSearchParams *argp) {
+  HexSearch *search = argp->search;
+
+  search->result = -1;
+  search->percent = -1;
+
+  uint8_t *buffer = malloc(HEX_SEARCH_CHUNK_SIZE);
+  if (buffer) {
+    HexSearchStream stream;
+    stream.pattern = &search->pattern;
+    stream.buffer = buffer;
+    stream.buffer_size = HEX_SEARCH_CHUNK_SIZE;
+    stream.size = search->engine->size;
+    stream.read = hex_search_read;
+    stream.progress = hex_search_progress;
+    stream.context = search;
+
+    search->result = hexSearchStream(&stream, search->start, search->backward);
+
+    free(buffer);
   } else {
-    size = ReadFile(file, buffer, BIG_BUFFER_SIZE);
+    search->error = VITASHELL_ERROR_NO_MEMORY;
   }
 
-  if (size <= 0) {
-    free(buffer);
-    return size;
+  // Closing the dialog tells the viewer the search is over
+  if (search->running) {
+    search->done = 1;
+    sceMsgDialogClose();
   }
 
+  return sceKernelExitDeleteThread(0);
+}
+
+static void hex_search_start(HexSearch *search, SceOff start, int backward) {
+  search->start = start;
+  search->backward = backward;
+  search->result = -1;
+  search->done = 0;
+  search->error = 0;
+
+  search->thid = sceKernelCreateThread("hex_search_thread", (SceKernelThreadEntry)hex_search_thread, 0x10000100, 0x10000, 0, 0x70000, NULL);
+  if (search->thid < 0) {
+    errorDialog(search->thid);
+    return;
+  }
+
+  initMessageDialog(MESSAGE_DIALOG_PROGRESS_BAR, language_container[SEARCHING]);
+
+  search->running = 1;
+
+  HexSearchParams params;
+  params.search = search;
+
+  // The error is shown once the progress dialog has closed
+  int res = sceKernelStartThread(search->thid, sizeof(HexSearchParams), &params);
+  if (res < 0) {
+    sceKernelDeleteThread(search->thid);
+    search->thid = -1;
+    search->error = res;
+    sceMsgDialogClose();
+  }
+}
+
+static int contextMenuEnterCallback(int sel, void *context) {
+  HexSearch *search = (HexSearch *)context;
+
+  switch (sel) {
+    case HEX_MENU_ENTRY_SEARCH_HEX_BYTES:
+      initImeDialog(language_container[ENTER_HEX_BYTES], "", HEX_SEARCH_MAX_PATTERN * 3, SCE_IME_TYPE_DEFAULT, 0, 0);
+      search->input_type = HEX_SEARCH_BYTES;
+      break;
+
+    case HEX_MENU_ENTRY_SEARCH_ASCII:
+      initImeDialog(language_container[ENTER_SEARCH_TERM], "", HEX_SEARCH_MAX_PATTERN, SCE_IME_TYPE_DEFAULT, 0, 0);
+      search->input_type = HEX_SEARCH_ASCII;
+      break;
+
+    case HEX_MENU_ENTRY_SEARCH_UTF16:
+      initImeDialog(language_container[ENTER_SEARCH_TERM], "", HEX_SEARCH_MAX_PATTERN / 2, SCE_IME_TYPE_DEFAULT, 0, 0);
+      search->input_type = HEX_SEARCH_UTF16LE;
+      break;
+
+    case HEX_MENU_ENTRY_SEARCH_INT_LE:
+    case HEX_MENU_ENTRY_SEARCH_INT_BE:
+      initImeDialog(language_container[ENTER_INTEGER], "", 32, SCE_IME_TYPE_DEFAULT, 0, 0);
+      search->input_type = (sel == HEX_MENU_ENTRY_SEARCH_INT_BE) ? HEX_SEARCH_INT_BE : HEX_SEARCH_INT_LE;
+      break;
+
+    case HEX_MENU_ENTRY_FIND_NEXT:
+      search->request = HEX_REQUEST_FIND_NEXT;
+      break;
+
+    case HEX_MENU_ENTRY_FIND_PREVIOUS:
+      search->request = HEX_REQUEST_FIND_PREVIOUS;
+      break;
+
+    case HEX_MENU_ENTRY_NEXT_DIFFERENCE:
+      search->request = HEX_REQUEST_NEXT_DIFFERENCE;
+      break;
+
+    case HEX_MENU_ENTRY_PREVIOUS_DIFFERENCE:
+      search->request = HEX_REQUEST_PREVIOUS_DIFFERENCE;
+      break;
+  }
+
+  return CONTEXT_MENU_CLOSING;
+}
+
+static void setContextMenuVisibilities(HexSearch *search, int n_differences) {
+  // Find next & previous only visible when there is a pattern
+  hex_menu_entries[HEX_MENU_ENTRY_FIND_NEXT].visibility = search->pattern.length > 0 ? CTX_VISIBLE : CTX_INVISIBLE;
+  hex_menu_entries[HEX_MENU_ENTRY_FIND_PREVIOUS].visibility = search->pattern.length > 0 ? CTX_VISIBLE : CTX_INVISIBLE;
+
+  // Differences only visible after comparing this file
+  hex_menu_entries[HEX_MENU_ENTRY_NEXT_DIFFERENCE].visibility = n_differences > 0 ? CTX_VISIBLE : CTX_INVISIBLE;
+  hex_menu_entries[HEX_MENU_ENTRY_PREVIOUS_DIFFERENCE].visibility = n_differences > 0 ? CTX_VISIBLE : CTX_INVISIBLE;
+
+  context_menu_hex.sel = 0;
+}
+
+// Put the line of offset in the middle of the screen, the cursor on its byte
+static void hex_jump(SceOff offset, SceOff size, SceOff *base_pos, int *rel_pos, uint8_t *nibble_pos) {
+  SceOff line = offset - (offset % 0x10);
+  SceOff last_line = ALIGN(size, 0x10);
+
+  SceOff base = MAX(line - (MAX_POSITION / 2) * 0x10, 0);
+  base = MIN(base, MAX(last_line - 0xF0, 0));
+
+  *base_pos = base;
+  *rel_pos = (int)(line - base);
+  *nibble_pos = (offset % 0x10) * 2;
+}
+
+// Index of the first difference that ends after offset
+static int hex_find_difference(CompareRange *differences, int n_differences, SceOff offset) {
+  int low = 0, high = n_differences;
+
+  while (low < high) {
+    int mid = (low + high) / 2;
+    if (differences[mid].offset + differences[mid].length <= offset) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+
+  return low;
+}
+
+int hexViewer(const char *file) {
+  int text_viewer = 0;
+
+  HexEngine engine;
+  int res = hex_engine_open(&engine, file);
+  if (res <= 0)
+    return res;
+
+  SceOff size = engine.size;
+
   int modify_allowed = 1;
 
   if (isInArchive()) {
@@ -100,43 +493,99 @@ int hexViewer(const char *file) {
 
   int changed = 0;
 
-  int base_pos = 0, rel_pos = 0;
+  SceOff base_pos = 0;
+  int rel_pos = 0;
   uint8_t nibble_pos = 0;
 
-  HexList list;
-  memset(&list, 0, sizeof(HexList));
+  HexSearch search;
+  memset(&search, 0, sizeof(HexSearch));
+  search.engine = &engine;
+  search.input_type = -1;
+  search.thid = -1;
 
-  int i;
-  for (i = 0; i < 0x10; i++) {
-    HexListEntry *entry = malloc(sizeof(HexListEntry));
-    memcpy(entry->data, buffer + i * 0x10, 0x10);
-    hexListAddEntry(&list, entry);
-  }
+  context_menu_hex.context = &search;
+
+  // Differences of a comparison of this file, starting at the first
+  CompareRange *differences = NULL;
+  int n_differences = compareGetDifferences(file, &differences);
+  if (n_differences > 0)
+    hex_jump(differences[0].offset, size, &base_pos, &rel_pos, &nibble_pos);
 
   while (1) {
     readPad();
 
-    if (!isMessageDialogRunning()) {
+    if (getContextMenuMode() != CONTEXT_MENU_CLOSED) {
+      contextMenuCtrl();
+    } else if (isImeDialogRunning()) {
+      int ime_result = updateImeDialog();
+
+      if (search.input_type >= 0) {
+        if (ime_result == IME_DIALOG_RESULT_FINISHED) {
+          if (hexPatternCompile(&search.pattern, search.input_type, (char *)getImeDialogInputTextUTF8(), getImeDialogInputTextUTF16()) >= 0) {
+            search.request = HEX_REQUEST_SEARCH;
+          }
+
+          search.input_type = -1;
+        } else if (ime_result == IME_DIALOG_RESULT_CANCELED) {
+          search.input_type = -1;
+        }
+      }
+    } else if (!isMessageDialogRunning()) {
+      // A new search starts at the cursor, find next after it
+      if (search.request != HEX_REQUEST_NONE) {
+        SceOff cur_pos = base_pos + rel_pos + nibble_pos / 2;
+
+        switch (search.request) {
+          case HEX_REQUEST_SEARCH:
+            hex_search_start(&search, cur_pos, 0);
+            break;
+
+          case HEX_REQUEST_FIND_NEXT:
+            hex_search_start(&search, cur_pos + 1, 0);
+            break;
+
+          case HEX_REQUEST_FIND_PREVIOUS:
+            hex_search_start(&search, cur_pos, 1);
+            break;
+
+          case HEX_REQUEST_NEXT_DIFFERENCE:
+          {
+            int i = hex_find_difference(differences, n_differences, cur_pos);
+            if (i < n_differences && differences[i].offset <= cur_pos)
+              i++;
+
+            if (i < n_differences)
+              hex_jump(differences[i].offset, size, &base_pos, &rel_pos, &nibble_pos);
+            break;
+          }
+
+          case HEX_REQUEST_PREVIOUS_DIFFERENCE:
+          {
+            int i = hex_find_difference(differences, n_differences, cur_pos);
+            if (i == n_differences || differences[i].offset >= cur_pos)
+              i--;
+
+            if (i >= 0)
+              hex_jump(differences[i].offset, size, &base_pos, &rel_pos, &nibble_pos);
+            break;
+          }
+        }
+
+        search.request = HEX_REQUEST_NONE;
+      }
+
+      // Context menu trigger
+      if (pressed_pad[PAD_TRIANGLE]) {
+        setContextMenu(&context_menu_hex);
+        setContextMenuVisibilities(&search, n_differences);
+        setContextMenuMode(CONTEXT_MENU_OPENING);
+      }
+
       if (hold_pad[PAD_UP] || hold2_pad[PAD_LEFT_ANALOG_UP]) {
         if (rel_pos > 0) {
           rel_pos -= 0x10;
         } else if (base_pos > 0) {
           base_pos -= 0x10;
-
-          // Tail to head
-          list.tail->next = list.head;
-          list.head->previous = list.tail;
-          list.head = list.tail;
-
-          // Second last to tail
-          list.tail = list.tail->previous;
-          list.tail->next = NULL;
-
-          // No previous
-          list.head->previous = NULL;
-
-          // Read
-          memcpy(list.head->data, buffer + base_pos, 0x10);
         }
       } else if (hold_pad[PAD_DOWN] || hold2_pad[PAD_LEFT_ANALOG_DOWN]) {
         if ((rel_pos + 0x10) < size) {
@@ -144,21 +593,6 @@ int hexViewer(const char *file) {
             rel_pos += 0x10;
           } else if ((base_pos + rel_pos + 0x10) < size) {
             base_pos += 0x10;
-
-            // Head to tail
-            list.head->previous = list.tail;
-            list.tail->next = list.head;
-            list.tail = list.head;
-
-            // Second first to head
-            list.head = list.head->next;
-            list.head->previous = NULL;
-
-            // No next
-            list.tail->next = NULL;
-
-            // Read
-            memcpy(list.tail->data, buffer + base_pos + (0x10 - 1) * 0x10, 0x10);
           }
         }
       }
@@ -172,21 +606,13 @@ int hexViewer(const char *file) {
             rel_pos = 0;
           }
         } else { // Skip page down
-          int last_line = ALIGN(size, 0x10);
+          SceOff last_line = ALIGN(size, 0x10);
           base_pos = base_pos + 0x100;
           if (base_pos >= last_line - 0xF0) {
             base_pos = MAX(last_line - 0xF0, 0);
-            rel_pos = MIN(0xE0, last_line - 0x10);
+            rel_pos = (int)MIN(0xE0, last_line - 0x10);
           }
         }
-
-        HexListEntry *entry = list.head;
-
-        int i;
-        for (i = 0; i < 0x10; i++) {
-          memcpy(entry->data, buffer + base_pos + i * 0x10, 0x10);
-          entry = entry->next;
-        }
       }
 
       uint8_t max_nibble = (2 * 0x10) - 1;
@@ -231,9 +657,11 @@ int hexViewer(const char *file) {
       // Increase nibble
       if (modify_allowed && hold_pad[PAD_ENTER]) {
         changed = 1;
-        int cur_pos = rel_pos + base_pos + nibble_pos / 2;
+        SceOff cur_pos = base_pos + rel_pos + nibble_pos / 2;
+
+        uint8_t ch = 0;
+        hex_read(&engine, cur_pos, &ch, 1);
 
-        uint8_t ch = buffer[cur_pos];
         uint8_t high_nibble = (ch >> 4) & 0xF;
         uint8_t low_nibble = ch & 0xF;
 
@@ -246,28 +674,41 @@ int hexViewer(const char *file) {
           nibble = 0;
         }
 
-        HexListEntry *entry = hexListGetNthEntry(&list, rel_pos / 0x10);
-
         if (low) {
-          uint8_t byte = (high_nibble << 4) | nibble;
-          buffer[cur_pos] = byte;
-          entry->data[nibble_pos/2] = byte;
+          hex_write_byte(&engine, cur_pos, (high_nibble << 4) | nibble);
         } else {
-          uint8_t byte = (nibble << 4) | low_nibble;
-          buffer[cur_pos] = byte;
-          entry->data[nibble_pos/2] = byte;
+          hex_write_byte(&engine, cur_pos, (nibble << 4) | low_nibble);
         }
       }
     } else {
       int msg_result = updateMessageDialog();
-      if (msg_result == MESSAGE_DIALOG_RESULT_YES) {
-        SceUID fd = sceIoOpen(file, SCE_O_WRONLY, 0777);
-        if (fd >= 0) {
-          sceIoWrite(fd, buffer, size);
-          sceIoClose(fd);
-        }
 
-        break;
+      if (search.running) {
+        // The dialog is the search progress, not the save question
+        if (pressed_pad[PAD_CANCEL])
+          sceMsgDialogClose();
+
+        if (msg_result != MESSAGE_DIALOG_RESULT_RUNNING) {
+          search.running = 0;
+          if (search.thid >= 0)
+            sceKernelWaitThreadEnd(search.thid, NULL, NULL);
+
+          if (search.result >= 0) {
+            hex_jump(search.result, size, &base_pos, &rel_pos, &nibble_pos);
+          } else if (search.error < 0) {
+            errorDialog(search.error);
+          } else if (search.done) {
+            initMessageDialog(SCE_MSG_DIALOG_BUTTON_TYPE_OK, language_container[NO_MATCHES_FOUND]);
+          }
+        }
+      } else if (msg_result == MESSAGE_DIALOG_RESULT_YES) {
+        // Failed pages stay dirty, so the save can be tried again
+        int res = hex_save(&engine, file);
+        if (res < 0) {
+          errorDialog(res);
+        } else {
+          break;
+        }
       } else if (msg_result == MESSAGE_DIALOG_RESULT_NO) {
         break;
       }
@@ -280,12 +721,12 @@ int hexViewer(const char *file) {
     drawShellInfo(file);
 
     // Draw scroll bar
-    int pos = (base_pos - (base_pos % 0x10)) / 0x10 + ((base_pos % 0x10) ? 1 : 0);
-    int n_lines = (size - (size % 0x10)) / 0x10 + ((size % 0x10) ? 1 : 0);
+    int pos = (int)((base_pos + 0xF) / 0x10);
+    int n_lines = (int)((size + 0xF) / 0x10);
     drawScrollBar(pos, n_lines);
 
     // Offset/size
-    pgf_draw_textf(HEX_CHAR_X, START_Y, HEX_OFFSET_COLOR, "%08X/%08X", rel_pos+base_pos, size);
+    pgf_draw_textf(HEX_CHAR_X, START_Y, HEX_OFFSET_COLOR, "%08llX/%08llX", (unsigned long long)(rel_pos + base_pos), (unsigned long long)size);
 
     // Offset x
     pgf_draw_text(SHELL_MARGIN_X, START_Y, HEX_OFFSET_COLOR, language_container[OFFSET]);
@@ -295,22 +736,30 @@ int hexViewer(const char *file) {
       pgf_draw_textf(HEX_OFFSET_X + (x * HEX_OFFSET_SPACE), START_Y, HEX_OFFSET_COLOR, "%02X", x);
     }
 
-    HexListEntry *entry = list.head;
-
     int y;
     for (y = 0; y < 0x10; y++) {
+      // Rows are addressed directly in the pages
+      uint8_t data[0x10];
+      SceOff row_pos = base_pos + y * 0x10;
+      int length = hex_read(&engine, row_pos, data, 0x10);
+
+      int difference = hex_find_difference(differences, n_differences, row_pos);
+
       int x;
-      for (x = 0; x < 0x10; x++) {
+      for (x = 0; x < length; x++) {
         uint8_t nibble_x = x * 2;
 
-        uint8_t ch = entry->data[x];
-
-        uint32_t offset = base_pos + x + y * 0x10;
-        if (offset >= size)
-          break;
+        uint8_t ch = data[x];
 
         uint32_t color = HEX_COLOR;
 
+        // Bytes that differ from the compared file
+        while (difference < n_differences && differences[difference].offset + differences[difference].length <= row_pos + x)
+          difference++;
+
+        if (difference < n_differences && differences[difference].offset <= row_pos + x)
+          color = TEXT_HIGHLIGHT_COLOR;
+
         int on_line = 0;
         if (rel_pos == (y * 0x10)) {
           color = FOCUS_COLOR;
@@ -335,23 +784,26 @@ int hexViewer(const char *file) {
 
       // Offset y
       if (x > 0)
-        pgf_draw_textf(SHELL_MARGIN_X, START_Y + ((y + 1) * FONT_Y_SPACE), HEX_OFFSET_COLOR, "%08X", base_pos + (y * 0x10));
+        pgf_draw_textf(SHELL_MARGIN_X, START_Y + ((y + 1) * FONT_Y_SPACE), HEX_OFFSET_COLOR, "%08llX", (unsigned long long)(base_pos + (y * 0x10)));
 
       // It's the end, break
       if (x < 0x10)
         break;
-
-      // Next
-      entry = entry->next;
     }
 
+    // Draw context menu
+    drawContextMenu();
+
     // End drawing
     endDrawing();
   }
 
-  hexListEmpty(&list);
+  if (search.running) {
+    search.running = 0;
+    sceKernelWaitThreadEnd(search.thid, NULL, NULL);
+  }
 
-  free(buffer);
+  hex_engine_close(&engine);
 
   if (text_viewer)
     textViewer(file);
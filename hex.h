@@ -19,6 +19,8 @@
 #ifndef __HEX_H__
 #define __HEX_H__
 
+#include "hex_search.h"
+
 // TODO
 enum GroupSizes {
   GROUP_SIZE_1_BYTE,
@@ -26,17 +28,48 @@ enum GroupSizes {
   GROUP_SIZE_4_BYTE,
 };
 
-typedef struct HexListEntry {
-  struct HexListEntry *next;
-  struct HexListEntry *previous;
-  uint8_t data[0x10];
-} HexListEntry;
+#define HEX_PAGE_SIZE (64 * 1024)
+#define HEX_CACHE_PAGES 16
 
-typedef struct {
-  HexListEntry *head;
-  HexListEntry *tail;
+typedef struct HexPage {
+  uint8_t *data;
+  SceOff offset;
   int length;
-} HexList;
+  int dirty;
+  int last_used;
+} HexPage;
+
+// Pages of the file are read on demand. Clean pages are evicted in LRU
+// order, dirty pages are kept until they are written back in place.
+typedef struct HexEngine {
+  SceUID fd;
+  uint8_t *memory;
+  SceOff size;
+  HexPage *pages;
+  int n_pages;
+  int max_pages;
+  int n_clean;
+  int last_page;
+  int clock;
+  SceKernelLwMutexWork mutex;
+} HexEngine;
+
+typedef struct HexSearch {
+  HexPattern pattern;
+  HexEngine *engine;
+  SceUID thid;
+  int running;
+  int done;
+  int error;
+  int input_type;
+  int request;
+  SceOff start;
+  int backward;
+  SceOff result;
+  int percent;
+} HexSearch;
+
+void initHexContextMenuWidth();
 
 int hexViewer(const char *file);
 
@@ -0,0 +1,248 @@
+/*
+  VitaShell
+  Copyright (C) 2015-2018, TheFloW
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "hex_search.h"
+
+static int hex_digit(char c) {
+  if (c >= '0' && c <= '9')
+    return c - '0';
+  if (c >= 'a' && c <= 'f')
+    return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F')
+    return c - 'A' + 10;
+  return -1;
+}
+
+// "DE AD ?F": pairs of hex digits, '?' matches any nibble
+static int hex_pattern_parse_bytes(HexPattern *pattern, const char *text) {
+  int n = 0;
+
+  while (*text) {
+    if (*text == ' ') {
+      text++;
+      continue;
+    }
+
+    int i = n / 2;
+    if (i >= HEX_SEARCH_MAX_PATTERN)
+      return -1;
+
+    uint8_t value = 0, mask = 0;
+    if (*text != '?') {
+      int digit = hex_digit(*text);
+      if (digit < 0)
+        return -1;
+
+      value = digit;
+      mask = 0xF;
+    }
+
+    if (n % 2 == 0) {
+      pattern->bytes[i] = value << 4;
+      pattern->mask[i] = mask << 4;
+    } else {
+      pattern->bytes[i] |= value;
+      pattern->mask[i] |= mask;
+    }
+
+    n++;
+    text++;
+  }
+
+  if (n % 2 != 0)
+    return -1;
+
+  return n / 2;
+}
+
+// "value[:size]", the value in any base strtoull takes, size 1, 2, 4 or 8
+static int hex_pattern_parse_integer(HexPattern *pattern, const char *text, int big_endian) {
+  char *end;
+  unsigned long long value = strtoull(text, &end, 0);
+  if (end == text)
+    return -1;
+
+  int size = 4;
+  if (*end == ':') {
+    text = end + 1;
+    size = strtol(text, &end, 10);
+    if (end == text)
+      return -1;
+  }
+
+  if (*end != '\0' || (size != 1 && size != 2 && size != 4 && size != 8))
+    return -1;
+
+  int i;
+  for (i = 0; i < size; i++) {
+    uint8_t byte = (value >> (i * 8)) & 0xFF;
+    pattern->bytes[big_endian ? (size - 1 - i) : i] = byte;
+  }
+
+  memset(pattern->mask, 0xFF, size);
+  return size;
+}
+
+int hexPatternCompile(HexPattern *pattern, int type, const char *text, const uint16_t *text_utf16) {
+  memset(pattern, 0, sizeof(HexPattern));
+
+  int length = -1;
+
+  switch (type) {
+    case HEX_SEARCH_BYTES:
+      length = hex_pattern_parse_bytes(pattern, text);
+      break;
+
+    case HEX_SEARCH_ASCII:
+      length = strlen(text);
+      if (length > HEX_SEARCH_MAX_PATTERN)
+        return -1;
+
+      memcpy(pattern->bytes, text, length);
+      memset(pattern->mask, 0xFF, length);
+      break;
+
+    case HEX_SEARCH_UTF16LE:
+    {
+      int i;
+      for (i = 0; text_utf16[i]; i++) {
+        if ((i + 1) * 2 > HEX_SEARCH_MAX_PATTERN)
+          return -1;
+
+        pattern->bytes[i * 2] = text_utf16[i] & 0xFF;
+        pattern->bytes[i * 2 + 1] = (text_utf16[i] >> 8) & 0xFF;
+      }
+
+      length = i * 2;
+      memset(pattern->mask, 0xFF, length);
+      break;
+    }
+
+    case HEX_SEARCH_INT_LE:
+    case HEX_SEARCH_INT_BE:
+      length = hex_pattern_parse_integer(pattern, text, type == HEX_SEARCH_INT_BE);
+      break;
+  }
+
+  if (length <= 0)
+    return -1;
+
+  pattern->length = length;
+
+  // Horspool shift table. With wildcard nibbles a byte is the same as
+  // every pattern position whose masked value it matches.
+  int last = length - 1;
+
+  int c;
+  for (c = 0; c < 256; c++) {
+    pattern->skip[c] = length;
+
+    int i;
+    for (i = last - 1; i >= 0; i--) {
+      if ((c & pattern->mask[i]) == pattern->bytes[i]) {
+        pattern->skip[c] = last - i;
+        break;
+      }
+    }
+  }
+
+  return 0;
+}
+
+// Offset of the first (or last) match in buffer, or -1
+int hexPatternFind(HexPattern *pattern, const uint8_t *buffer, int length, int find_last) {
+  const uint8_t *bytes = pattern->bytes;
+  const uint8_t *mask = pattern->mask;
+  int last = pattern->length - 1;
+
+  int found = -1;
+
+  int i = 0;
+  while (i + last < length) {
+    uint8_t c = buffer[i + last];
+
+    if ((c & mask[last]) == bytes[last]) {
+      int j = 0;
+      while (j < last && (buffer[i + j] & mask[j]) == bytes[j])
+        j++;
+
+      if (j == last) {
+        if (!find_last)
+          return i;
+
+        found = i;
+      }
+    }
+
+    i += pattern->skip[c];
+  }
+
+  return found;
+}
+
+// Forward the search covers matches from start on, backward the ones
+// beginning before it. Chunks overlap by the pattern length - 1.
+// Returns the offset of the match, or -1
+SceOff hexSearchStream(HexSearchStream *stream, SceOff start, int backward) {
+  HexPattern *pattern = stream->pattern;
+  uint8_t *buffer = stream->buffer;
+  int m = pattern->length;
+  SceOff size = stream->size;
+
+  if (!backward) {
+    SceOff offset = start;
+
+    while (offset + m <= size && stream->progress(stream, offset - start, size - start)) {
+      int length = stream->read(stream, offset, buffer, stream->buffer_size);
+      if (length < m)
+        break;
+
+      int pos = hexPatternFind(pattern, buffer, length, 0);
+      if (pos >= 0)
+        return offset + pos;
+
+      if (offset + length >= size)
+        break;
+
+      offset += length - (m - 1);
+    }
+  } else {
+    SceOff end = (start + m - 1 < size) ? start + m - 1 : size;
+
+    while (end >= m && stream->progress(stream, start - (end - (m - 1)), start)) {
+      SceOff offset = (end > stream->buffer_size) ? end - stream->buffer_size : 0;
+      int length = stream->read(stream, offset, buffer, (int)(end - offset));
+      if (length < m)
+        break;
+
+      int pos = hexPatternFind(pattern, buffer, length, 1);
+      if (pos >= 0)
+        return offset + pos;
+
+      if (offset == 0)
+        break;
+
+      end = offset + m - 1;
+    }
+  }
+
+  return -1;
+}
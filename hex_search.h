@@ -0,0 +1,66 @@
+/*
+  VitaShell
+  Copyright (C) 2015-2018, TheFloW
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __HEX_SEARCH_H__
+#define __HEX_SEARCH_H__
+
+#include <psp2/types.h>
+
+#define HEX_SEARCH_MAX_PATTERN 256
+#define HEX_SEARCH_CHUNK_SIZE (256 * 1024)
+
+enum HexSearchTypes {
+  HEX_SEARCH_BYTES,
+  HEX_SEARCH_ASCII,
+  HEX_SEARCH_UTF16LE,
+  HEX_SEARCH_INT_LE,
+  HEX_SEARCH_INT_BE,
+};
+
+// Bytes to find, a position matches if (data & mask) == bytes
+typedef struct HexPattern {
+  uint8_t bytes[HEX_SEARCH_MAX_PATTERN];
+  uint8_t mask[HEX_SEARCH_MAX_PATTERN];
+  int length;
+  int skip[256];
+} HexPattern;
+
+typedef struct HexSearchStream HexSearchStream;
+
+// A file searched in chunks of buffer_size bytes
+struct HexSearchStream {
+  HexPattern *pattern;
+  uint8_t *buffer;
+  int buffer_size;
+  SceOff size;
+
+  // Returns the number of bytes read or < 0 on errors
+  int (* read)(HexSearchStream *stream, SceOff offset, uint8_t *data, int length);
+
+  // Called before every chunk, returns 0 to cancel
+  int (* progress)(HexSearchStream *stream, SceOff done, SceOff total);
+
+  void *context;
+};
+
+int hexPatternCompile(HexPattern *pattern, int type, const char *text, const uint16_t *text_utf16);
+int hexPatternFind(HexPattern *pattern, const uint8_t *buffer, int length, int find_last);
+
+SceOff hexSearchStream(HexSearchStream *stream, SceOff start, int backward);
+
+#endif
@@ -0,0 +1,455 @@
+/*
+  VitaShell
+  Copyright (C) 2015-2018, TheFloW
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "main.h"
+#include "browser.h"
+#include "archive.h"
+#include "file.h"
+#include "image.h"
+#include "utils.h"
+
+#include <setjmp.h>
+#include <jpeglib.h>
+#include <png.h>
+
+// Averages boxes of factor x factor pixels of the rows pushed into it
+// and writes the result straight into the texture
+typedef struct ImageScaler {
+  vita2d_texture *tex;
+  uint8_t *data;
+  int stride;
+  int width;
+  int factor;
+  int out_width;
+  int out_height;
+  uint32_t *sums;
+  int rows;
+  int y;
+} ImageScaler;
+
+typedef struct ImageMemory {
+  const uint8_t *buffer;
+  int size;
+  int offset;
+} ImageMemory;
+
+typedef struct ImageJpegError {
+  struct jpeg_error_mgr pub;
+  jmp_buf jmp;
+} ImageJpegError;
+
+// Box filter factor that brings a width x height image down by ratio,
+// and further if it is still too large for the GPU
+static int get_box_factor(int width, int height, float ratio) {
+  int factor = MAX((int)ratio, 1);
+
+  while ((width + factor - 1) / factor > IMAGE_MAX_TEXTURE_SIZE ||
+         (height + factor - 1) / factor > IMAGE_MAX_TEXTURE_SIZE)
+    factor++;
+
+  return factor;
+}
+
+static float get_ratio(int width, int height, int max_width, int max_height) {
+  if (max_width <= 0 || max_height <= 0)
+    return 1.0f;
+
+  return MAX((float)width / (float)max_width, (float)height / (float)max_height);
+}
+
+static int scaler_init(ImageScaler *s, int width, int height, int factor) {
+  memset(s, 0, sizeof(ImageScaler));
+
+  s->width = width;
+  s->factor = factor;
+  s->out_width = (width + factor - 1) / factor;
+  s->out_height = (height + factor - 1) / factor;
+
+  if (factor > 1) {
+    s->sums = malloc(s->out_width * 4 * sizeof(uint32_t));
+    if (!s->sums)
+      return VITASHELL_ERROR_NO_MEMORY;
+
+    memset(s->sums, 0, s->out_width * 4 * sizeof(uint32_t));
+  }
+
+  s->tex = vita2d_create_empty_texture(s->out_width, s->out_height);
+  if (!s->tex) {
+    free(s->sums);
+    s->sums = NULL;
+    return VITASHELL_ERROR_NO_MEMORY;
+  }
+
+  s->data = vita2d_texture_get_datap(s->tex);
+  s->stride = vita2d_texture_get_stride(s->tex);
+
+  return 0;
+}
+
+static void scaler_emit(ImageScaler *s) {
+  if (s->rows == 0)
+    return;
+
+  if (s->y < s->out_height) {
+    uint8_t *dst = s->data + s->y * s->stride;
+    uint32_t *sum = s->sums;
+
+    int x;
+    for (x = 0; x < s->out_width; x++, sum += 4, dst += 4) {
+      int box_width = MIN(s->factor, s->width - x * s->factor);
+      uint32_t n = box_width * s->rows;
+
+      dst[0] = sum[0] / n;
+      dst[1] = sum[1] / n;
+      dst[2] = sum[2] / n;
+      dst[3] = sum[3] / n;
+    }
+  }
+
+  memset(s->sums, 0, s->out_width * 4 * sizeof(uint32_t));
+  s->rows = 0;
+  s->y++;
+}
+
+// Rows are RGB or RGBA
+static void scaler_push(ImageScaler *s, const uint8_t *row, int channels) {
+  if (s->factor == 1) {
+    if (s->y < s->out_height) {
+      uint8_t *dst = s->data + s->y * s->stride;
+
+      if (channels == 4) {
+        memcpy(dst, row, s->width * 4);
+      } else {
+        int x;
+        for (x = 0; x < s->width; x++, row += 3, dst += 4) {
+          dst[0] = row[0];
+          dst[1] = row[1];
+          dst[2] = row[2];
+          dst[3] = 0xFF;
+        }
+      }
+    }
+
+    s->y++;
+    return;
+  }
+
+  uint32_t *sum = s->sums;
+
+  int x = 0, out_x;
+  for (out_x = 0; out_x < s->out_width; out_x++, sum += 4) {
+    int end = MIN(x + s->factor, s->width);
+
+    for (; x < end; x++, row += channels) {
+      sum[0] += row[0];
+      sum[1] += row[1];
+      sum[2] += row[2];
+      sum[3] += (channels == 4) ? row[3] : 0xFF;
+    }
+  }
+
+  if (++s->rows == s->factor)
+    scaler_emit(s);
+}
+
+static vita2d_texture *scaler_finish(ImageScaler *s) {
+  if (s->factor > 1)
+    scaler_emit(s);
+
+  free(s->sums);
+  s->sums = NULL;
+
+  return s->tex;
+}
+
+static void scaler_abort(ImageScaler *s) {
+  free(s->sums);
+  s->sums = NULL;
+
+  if (s->tex) {
+    vita2d_free_texture(s->tex);
+    s->tex = NULL;
+  }
+}
+
+static void jpeg_error_exit(j_common_ptr cinfo) {
+  ImageJpegError *error = (ImageJpegError *)cinfo->err;
+  longjmp(error->jmp, 1);
+}
+
+// libjpeg scales by 1/2, 1/4 and 1/8 while decoding, the box filter does the rest
+static vita2d_texture *load_jpeg(FILE *fp, ImageMemory *memory, int max_width, int max_height, int *width, int *height, volatile int *cancel) {
+  struct jpeg_decompress_struct cinfo;
+  ImageJpegError error;
+  ImageScaler scaler;
+  uint8_t * volatile row = NULL;
+
+  memset(&scaler, 0, sizeof(ImageScaler));
+
+  cinfo.err = jpeg_std_error(&error.pub);
+  error.pub.error_exit = jpeg_error_exit;
+
+  if (setjmp(error.jmp)) {
+    free(row);
+    scaler_abort(&scaler);
+    jpeg_destroy_decompress(&cinfo);
+    return NULL;
+  }
+
+  jpeg_create_decompress(&cinfo);
+
+  if (fp) {
+    jpeg_stdio_src(&cinfo, fp);
+  } else {
+    jpeg_mem_src(&cinfo, (unsigned char *)memory->buffer, memory->size);
+  }
+
+  jpeg_read_header(&cinfo, TRUE);
+
+  *width = cinfo.image_width;
+  *height = cinfo.image_height;
+
+  float ratio = get_ratio(cinfo.image_width, cinfo.image_height, max_width, max_height);
+
+  int denom = 1;
+  while (denom < 8 && (denom * 2 <= ratio ||
+                       (int)cinfo.image_width > denom * IMAGE_MAX_TEXTURE_SIZE ||
+                       (int)cinfo.image_height > denom * IMAGE_MAX_TEXTURE_SIZE))
+    denom *= 2;
+
+  cinfo.scale_num = 1;
+  cinfo.scale_denom = denom;
+  cinfo.out_color_space = JCS_RGB;
+  cinfo.dct_method = JDCT_IFAST;
+
+  jpeg_start_decompress(&cinfo);
+
+  int factor = get_box_factor(cinfo.output_width, cinfo.output_height, ratio / denom);
+  if (scaler_init(&scaler, cinfo.output_width, cinfo.output_height, factor) < 0)
+    longjmp(error.jmp, 1);
+
+  row = malloc(cinfo.output_width * cinfo.output_components);
+  if (!row)
+    longjmp(error.jmp, 1);
+
+  while (cinfo.output_scanline < cinfo.output_height) {
+    if (cancel && *cancel)
+      longjmp(error.jmp, 1);
+
+    JSAMPROW rows[1] = { row };
+    jpeg_read_scanlines(&cinfo, rows, 1);
+    scaler_push(&scaler, row, 3);
+  }
+
+  jpeg_finish_decompress(&cinfo);
+  jpeg_destroy_decompress(&cinfo);
+  free(row);
+
+  return scaler_finish(&scaler);
+}
+
+static void png_read_memory(png_structp png_ptr, png_bytep data, png_size_t length) {
+  ImageMemory *memory = (ImageMemory *)png_get_io_ptr(png_ptr);
+
+  if (length > memory->size - memory->offset)
+    png_error(png_ptr, "read past end");
+
+  memcpy(data, memory->buffer + memory->offset, length);
+  memory->offset += length;
+}
+
+// Rows are decoded one at a time and box filtered, interlaced images
+// can't be streamed like this and are left to vita2d
+static vita2d_texture *load_png(FILE *fp, ImageMemory *memory, int max_width, int max_height, int *width, int *height, volatile int *cancel) {
+  png_structp png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+  if (!png_ptr)
+    return NULL;
+
+  png_infop info_ptr = png_create_info_struct(png_ptr);
+  if (!info_ptr) {
+    png_destroy_read_struct(&png_ptr, NULL, NULL);
+    return NULL;
+  }
+
+  ImageScaler scaler;
+  uint8_t * volatile row = NULL;
+
+  memset(&scaler, 0, sizeof(ImageScaler));
+
+  if (setjmp(png_jmpbuf(png_ptr))) {
+    free(row);
+    scaler_abort(&scaler);
+    png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+    return NULL;
+  }
+
+  if (fp) {
+    png_init_io(png_ptr, fp);
+  } else {
+    png_set_read_fn(png_ptr, memory, png_read_memory);
+  }
+
+  png_read_info(png_ptr, info_ptr);
+
+  png_uint_32 w, h;
+  int bit_depth, color_type, interlace_type;
+  png_get_IHDR(png_ptr, info_ptr, &w, &h, &bit_depth, &color_type, &interlace_type, NULL, NULL);
+
+  if (interlace_type != PNG_INTERLACE_NONE)
+    png_error(png_ptr, "interlaced");
+
+  *width = w;
+  *height = h;
+
+  if (color_type == PNG_COLOR_TYPE_PALETTE)
+    png_set_palette_to_rgb(png_ptr);
+
+  if (color_type == PNG_COLOR_TYPE_GRAY && bit_depth < 8)
+    png_set_expand_gray_1_2_4_to_8(png_ptr);
+
+  int has_alpha = (color_type & PNG_COLOR_MASK_ALPHA);
+  if (png_get_valid(png_ptr, info_ptr, PNG_INFO_tRNS)) {
+    png_set_tRNS_to_alpha(png_ptr);
+    has_alpha = 1;
+  }
+
+  if (bit_depth == 16)
+    png_set_strip_16(png_ptr);
+
+  if (color_type == PNG_COLOR_TYPE_GRAY || color_type == PNG_COLOR_TYPE_GRAY_ALPHA)
+    png_set_gray_to_rgb(png_ptr);
+
+  if (!has_alpha)
+    png_set_filler(png_ptr, 0xFF, PNG_FILLER_AFTER);
+
+  png_read_update_info(png_ptr, info_ptr);
+
+  float ratio = get_ratio(w, h, max_width, max_height);
+  int factor = get_box_factor(w, h, ratio);
+  if (scaler_init(&scaler, w, h, factor) < 0)
+    png_error(png_ptr, "no memory");
+
+  row = malloc(png_get_rowbytes(png_ptr, info_ptr));
+  if (!row)
+    png_error(png_ptr, "no memory");
+
+  png_uint_32 y;
+  for (y = 0; y < h; y++) {
+    if (cancel && *cancel)
+      png_error(png_ptr, "canceled");
+
+    png_read_row(png_ptr, row, NULL);
+    scaler_push(&scaler, row, 4);
+  }
+
+  png_destroy_read_struct(&png_ptr, &info_ptr, NULL);
+  free(row);
+
+  return scaler_finish(&scaler);
+}
+
+static vita2d_texture *load_image(const char *file, int type, ImageMemory *memory, int max_width, int max_height, int *width, int *height, volatile int *cancel) {
+  vita2d_texture *tex = NULL;
+  FILE *fp = NULL;
+
+  if (!memory->buffer && type != FILE_TYPE_BMP) {
+    fp = fopen(file, "rb");
+    if (!fp)
+      return NULL;
+  }
+
+  switch (type) {
+    case FILE_TYPE_JPEG:
+      tex = load_jpeg(fp, memory, max_width, max_height, width, height, cancel);
+      break;
+
+    case FILE_TYPE_PNG:
+      tex = load_png(fp, memory, max_width, max_height, width, height, cancel);
+      break;
+  }
+
+  if (fp)
+    fclose(fp);
+
+  if (cancel && *cancel) {
+    if (tex)
+      vita2d_free_texture(tex);
+    return NULL;
+  }
+
+  // BMPs and what the streaming decoders don't handle are loaded whole
+  if (!tex) {
+    switch (type) {
+      case FILE_TYPE_BMP:
+        tex = memory->buffer ? vita2d_load_BMP_buffer((void *)memory->buffer) : vita2d_load_BMP_file(file);
+        break;
+
+      case FILE_TYPE_PNG:
+        tex = memory->buffer ? vita2d_load_PNG_buffer(memory->buffer) : vita2d_load_PNG_file(file);
+        break;
+
+      case FILE_TYPE_JPEG:
+        tex = memory->buffer ? vita2d_load_JPEG_buffer(memory->buffer, memory->size) : vita2d_load_JPEG_file(file);
+        break;
+    }
+
+    if (tex) {
+      *width = vita2d_texture_get_width(tex);
+      *height = vita2d_texture_get_height(tex);
+    }
+  }
+
+  // Set bilinear filter
+  if (tex)
+    vita2d_texture_set_filters(tex, SCE_GXM_TEXTURE_FILTER_LINEAR, SCE_GXM_TEXTURE_FILTER_LINEAR);
+
+  return tex;
+}
+
+// Decodes file to a texture no larger than needed to show it in
+// max_width x max_height (0 for the full resolution). width and height
+// receive the size of the image itself. Setting *cancel stops decoding.
+vita2d_texture *imageLoad(const char *file, int type, char *buffer, int max_width, int max_height, int *width, int *height, volatile int *cancel) {
+  if (isInArchive()) {
+    int size = ReadArchiveFile(file, buffer, BIG_BUFFER_SIZE);
+    if (size <= 0)
+      return NULL;
+
+    return imageLoadBuffer(buffer, size, type, max_width, max_height, width, height, cancel);
+  }
+
+  return imageLoadFile(file, type, max_width, max_height, width, height, cancel);
+}
+
+// Same as imageLoad, for a file that is never inside the open archive
+vita2d_texture *imageLoadFile(const char *file, int type, int max_width, int max_height, int *width, int *height, volatile int *cancel) {
+  ImageMemory memory;
+  memset(&memory, 0, sizeof(ImageMemory));
+
+  return load_image(file, type, &memory, max_width, max_height, width, height, cancel);
+}
+
+// Same as imageLoad, for an image already in memory
+vita2d_texture *imageLoadBuffer(const void *buffer, int size, int type, int max_width, int max_height, int *width, int *height, volatile int *cancel) {
+  ImageMemory memory;
+  memory.buffer = (const uint8_t *)buffer;
+  memory.size = size;
+  memory.offset = 0;
+
+  return load_image(NULL, type, &memory, max_width, max_height, width, height, cancel);
+}
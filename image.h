@@ -0,0 +1,29 @@
+/*
+  VitaShell
+  Copyright (C) 2015-2018, TheFloW
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __IMAGE_H__
+#define __IMAGE_H__
+
+// Largest texture the GPU takes
+#define IMAGE_MAX_TEXTURE_SIZE 4096
+
+vita2d_texture *imageLoad(const char *file, int type, char *buffer, int max_width, int max_height, int *width, int *height, volatile int *cancel);
+vita2d_texture *imageLoadFile(const char *file, int type, int max_width, int max_height, int *width, int *height, volatile int *cancel);
+vita2d_texture *imageLoadBuffer(const void *buffer, int size, int type, int max_width, int max_height, int *width, int *height, volatile int *cancel);
+
+#endif
@@ -288,6 +288,7 @@ static void finishVita2dLib() {
 }
 
 static int initSQLite() {
+  rif_index_init();
   return sqlite_init();
 }
 
@@ -93,6 +93,8 @@ void loadLanguage(int id) {
     LANGUAGE_ENTRY(EXTRACTING),
     LANGUAGE_ENTRY(COMPRESSING),
     LANGUAGE_ENTRY(HASHING),
+    LANGUAGE_ENTRY(SEARCHING),
+    LANGUAGE_ENTRY(COMPARING),
     LANGUAGE_ENTRY(REFRESHING),
     LANGUAGE_ENTRY(SENDING),
     LANGUAGE_ENTRY(RECEIVING),
@@ -107,10 +109,22 @@ void loadLanguage(int id) {
     // Hex editor strings
     LANGUAGE_ENTRY(OFFSET),
     LANGUAGE_ENTRY(OPEN_HEX_EDITOR),
+    LANGUAGE_ENTRY(SEARCH_HEX_BYTES),
+    LANGUAGE_ENTRY(SEARCH_ASCII),
+    LANGUAGE_ENTRY(SEARCH_UTF16),
+    LANGUAGE_ENTRY(SEARCH_INT_LE),
+    LANGUAGE_ENTRY(SEARCH_INT_BE),
+    LANGUAGE_ENTRY(FIND_NEXT),
+    LANGUAGE_ENTRY(FIND_PREVIOUS),
+    LANGUAGE_ENTRY(NEXT_DIFFERENCE),
+    LANGUAGE_ENTRY(PREVIOUS_DIFFERENCE),
+    LANGUAGE_ENTRY(ENTER_HEX_BYTES),
+    LANGUAGE_ENTRY(ENTER_INTEGER),
 
     // Text editor strings
     LANGUAGE_ENTRY(EDIT_LINE),
     LANGUAGE_ENTRY(ENTER_SEARCH_TERM),
+    LANGUAGE_ENTRY(ENTER_LINE_OR_PERCENTAGE),
 
     // Context menu strings
     LANGUAGE_ENTRY(REFRESH_LIVEAREA),
@@ -159,7 +173,13 @@ void loadLanguage(int id) {
     LANGUAGE_ENTRY(CUT),
     LANGUAGE_ENTRY(INSERT_EMPTY_LINE),
     LANGUAGE_ENTRY(SEARCH),
+    LANGUAGE_ENTRY(SEARCH_REGEX),
+    LANGUAGE_ENTRY(SEARCH_IN_FILES),
+    LANGUAGE_ENTRY(COMPARE_FILES),
     LANGUAGE_ENTRY(COPY_TO_CLIPBOARD),
+    LANGUAGE_ENTRY(UNDO),
+    LANGUAGE_ENTRY(REDO),
+    LANGUAGE_ENTRY(GO_TO_LINE),
 
     // File browser properties strings
     LANGUAGE_ENTRY(PROPERTY_NAME),
@@ -193,6 +213,7 @@ void loadLanguage(int id) {
     LANGUAGE_ENTRY(COPIED_FOLDER),
     LANGUAGE_ENTRY(COPIED_FILES_FOLDERS),
     LANGUAGE_ENTRY(IMPORTED_LICENSES),
+    LANGUAGE_ENTRY(IMPORTED_LICENSES_DETAILS),
     LANGUAGE_ENTRY(OPERATION_COMPLETED),
     LANGUAGE_ENTRY(FILE_COPIED_TO_CLIPBOARD),
     LANGUAGE_ENTRY(PROCESSING_FILE),
@@ -220,7 +241,11 @@ void loadLanguage(int id) {
     LANGUAGE_ENTRY(INSTALL_WARNING),
     LANGUAGE_ENTRY(INSTALL_BRICK_WARNING),
     LANGUAGE_ENTRY(INSTALL_COMPLETE_SUCCESS),
+    LANGUAGE_ENTRY(NO_MATCHES_FOUND),
+    LANGUAGE_ENTRY(FILES_ARE_IDENTICAL),
     LANGUAGE_ENTRY(HASH_FILE_QUESTION),
+    LANGUAGE_ENTRY(SEARCH_IN_ARCHIVES_QUESTION),
+    LANGUAGE_ENTRY(COMPARE_SIZE_MISMATCH_QUESTION),
     LANGUAGE_ENTRY(SAVE_MODIFICATIONS),
     LANGUAGE_ENTRY(REFRESH_LIVEAREA_QUESTION),
     LANGUAGE_ENTRY(REFRESH_LICENSE_DB_QUESTION),
@@ -326,6 +351,7 @@ void loadLanguage(int id) {
   LANGUAGE_ENTRY(VITASHELL_SETTINGS_FOCUS_COLOR_RAINBOW),
   LANGUAGE_ENTRY(VITASHELL_SETTINGS_FONT_SIZE),
   LANGUAGE_ENTRY(VITASHELL_SETTINGS_ENABLE_TOUCH),
+  LANGUAGE_ENTRY(VITASHELL_SETTINGS_THUMBNAIL_VIEW),
   LANGUAGE_ENTRY(VITASHELL_SETTINGS_FONT_SIZE_SMALL),
   LANGUAGE_ENTRY(VITASHELL_SETTINGS_FONT_SIZE_NORMAL),
   LANGUAGE_ENTRY(VITASHELL_SETTINGS_FONT_SIZE_LARGE),
@@ -41,6 +41,8 @@ enum LanguageContainer {
   EXTRACTING,
   COMPRESSING,
   HASHING,
+  SEARCHING,
+  COMPARING,
   REFRESHING,
   SENDING,
   RECEIVING,
@@ -55,10 +57,22 @@ enum LanguageContainer {
   // Hex editor strings
   OFFSET,
   OPEN_HEX_EDITOR,
+  SEARCH_HEX_BYTES,
+  SEARCH_ASCII,
+  SEARCH_UTF16,
+  SEARCH_INT_LE,
+  SEARCH_INT_BE,
+  FIND_NEXT,
+  FIND_PREVIOUS,
+  NEXT_DIFFERENCE,
+  PREVIOUS_DIFFERENCE,
+  ENTER_HEX_BYTES,
+  ENTER_INTEGER,
 
   // Text editor strings
   EDIT_LINE,
   ENTER_SEARCH_TERM,
+  ENTER_LINE_OR_PERCENTAGE,
 
   // Context menu strings
   REFRESH_LIVEAREA,
@@ -107,7 +121,13 @@ enum LanguageContainer {
   CUT,
   INSERT_EMPTY_LINE,
   SEARCH,
+  SEARCH_REGEX,
+  SEARCH_IN_FILES,
+  COMPARE_FILES,
   COPY_TO_CLIPBOARD,
+  UNDO,
+  REDO,
+  GO_TO_LINE,
 
   // File browser properties strings
   PROPERTY_NAME,
@@ -141,6 +161,7 @@ enum LanguageContainer {
   COPIED_FOLDER,
   COPIED_FILES_FOLDERS,
   IMPORTED_LICENSES,
+  IMPORTED_LICENSES_DETAILS,
   OPERATION_COMPLETED,
   FILE_COPIED_TO_CLIPBOARD,
   PROCESSING_FILE,
@@ -168,7 +189,11 @@ enum LanguageContainer {
   INSTALL_WARNING,
   INSTALL_BRICK_WARNING,
   INSTALL_COMPLETE_SUCCESS,
+  NO_MATCHES_FOUND,
+  FILES_ARE_IDENTICAL,
   HASH_FILE_QUESTION,
+  SEARCH_IN_ARCHIVES_QUESTION,
+  COMPARE_SIZE_MISMATCH_QUESTION,
   SAVE_MODIFICATIONS,
   REFRESH_LIVEAREA_QUESTION,
   REFRESH_LICENSE_DB_QUESTION,
@@ -221,6 +246,7 @@ enum LanguageContainer {
   VITASHELL_SETTINGS_FOCUS_COLOR_RAINBOW,
   VITASHELL_SETTINGS_FONT_SIZE,
   VITASHELL_SETTINGS_ENABLE_TOUCH,
+  VITASHELL_SETTINGS_THUMBNAIL_VIEW,
   VITASHELL_SETTINGS_FONT_SIZE_SMALL,
   VITASHELL_SETTINGS_FONT_SIZE_NORMAL,
   VITASHELL_SETTINGS_FONT_SIZE_LARGE,
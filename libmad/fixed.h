@@ -275,12 +275,15 @@ mad_fixed_t mad_f_mul_inline(mad_fixed_t x, mad_fixed_t y)
 	 : "+r" (lo), "+r" (hi)  \
 	 : "%r" (x), "r" (y))
 
-#  define MAD_F_MLN(hi, lo)  \
+/* Thumb-2 has no RSC, the generic negation below is used instead */
+#  if !defined(__thumb__)
+#   define MAD_F_MLN(hi, lo)  \
     asm ("rsbs	%0, %2, #0\n\t"  \
 	 "rsc	%1, %3, #0"  \
 	 : "=r" (lo), "=r" (hi)  \
 	 : "0" (lo), "1" (hi)  \
 	 : "cc")
+#  endif
 
 #  define mad_f_scale64(hi, lo)  \
     ({ mad_fixed_t __result;  \
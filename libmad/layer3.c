@@ -43,6 +43,10 @@
 # include "huffman.h"
 # include "layer3.h"
 
+# if defined(ASO_NEON)
+#  include <arm_neon.h>
+# endif
+
 /* --- Layer III ----------------------------------------------------------- */
 
 enum {
@@ -436,6 +440,39 @@ mad_fixed_t const window_s[12] = {
   MAD_F(0x061f78aa) /* 0.382683432 */, MAD_F(0x0216a2a2) /* 0.130526192 */,
 };
 
+# if defined(ASO_NEON)
+/*
+ * NAME:	III_neon_mul()
+ * DESCRIPTION:	mad_f_mul() of two pairs of values, rounded the same way
+ */
+static inline
+int32x2_t III_neon_mul(int32x2_t x, int32x2_t y)
+{
+  return vrshrn_n_s64(vmull_s32(x, y), MAD_F_SCALEBITS);
+}
+
+/*
+ * NAME:	III_neon_dot6()
+ * DESCRIPTION:	sum of six products, as MAD_F_ML0(), MAD_F_MLA() and
+ *		MAD_F_MLZ() would compute it
+ */
+static inline
+mad_fixed_t III_neon_dot6(int32x2_t x0, int32x2_t x1, int32x2_t x2,
+			  mad_fixed_t const s[6])
+{
+  int64x2_t sum;
+
+  sum = vmull_s32(x0, vld1_s32((int32_t const *) &s[0]));
+  sum = vmlal_s32(sum, x1, vld1_s32((int32_t const *) &s[2]));
+  sum = vmlal_s32(sum, x2, vld1_s32((int32_t const *) &s[4]));
+
+  return (mad_fixed_t)
+    vget_lane_s64(vrshr_n_s64(vadd_s64(vget_low_s64(sum),
+				       vget_high_s64(sum)),
+			      MAD_F_SCALEBITS), 0);
+}
+# endif
+
 /*
  * coefficients for intensity stereo processing
  * derived from section 2.4.3.4.9.3 of ISO/IEC 11172-3
@@ -2102,6 +2139,15 @@ void III_imdct_l(mad_fixed_t const X[18], mad_fixed_t z[36],
 
       z[35] = mad_f_mul(tmp1, tmp2);
     }
+# elif defined(ASO_NEON)
+    for (i = 0; i < 36; i += 4) {
+      int32x4_t x = vld1q_s32((int32_t const *) &z[i]);
+      int32x4_t w = vld1q_s32((int32_t const *) &window_l[i]);
+
+      vst1q_s32((int32_t *) &z[i],
+		vcombine_s32(III_neon_mul(vget_low_s32(x),  vget_low_s32(w)),
+			     III_neon_mul(vget_high_s32(x), vget_high_s32(w))));
+    }
 # elif 1
     for (i = 0; i < 36; i += 4) {
       z[i + 0] = mad_f_mul(z[i + 0], window_l[i + 0]);
@@ -2143,6 +2189,64 @@ void III_imdct_l(mad_fixed_t const X[18], mad_fixed_t z[36],
  * NAME:	III_imdct_s()
  * DESCRIPTION:	perform IMDCT and windowing for short blocks
  */
+# if defined(ASO_NEON)
+static
+void III_imdct_s(mad_fixed_t const X[18], mad_fixed_t z[36])
+{
+  mad_fixed_t y[36], *yptr;
+  int w, i;
+
+  /* IMDCT */
+
+  yptr = &y[0];
+
+  for (w = 0; w < 3; ++w) {
+    register mad_fixed_t const (*s)[6];
+    int32x2_t x0, x1, x2;
+
+    s = imdct_s;
+
+    x0 = vld1_s32((int32_t const *) &X[0]);
+    x1 = vld1_s32((int32_t const *) &X[2]);
+    x2 = vld1_s32((int32_t const *) &X[4]);
+
+    for (i = 0; i < 3; ++i) {
+      yptr[i + 0] = III_neon_dot6(x0, x1, x2, *s++);
+      yptr[5 - i] = -yptr[i + 0];
+
+      yptr[ i + 6] = III_neon_dot6(x0, x1, x2, *s++);
+      yptr[11 - i] = yptr[i + 6];
+    }
+
+    yptr += 12;
+    X    += 6;
+  }
+
+  /* windowing, overlapping and concatenation */
+
+  for (i = 0; i < 6; i += 2) {
+    int32x2_t w0 = vld1_s32((int32_t const *) &window_s[i + 0]);
+    int32x2_t w6 = vld1_s32((int32_t const *) &window_s[i + 6]);
+    int64x2_t sum;
+
+    vst1_s32((int32_t *) &z[i +  0], vdup_n_s32(0));
+    vst1_s32((int32_t *) &z[i +  6],
+	     III_neon_mul(vld1_s32((int32_t const *) &y[i + 0]), w0));
+
+    sum = vmull_s32(vld1_s32((int32_t const *) &y[i +  6]), w6);
+    sum = vmlal_s32(sum, vld1_s32((int32_t const *) &y[i + 12]), w0);
+    vst1_s32((int32_t *) &z[i + 12], vrshrn_n_s64(sum, MAD_F_SCALEBITS));
+
+    sum = vmull_s32(vld1_s32((int32_t const *) &y[i + 18]), w6);
+    sum = vmlal_s32(sum, vld1_s32((int32_t const *) &y[i + 24]), w0);
+    vst1_s32((int32_t *) &z[i + 18], vrshrn_n_s64(sum, MAD_F_SCALEBITS));
+
+    vst1_s32((int32_t *) &z[i + 24],
+	     III_neon_mul(vld1_s32((int32_t const *) &y[i + 30]), w6));
+    vst1_s32((int32_t *) &z[i + 30], vdup_n_s32(0));
+  }
+}
+# else
 static
 void III_imdct_s(mad_fixed_t const X[18], mad_fixed_t z[36])
 {
@@ -2217,6 +2321,7 @@ void III_imdct_s(mad_fixed_t const X[18], mad_fixed_t z[36])
     ++wptr;
   }
 }
+# endif
 
 /*
  * NAME:	III_overlap()
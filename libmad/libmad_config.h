@@ -129,7 +129,17 @@
 /* Define to `int' if <sys/types.h> does not define. */
 /* #undef pid_t */
 
-#define FPM_DEFAULT 1
+/* Use the ARM multiply-accumulate instructions for fixed point math, and
+   NEON for the subband synthesis and layer III IMDCT where available. The
+   portable C version is kept for other hosts. */
+#if defined(__arm__)
+# define FPM_ARM 1
+# if defined(__ARM_NEON)
+#  define ASO_NEON 1
+# endif
+#else
+# define FPM_DEFAULT 1
+#endif
 
 #ifdef _MSC_VER
 #pragma warning (disable:4018)
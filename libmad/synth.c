@@ -27,6 +27,10 @@
 # include "frame.h"
 # include "synth.h"
 
+# if defined(ASO_NEON)
+#  include <arm_neon.h>
+# endif
+
 /*
  * NAME:	synth->init()
  * DESCRIPTION:	initialize synth struct
@@ -547,6 +551,176 @@ mad_fixed_t const D[17][32] = {
 # if defined(ASO_SYNTH)
 void synth_full(struct mad_synth *, struct mad_frame const *,
 		unsigned int, unsigned int);
+# elif defined(ASO_NEON) && !defined(OPT_SSO)
+/*
+ * The NEON version computes the same 64-bit sums of products as the C
+ * version below, two at a time, and rounds them the same way, so the output
+ * is bit-identical to it.
+ */
+
+/*
+ * NAME:	synth->neon_taps()
+ * DESCRIPTION:	load the window coefficients ptr[0], ptr[2], ..., ptr[14]
+ */
+static inline
+int32x4x2_t synth_neon_taps(mad_fixed_t const *ptr)
+{
+  int32x4x2_t taps;
+
+  taps.val[0] = vld2q_s32((int32_t const *) ptr + 0).val[0];
+  taps.val[1] = vld2q_s32((int32_t const *) ptr + 8).val[0];
+
+  return taps;
+}
+
+/*
+ * NAME:	synth->neon_taps_rev()
+ * DESCRIPTION:	load ptr[0], ptr[14], ptr[12], ..., ptr[2], the order in
+ *		which they meet the filter values of the even half
+ */
+static inline
+int32x4x2_t synth_neon_taps_rev(mad_fixed_t const *ptr)
+{
+  int32x4x2_t taps;
+  int32x4_t a, b;
+
+  taps = synth_neon_taps(ptr);
+
+  a = vrev64q_s32(taps.val[0]);
+  a = vcombine_s32(vget_high_s32(a), vget_low_s32(a));
+  b = vrev64q_s32(taps.val[1]);
+  b = vcombine_s32(vget_high_s32(b), vget_low_s32(b));
+
+  taps.val[0] = vextq_s32(a, b, 3);
+  taps.val[1] = vextq_s32(b, a, 3);
+
+  return taps;
+}
+
+/*
+ * NAME:	synth->neon_mla()
+ * DESCRIPTION:	add the products of eight filter values and taps to sum
+ */
+static inline
+int64x2_t synth_neon_mla(int64x2_t sum, mad_fixed_t const f[8],
+			 int32x4x2_t taps)
+{
+  int32x4_t f0 = vld1q_s32((int32_t const *) f + 0);
+  int32x4_t f1 = vld1q_s32((int32_t const *) f + 4);
+
+  sum = vmlal_s32(sum, vget_low_s32(f0),  vget_low_s32(taps.val[0]));
+  sum = vmlal_s32(sum, vget_high_s32(f0), vget_high_s32(taps.val[0]));
+  sum = vmlal_s32(sum, vget_low_s32(f1),  vget_low_s32(taps.val[1]));
+  sum = vmlal_s32(sum, vget_high_s32(f1), vget_high_s32(taps.val[1]));
+
+  return sum;
+}
+
+/*
+ * NAME:	synth->neon_mls()
+ * DESCRIPTION:	subtract the products of eight filter values and taps
+ */
+static inline
+int64x2_t synth_neon_mls(int64x2_t sum, mad_fixed_t const f[8],
+			 int32x4x2_t taps)
+{
+  int32x4_t f0 = vld1q_s32((int32_t const *) f + 0);
+  int32x4_t f1 = vld1q_s32((int32_t const *) f + 4);
+
+  sum = vmlsl_s32(sum, vget_low_s32(f0),  vget_low_s32(taps.val[0]));
+  sum = vmlsl_s32(sum, vget_high_s32(f0), vget_high_s32(taps.val[0]));
+  sum = vmlsl_s32(sum, vget_low_s32(f1),  vget_low_s32(taps.val[1]));
+  sum = vmlsl_s32(sum, vget_high_s32(f1), vget_high_s32(taps.val[1]));
+
+  return sum;
+}
+
+/*
+ * NAME:	synth->neon_scale()
+ * DESCRIPTION:	round a sum to a sample, like mad_f_scale64()
+ */
+static inline
+mad_fixed_t synth_neon_scale(int64x2_t sum)
+{
+  int64x1_t total = vadd_s64(vget_low_s64(sum), vget_high_s64(sum));
+
+  return (mad_fixed_t) vget_lane_s64(vrshr_n_s64(total, MAD_F_SCALEBITS), 0);
+}
+
+/*
+ * NAME:	synth->full()
+ * DESCRIPTION:	perform full frequency PCM synthesis
+ */
+static
+void synth_full(struct mad_synth *synth, struct mad_frame const *frame,
+		unsigned int nch, unsigned int ns)
+{
+  unsigned int phase, ch, s, sb, pe, po;
+  mad_fixed_t *pcm1, *pcm2, (*filter)[2][2][16][8];
+  mad_fixed_t const (*sbsample)[36][32];
+  mad_fixed_t (*fe)[8], (*fx)[8], (*fo)[8];
+  mad_fixed_t const (*Dptr)[32];
+  int64x2_t const zero = vdupq_n_s64(0);
+  int64x2_t sum;
+
+  for (ch = 0; ch < nch; ++ch) {
+    sbsample = &frame->sbsample[ch];
+    filter   = &synth->filter[ch];
+    phase    = synth->phase;
+    pcm1     = synth->pcm.samples[ch];
+
+    for (s = 0; s < ns; ++s) {
+      dct32((*sbsample)[s], phase >> 1,
+	    (*filter)[0][phase & 1], (*filter)[1][phase & 1]);
+
+      pe = phase & ~1;
+      po = ((phase - 1) & 0xf) | 1;
+
+      /* calculate 32 samples */
+
+      fe = &(*filter)[0][ phase & 1][0];
+      fx = &(*filter)[0][~phase & 1][0];
+      fo = &(*filter)[1][~phase & 1][0];
+
+      Dptr = &D[0];
+
+      sum = synth_neon_mls(zero, *fx, synth_neon_taps_rev(*Dptr + po));
+      sum = synth_neon_mla(sum,  *fe, synth_neon_taps_rev(*Dptr + pe));
+
+      *pcm1++ = synth_neon_scale(sum);
+
+      pcm2 = pcm1 + 30;
+
+      for (sb = 1; sb < 16; ++sb) {
+	++fe;
+	++Dptr;
+
+	/* D[32 - sb][i] == -D[sb][31 - i] */
+
+	sum = synth_neon_mls(zero, *fo, synth_neon_taps_rev(*Dptr + po));
+	sum = synth_neon_mla(sum,  *fe, synth_neon_taps_rev(*Dptr + pe));
+
+	*pcm1++ = synth_neon_scale(sum);
+
+	sum = synth_neon_mla(zero, *fe, synth_neon_taps(*Dptr + 15 - pe));
+	sum = synth_neon_mla(sum,  *fo, synth_neon_taps(*Dptr + 15 - po));
+
+	*pcm2-- = synth_neon_scale(sum);
+
+	++fo;
+      }
+
+      ++Dptr;
+
+      sum = synth_neon_mla(zero, *fo, synth_neon_taps_rev(*Dptr + po));
+
+      *pcm1 = -synth_neon_scale(sum);
+      pcm1 += 16;
+
+      phase = (phase + 1) % 16;
+    }
+  }
+}
 # else
 /*
  * NAME:	synth->full()
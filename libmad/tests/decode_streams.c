@@ -0,0 +1,463 @@
+/*
+ * libmad - MPEG audio decoder library
+ *
+ * Reference Layer III streams for the NEON conformance test. The streams
+ * are written here bit by bit, so the test needs no encoder: every frame
+ * has random scalefactors, gains and spectral values coded with Huffman
+ * table 1 and count1 table B, over the block types, stereo modes and
+ * sample rates the decoder handles differently. Each stream is decoded
+ * through the whole decoder and its PCM is written to stdout, so the
+ * scalar and NEON builds can be compared on real decoding paths.
+ */
+
+# include "libmad_config.h"
+
+# include "libmad_global.h"
+
+# include <stdio.h>
+# include <string.h>
+
+# include "fixed.h"
+# include "bit.h"
+# include "stream.h"
+# include "frame.h"
+# include "synth.h"
+
+# define STREAM_MAX_FRAMES  48
+# define STREAM_MAX_FRAME   1044
+
+enum {
+  MODE_STEREO       = 0,
+  MODE_JOINT_STEREO = 1,
+  MODE_MONO         = 3
+};
+
+enum {
+  EXT_I_STEREO  = 0x1,
+  EXT_MS_STEREO = 0x2
+};
+
+struct stream_params {
+  char const *name;
+  int lsf;			/* MPEG-2 low sampling frequencies */
+  unsigned int samplerate_index;
+  unsigned int mode;
+  unsigned int mode_extension;
+  int block_switching;
+  unsigned int frames;
+};
+
+static struct stream_params const streams[] = {
+  { "long blocks, stereo",         0, 0, MODE_STEREO,       0,
+    0, 24 },
+  { "block switching, ms stereo",  0, 0, MODE_JOINT_STEREO, EXT_MS_STEREO,
+    1, 48 },
+  { "intensity and ms stereo",     0, 0, MODE_JOINT_STEREO,
+    EXT_I_STEREO | EXT_MS_STEREO, 1, 32 },
+  { "block switching, mono 48kHz", 0, 1, MODE_MONO,         0,
+    1, 32 },
+  { "mpeg-2 22.05kHz, ms stereo",  1, 0, MODE_JOINT_STEREO, EXT_MS_STEREO,
+    1, 48 }
+};
+
+struct channel_params {
+  unsigned int part2_3_length;
+  unsigned int big_values;
+  unsigned int global_gain;
+  unsigned int scalefac_compress;
+  unsigned int block_type;
+  unsigned int mixed_block;
+  unsigned int region0_count;
+  unsigned int region1_count;
+  unsigned int subblock_gain[3];
+  unsigned int preflag;
+  unsigned int scalefac_scale;
+};
+
+struct bit_writer {
+  unsigned char *data;
+  unsigned long bit;
+};
+
+/* slen1 and slen2 of the MPEG-1 scalefac_compress values */
+static
+unsigned char const sflen[16][2] = {
+  { 0, 0 }, { 0, 1 }, { 0, 2 }, { 0, 3 }, { 3, 0 }, { 1, 1 }, { 1, 2 }, { 1, 3 },
+  { 2, 1 }, { 2, 2 }, { 2, 3 }, { 3, 1 }, { 3, 2 }, { 3, 3 }, { 4, 2 }, { 4, 3 }
+};
+
+/* MPEG-2 scalefactor counts per slen, for long, short and mixed blocks */
+static
+unsigned char const nsfb_lsf[3][4] = {
+  { 6, 5, 5, 5 }, { 9, 9, 9, 9 }, { 6, 9, 9, 9 }
+};
+
+static unsigned long long seed = 0x9E3779B97F4A7C15ULL;
+
+/*
+ * NAME:	random_bits()
+ * DESCRIPTION:	return an unsigned xorshift value of the given width
+ */
+static
+unsigned int random_bits(int bits)
+{
+  seed ^= seed << 13;
+  seed ^= seed >> 7;
+  seed ^= seed << 17;
+
+  return bits ? (unsigned int) (seed >> (64 - bits)) : 0;
+}
+
+static
+unsigned int random_below(unsigned int n)
+{
+  return random_bits(16) % n;
+}
+
+/*
+ * NAME:	put_bits()
+ * DESCRIPTION:	append the low n bits of value, most significant first
+ */
+static
+void put_bits(struct bit_writer *writer, unsigned long value, unsigned int n)
+{
+  while (n--) {
+    unsigned char *byte = &writer->data[writer->bit / 8];
+    unsigned int shift  = 7 - writer->bit % 8;
+
+    *byte = (*byte & ~(1 << shift)) | (((value >> n) & 1) << shift);
+    ++writer->bit;
+  }
+}
+
+/*
+ * NAME:	put_scalefactors()
+ * DESCRIPTION:	write random scalefactors in the layout libmad reads them
+ */
+static
+void put_scalefactors(struct bit_writer *writer, struct channel_params *ch,
+		      int lsf)
+{
+  unsigned int part, i;
+
+  if (lsf) {
+    unsigned int slen[4], index;
+
+    /* scalefac_compress < 400: four slen values, no preflag */
+    slen[0] = random_below(5);
+    slen[1] = random_below(5);
+    slen[2] = random_below(4);
+    slen[3] = random_below(4);
+
+    ch->scalefac_compress = ((slen[0] * 5 + slen[1]) << 4) |
+      (slen[2] << 2) | slen[3];
+    ch->preflag = 0;
+
+    index = (ch->block_type == 2) ? (ch->mixed_block ? 2 : 1) : 0;
+
+    for (part = 0; part < 4; ++part) {
+      for (i = 0; i < nsfb_lsf[index][part]; ++i)
+	put_bits(writer, random_bits(slen[part]), slen[part]);
+    }
+  }
+  else {
+    unsigned int slen1, slen2, n1, n2;
+
+    ch->scalefac_compress = random_below(16);
+
+    slen1 = sflen[ch->scalefac_compress][0];
+    slen2 = sflen[ch->scalefac_compress][1];
+
+    if (ch->block_type == 2) {
+      n1 = ch->mixed_block ? 8 + 3 * 3 : 6 * 3;
+      n2 = 6 * 3;
+    }
+    else {
+      n1 = 6 + 5;
+      n2 = 5 + 5;
+    }
+
+    for (i = 0; i < n1; ++i)
+      put_bits(writer, random_bits(slen1), slen1);
+    for (i = 0; i < n2; ++i)
+      put_bits(writer, random_bits(slen2), slen2);
+  }
+}
+
+/*
+ * NAME:	put_spectrum()
+ * DESCRIPTION:	write random big_values pairs with Huffman table 1 and
+ *		quadruples with count1 table B
+ */
+static
+void put_spectrum(struct bit_writer *writer, struct channel_params *ch)
+{
+  unsigned int i, quads, max_quads;
+
+  ch->big_values = random_below(100);
+
+  for (i = 0; i < ch->big_values; ++i) {
+    unsigned int x = random_bits(1), y = random_bits(1);
+
+    /* 1: (0,0), 01: (1,0), 001: (0,1), 000: (1,1) */
+    if (!x && !y)
+      put_bits(writer, 1, 1);
+    else if (x && !y)
+      put_bits(writer, 1, 2);
+    else if (!x && y)
+      put_bits(writer, 1, 3);
+    else
+      put_bits(writer, 0, 3);
+
+    if (x)
+      put_bits(writer, random_bits(1), 1);
+    if (y)
+      put_bits(writer, random_bits(1), 1);
+  }
+
+  max_quads = (572 - 2 * ch->big_values) / 4 + 1;
+  quads = random_below(60);
+  if (quads > max_quads)
+    quads = max_quads;
+
+  for (i = 0; i < quads; ++i) {
+    unsigned int value = random_bits(4), n;
+
+    /* table B codes vwxy as its complement, then one sign per 1 bit */
+    put_bits(writer, 15 - value, 4);
+
+    for (n = 0; n < 4; ++n) {
+      if (value & (8 >> n))
+	put_bits(writer, random_bits(1), 1);
+    }
+  }
+}
+
+/*
+ * NAME:	put_sideinfo()
+ * DESCRIPTION:	write the side info of one frame, main data starts right
+ *		after it
+ */
+static
+void put_sideinfo(struct bit_writer *writer, struct stream_params const *p,
+		  unsigned int nch, struct channel_params ch[2][2])
+{
+  unsigned int ngr = p->lsf ? 1 : 2, gr, c, i;
+
+  put_bits(writer, 0, p->lsf ? 8 : 9);		/* main_data_begin */
+  put_bits(writer, 0, p->lsf ? (nch == 1 ? 1 : 2) : (nch == 1 ? 5 : 3));
+
+  if (!p->lsf)
+    put_bits(writer, 0, 4 * nch);		/* scfsi */
+
+  for (gr = 0; gr < ngr; ++gr) {
+    for (c = 0; c < nch; ++c) {
+      struct channel_params *channel = &ch[gr][c];
+
+      put_bits(writer, channel->part2_3_length, 12);
+      put_bits(writer, channel->big_values, 9);
+      put_bits(writer, channel->global_gain, 8);
+      put_bits(writer, channel->scalefac_compress, p->lsf ? 9 : 4);
+
+      if (channel->block_type) {
+	put_bits(writer, 1, 1);
+	put_bits(writer, channel->block_type, 2);
+	put_bits(writer, channel->mixed_block, 1);
+
+	for (i = 0; i < 2; ++i)
+	  put_bits(writer, 1, 5);		/* table_select */
+	for (i = 0; i < 3; ++i)
+	  put_bits(writer, channel->subblock_gain[i], 3);
+      }
+      else {
+	put_bits(writer, 0, 1);
+
+	for (i = 0; i < 3; ++i)
+	  put_bits(writer, 1, 5);
+	put_bits(writer, channel->region0_count, 4);
+	put_bits(writer, channel->region1_count, 3);
+      }
+
+      if (!p->lsf)
+	put_bits(writer, channel->preflag, 1);
+      put_bits(writer, channel->scalefac_scale, 1);
+      put_bits(writer, 1, 1);			/* count1 table B */
+    }
+  }
+}
+
+/*
+ * NAME:	next_block_type()
+ * DESCRIPTION:	long, start, short and stop blocks in the order encoders
+ *		switch them
+ */
+static
+unsigned int next_block_type(unsigned int block_type)
+{
+  switch (block_type) {
+  case 0:
+    return random_below(3) ? 0 : 1;
+  case 1:
+    return 2;
+  case 2:
+    return random_below(2) ? 2 : 3;
+  default:
+    return 0;
+  }
+}
+
+/*
+ * NAME:	build_stream()
+ * DESCRIPTION:	write the frames of a stream, return its length in bytes
+ */
+static
+unsigned int build_stream(struct stream_params const *p, unsigned char *data)
+{
+  static unsigned char main_data[STREAM_MAX_FRAME];
+  unsigned int nch = (p->mode == MODE_MONO) ? 1 : 2;
+  unsigned int ngr = p->lsf ? 1 : 2;
+  unsigned int length, size = 0, frame, gr, c, block_type = 0;
+
+  /* 320 kbit/s for MPEG-1, 160 kbit/s for MPEG-2, no padding */
+  if (p->lsf)
+    length = 72000 * 160 / (p->samplerate_index == 1 ? 24000 : 22050);
+  else
+    length = 144000 * 320 / (p->samplerate_index == 1 ? 48000 : 44100);
+
+  for (frame = 0; frame < p->frames; ++frame) {
+    struct channel_params ch[2][2];
+    struct bit_writer writer, main_writer;
+    unsigned char *header = data + size;
+
+    memset(header, 0, length);
+    memset(main_data, 0, sizeof(main_data));
+    memset(ch, 0, sizeof(ch));
+
+    header[0] = 0xff;
+    header[1] = p->lsf ? 0xf3 : 0xfb;
+    header[2] = (14 << 4) | (p->samplerate_index << 2);
+    header[3] = (p->mode << 6) | (p->mode_extension << 4);
+
+    main_writer.data = main_data;
+    main_writer.bit  = 0;
+
+    for (gr = 0; gr < ngr; ++gr) {
+      unsigned int mixed = 0;
+
+      if (p->block_switching) {
+	block_type = next_block_type(block_type);
+	mixed = (block_type == 2) && !random_below(4);
+      }
+
+      for (c = 0; c < nch; ++c) {
+	struct channel_params *channel = &ch[gr][c];
+	unsigned long start = main_writer.bit;
+
+	/* joint stereo needs the same blocks in both channels */
+	channel->block_type  = block_type;
+	channel->mixed_block = mixed;
+
+	/* every eighth frame is louder, up to clipping */
+	channel->global_gain    = 130 + random_below((frame % 8 == 7) ? 80 : 50);
+	channel->region0_count  = random_below(8);
+	channel->region1_count  = random_below(8);
+	channel->subblock_gain[0] = random_below(8);
+	channel->subblock_gain[1] = random_below(8);
+	channel->subblock_gain[2] = random_below(8);
+	channel->preflag        = p->lsf ? 0 : random_bits(1);
+	channel->scalefac_scale = random_bits(1);
+
+	put_scalefactors(&main_writer, channel, p->lsf);
+	put_spectrum(&main_writer, channel);
+
+	channel->part2_3_length = main_writer.bit - start;
+      }
+    }
+
+    writer.data = header + 4;
+    writer.bit  = 0;
+
+    put_sideinfo(&writer, p, nch, ch);
+
+    if (4 + writer.bit / 8 + (main_writer.bit + 7) / 8 > length) {
+      fprintf(stderr, "%s: frame %u does not fit\n", p->name, frame);
+      return 0;
+    }
+
+    memcpy(header + 4 + writer.bit / 8, main_data, (main_writer.bit + 7) / 8);
+
+    size += length;
+  }
+
+  return size;
+}
+
+/*
+ * NAME:	decode_streams()
+ * DESCRIPTION:	build and decode every stream, writing its PCM to stdout;
+ *		return 0 if every frame was decoded without errors
+ */
+int decode_streams(void)
+{
+  static unsigned char data[STREAM_MAX_FRAMES * STREAM_MAX_FRAME +
+			    MAD_BUFFER_GUARD];
+  struct mad_stream stream;
+  struct mad_frame frame;
+  struct mad_synth synth;
+  unsigned int i, ch;
+  int result = 0;
+
+  for (i = 0; i < sizeof(streams) / sizeof(streams[0]); ++i) {
+    struct stream_params const *p = &streams[i];
+    unsigned int size, frames = 0, errors = 0;
+
+    memset(data, 0, sizeof(data));
+
+    size = build_stream(p, data);
+    if (size == 0) {
+      result = 1;
+      continue;
+    }
+
+    mad_stream_init(&stream);
+    mad_frame_init(&frame);
+    mad_synth_init(&synth);
+
+    mad_stream_buffer(&stream, data, size + MAD_BUFFER_GUARD);
+
+    while (1) {
+      if (mad_frame_decode(&frame, &stream) == -1) {
+	/* only the guard bytes are left */
+	if (stream.error == MAD_ERROR_BUFLEN || stream.this_frame >= data + size)
+	  break;
+
+	if (MAD_RECOVERABLE(stream.error)) {
+	  ++errors;
+	  continue;
+	}
+
+	break;
+      }
+
+      mad_synth_frame(&synth, &frame);
+
+      for (ch = 0; ch < synth.pcm.channels; ++ch)
+	fwrite(synth.pcm.samples[ch], sizeof(mad_fixed_t),
+	       synth.pcm.length, stdout);
+
+      ++frames;
+    }
+
+    if (errors || frames != p->frames) {
+      fprintf(stderr, "%s: %u of %u frames decoded, %u errors\n",
+	      p->name, frames, p->frames, errors);
+      result = 1;
+    }
+
+    mad_synth_finish(&synth);
+    mad_frame_finish(&frame);
+    mad_stream_finish(&stream);
+  }
+
+  return result;
+}
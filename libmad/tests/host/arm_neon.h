@@ -0,0 +1,194 @@
+/*
+ * libmad - MPEG audio decoder library
+ *
+ * Host version of the NEON intrinsics used by synth.c and layer3.c, for the
+ * NEON conformance test. Lanes are plain arrays and every operation follows
+ * the ARM definition: 64-bit accumulations wrap around, and the rounding
+ * shifts add 1 << (n - 1) before shifting without losing the carry.
+ *
+ * Only what the kernels use is here; a new intrinsic in the kernels has to
+ * be added to this file as well.
+ */
+
+# ifndef LIBMAD_TESTS_ARM_NEON_H
+# define LIBMAD_TESTS_ARM_NEON_H
+
+# include <stdint.h>
+
+typedef struct { int32_t v[2]; } int32x2_t;
+typedef struct { int32_t v[4]; } int32x4_t;
+typedef struct { int64_t v[1]; } int64x1_t;
+typedef struct { int64_t v[2]; } int64x2_t;
+typedef struct { int32x4_t val[2]; } int32x4x2_t;
+
+/* --- loads and stores ---------------------------------------------------- */
+
+static inline int32x2_t vld1_s32(int32_t const *p)
+{
+  int32x2_t r = { { p[0], p[1] } };
+  return r;
+}
+
+static inline int32x4_t vld1q_s32(int32_t const *p)
+{
+  int32x4_t r = { { p[0], p[1], p[2], p[3] } };
+  return r;
+}
+
+static inline int32x4x2_t vld2q_s32(int32_t const *p)
+{
+  int32x4x2_t r;
+  int i;
+
+  for (i = 0; i < 4; ++i) {
+    r.val[0].v[i] = p[2 * i];
+    r.val[1].v[i] = p[2 * i + 1];
+  }
+
+  return r;
+}
+
+static inline void vst1_s32(int32_t *p, int32x2_t a)
+{
+  p[0] = a.v[0];
+  p[1] = a.v[1];
+}
+
+static inline void vst1q_s32(int32_t *p, int32x4_t a)
+{
+  int i;
+
+  for (i = 0; i < 4; ++i)
+    p[i] = a.v[i];
+}
+
+/* --- lane moves ---------------------------------------------------------- */
+
+static inline int32x2_t vdup_n_s32(int32_t x)
+{
+  int32x2_t r = { { x, x } };
+  return r;
+}
+
+static inline int64x2_t vdupq_n_s64(int64_t x)
+{
+  int64x2_t r = { { x, x } };
+  return r;
+}
+
+static inline int32x2_t vget_low_s32(int32x4_t a)
+{
+  int32x2_t r = { { a.v[0], a.v[1] } };
+  return r;
+}
+
+static inline int32x2_t vget_high_s32(int32x4_t a)
+{
+  int32x2_t r = { { a.v[2], a.v[3] } };
+  return r;
+}
+
+static inline int64x1_t vget_low_s64(int64x2_t a)
+{
+  int64x1_t r = { { a.v[0] } };
+  return r;
+}
+
+static inline int64x1_t vget_high_s64(int64x2_t a)
+{
+  int64x1_t r = { { a.v[1] } };
+  return r;
+}
+
+static inline int64_t vget_lane_s64(int64x1_t a, int lane)
+{
+  return a.v[lane];
+}
+
+static inline int32x4_t vcombine_s32(int32x2_t a, int32x2_t b)
+{
+  int32x4_t r = { { a.v[0], a.v[1], b.v[0], b.v[1] } };
+  return r;
+}
+
+static inline int32x4_t vrev64q_s32(int32x4_t a)
+{
+  int32x4_t r = { { a.v[1], a.v[0], a.v[3], a.v[2] } };
+  return r;
+}
+
+static inline int32x4_t vextq_s32(int32x4_t a, int32x4_t b, int n)
+{
+  int32_t t[8];
+  int32x4_t r;
+  int i;
+
+  for (i = 0; i < 4; ++i) {
+    t[i]     = a.v[i];
+    t[i + 4] = b.v[i];
+  }
+
+  for (i = 0; i < 4; ++i)
+    r.v[i] = t[i + n];
+
+  return r;
+}
+
+/* --- arithmetic ---------------------------------------------------------- */
+
+static inline int64x2_t vmull_s32(int32x2_t a, int32x2_t b)
+{
+  int64x2_t r;
+  int i;
+
+  for (i = 0; i < 2; ++i)
+    r.v[i] = (int64_t) a.v[i] * b.v[i];
+
+  return r;
+}
+
+static inline int64x2_t vmlal_s32(int64x2_t s, int32x2_t a, int32x2_t b)
+{
+  int i;
+
+  for (i = 0; i < 2; ++i)
+    s.v[i] = (int64_t) ((uint64_t) s.v[i] + (uint64_t) ((int64_t) a.v[i] * b.v[i]));
+
+  return s;
+}
+
+static inline int64x2_t vmlsl_s32(int64x2_t s, int32x2_t a, int32x2_t b)
+{
+  int i;
+
+  for (i = 0; i < 2; ++i)
+    s.v[i] = (int64_t) ((uint64_t) s.v[i] - (uint64_t) ((int64_t) a.v[i] * b.v[i]));
+
+  return s;
+}
+
+static inline int64x1_t vadd_s64(int64x1_t a, int64x1_t b)
+{
+  int64x1_t r = { { (int64_t) ((uint64_t) a.v[0] + (uint64_t) b.v[0]) } };
+  return r;
+}
+
+static inline int64_t neon_rshr_s64(int64_t x, int n)
+{
+  return (int64_t) (((__int128) x + ((__int128) 1 << (n - 1))) >> n);
+}
+
+static inline int64x1_t vrshr_n_s64(int64x1_t a, int n)
+{
+  int64x1_t r = { { neon_rshr_s64(a.v[0], n) } };
+  return r;
+}
+
+static inline int32x2_t vrshrn_n_s64(int64x2_t a, int n)
+{
+  int32x2_t r = { { (int32_t) neon_rshr_s64(a.v[0], n),
+		    (int32_t) neon_rshr_s64(a.v[1], n) } };
+  return r;
+}
+
+# endif
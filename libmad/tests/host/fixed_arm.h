@@ -0,0 +1,66 @@
+/*
+ * libmad - MPEG audio decoder library
+ *
+ * Host build of the FPM_ARM fixed point math, for the NEON conformance test.
+ *
+ * fixed.h only has the ARM version as inline assembly, so this header is
+ * force-included before everything else: it pulls in fixed.h through the
+ * portable FPM_64BIT branch for the types and constants, then replaces the
+ * multiply macros with C versions computing exactly what smull, smlal and
+ * the rounding movs/adc pair do.
+ */
+
+# ifndef LIBMAD_TESTS_FIXED_ARM_H
+# define LIBMAD_TESTS_FIXED_ARM_H
+
+# if !defined(__arm__)
+#  error "build with -D__arm__ so that libmad_config.h selects FPM_ARM"
+# endif
+
+# include "libmad_config.h"
+
+# define FPM_64BIT
+# include "fixed.h"
+# undef FPM_64BIT
+
+# undef mad_f_mul
+# undef MAD_F_ML0
+# undef MAD_F_MLA
+# undef MAD_F_MLN
+# undef MAD_F_MLZ
+# undef mad_f_scale64
+
+/* smull, then round to nearest on bit MAD_F_SCALEBITS - 1 */
+# define mad_f_mul(x, y)  \
+    ((mad_fixed_t)  \
+     ((((mad_fixed64_t) (x) * (y)) +  \
+       (1LL << (MAD_F_SCALEBITS - 1))) >> MAD_F_SCALEBITS))
+
+# define MAD_F_MLX(hi, lo, x, y)  \
+    do {  \
+      mad_fixed64_t __t = (mad_fixed64_t) (x) * (y);  \
+      (hi) = (mad_fixed64hi_t) (__t >> 32);  \
+      (lo) = (mad_fixed64lo_t) __t;  \
+    } while (0)
+
+/* smlal wraps around in 64 bits */
+# define MAD_F_MLA(hi, lo, x, y)  \
+    do {  \
+      unsigned long long __t =  \
+	((unsigned long long) (unsigned int) (hi) << 32 | (unsigned int) (lo)) +  \
+	(unsigned long long) ((mad_fixed64_t) (x) * (y));  \
+      (hi) = (mad_fixed64hi_t) (__t >> 32);  \
+      (lo) = (mad_fixed64lo_t) __t;  \
+    } while (0)
+
+# define MAD_F_ML0(hi, lo, x, y)	MAD_F_MLX((hi), (lo), (x), (y))
+# define MAD_F_MLN(hi, lo)		((hi) = ((lo) = -(lo)) ? ~(hi) : -(hi))
+# define MAD_F_MLZ(hi, lo)		mad_f_scale64((hi), (lo))
+
+# define mad_f_scale64(hi, lo)  \
+    ((mad_fixed_t)  \
+     ((mad_fixed64_t)  \
+      (((unsigned long long) (unsigned int) (hi) << 32 | (unsigned int) (lo)) +  \
+       (1ULL << (MAD_F_SCALEBITS - 1))) >> MAD_F_SCALEBITS))
+
+# endif
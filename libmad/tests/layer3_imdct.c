@@ -0,0 +1,19 @@
+/*
+ * libmad - MPEG audio decoder library
+ *
+ * Builds layer3.c as part of the NEON conformance test and exposes its
+ * static IMDCT routines to the test driver.
+ */
+
+# include "../layer3.c"
+
+void test_imdct_l(mad_fixed_t const X[18], mad_fixed_t z[36],
+		  unsigned int block_type)
+{
+  III_imdct_l(X, z, block_type);
+}
+
+void test_imdct_s(mad_fixed_t const X[18], mad_fixed_t z[36])
+{
+  III_imdct_s(X, z);
+}
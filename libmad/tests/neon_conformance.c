@@ -0,0 +1,106 @@
+/*
+ * libmad - MPEG audio decoder library
+ *
+ * NEON conformance test. The same driver is built twice, once with the
+ * scalar FPM_ARM code and once with ASO_NEON, and both builds write every
+ * output sample to stdout: the kernels on random input first, then the
+ * PCM of the reference streams in decode_streams.c. The Makefile compares
+ * the two outputs byte for byte: the NEON kernels have to be bit-identical
+ * to the C versions.
+ */
+
+# include "libmad_config.h"
+
+# include "libmad_global.h"
+
+# include <stdio.h>
+
+# include "fixed.h"
+# include "frame.h"
+# include "synth.h"
+
+# if defined(__ARM_NEON) && !defined(ASO_NEON)
+#  error "the NEON build did not select ASO_NEON"
+# endif
+
+# define TEST_FRAMES  200
+
+void test_imdct_l(mad_fixed_t const [18], mad_fixed_t [36], unsigned int);
+void test_imdct_s(mad_fixed_t const [18], mad_fixed_t [36]);
+int decode_streams(void);
+
+static unsigned long long seed = 88172645463325252ULL;
+
+/*
+ * NAME:	random_fixed()
+ * DESCRIPTION:	return a signed xorshift value of the given width
+ */
+static
+mad_fixed_t random_fixed(int bits)
+{
+  seed ^= seed << 13;
+  seed ^= seed >> 7;
+  seed ^= seed << 17;
+
+  return (mad_fixed_t) (seed >> (64 - bits)) - (1L << (bits - 1));
+}
+
+static
+void write_samples(mad_fixed_t const *samples, unsigned int count)
+{
+  fwrite(samples, sizeof(mad_fixed_t), count, stdout);
+}
+
+int main(void)
+{
+  static struct mad_synth synth;
+  static struct mad_frame frame;
+  mad_fixed_t X[18], z[36];
+  unsigned int i, ch, s, sb, block_type;
+  int bits;
+
+  mad_synth_init(&synth);
+  mad_frame_init(&frame);
+
+  frame.header.layer      = MAD_LAYER_III;
+  frame.header.mode       = MAD_MODE_STEREO;
+  frame.header.samplerate = 44100;
+
+  for (i = 0; i < TEST_FRAMES; ++i) {
+    /* alternate between normal levels and values close to overflow */
+    bits = (i & 1) ? 30 : 26;
+
+    for (ch = 0; ch < 2; ++ch) {
+      for (s = 0; s < 36; ++s) {
+	for (sb = 0; sb < 32; ++sb)
+	  frame.sbsample[ch][s][sb] = random_fixed(bits);
+      }
+    }
+
+    mad_synth_frame(&synth, &frame);
+
+    for (ch = 0; ch < synth.pcm.channels; ++ch)
+      write_samples(synth.pcm.samples[ch], synth.pcm.length);
+
+    /* block types 0, 1 and 3 are long blocks, 2 is three short blocks */
+    for (block_type = 0; block_type < 4; ++block_type) {
+      for (s = 0; s < 18; ++s)
+	X[s] = random_fixed((i & 1) ? 30 : 27);
+
+      if (block_type == 2)
+	test_imdct_s(X, z);
+      else
+	test_imdct_l(X, z, block_type);
+
+      write_samples(z, 36);
+    }
+  }
+
+  mad_frame_finish(&frame);
+  mad_synth_finish(&synth);
+
+  if (decode_streams() != 0)
+    return 1;
+
+  return ferror(stdout) ? 1 : 0;
+}
@@ -28,10 +28,14 @@
 #include "network_download.h"
 #include "context_menu.h"
 #include "archive.h"
+#include "archive_cache.h"
 #include "photo.h"
+#include "thumbnail.h"
 #include "audioplayer.h"
 #include "file.h"
 #include "text.h"
+#include "file_search.h"
+#include "compare.h"
 #include "hex.h"
 #include "settings.h"
 #include "adhoc_dialog.h"
@@ -81,6 +85,8 @@ static volatile int dialog_step = DIALOG_STEP_NONE;
 
 static char install_path[MAX_PATH_LENGTH];
 static char compress_name[MAX_NAME_LENGTH];
+static char search_in_files_term[MAX_NAME_LENGTH];
+static int search_in_archives = 0;
 
 static SceUID usbdevice_modid = -1;
 
@@ -455,6 +461,7 @@ int dialogSteps() {
 
         // Also clear install_list to prevent unwanted installations
         fileListEmpty(&install_list);
+        finishInstallSession();
 
         refresh = REFRESH_MODE_SETFOCUS;
         setDialogStep(DIALOG_STEP_NONE);
@@ -886,6 +893,121 @@ int dialogSteps() {
       break;
     }
     
+    case DIALOG_STEP_SEARCH_IN_FILES_TERM:
+    {
+      if (ime_result == IME_DIALOG_RESULT_FINISHED) {
+        char *term = (char *)getImeDialogInputTextUTF8();
+        if (term[0] == '\0') {
+          setDialogStep(DIALOG_STEP_NONE);
+        } else {
+          strcpy(search_in_files_term, term);
+
+          initMessageDialog(SCE_MSG_DIALOG_BUTTON_TYPE_YESNO, language_container[SEARCH_IN_ARCHIVES_QUESTION]);
+          setDialogStep(DIALOG_STEP_SEARCH_IN_FILES_QUESTION);
+        }
+      } else if (ime_result == IME_DIALOG_RESULT_CANCELED) {
+        setDialogStep(DIALOG_STEP_NONE);
+      }
+
+      break;
+    }
+
+    case DIALOG_STEP_SEARCH_IN_FILES_QUESTION:
+    {
+      if (msg_result == MESSAGE_DIALOG_RESULT_YES || msg_result == MESSAGE_DIALOG_RESULT_NO) {
+        search_in_archives = (msg_result == MESSAGE_DIALOG_RESULT_YES);
+
+        initMessageDialog(MESSAGE_DIALOG_PROGRESS_BAR, language_container[SEARCHING]);
+        setDialogStep(DIALOG_STEP_SEARCH_IN_FILES_CONFIRMED);
+      }
+
+      break;
+    }
+
+    case DIALOG_STEP_SEARCH_IN_FILES_CONFIRMED:
+    {
+      if (msg_result == MESSAGE_DIALOG_RESULT_RUNNING) {
+        FileListEntry *file_entry = fileListGetNthEntry(&file_list, base_pos + rel_pos);
+        if (!file_entry) {
+          closeWaitDialog();
+          setDialogStep(DIALOG_STEP_NONE);
+          break;
+        }
+
+        // Search the folder or the file
+        snprintf(cur_file, MAX_PATH_LENGTH, "%s%s", file_list.path, file_entry->name);
+
+        FileSearchArguments args;
+        args.path = cur_file;
+        args.term = search_in_files_term;
+        args.flags = 0;
+        args.archives = search_in_archives;
+
+        setDialogStep(DIALOG_STEP_SEARCHING_FILES);
+
+        SceUID thid = sceKernelCreateThread("file_search_thread", (SceKernelThreadEntry)file_search_thread, 0x40, 0x100000, 0, 0, NULL);
+        if (thid >= 0)
+          sceKernelStartThread(thid, sizeof(FileSearchArguments), &args);
+      }
+
+      break;
+    }
+
+    case DIALOG_STEP_SEARCHED_FILES:
+    {
+      if (msg_result == MESSAGE_DIALOG_RESULT_NONE ||
+          msg_result == MESSAGE_DIALOG_RESULT_FINISHED) {
+        setDialogStep(DIALOG_STEP_NONE);
+
+        fileSearchViewer();
+        fileSearchFree();
+
+        refresh = REFRESH_MODE_NORMAL;
+      }
+
+      break;
+    }
+
+    case DIALOG_STEP_COMPARE_QUESTION:
+    {
+      if (msg_result == MESSAGE_DIALOG_RESULT_YES) {
+        initMessageDialog(MESSAGE_DIALOG_PROGRESS_BAR, language_container[COMPARING]);
+        setDialogStep(DIALOG_STEP_COMPARE_CONFIRMED);
+      } else if (msg_result == MESSAGE_DIALOG_RESULT_NO) {
+        setDialogStep(DIALOG_STEP_NONE);
+      }
+
+      break;
+    }
+
+    case DIALOG_STEP_COMPARE_CONFIRMED:
+    {
+      if (msg_result == MESSAGE_DIALOG_RESULT_RUNNING) {
+        setDialogStep(DIALOG_STEP_COMPARING);
+
+        SceUID thid = sceKernelCreateThread("compare_thread", (SceKernelThreadEntry)compare_thread, 0x40, 0x100000, 0, 0, NULL);
+        if (thid >= 0)
+          sceKernelStartThread(thid, 0, NULL);
+      }
+
+      break;
+    }
+
+    case DIALOG_STEP_COMPARED_FILES:
+    {
+      if (msg_result == MESSAGE_DIALOG_RESULT_NONE ||
+          msg_result == MESSAGE_DIALOG_RESULT_FINISHED) {
+        setDialogStep(DIALOG_STEP_NONE);
+
+        compareViewer();
+        compareFree();
+
+        refresh = REFRESH_MODE_NORMAL;
+      }
+
+      break;
+    }
+
     case DIALOG_STEP_INSTALL_QUESTION:
     {
       if (msg_result == MESSAGE_DIALOG_RESULT_YES) {
@@ -922,6 +1044,8 @@ int dialogSteps() {
         SceUID thid = sceKernelCreateThread("install_thread", (SceKernelThreadEntry)install_thread, 0x40, 0x100000, 0, 0, NULL);
         if (thid >= 0)
           sceKernelStartThread(thid, sizeof(InstallArguments), &args);
+        else
+          finishInstallSession(); // The queue stops here
       }
 
       break;
@@ -1180,6 +1304,7 @@ int dialogSteps() {
       if (ime_result == IME_DIALOG_RESULT_FINISHED) {
         char *password = (char *)getImeDialogInputTextUTF8();
         if (password[0] == '\0') {
+          cancelEnterArchive();
           setDialogStep(DIALOG_STEP_NONE);
         } else {
           // TODO: verify password
@@ -1187,14 +1312,19 @@ int dialogSteps() {
           
           FileListEntry *file_entry = fileListGetNthEntry(&file_list, base_pos + rel_pos);
           if (!file_entry) {
+            cancelEnterArchive();
             setDialogStep(DIALOG_STEP_NONE);
             break;
           }
           
-          setInArchive();
-          setDirArchiveLevel();
-
-          snprintf(archive_path, MAX_PATH_LENGTH, "%s%s", file_list.path, file_entry->name);
+          char path[MAX_PATH_LENGTH];
+          snprintf(path, MAX_PATH_LENGTH, "%s%s", file_list.path, file_entry->name);
+          int res = enterArchive(path);
+          if (res < 0) {
+            cancelEnterArchive();
+            errorDialog(res);
+            break;
+          }
 
           strcat(file_list.path, file_entry->name);
           addEndSlash(file_list.path);
@@ -1205,6 +1335,7 @@ int dialogSteps() {
           setDialogStep(DIALOG_STEP_NONE);
         }
       } else if (ime_result == IME_DIALOG_RESULT_CANCELED) {
+        cancelEnterArchive();
         setDialogStep(DIALOG_STEP_NONE);
       }
 
@@ -1474,9 +1605,15 @@ int main(int argc, const char *argv[]) {
   // Create mutex
   sceKernelCreateLwMutex(&dialog_mutex, "dialog_mutex", 2, 0, NULL);
 
+  // Init promoter lock, needed before initVitaShell's updater cleanup
+  initPromoter();
+
   // Init VitaShell
   initVitaShell();
 
+  // Move back titles staged by an interrupted refresh
+  refreshRestoreJournal();
+
   // No custom config, in case they are damaged or unuseable
   readPad();
   if (current_pad[PAD_LTRIGGER])
@@ -1487,9 +1624,16 @@ int main(int argc, const char *argv[]) {
   loadTheme();
   loadLanguage(language);
 
+  // Init archive entry cache
+  initArchiveCache(vitashell_config.archive_cache_size);
+
+  // Init thumbnail generator
+  initThumbnails();
+
   // Init context menu width
   initContextMenuWidth();
   initTextContextMenuWidth();
+  initHexContextMenuWidth();
   
   // Automatic network update
   if (!vitashell_config.disable_autoupdate) {
@@ -166,6 +166,14 @@ extern float current_font_size;
 #define FILE_LIST_END_Y (START_Y + MAX_ENTRIES * FONT_Y_SPACE)
 #define FILE_LIST_AREA_HEIGHT (MAX_ENTRIES * FONT_Y_SPACE)
 
+// Thumbnail grid
+#define GRID_COLUMNS 5
+#define GRID_ROWS 3
+#define GRID_ENTRIES (GRID_COLUMNS * GRID_ROWS)
+#define GRID_CELL_WIDTH (MARK_WIDTH / GRID_COLUMNS)
+#define GRID_CELL_HEIGHT 125.0f
+#define GRID_THUMBNAIL_Y 4.0f
+
 enum RefreshModes {
   REFRESH_MODE_NONE,
   REFRESH_MODE_NORMAL,
@@ -242,6 +250,17 @@ enum DialogSteps {
   DIALOG_STEP_HASH_SHA256_CONFIRMED,
   DIALOG_STEP_HASHING_SHA256,
 
+  DIALOG_STEP_SEARCH_IN_FILES_TERM,
+  DIALOG_STEP_SEARCH_IN_FILES_QUESTION,
+  DIALOG_STEP_SEARCH_IN_FILES_CONFIRMED,
+  DIALOG_STEP_SEARCHING_FILES,
+  DIALOG_STEP_SEARCHED_FILES,
+
+  DIALOG_STEP_COMPARE_QUESTION,
+  DIALOG_STEP_COMPARE_CONFIRMED,
+  DIALOG_STEP_COMPARING,
+  DIALOG_STEP_COMPARED_FILES,
+
   DIALOG_STEP_SETTINGS_AGREEMENT,
   DIALOG_STEP_SETTINGS_STRING,
   
@@ -20,6 +20,7 @@
 #include "browser.h"
 #include "init.h"
 #include "io_process.h"
+#include "package_installer.h"
 #include "context_menu.h"
 #include "file.h"
 #include "language.h"
@@ -30,6 +31,7 @@
 #include "utils.h"
 #include "usb.h"
 #include "pfs.h"
+#include "compare.h"
 
 // External variables from main.c
 extern char last_installed_titleid[12];
@@ -150,6 +152,8 @@ enum MenuMoreEntrys {
   MENU_MORE_ENTRY_INSTALL_ALL,
   MENU_MORE_ENTRY_INSTALL_FOLDER,
   MENU_MORE_ENTRY_EXPORT_MEDIA,
+  MENU_MORE_ENTRY_SEARCH_IN_FILES,
+  MENU_MORE_ENTRY_COMPARE_FILES,
 };
 
 MenuEntry menu_more_entries[] = {
@@ -160,6 +164,8 @@ MenuEntry menu_more_entries[] = {
   { INSTALL_ALL,      5, 0, CTX_INVISIBLE },
   { INSTALL_FOLDER,   6, 0, CTX_INVISIBLE },
   { EXPORT_MEDIA,     7, 0, CTX_INVISIBLE },
+  { SEARCH_IN_FILES,  9, 0, CTX_INVISIBLE },
+  { COMPARE_FILES,   10, 0, CTX_INVISIBLE },
 };
 
 #define N_MENU_MORE_ENTRIES (sizeof(menu_more_entries) / sizeof(MenuEntry))
@@ -581,6 +587,7 @@ void setContextMenuMoreVisibilities() {
 
   // Invisble entries when on '..'
   if (strcmp(file_entry->name, DIR_UP) == 0) {
+    menu_more_entries[MENU_MORE_ENTRY_SEARCH_IN_FILES].visibility = CTX_INVISIBLE;
     menu_more_entries[MENU_MORE_ENTRY_COMPRESS].visibility = CTX_INVISIBLE;
     menu_more_entries[MENU_MORE_ENTRY_INSTALL_ALL].visibility = CTX_INVISIBLE;
     menu_more_entries[MENU_MORE_ENTRY_INSTALL_FOLDER].visibility = CTX_INVISIBLE;
@@ -601,6 +608,14 @@ void setContextMenuMoreVisibilities() {
     menu_more_entries[MENU_MORE_ENTRY_CALCULATE_SHA256].visibility = CTX_INVISIBLE;
   }
 
+  // Archives are searched from the outside
+  if (isInArchive())
+    menu_more_entries[MENU_MORE_ENTRY_SEARCH_IN_FILES].visibility = CTX_INVISIBLE;
+
+  // Compare only visible when exactly two files are marked
+  if (isInArchive() || mark_list.length != 2 || mark_list.head->is_folder || mark_list.head->next->is_folder)
+    menu_more_entries[MENU_MORE_ENTRY_COMPARE_FILES].visibility = CTX_INVISIBLE;
+
   if (file_entry->is_folder) {
     menu_more_entries[MENU_MORE_ENTRY_CALCULATE_SHA1].visibility = CTX_INVISIBLE;
     menu_more_entries[MENU_MORE_ENTRY_CALCULATE_MD5].visibility = CTX_INVISIBLE;
@@ -637,6 +652,7 @@ void setContextMenuMoreVisibilities() {
 
   // Clear install_list when refreshing context menu to prevent unwanted installations
   fileListEmpty(&install_list);
+  finishInstallSession();
 
   // Invisible export for non-media files
   if (!file_entry->is_folder &&
@@ -1270,6 +1286,7 @@ static int contextMenuMoreEnterCallback(int sel, void *context) {
       if (getDialogStep() == DIALOG_STEP_NONE) {
         // Empty install list
         fileListEmpty(&install_list);
+        finishInstallSession();
 
         FileListEntry *file_entry = file_list.head->next; // Ignore '..'
 
@@ -1331,6 +1348,34 @@ static int contextMenuMoreEnterCallback(int sel, void *context) {
       break;
     }
 
+    case MENU_MORE_ENTRY_SEARCH_IN_FILES:
+    {
+      initImeDialog(language_container[ENTER_SEARCH_TERM], "", MAX_NAME_LENGTH, SCE_IME_TYPE_DEFAULT, 0, 0);
+      setDialogStep(DIALOG_STEP_SEARCH_IN_FILES_TERM);
+      break;
+    }
+
+    case MENU_MORE_ENTRY_COMPARE_FILES:
+    {
+      char path[MAX_PATH_LENGTH], other_path[MAX_PATH_LENGTH];
+      snprintf(path, MAX_PATH_LENGTH, "%s%s", file_list.path, mark_list.head->name);
+      snprintf(other_path, MAX_PATH_LENGTH, "%s%s", file_list.path, mark_list.head->next->name);
+
+      // Files of different sizes can't be equal, ask before reading them
+      int res = compareSetFiles(path, other_path);
+      if (res < 0) {
+        errorDialog(res);
+      } else if (res == 0) {
+        initMessageDialog(SCE_MSG_DIALOG_BUTTON_TYPE_YESNO, language_container[COMPARE_SIZE_MISMATCH_QUESTION]);
+        setDialogStep(DIALOG_STEP_COMPARE_QUESTION);
+      } else {
+        initMessageDialog(MESSAGE_DIALOG_PROGRESS_BAR, language_container[COMPARING]);
+        setDialogStep(DIALOG_STEP_COMPARE_CONFIRMED);
+      }
+
+      break;
+    }
+
     case MENU_MORE_ENTRY_CALCULATE_SHA1:
     {
       // Ensure user wants to actually take the hash
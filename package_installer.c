@@ -17,6 +17,7 @@
 */
 
 #include "main.h"
+#include "browser.h"
 #include "io_process.h"
 #include "package_installer.h"
 #include "archive.h"
@@ -60,113 +61,167 @@ static int unloadScePaf() {
     );
 }
 
-int promoteCma(const char *path, const char *titleid, int type) {
+// PAF and the promoter module are loaded once per session and shared by
+// every promoter call made while the session is open
+static int promoter_refs = 0;
+static PromoterStats promoter_stats;
+
+// The promoter may be used from several threads, e.g. while refreshing
+static SceKernelLwMutexWork promoter_mutex;
+
+void initPromoter() {
+  sceKernelCreateLwMutex(&promoter_mutex, "promoter_mutex", 2, 0, NULL);
+}
+
+int promoterSessionOpen() {
   int res;
-  
-  ScePromoterUtilityImportParams promoteArgs;
-  memset(&promoteArgs,0x00,sizeof(ScePromoterUtilityImportParams));
-  strncpy(promoteArgs.path,path,0x7F);
-  strncpy(promoteArgs.titleid,titleid,0xB);
-  promoteArgs.type = type;
-  promoteArgs.attribute = 0x1;
+  uint64_t time;
+
+  sceKernelLockLwMutex(&promoter_mutex, 1, NULL);
+
+  if (promoter_refs > 0) {
+    promoter_refs++;
+    sceKernelUnlockLwMutex(&promoter_mutex, 1);
+    return 0;
+  }
 
+  memset(&promoter_stats, 0, sizeof(PromoterStats));
+  time = sceKernelGetProcessTimeWide();
+
+  // A session only counts once everything is loaded, a failed open
+  // unloads what it loaded so that no reference is left to release it
   res = loadScePaf();
   if (res < 0)
-    return res;
+    goto EXIT;
 
   res = sceSysmoduleLoadModuleInternal(SCE_SYSMODULE_INTERNAL_PROMOTER_UTIL);
   if (res < 0)
-    return res;
+    goto UNLOAD_PAF;
 
   res = scePromoterUtilityInit();
   if (res < 0)
-    return res;
+    goto UNLOAD_PROMOTER;
 
-  res = scePromoterUtilityPromoteImport(&promoteArgs);
-  if (res < 0)
-    return res;
+  promoter_stats.load_time = sceKernelGetProcessTimeWide() - time;
+  promoter_refs = 1;
+  res = 0;
+  goto EXIT;
 
+UNLOAD_PROMOTER:
+  sceSysmoduleUnloadModuleInternal(SCE_SYSMODULE_INTERNAL_PROMOTER_UTIL);
+UNLOAD_PAF:
+  unloadScePaf();
+EXIT:
+  sceKernelUnlockLwMutex(&promoter_mutex, 1);
+  return res;
+}
+
+int promoterSessionClose() {
+  int res, ret;
+  uint64_t time;
+
+  sceKernelLockLwMutex(&promoter_mutex, 1, NULL);
+
+  res = -1;
+  if (promoter_refs <= 0)
+    goto EXIT;
+
+  res = 0;
+  if (--promoter_refs > 0)
+    goto EXIT;
+
+  time = sceKernelGetProcessTimeWide();
+
+  // Unload everything even if a step fails, the next open loads it again
   res = scePromoterUtilityExit();
-  if (res < 0)
-    return res;
 
-  res = sceSysmoduleUnloadModuleInternal(SCE_SYSMODULE_INTERNAL_PROMOTER_UTIL);
-  if (res < 0)
-    return res;
+  ret = sceSysmoduleUnloadModuleInternal(SCE_SYSMODULE_INTERNAL_PROMOTER_UTIL);
+  if (res >= 0)
+    res = ret;
 
-  res = unloadScePaf();
-  if (res < 0)
-    return res;
+  ret = unloadScePaf();
+  if (res >= 0)
+    res = ret;
 
+  promoter_stats.unload_time = sceKernelGetProcessTimeWide() - time;
+
+EXIT:
+  sceKernelUnlockLwMutex(&promoter_mutex, 1);
   return res;
 }
 
-int promoteApp(const char *path) {
+// The stats of the open session, or of the last one once it is closed
+void promoterSessionGetStats(PromoterStats *stats) {
+  sceKernelLockLwMutex(&promoter_mutex, 1, NULL);
+  memcpy(stats, &promoter_stats, sizeof(PromoterStats));
+  sceKernelUnlockLwMutex(&promoter_mutex, 1);
+}
+
+int promoteCma(const char *path, const char *titleid, int type) {
   int res;
+  uint64_t time;
+  
+  ScePromoterUtilityImportParams promoteArgs;
+  memset(&promoteArgs,0x00,sizeof(ScePromoterUtilityImportParams));
+  strncpy(promoteArgs.path,path,0x7F);
+  strncpy(promoteArgs.titleid,titleid,0xB);
+  promoteArgs.type = type;
+  promoteArgs.attribute = 0x1;
 
-  res = loadScePaf();
+  res = promoterSessionOpen();
   if (res < 0)
     return res;
 
-  res = sceSysmoduleLoadModuleInternal(SCE_SYSMODULE_INTERNAL_PROMOTER_UTIL);
-  if (res < 0)
-    return res;
+  sceKernelLockLwMutex(&promoter_mutex, 1, NULL);
+  time = sceKernelGetProcessTimeWide();
+  res = scePromoterUtilityPromoteImport(&promoteArgs);
+  promoter_stats.promote_time += sceKernelGetProcessTimeWide() - time;
+  promoter_stats.promote_count++;
+  sceKernelUnlockLwMutex(&promoter_mutex, 1);
 
-  res = scePromoterUtilityInit();
-  if (res < 0)
-    return res;
+  promoterSessionClose();
 
-  res = scePromoterUtilityPromotePkgWithRif(path, 1);
-  if (res < 0)
-    return res;
+  return res;
+}
 
-  res = scePromoterUtilityExit();
-  if (res < 0)
-    return res;
+int promoteApp(const char *path) {
+  int res;
+  uint64_t time;
 
-  res = sceSysmoduleUnloadModuleInternal(SCE_SYSMODULE_INTERNAL_PROMOTER_UTIL);
+  res = promoterSessionOpen();
   if (res < 0)
     return res;
 
-  res = unloadScePaf();
-  if (res < 0)
-    return res;
+  sceKernelLockLwMutex(&promoter_mutex, 1, NULL);
+  time = sceKernelGetProcessTimeWide();
+  res = scePromoterUtilityPromotePkgWithRif(path, 1);
+  promoter_stats.promote_time += sceKernelGetProcessTimeWide() - time;
+  promoter_stats.promote_count++;
+  sceKernelUnlockLwMutex(&promoter_mutex, 1);
+
+  promoterSessionClose();
 
   return res;
 }
 
 int deleteApp(const char *titleid) {
   int res;
+  uint64_t time;
 
   sceAppMgrDestroyOtherApp();
 
-  res = loadScePaf();
-  if (res < 0)
-    return res;
-
-  res = sceSysmoduleLoadModuleInternal(SCE_SYSMODULE_INTERNAL_PROMOTER_UTIL);
-  if (res < 0)
-    return res;
-
-  res = scePromoterUtilityInit();
+  res = promoterSessionOpen();
   if (res < 0)
     return res;
 
+  sceKernelLockLwMutex(&promoter_mutex, 1, NULL);
+  time = sceKernelGetProcessTimeWide();
   res = scePromoterUtilityDeletePkg(titleid);
-  if (res < 0)
-    return res;
+  promoter_stats.delete_time += sceKernelGetProcessTimeWide() - time;
+  promoter_stats.delete_count++;
+  sceKernelUnlockLwMutex(&promoter_mutex, 1);
 
-  res = scePromoterUtilityExit();
-  if (res < 0)
-    return res;
-
-  res = sceSysmoduleUnloadModuleInternal(SCE_SYSMODULE_INTERNAL_PROMOTER_UTIL);
-  if (res < 0)
-    return res;
-
-  res = unloadScePaf();
-  if (res < 0)
-    return res;
+  promoterSessionClose();
 
   return res;
 }
@@ -174,34 +229,24 @@ int deleteApp(const char *titleid) {
 int checkAppExist(const char *titleid) {
   int res;
   int ret;
+  uint64_t time;
 
-  res = loadScePaf();
+  res = promoterSessionOpen();
   if (res < 0)
-    return res;
-
-  res = sceSysmoduleLoadModuleInternal(SCE_SYSMODULE_INTERNAL_PROMOTER_UTIL);
-  if (res < 0)
-    return res;
-
-  res = scePromoterUtilityInit();
-  if (res < 0)
-    return res;
+    return 0;
 
+  sceKernelLockLwMutex(&promoter_mutex, 1, NULL);
+  time = sceKernelGetProcessTimeWide();
   ret = scePromoterUtilityCheckExist(titleid, &res);
-  if (res < 0)
-    return res;
-
-  res = scePromoterUtilityExit();
-  if (res < 0)
-    return res;
+  promoter_stats.check_time += sceKernelGetProcessTimeWide() - time;
+  promoter_stats.check_count++;
+  sceKernelUnlockLwMutex(&promoter_mutex, 1);
 
-  res = sceSysmoduleUnloadModuleInternal(SCE_SYSMODULE_INTERNAL_PROMOTER_UTIL);
-  if (res < 0)
-    return res;
+  promoterSessionClose();
 
-  res = unloadScePaf();
+  // A failed check does not mean the app exists
   if (res < 0)
-    return res;
+    return 0;
 
   return ret >= 0;
 }
@@ -347,6 +392,16 @@ int installPackage(const char *file) {
   return 0;
 }
 
+// Set while the install queue holds a promoter session
+static int install_session = 0;
+
+// Releases the promoter session of the install queue, e.g. when the
+// queue is cleared before its last package was installed
+void finishInstallSession() {
+  if (__atomic_exchange_n(&install_session, 0, __ATOMIC_ACQ_REL))
+    promoterSessionClose();
+}
+
 int install_thread(SceSize args_size, InstallArguments *args) {
   int res;
   SceUID thid = -1;
@@ -357,6 +412,10 @@ int install_thread(SceSize args_size, InstallArguments *args) {
   // Lock power timers
   powerLock();
 
+  // Keep the promoter loaded across the whole install queue
+  if (!__atomic_load_n(&install_session, __ATOMIC_ACQUIRE) && promoterSessionOpen() >= 0)
+    __atomic_store_n(&install_session, 1, __ATOMIC_RELEASE);
+
   // Set progress to 0%
   sceMsgDialogProgressBarSetValue(SCE_MSG_DIALOG_PROGRESSBAR_TARGET_BAR_DEFAULT, 0);
   sceKernelDelayThread(200 * 1000); // Further optimized to 200ms for even faster dialog opening
@@ -555,6 +614,10 @@ EXIT:
   // Recursively clean up package_temp directory
   removePath(PACKAGE_DIR, NULL);
 
+  // Release the promoter unless the next queued package follows
+  if (!(getDialogStep() == DIALOG_STEP_INSTALLED && install_list.length > 0))
+    finishInstallSession();
+
   // Unlock power timers
   powerUnlock();
 
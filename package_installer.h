@@ -30,6 +30,23 @@ typedef struct {
   char *file;
 } InstallArguments;
 
+typedef struct {
+  uint64_t load_time;
+  uint64_t unload_time;
+  uint64_t check_time;
+  uint64_t promote_time;
+  uint64_t delete_time;
+  int check_count;
+  int promote_count;
+  int delete_count;
+} PromoterStats;
+
+void initPromoter();
+
+int promoterSessionOpen();
+int promoterSessionClose();
+void promoterSessionGetStats(PromoterStats *stats);
+
 int promoteApp(const char *path);
 int promoteCma(const char *path, const char *titleid, int type);
 int promotePsp(const char *path);
@@ -40,6 +57,7 @@ int checkAppExist(const char *titleid);
 int makeHeadBin();
 
 int installPackage(const char *file);
+void finishInstallSession();
 int install_thread(SceSize args_size, InstallArguments *args);
 
 #endif
@@ -21,102 +21,90 @@
 #include "pbp.h"
 #include "sfo.h"
 
-int read_content_id_data_psp(SceUID pbp_fd, char* content_id) {
-  DataPspHeader data_psp_header;
+// Larger reads make hashing 1-2 GB eboots far less syscall-bound
+#define PBP_HASH_BUFFER_SIZE (256 * 1024)
 
-  // read data.psp header
-  int read_sz = sceIoRead(pbp_fd, &data_psp_header, sizeof(DataPspHeader));
-  if(read_sz < sizeof(DataPspHeader)) return 0;
+// Enough of data.psar to cover the NPUMDIMG header and the PGD magic
+#define PBP_PSAR_HEADER_SIZE 0x408
 
-  // copy the content id from data.psp header to this content_id buffer
-  strncpy(content_id, data_psp_header.content_id, 0x30);
-  
-  return (strlen(content_id) == 36);
+static int is_content_id_valid(const char* content_id) {
+  return strnlen(content_id, 0x30) == 0x24;
 }
 
-int read_content_id_npumdimg(SceUID pbp_fd, char* content_id) {
-  NpUmdImgHeader npumdimg_header;
-  
-  // read npumd header
-  int read_sz = sceIoRead(pbp_fd, &npumdimg_header, sizeof(NpUmdImgHeader));
-  if(read_sz < sizeof(NpUmdImgHeader)) return 0;
-  
-  // copy the content id from npumdimg_header to this content_id buffer
-  strncpy(content_id, npumdimg_header.content_id, 0x30);
-  
-  return (strlen(content_id) == 36);
-}
+// check psx eboot is signed.
+// this is to filter out psx2psp eboots, and other such tools.
+// which could never work from the vita's LiveSpace.
+static int is_psx_signed(const uint8_t* psar, int psar_size, int pbp_type) {
+  // iso header
+  int offset = (pbp_type == PBP_TYPE_PSISOIMG) ? 0x400 : 0x200;
+  if(psar_size < offset + 4)
+    return PBP_TYPE_UNKNOWN;
 
-int is_psx_signed(SceUID pbp_fd, int data_psar_offset, int pbp_type) { // check psx eboot is signed.
-  char pgd_magic[0x4];                                                 // this is to filter out psx2psp eboots, and other such tools.
-                                                                       // which could never work from the vita's LiveSpace.
-  // seek to iso header
-  if(pbp_type == PBP_TYPE_PSISOIMG)
-    sceIoLseek(pbp_fd, data_psar_offset+0x400, SCE_SEEK_SET);
-  else          
-    sceIoLseek(pbp_fd, data_psar_offset+0x200, SCE_SEEK_SET);
-
-  // read magic
-  int read_len = sceIoRead(pbp_fd, pgd_magic, sizeof(pgd_magic));
-  if(read_len < sizeof(pgd_magic))
-	  return PBP_TYPE_UNKNOWN;
-  
   // if is not PGD, then it is not a signed PSX PBP.
-  if(memcmp(pgd_magic, "\0PGD", sizeof(pgd_magic)) == 0)
+  if(memcmp(&psar[offset], "\0PGD", 4) == 0)
     return pbp_type;
   else
     return PBP_TYPE_UNKNOWN;
 }
 
-int determine_pbp_type(SceUID pbp_fd, PbpHeader* pbp_header) {
-  char data_psar_magic[0x8];
-  
-  int read_sz = sceIoRead(pbp_fd, pbp_header, sizeof(PbpHeader));
-  if(read_sz < sizeof(PbpHeader)) return 0;
-  
-  // seek to data.psar
-  sceIoLseek(pbp_fd, pbp_header->data_psar_ptr, SCE_SEEK_SET);
-  
+// Read the header, the pbp type and the content id with as few reads as possible
+int pbp_open(PbpHandle* pbp, const char* pbp_file) {
+  uint8_t psar[PBP_PSAR_HEADER_SIZE];
+
+  memset(pbp, 0, sizeof(PbpHandle));
+  pbp->type = PBP_TYPE_UNKNOWN;
+  pbp->hash_thid = -1;
+
+  pbp->fd = sceIoOpen(pbp_file, SCE_O_RDONLY, 0);
+  if(pbp->fd < 0)
+    return pbp->fd;
+
+  int read_sz = sceIoPread(pbp->fd, &pbp->header, sizeof(PbpHeader), 0);
+  if(read_sz < (int)sizeof(PbpHeader))
+    return 0;
+  pbp->header_valid = 1;
+
   // read magic value to determine pbp type
-  read_sz = sceIoRead(pbp_fd, data_psar_magic, sizeof(data_psar_magic));
-  if(read_sz < sizeof(data_psar_magic)) return 0;
-  
-  if(memcmp(data_psar_magic, "NPUMDIMG", 0x8) == 0) { // psp
-    return PBP_TYPE_NPUMDIMG;
-  }
-  else if(memcmp(data_psar_magic, "PSISOIMG", 0x8) == 0) { // ps1 single disc
-    return is_psx_signed(pbp_fd, pbp_header->data_psar_ptr, PBP_TYPE_PSISOIMG);
-  }
-  else if(memcmp(data_psar_magic, "PSTITLEI", 0x8) == 0) { // ps1 multi disc
-    return is_psx_signed(pbp_fd, pbp_header->data_psar_ptr, PBP_TYPE_PSTITLEIMG);
+  int psar_size = sceIoPread(pbp->fd, psar, sizeof(psar), pbp->header.data_psar_ptr);
+  if(psar_size < 0x8)
+    return 0;
+
+  if(memcmp(psar, "NPUMDIMG", 0x8) == 0) { // psp
+    pbp->type = PBP_TYPE_NPUMDIMG;
+
+    // read content_id from npumdimg
+    if(psar_size >= (int)sizeof(NpUmdImgHeader))
+      strncpy(pbp->content_id, ((NpUmdImgHeader*)psar)->content_id, 0x30);
   }
-  else{ // update package, homebrew, etc, 
-    return PBP_TYPE_UNKNOWN; 
+  else if(memcmp(psar, "PSISOIMG", 0x8) == 0 || memcmp(psar, "PSTITLEI", 0x8) == 0) { // ps1 single/multi disc
+    pbp->type = is_psx_signed(psar, psar_size, (psar[2] == 'I') ? PBP_TYPE_PSISOIMG : PBP_TYPE_PSTITLEIMG);
+
+    // read content_id from data.psp
+    if(pbp->type != PBP_TYPE_UNKNOWN) {
+      DataPspHeader data_psp_header;
+      read_sz = sceIoPread(pbp->fd, &data_psp_header, sizeof(DataPspHeader), pbp->header.data_psp_ptr);
+      if(read_sz >= (int)sizeof(DataPspHeader))
+        strncpy(pbp->content_id, data_psp_header.content_id, 0x30);
+    }
   }
-  
-  if(read_sz < sizeof(PbpHeader)) return PBP_TYPE_UNKNOWN;
+  // else update package, homebrew, etc,
+
+  pbp->content_id_valid = is_content_id_valid(pbp->content_id);
+
+  return 0;
 }
 
-int read_data_psar_header(SceUID pbp_fd, char* content_id) {
-  PbpHeader pbp_header;
-  int pbp_type = determine_pbp_type(pbp_fd, &pbp_header);
-  if(pbp_type == PBP_TYPE_NPUMDIMG) {
-    // seek to start of npumdimg
-    sceIoLseek(pbp_fd, pbp_header.data_psar_ptr, SCE_SEEK_SET);
-    
-    // read content_id from npumdimg
-    return read_content_id_npumdimg(pbp_fd, content_id);
+void pbp_close(PbpHandle* pbp) {
+  // never close the file under a running hash
+  if(pbp->hash_thid >= 0) {
+    sceKernelWaitThreadEnd(pbp->hash_thid, NULL, NULL);
+    pbp->hash_thid = -1;
   }
-  else if(pbp_type == PBP_TYPE_PSISOIMG || pbp_type == PBP_TYPE_PSTITLEIMG) {
-    // seek to start of data.psp
-    sceIoLseek(pbp_fd, pbp_header.data_psp_ptr, SCE_SEEK_SET);
 
-    // read content_id from data.psp
-    return read_content_id_data_psp(pbp_fd, content_id);	  
+  if(pbp->fd >= 0) {
+    sceIoClose(pbp->fd);
+    pbp->fd = -1;
   }
-  else {
-    return 0; 
-  }  
 }
 
 void get_sce_discinfo_sig(char* sce_discinfo, char* disc_id) {
@@ -137,25 +125,22 @@ void get_sce_discinfo_sig(char* sce_discinfo, char* disc_id) {
   sceIoClose(discinfo_fd);
 }
 
-int read_sfo(SceUID pbp_fd, void** param_sfo_buffer){
-  PbpHeader pbp_header;
-  // read pbp header
-  int read_sz = sceIoRead(pbp_fd, &pbp_header, sizeof(PbpHeader));
-  if(read_sz < sizeof(PbpHeader)) return 0;
+int pbp_read_sfo(PbpHandle* pbp, void** param_sfo_buffer) {
+  if(param_sfo_buffer == NULL) return 0;
+  *param_sfo_buffer = NULL;
+
+  if(!pbp->header_valid) return 0;
 
   // get sfo size
-  int param_sfo_size = pbp_header.icon0_png_ptr - pbp_header.param_sfo_ptr;
+  int param_sfo_size = pbp->header.icon0_png_ptr - pbp->header.param_sfo_ptr;
   if(param_sfo_size <= 0) return 0;
   
   // allocate a buffer for the param.sfo file
   *param_sfo_buffer = malloc(param_sfo_size);
   if(*param_sfo_buffer == NULL) return 0;
   
-  // seek to the start of param.sfo
-  sceIoLseek(pbp_fd, pbp_header.param_sfo_ptr, SCE_SEEK_SET);
-  
   // read the param.sfo file
-  read_sz = sceIoRead(pbp_fd, *param_sfo_buffer,  param_sfo_size);
+  int read_sz = sceIoPread(pbp->fd, *param_sfo_buffer, param_sfo_size, pbp->header.param_sfo_ptr);
   if(read_sz < param_sfo_size) {
      free(*param_sfo_buffer);
      *param_sfo_buffer = NULL;
@@ -165,107 +150,76 @@ int read_sfo(SceUID pbp_fd, void** param_sfo_buffer){
   return param_sfo_size;
 }
 
-int hash_pbp(SceUID pbp_fd, unsigned char* out_hash) {
-  unsigned char wbuf[0x7c0]; 
-  
-  // seek to the start of the eboot.pbp
-  sceIoLseek(pbp_fd, 0x00, SCE_SEEK_SET);
-  
-  // inital read
-  int read_sz = sceIoRead(pbp_fd, wbuf, sizeof(wbuf));
-  if(read_sz < sizeof(PbpHeader)) return read_sz;
-  
+static int hash_pbp(PbpHandle* pbp, unsigned char* out_hash) {
+  if(!pbp->header_valid) return 0;
+
+  uint8_t *buf = memalign(64, PBP_HASH_BUFFER_SIZE);
+  if(buf == NULL) return VITASHELL_ERROR_NO_MEMORY;
+
   // calculate data hash size
-  size_t hash_sz = (((PbpHeader*)wbuf)->data_psar_ptr + 0x1C0000);
+  SceOff hash_sz = (SceOff)pbp->header.data_psar_ptr + 0x1C0000;
+  SceOff total_hashed = 0;
 
   // initalize hash
   SHA256_CTX ctx;
   sha256_init(&ctx);
   
-  // first hash
-  sha256_update(&ctx, wbuf, read_sz);
-  size_t total_hashed = read_sz;  
-  
-  do {
-    read_sz = sceIoRead(pbp_fd, wbuf, sizeof(wbuf));
-    
-    if((total_hashed + read_sz) > hash_sz)
-      read_sz = (hash_sz - total_hashed); // calculate remaining 
+  while(total_hashed < hash_sz) {
+    int size = PBP_HASH_BUFFER_SIZE;
+    if((total_hashed + size) > hash_sz)
+      size = (int)(hash_sz - total_hashed); // calculate remaining 
+
+    int read_sz = sceIoPread(pbp->fd, buf, size, total_hashed);
+    if(read_sz <= 0) // treat EOF as complete
+      break;
     
-    sha256_update(&ctx, wbuf, read_sz);
+    sha256_update(&ctx, buf, read_sz);
     total_hashed += read_sz;
-    
-    if(read_sz < sizeof(wbuf)) // treat EOF as complete
-      total_hashed = hash_sz;
-    
-  } while(total_hashed < hash_sz);
+
+    if(read_sz < size)
+      break;
+  }
   
   sha256_final(&ctx, out_hash);
+  free(buf);
   
   return 1;
 }
 
-
-int get_pbp_sfo(const char* pbp_file, void** param_sfo_buffer) {
-  PbpHeader pbp_header;
-  
-  if(param_sfo_buffer == NULL) return 0;
-  *param_sfo_buffer = NULL;
-  
-  int res = 0;
-  
-  if(pbp_file != NULL) {
-    SceUID pbp_fd = sceIoOpen(pbp_file, SCE_O_RDONLY, 0);
-    if(pbp_fd < 0) return 0;
-    
-    // read param.sfo from pbp
-    res = read_sfo(pbp_fd, param_sfo_buffer);
-    
-    sceIoClose(pbp_fd);
-  }
-  
-  return res;
+static int pbp_hash_thread(SceSize args, void *argp) {
+  PbpHandle *pbp = *(PbpHandle **)argp;
+  pbp->hash_res = hash_pbp(pbp, pbp->hash);
+  return sceKernelExitDeleteThread(0);
 }
 
-int get_pbp_type(const char* pbp_file) {
-  int res = 0;
-  PbpHeader pbp_header;
-  if(pbp_file != NULL) {
-    SceUID pbp_fd = sceIoOpen(pbp_file, SCE_O_RDONLY, 0);
-    if(pbp_fd < 0)
-      return 0;
-    
-    res = determine_pbp_type(pbp_fd, &pbp_header);
-    
-    sceIoClose(pbp_fd);
-  }
-  
-  return res;
+// Hash the eboot in the background, while the caller does other work
+int pbp_hash_start(PbpHandle* pbp) {
+  if(pbp->hash_thid >= 0 || pbp->hash_done)
+    return 0;
+
+  pbp->hash_thid = sceKernelCreateThread("pbp_hash_thread", (SceKernelThreadEntry)pbp_hash_thread, 0x10000100, 0x4000, 0, 0, NULL);
+  if(pbp->hash_thid < 0)
+    return pbp->hash_thid;
+
+  pbp->hash_done = 1;
+  sceKernelStartThread(pbp->hash_thid, sizeof(PbpHandle *), &pbp);
+  return 0;
 }
 
-int get_pbp_content_id(const char* pbp_file, char* content_id) {  
-  int res = 0;
-  
-  if(pbp_file != NULL && content_id != NULL) {
-    SceUID pbp_fd = sceIoOpen(pbp_file, SCE_O_RDONLY, 0);
-    if(pbp_fd < 0)
-      return 0;
-    res = read_data_psar_header(pbp_fd, content_id);
-    
-    // check the content id is valid
-    if(res) {
-      int content_id_len = strnlen(content_id, 0x30);
-      if(content_id_len != 0x24) res = 0;
-    }
-   
-    sceIoClose(pbp_fd);
+int pbp_hash_wait(PbpHandle* pbp, unsigned char* out_hash) {
+  if(pbp->hash_thid >= 0) {
+    sceKernelWaitThreadEnd(pbp->hash_thid, NULL, NULL);
+    pbp->hash_thid = -1;
+  } else if(!pbp->hash_done) {
+    pbp->hash_res = hash_pbp(pbp, pbp->hash);
+    pbp->hash_done = 1;
   }
-  
-  return res;
-  
+
+  memcpy(out_hash, pbp->hash, sizeof(pbp->hash));
+  return pbp->hash_res;
 }
 
-int gen_sce_ebootpbp(const char* psp_game_folder, char* disc_id) {
+int gen_sce_ebootpbp(PbpHandle* pbp, const char* psp_game_folder, char* disc_id) {
   int res = 0;
   
   unsigned char pbp_hash[0x20];
@@ -273,7 +227,6 @@ int gen_sce_ebootpbp(const char* psp_game_folder, char* disc_id) {
   char sce_discinfo[0x100];
   
   int sw_version = 0;
-  PbpHeader pbp_header;
   
   if(psp_game_folder != NULL) {
     char ebootpbp_path[MAX_PATH_LENGTH];  
@@ -285,20 +238,13 @@ int gen_sce_ebootpbp(const char* psp_game_folder, char* disc_id) {
     memset(pbp_hash, 0x00, sizeof(pbp_hash));
     memset(sce_ebootpbp, 0x00, sizeof(pbp_hash));
  
-    SceUID pbp_fd = sceIoOpen(ebootpbp_path, SCE_O_RDONLY, 0);
-    
-    if(pbp_fd < 0)
-      return res;
-    
-    int pbp_type = determine_pbp_type(pbp_fd, &pbp_header); // determine pbp header
+    int pbp_type = pbp->type;
 
     if(pbp_type == PBP_TYPE_PSISOIMG || pbp_type == PBP_TYPE_NPUMDIMG)
-      res = hash_pbp(pbp_fd, pbp_hash); // hash eboot.pbp
+      res = pbp_hash_wait(pbp, pbp_hash); // hash eboot.pbp
     if(pbp_type == PBP_TYPE_PSTITLEIMG)
       get_sce_discinfo_sig(sce_discinfo, disc_id); // read sce_discinfo
 
-    sceIoClose(pbp_fd);
-
     if(pbp_type == PBP_TYPE_UNKNOWN)
       return res;
   
@@ -316,4 +262,4 @@ int gen_sce_ebootpbp(const char* psp_game_folder, char* disc_id) {
     }
   }
   return res;
-}
\ No newline at end of file
+}
@@ -98,8 +98,25 @@ typedef struct PbpHeader
   SceUInt32 data_psar_ptr;
 } PbpHeader;
 
-int get_pbp_type(const char* pbp_file);
-int get_pbp_sfo(const char* pbp_file, void** param_sfo_buffer);
-int get_pbp_content_id(const char* pbp_file, char* content_id);
-int gen_sce_ebootpbp(const char* psp_game_folder, char* disc_id);
-#endif
\ No newline at end of file
+// An opened EBOOT.PBP, with its header and section info read once
+typedef struct PbpHandle {
+  SceUID fd;
+  PbpHeader header;
+  int header_valid;
+  PbpType type;
+  char content_id[0x31];
+  int content_id_valid;
+  // Hash of the eboot, computed by pbp_hash_start/pbp_hash_wait
+  SceUID hash_thid;
+  int hash_done;
+  int hash_res;
+  unsigned char hash[0x20];
+} PbpHandle;
+
+int pbp_open(PbpHandle* pbp, const char* pbp_file);
+void pbp_close(PbpHandle* pbp);
+int pbp_read_sfo(PbpHandle* pbp, void** param_sfo_buffer);
+int pbp_hash_start(PbpHandle* pbp);
+int pbp_hash_wait(PbpHandle* pbp, unsigned char* out_hash);
+int gen_sce_ebootpbp(PbpHandle* pbp, const char* psp_game_folder, char* disc_id);
+#endif
@@ -21,59 +21,323 @@
 #include "archive.h"
 #include "photo.h"
 #include "file.h"
+#include "image.h"
 #include "theme.h"
 #include "utils.h"
 
-static vita2d_texture *loadImage(const char *file, int type, char *buffer) {
-  vita2d_texture *tex = NULL;
+enum PhotoSlots {
+  PHOTO_SLOT_CURRENT,
+  PHOTO_SLOT_NEXT,
+  PHOTO_SLOT_PREVIOUS,
+  PHOTO_SLOTS,
+};
+
+enum PhotoSlotStates {
+  PHOTO_SLOT_EMPTY,
+  PHOTO_SLOT_PENDING,
+  PHOTO_SLOT_LOADING,
+  PHOTO_SLOT_READY,
+};
+
+typedef struct PhotoSlot {
+  char path[MAX_PATH_LENGTH];
+  int type;
+  int full_resolution;
+  int state;
+  volatile int cancel;
+  vita2d_texture *tex;
+  int width;
+  int height;
+} PhotoSlot;
+
+// All images are decoded on one thread, in the order of the slots. The
+// current image is waited for, the others are prefetched. Slots are only
+// changed with the mutex held.
+typedef struct PhotoLoader {
+  PhotoSlot slots[PHOTO_SLOTS];
+  SceKernelLwMutexWork mutex;
+  SceUID work_sema;
+  SceUID done_sema;
+  SceUID thid;
+  int running;
+  char *buffer;
+} PhotoLoader;
+
+// The preview is decoded at about the screen size, the full resolution
+// only once it is zoomed into
+static vita2d_texture *loadImage(const char *file, int type, char *buffer, int full_resolution, int *width, int *height, volatile int *cancel) {
+  if (full_resolution)
+    return imageLoad(file, type, buffer, 0, 0, width, height, cancel);
+
+  return imageLoad(file, type, buffer, SCREEN_WIDTH, SCREEN_HEIGHT, width, height, cancel);
+}
+
+static int is_image_type(int type) {
+  return type == FILE_TYPE_BMP || type == FILE_TYPE_JPEG || type == FILE_TYPE_PNG;
+}
 
-  if (isInArchive()) {
-    int size = 0;
+static int photo_loader_thread(SceSize args, PhotoLoader **argp) {
+  PhotoLoader *loader = *argp;
 
-    if (isInArchive()) {
-      size = ReadArchiveFile(file, buffer, BIG_BUFFER_SIZE);
-    } else {
-      size = ReadFile(file, buffer, BIG_BUFFER_SIZE);
+  while (1) {
+    sceKernelWaitSema(loader->work_sema, 1, NULL);
+    if (!loader->running)
+      break;
+
+    while (loader->running) {
+      char path[MAX_PATH_LENGTH];
+      int type = 0, full_resolution = 0;
+
+      sceKernelLockLwMutex(&loader->mutex, 1, NULL);
+
+      PhotoSlot *slot = NULL;
+
+      int i;
+      for (i = 0; i < PHOTO_SLOTS; i++) {
+        if (loader->slots[i].state == PHOTO_SLOT_PENDING) {
+          slot = &loader->slots[i];
+          slot->state = PHOTO_SLOT_LOADING;
+          slot->cancel = 0;
+          strcpy(path, slot->path);
+          type = slot->type;
+          full_resolution = slot->full_resolution;
+          break;
+        }
+      }
+
+      sceKernelUnlockLwMutex(&loader->mutex, 1);
+
+      if (!slot)
+        break;
+
+      int width = 0, height = 0;
+      vita2d_texture *tex = loadImage(path, type, loader->buffer, full_resolution, &width, &height, &slot->cancel);
+
+      sceKernelLockLwMutex(&loader->mutex, 1, NULL);
+
+      // A slot asked for something else meanwhile is back to pending
+      if (slot->state == PHOTO_SLOT_LOADING) {
+        if (tex && slot != &loader->slots[PHOTO_SLOT_CURRENT]) {
+          int used = vita2d_texture_get_width(tex) * vita2d_texture_get_height(tex) * 4;
+
+          for (i = 0; i < PHOTO_SLOTS; i++) {
+            PhotoSlot *other = &loader->slots[i];
+            if (other != slot && other->state == PHOTO_SLOT_READY && other->tex)
+              used += vita2d_texture_get_width(other->tex) * vita2d_texture_get_height(other->tex) * 4;
+          }
+
+          // Not kept, it is decoded again when it is shown
+          if (used > PHOTO_PREFETCH_BUDGET) {
+            vita2d_free_texture(tex);
+            tex = NULL;
+            slot->state = PHOTO_SLOT_EMPTY;
+          }
+        }
+
+        if (slot->state == PHOTO_SLOT_LOADING) {
+          slot->tex = tex;
+          slot->width = width;
+          slot->height = height;
+          slot->state = PHOTO_SLOT_READY;
+        }
+      } else if (tex) {
+        vita2d_free_texture(tex);
+      }
+
+      sceKernelUnlockLwMutex(&loader->mutex, 1);
+
+      sceKernelSignalSema(loader->done_sema, 1);
+    }
+  }
+
+  return sceKernelExitDeleteThread(0);
+}
+
+static int photo_loader_init(PhotoLoader *loader, char *buffer) {
+  memset(loader, 0, sizeof(PhotoLoader));
+  loader->buffer = buffer;
+  loader->running = 1;
+
+  sceKernelCreateLwMutex(&loader->mutex, "photo_loader_mutex", 2, 0, NULL);
+
+  loader->work_sema = sceKernelCreateSema("photo_loader_work_sema", 0, 0, 0x7FFFFFFF, NULL);
+  loader->done_sema = sceKernelCreateSema("photo_loader_done_sema", 0, 0, 0x7FFFFFFF, NULL);
+  if (loader->work_sema < 0 || loader->done_sema < 0)
+    goto ERROR;
+
+  PhotoLoader *loader_ptr = loader;
+  loader->thid = sceKernelCreateThread("photo_loader_thread", (SceKernelThreadEntry)photo_loader_thread, 0x10000100, 0x40000, 0, 0x70000, NULL);
+  if (loader->thid < 0)
+    goto ERROR;
+
+  sceKernelStartThread(loader->thid, sizeof(PhotoLoader *), &loader_ptr);
+  return 0;
+
+ERROR:
+  if (loader->work_sema >= 0)
+    sceKernelDeleteSema(loader->work_sema);
+  if (loader->done_sema >= 0)
+    sceKernelDeleteSema(loader->done_sema);
+  sceKernelDeleteLwMutex(&loader->mutex);
+  return VITASHELL_ERROR_INTERNAL;
+}
+
+static void photo_loader_finish(PhotoLoader *loader) {
+  sceKernelLockLwMutex(&loader->mutex, 1, NULL);
+
+  loader->running = 0;
+
+  int i;
+  for (i = 0; i < PHOTO_SLOTS; i++)
+    loader->slots[i].cancel = 1;
+
+  sceKernelUnlockLwMutex(&loader->mutex, 1);
+
+  sceKernelSignalSema(loader->work_sema, 1);
+  sceKernelWaitThreadEnd(loader->thid, NULL, NULL);
+
+  vita2d_wait_rendering_done();
+
+  for (i = 0; i < PHOTO_SLOTS; i++) {
+    if (loader->slots[i].tex)
+      vita2d_free_texture(loader->slots[i].tex);
+  }
+
+  sceKernelDeleteSema(loader->work_sema);
+  sceKernelDeleteSema(loader->done_sema);
+  sceKernelDeleteLwMutex(&loader->mutex);
+}
+
+static void photo_slot_clear(PhotoSlot *slot) {
+  if (slot->tex) {
+    vita2d_wait_rendering_done();
+    vita2d_free_texture(slot->tex);
+    slot->tex = NULL;
+  }
+
+  slot->state = PHOTO_SLOT_EMPTY;
+}
+
+// Queues path for slot unless it is already there. Work on something
+// else in the slot is dropped.
+static void photo_loader_request(PhotoLoader *loader, int n, const char *path, int type, int full_resolution) {
+  sceKernelLockLwMutex(&loader->mutex, 1, NULL);
+
+  PhotoSlot *slot = &loader->slots[n];
+
+  if (slot->state != PHOTO_SLOT_EMPTY && slot->full_resolution == full_resolution && strcmp(slot->path, path) == 0) {
+    sceKernelUnlockLwMutex(&loader->mutex, 1);
+    return;
+  }
+
+  if (slot->state == PHOTO_SLOT_LOADING)
+    slot->cancel = 1;
+
+  photo_slot_clear(slot);
+
+  strcpy(slot->path, path);
+  slot->type = type;
+  slot->full_resolution = full_resolution;
+  slot->state = PHOTO_SLOT_PENDING;
+
+  // The image to show goes first, prefetching is done again after it
+  if (n == PHOTO_SLOT_CURRENT) {
+    int i;
+    for (i = 0; i < PHOTO_SLOTS; i++) {
+      if (loader->slots[i].state == PHOTO_SLOT_LOADING) {
+        loader->slots[i].cancel = 1;
+        loader->slots[i].state = PHOTO_SLOT_PENDING;
+      }
     }
+  }
 
-    if (size <= 0) {
+  sceKernelUnlockLwMutex(&loader->mutex, 1);
+
+  sceKernelSignalSema(loader->work_sema, 1);
+}
+
+// Takes the texture of path out of slot, waiting if it is being decoded.
+// NULL if the slot holds something else or decoding failed.
+static vita2d_texture *photo_loader_take(PhotoLoader *loader, int n, const char *path, int full_resolution, int *width, int *height) {
+  PhotoSlot *slot = &loader->slots[n];
+
+  while (1) {
+    sceKernelLockLwMutex(&loader->mutex, 1, NULL);
+
+    if (slot->state == PHOTO_SLOT_EMPTY || slot->full_resolution != full_resolution || strcmp(slot->path, path) != 0) {
+      sceKernelUnlockLwMutex(&loader->mutex, 1);
       return NULL;
     }
 
-    switch (type) {
-      case FILE_TYPE_BMP:
-        tex = vita2d_load_BMP_buffer(buffer);
-        break;
-      
-      case FILE_TYPE_PNG:
-        tex = vita2d_load_PNG_buffer(buffer);
-        break;
-        
-      case FILE_TYPE_JPEG:
-        tex = vita2d_load_JPEG_buffer(buffer, size);
-        break;
+    if (slot->state == PHOTO_SLOT_READY) {
+      vita2d_texture *tex = slot->tex;
+      *width = slot->width;
+      *height = slot->height;
+
+      slot->tex = NULL;
+      slot->state = PHOTO_SLOT_EMPTY;
+
+      sceKernelUnlockLwMutex(&loader->mutex, 1);
+      return tex;
     }
-  } else {
-    switch (type) {
-      case FILE_TYPE_BMP:
-        tex = vita2d_load_BMP_file(file);
-        break;
-      
-      case FILE_TYPE_PNG:
-        tex = vita2d_load_PNG_file(file);
-        break;
-        
-      case FILE_TYPE_JPEG:
-        tex = vita2d_load_JPEG_file(file);
-        break;
+
+    sceKernelUnlockLwMutex(&loader->mutex, 1);
+
+    sceKernelWaitSema(loader->done_sema, 1, NULL);
+  }
+}
+
+static vita2d_texture *photo_loader_load(PhotoLoader *loader, const char *path, int type, int full_resolution, int *width, int *height) {
+  photo_loader_request(loader, PHOTO_SLOT_CURRENT, path, type, full_resolution);
+  return photo_loader_take(loader, PHOTO_SLOT_CURRENT, path, full_resolution, width, height);
+}
+
+// Puts an image that was shown back as a neighbour
+static void photo_loader_store(PhotoLoader *loader, int n, const char *path, int type, vita2d_texture *tex, int width, int height) {
+  sceKernelLockLwMutex(&loader->mutex, 1, NULL);
+
+  PhotoSlot *slot = &loader->slots[n];
+
+  if (slot->state == PHOTO_SLOT_LOADING)
+    slot->cancel = 1;
+
+  photo_slot_clear(slot);
+
+  strcpy(slot->path, path);
+  slot->type = type;
+  slot->full_resolution = 0;
+  slot->tex = tex;
+  slot->width = width;
+  slot->height = height;
+  slot->state = PHOTO_SLOT_READY;
+
+  sceKernelUnlockLwMutex(&loader->mutex, 1);
+}
+
+static FileListEntry *get_neighbour_image(FileList *list, FileListEntry *entry, int previous, char *path, int *type) {
+  while (previous ? entry->previous : entry->next) {
+    entry = previous ? entry->previous : entry->next;
+
+    if (!entry->is_folder) {
+      snprintf(path, MAX_PATH_LENGTH, "%s%s", list->path, entry->name);
+      *type = getFileType(path);
+      if (is_image_type(*type))
+        return entry;
     }
   }
 
-  // Set bilinear filter
-  if (tex)
-    vita2d_texture_set_filters(tex, SCE_GXM_TEXTURE_FILTER_LINEAR, SCE_GXM_TEXTURE_FILTER_LINEAR);
+  return NULL;
+}
+
+static void photo_loader_prefetch(PhotoLoader *loader, FileList *list, FileListEntry *entry) {
+  char path[MAX_PATH_LENGTH];
+  int type;
 
-  return tex;
+  if (get_neighbour_image(list, entry, 0, path, &type))
+    photo_loader_request(loader, PHOTO_SLOT_NEXT, path, type, 0);
+
+  if (get_neighbour_image(list, entry, 1, path, &type))
+    photo_loader_request(loader, PHOTO_SLOT_PREVIOUS, path, type, 0);
 }
 
 static int isHorizontal(float rad) {
@@ -152,9 +416,9 @@ static int getNextZoomMode(float *zoom, float width, float height, float rad, in
   return next_mode;
 }
 
-static void resetImageInfo(vita2d_texture *tex, float *width, float *height, float *x, float *y, float *rad, float *zoom, int *mode, uint64_t *time) {
-  *width = vita2d_texture_get_width(tex);
-  *height = vita2d_texture_get_height(tex);
+static void resetImageInfo(int image_width, int image_height, float *width, float *height, float *x, float *y, float *rad, float *zoom, int *mode, uint64_t *time) {
+  *width = image_width;
+  *height = image_height;
 
   *x = *width/2.0f;
   *y = *height/2.0f;
@@ -173,19 +437,37 @@ int photoViewer(const char *file, int type, FileList *list, FileListEntry *entry
   if (!buffer)
     return VITASHELL_ERROR_NO_MEMORY;
 
-  vita2d_texture *tex = loadImage(file, type, buffer);
+  PhotoLoader loader;
+  if (photo_loader_init(&loader, buffer) < 0) {
+    free(buffer);
+    return VITASHELL_ERROR_INTERNAL;
+  }
+
+  // Positions and zoom are in pixels of the image, not of the texture
+  int image_width = 0, image_height = 0;
+  int full_resolution = 0;
+
+  // Image shown, for loading it at full resolution
+  char image_path[MAX_PATH_LENGTH];
+  int image_type = type;
+  strcpy(image_path, file);
+
+  vita2d_texture *tex = photo_loader_load(&loader, file, type, full_resolution, &image_width, &image_height);
   if (!tex) {
+    photo_loader_finish(&loader);
     free(buffer);
     return VITASHELL_ERROR_NO_MEMORY;
   }
 
+  photo_loader_prefetch(&loader, list, entry);
+
   // Variables
   float width = 0.0f, height = 0.0f, x = 0.0f, y = 0.0f, rad = 0.0f, zoom = 1.0f;
   int mode = MODE_PERFECT;
   uint64_t time = 0;
 
   // Reset image
-  resetImageInfo(tex, &width, &height, &x, &y, &rad, &zoom, &mode, &time);
+  resetImageInfo(image_width, image_height, &width, &height, &x, &y, &rad, &zoom, &mode, &time);
 
   while (1) {
     readPad();
@@ -227,19 +509,39 @@ int photoViewer(const char *file, int type, FileList *list, FileListEntry *entry
           char path[MAX_PATH_LENGTH];
           snprintf(path, MAX_PATH_LENGTH, "%s%s", list->path, entry->name);
           int type = getFileType(path);
-          if (type == FILE_TYPE_BMP || type == FILE_TYPE_JPEG || type == FILE_TYPE_PNG) {
-            vita2d_wait_rendering_done();
-            vita2d_free_texture(tex);
-            
-            tex = loadImage(path, type, buffer);
+          if (is_image_type(type)) {
+            // Prefetched images are swapped in, others are decoded now
+            int new_width = 0, new_height = 0;
+            vita2d_texture *new_tex = photo_loader_take(&loader, previous ? PHOTO_SLOT_PREVIOUS : PHOTO_SLOT_NEXT, path, 0, &new_width, &new_height);
+            if (!new_tex)
+              new_tex = photo_loader_load(&loader, path, type, 0, &new_width, &new_height);
+
+            // The image shown so far is the neighbour on the other side now
+            if (!full_resolution) {
+              photo_loader_store(&loader, previous ? PHOTO_SLOT_NEXT : PHOTO_SLOT_PREVIOUS, image_path, image_type, tex, image_width, image_height);
+            } else {
+              vita2d_wait_rendering_done();
+              vita2d_free_texture(tex);
+            }
+
+            tex = new_tex;
             if (!tex) {
+              photo_loader_finish(&loader);
               free(buffer);
               return VITASHELL_ERROR_NO_MEMORY;
             }
 
+            full_resolution = 0;
+            image_width = new_width;
+            image_height = new_height;
+
             // Reset image
-            resetImageInfo(tex, &width, &height, &x, &y, &rad, &zoom, &mode, &time);
+            resetImageInfo(image_width, image_height, &width, &height, &x, &y, &rad, &zoom, &mode, &time);
+            strcpy(image_path, path);
+            image_type = type;
             available = 1;
+
+            photo_loader_prefetch(&loader, list, entry);
             break;
           }
         }
@@ -297,6 +599,19 @@ int photoViewer(const char *file, int type, FileList *list, FileListEntry *entry
       zoom = ZOOM_MAX;
     }
 
+    // Zoomed past the preview, decode the image at full resolution
+    if (!full_resolution && vita2d_texture_get_width(tex) < image_width &&
+        zoom * (width / vita2d_texture_get_width(tex)) > 1.0f) {
+      vita2d_texture *full_tex = photo_loader_load(&loader, image_path, image_type, 1, &image_width, &image_height);
+      if (full_tex) {
+        vita2d_wait_rendering_done();
+        vita2d_free_texture(tex);
+        tex = full_tex;
+      }
+
+      full_resolution = 1;
+    }
+
     // Move
     if (pad.lx < (ANALOG_CENTER - ANALOG_SENSITIVITY) || pad.lx > (ANALOG_CENTER + ANALOG_SENSITIVITY)) {
       float d = ((pad.lx - ANALOG_CENTER) / MOVE_DIVISION) / zoom;
@@ -346,8 +661,10 @@ int photoViewer(const char *file, int type, FileList *list, FileListEntry *entry
     // Start drawing
     startDrawing(bg_photo_image);
 
-    // Photo
-    vita2d_draw_texture_scale_rotate_hotspot(tex, SCREEN_HALF_WIDTH, SCREEN_HALF_HEIGHT, zoom, zoom, rad, x, y);
+    // Photo, the texture may be smaller than the image
+    float scale_x = width / vita2d_texture_get_width(tex);
+    float scale_y = height / vita2d_texture_get_height(tex);
+    vita2d_draw_texture_scale_rotate_hotspot(tex, SCREEN_HALF_WIDTH, SCREEN_HALF_HEIGHT, zoom * scale_x, zoom * scale_y, rad, x / scale_x, y / scale_y);
 
     // Zoom text
     if ((sceKernelGetProcessTimeWide() - time) < ZOOM_TEXT_TIME)
@@ -357,6 +674,8 @@ int photoViewer(const char *file, int type, FileList *list, FileListEntry *entry
     endDrawing();
   }
 
+  photo_loader_finish(&loader);
+
   vita2d_wait_rendering_done();
   vita2d_free_texture(tex);
 
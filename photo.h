@@ -37,6 +37,9 @@ enum PhotoModes {
 
 #define ZOOM_TEXT_TIME 2 * 1000 * 1000
 
+// Previous and next images are decoded ahead while within this budget
+#define PHOTO_PREFETCH_BUDGET (32 * 1024 * 1024)
+
 int photoViewer(const char *file, int type, FileList *list, FileListEntry *entry, int *base_pos, int *rel_pos);
 
 #endif
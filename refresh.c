@@ -33,6 +33,7 @@
 #include "rif.h"
 #include "pfs.h"
 #include "pbp.h"
+#include "refresh_cache.h"
 
 // Note: The promotion process is *VERY* sensitive to the directories used below
 // Don't change them unless you know what you are doing!
@@ -45,6 +46,27 @@
 
 #define MAX_DLC_PER_TITLE 1024
 
+// Threads preparing titles while the refresh thread promotes them
+#define REFRESH_SCAN_THREADS 2
+
+// Only one appmeta can be mounted at a time
+static SceKernelLwMutexWork appmeta_mutex;
+
+// Titles moved out of place for promotion, so that an interrupted refresh
+// can be rolled back on the next start
+#define REFRESH_JOURNAL "ux0:VitaShell/internal/refresh_journal.txt"
+
+//#define REFRESH_TIMING 1
+
+typedef struct {
+  char *src;
+  char *dst;
+} staged_title_t;
+
+static staged_title_t *staged_titles = NULL;
+static int staged_count = 0;
+static int staged_size = 0;
+
 int isCustomHomebrew(const char* path) {
   uint32_t work[RIF_SIZE/4];
 
@@ -111,17 +133,23 @@ int refreshNeeded(const char *app_path, const char* content_type) {
       free(app_directory);	  
       snprintf(ebootpbp_path, MAX_PATH_LENGTH, "%s/EBOOT.PBP", app_path);
       
-      int pbp_type = get_pbp_type(ebootpbp_path);
-      if(pbp_type == PBP_TYPE_UNKNOWN)
+      PbpHandle pbp;
+      if(pbp_open(&pbp, ebootpbp_path) < 0)
         return 0;
-      
-      // Get content_id
-      if(!get_pbp_content_id(ebootpbp_path, contentid)) 
+
+      int pbp_type = pbp.type;
+      if(pbp_type == PBP_TYPE_UNKNOWN || !pbp.content_id_valid) {
+        pbp_close(&pbp);
         return 0;
+      }
+
+      // Get content_id
+      strncpy(contentid, pbp.content_id, 0x30);
       
       // Get param.sfo
       void *sfo_buffer = NULL;
-      int sfo_size = get_pbp_sfo(ebootpbp_path, &sfo_buffer);
+      int sfo_size = pbp_read_sfo(&pbp, &sfo_buffer);
+      pbp_close(&pbp);
       if(sfo_size <= 0)
         return 0;
       
@@ -192,23 +220,32 @@ int refreshNeeded(const char *app_path, const char* content_type) {
   else if (strcmp(content_type, "patch") == 0) {
     if (!checkAppExist(titleid))
       return 0;
-  if (checkFileExist(sfo_path)) {
-    void *sfo_buffer = NULL;
+    if (checkFileExist(sfo_path)) {
+      void *sfo_buffer = NULL;
+      char promoted_appver[8];
       snprintf(appmeta_path, MAX_PATH_LENGTH, "ux0:appmeta/%s", titleid);
+      snprintf(appmeta_param, MAX_PATH_LENGTH, "ux0:appmeta/%s/param.sfo", titleid);
+
+      sceKernelLockLwMutex(&appmeta_mutex, 1, NULL);
       pfsUmount();
-      if(pfsMount(appmeta_path)<0)
+      if (pfsMount(appmeta_path) < 0) {
+        sceKernelUnlockLwMutex(&appmeta_mutex, 1);
         return 0;
+      }
       //Now read it
-    snprintf(appmeta_param, MAX_PATH_LENGTH, "ux0:appmeta/%s/param.sfo", titleid);
       int sfo_size = allocateReadFile(appmeta_param, &sfo_buffer);
+      if (sfo_size >= 0)
+        getSfoString(sfo_buffer, "APP_VER", promoted_appver, sizeof(promoted_appver));
+      pfsUmount();
+      sceKernelUnlockLwMutex(&appmeta_mutex, 1);
+
       if (sfo_size < 0)
         return sfo_size;
-      char promoted_appver[8];
-      getSfoString(sfo_buffer, "APP_VER", promoted_appver, sizeof(promoted_appver));
-      pfsUmount();
-    //Finally compare it
-    if (strcmp(appver, promoted_appver) == 0)
-      return 0;
+      free(sfo_buffer);
+
+      //Finally compare it
+      if (strcmp(appver, promoted_appver) == 0)
+        return 0;
     }
   }
   // license not needed to promote psp or psm contents
@@ -251,16 +288,16 @@ int refreshNeeded(const char *app_path, const char* content_type) {
   return 1;
 }
 
-int refreshApp(const char *app_path) {
+// Check the title's work.bin before it gets moved for promotion.
+// Returns the rif to restore from license.db, if any.
+uint8_t *refreshAppPrepare(const char *app_path, int *custom_homebrew) {
   char work_bin_path[MAX_PATH_LENGTH];
-  int res;
+  uint8_t *rif = NULL;
 
   snprintf(work_bin_path, MAX_PATH_LENGTH, "%s/sce_sys/package/work.bin", app_path);
 
-  // Remove work.bin for custom homebrews
-  if (isCustomHomebrew(work_bin_path)) {
-    sceIoRemove(work_bin_path);
-  } else if (!checkFileExist(work_bin_path)) {
+  *custom_homebrew = isCustomHomebrew(work_bin_path);
+  if (!*custom_homebrew && !checkFileExist(work_bin_path)) {
     // If available, restore work.bin from licenses.db
     void *sfo_buffer = NULL;
     char sfo_path[MAX_PATH_LENGTH], contentid[50];
@@ -268,19 +305,31 @@ int refreshApp(const char *app_path) {
     int sfo_size = allocateReadFile(sfo_path, &sfo_buffer);
     if (sfo_size > 0) {
       getSfoString(sfo_buffer, "CONTENT_ID", contentid, sizeof(contentid));
-      uint8_t* rif = query_rif(LICENSE_DB, contentid);
-      if (rif != NULL) {
-        int fh = sceIoOpen(work_bin_path, SCE_O_WRONLY | SCE_O_CREAT, 0777);
-        if (fh > 0) {
-          sceIoWrite(fh, rif, RIF_SIZE);
-          sceIoClose(fh);
-        }
-        free(rif);
-      }
+      rif = query_rif(LICENSE_DB, contentid);
     }
     free(sfo_buffer);
   }
 
+  return rif;
+}
+
+int refreshApp(const char *app_path, int custom_homebrew, const uint8_t *rif) {
+  char work_bin_path[MAX_PATH_LENGTH];
+  int res;
+
+  snprintf(work_bin_path, MAX_PATH_LENGTH, "%s/sce_sys/package/work.bin", app_path);
+
+  // Remove work.bin for custom homebrews
+  if (custom_homebrew) {
+    sceIoRemove(work_bin_path);
+  } else if (rif != NULL) {
+    int fh = sceIoOpen(work_bin_path, SCE_O_WRONLY | SCE_O_CREAT, 0777);
+    if (fh > 0) {
+      sceIoWrite(fh, rif, RIF_SIZE);
+      sceIoClose(fh);
+    }
+  }
+
   // Promote vita app/vita dlc/vita patch (if needed)
   res = promoteApp(app_path);
   return (res < 0) ? res : 1;
@@ -313,319 +362,637 @@ int parse_dir_with_callback(int target_type, const char* path, void(*callback)(v
   return 0;
 }
 
+static int journal_write() {
+  if (staged_count == 0)
+    return sceIoRemove(REFRESH_JOURNAL);
+
+  SceUID fd = sceIoOpen(REFRESH_JOURNAL, SCE_O_WRONLY | SCE_O_CREAT | SCE_O_TRUNC, 0777);
+  if (fd < 0)
+    return fd;
+
+  for (int i = 0; i < staged_count; i++) {
+    sceIoWrite(fd, staged_titles[i].src, strlen(staged_titles[i].src));
+    sceIoWrite(fd, "\n", 1);
+    sceIoWrite(fd, staged_titles[i].dst, strlen(staged_titles[i].dst));
+    sceIoWrite(fd, "\n", 1);
+  }
+
+  // The entry must be on disk before the title is moved
+  sceIoSyncByFd(fd, 0);
+  sceIoClose(fd);
+
+  return 0;
+}
+
+static int same_partition(const char *a, const char *b) {
+  const char *a_end = strchr(a, ':');
+  const char *b_end = strchr(b, ':');
+
+  if (!a_end || !b_end || (a_end - a) != (b_end - b))
+    return 0;
+
+  return strncasecmp(a, b, a_end - a) == 0;
+}
+
+// Move a title to its promotion directory. Only renames are attempted:
+// a title that cannot be moved is skipped rather than copied.
+static int refresh_stage(const char *src, const char *dst) {
+  int res;
+#if REFRESH_TIMING
+  uint64_t time = sceKernelGetProcessTimeWide();
+#endif
+
+  if (!same_partition(src, dst))
+    return VITASHELL_ERROR_NOT_SAME_PARTITION;
+
+  if (staged_count == staged_size) {
+    int size = staged_size ? staged_size * 2 : 16;
+    staged_title_t *titles = realloc(staged_titles, size * sizeof(staged_title_t));
+    if (titles == NULL)
+      return VITASHELL_ERROR_NO_MEMORY;
+    staged_titles = titles;
+    staged_size = size;
+  }
+
+  staged_titles[staged_count].src = strdup(src);
+  staged_titles[staged_count].dst = strdup(dst);
+  staged_count++;
+  journal_write();
+
+  removePath(dst, NULL);
+  res = sceIoRename(src, dst);
+  if (res < 0) {
+    staged_count--;
+    free(staged_titles[staged_count].src);
+    free(staged_titles[staged_count].dst);
+    journal_write();
+  }
+
+#if REFRESH_TIMING
+  debugPrintf("stage %s: 0x%08X, %llu us\n", src, res, sceKernelGetProcessTimeWide() - time);
+#endif
+
+  return res;
+}
+
+// Forget a staged title, moving it back first if it was not promoted
+static void refresh_unstage(const char *src, int restore) {
+  for (int i = 0; i < staged_count; i++) {
+    if (strcmp(staged_titles[i].src, src) == 0) {
+      if (restore)
+        sceIoRename(staged_titles[i].dst, staged_titles[i].src);
+
+      free(staged_titles[i].src);
+      free(staged_titles[i].dst);
+      memmove(&staged_titles[i], &staged_titles[i + 1], (staged_count - i - 1) * sizeof(staged_title_t));
+      staged_count--;
+      journal_write();
+      break;
+    }
+  }
+}
+
+// Move back titles left in the temp directories by an interrupted refresh
+void refreshRestoreJournal() {
+  char *buffer = NULL;
+
+  int size = allocateReadFile(REFRESH_JOURNAL, (void **)&buffer);
+  if (size <= 0) {
+    free(buffer);
+    return;
+  }
+
+  char *src = buffer, *dst, *end;
+  while (src < buffer + size) {
+    end = memchr(src, '\n', buffer + size - src);
+    if (!end)
+      break;
+    *end = '\0';
+
+    dst = end + 1;
+    end = memchr(dst, '\n', buffer + size - dst);
+    if (!end)
+      break;
+    *end = '\0';
+
+    // Only restore if the title was not promoted to its place in the meantime
+    if (!checkFolderExist(src) && checkFolderExist(dst))
+      sceIoRename(dst, src);
+
+    src = end + 1;
+  }
+
+  free(buffer);
+  sceIoRemove(REFRESH_JOURNAL);
+}
+
+enum RefreshItemTypes {
+  REFRESH_ITEM_APP,
+  REFRESH_ITEM_DLC,
+  REFRESH_ITEM_PATCH,
+  REFRESH_ITEM_PSM,
+  REFRESH_ITEM_PSP,
+};
+
+static const char *refresh_content_types[] = { "app", "dlc", "patch", "psm", "psp" };
+
+typedef struct {
+  int type;
+  int group; // dlc of the same title share a group
+  char *path;
+  // Filled in by the scanner threads
+  int ready;
+  int needed;
+  int custom_homebrew;
+  uint8_t *rif;
+  char titleid[12];
+} refresh_item_t;
+
+typedef struct {
+  refresh_item_t *items;
+  int count;
+  int size;
+  int group;
+  int group_count;
+} refresh_list_t;
+
 typedef struct {
-  int refresh_pass;
   int count;
   int processed;
   int refreshed;
 } refresh_data_t;
 
 typedef struct {
-  refresh_data_t *refresh_data;
-  char* list[MAX_DLC_PER_TITLE];
-  int list_size;
-} dlc_data_t;
+  refresh_list_t *list;
+  int next;
+  int abort;
+  SceKernelLwMutexWork mutex;
+  SceUID ready_sema;
+  int threads;
+} refresh_scan_t;
 
 typedef struct {
   int copy_pass;
   int count;
   int processed;
-  int copied;
   int cur_depth;
   int max_depth;
   uint8_t* rif;
+  rif_import_t* import;
 } license_data_t;
 
-
-void app_callback(void* data, const char* dir, const char* subdir) {
-  refresh_data_t *refresh_data = (refresh_data_t*)data;
+static int refresh_list_add(refresh_list_t *list, int type, const char *dir, const char *subdir) {
   char path[MAX_PATH_LENGTH];
 
+  if (list->count == list->size) {
+    int size = list->size ? list->size * 2 : 256;
+    refresh_item_t *items = realloc(list->items, size * sizeof(refresh_item_t));
+    if (items == NULL)
+      return -1;
+    list->items = items;
+    list->size = size;
+  }
+
+  snprintf(path, MAX_PATH_LENGTH, "%s/%s", dir, subdir);
+
+  refresh_item_t *item = &list->items[list->count];
+  memset(item, 0, sizeof(refresh_item_t));
+  item->type = type;
+  item->group = list->group;
+  item->path = strdup(path);
+  if (item->path == NULL)
+    return -1;
+
+  list->count++;
+  return 0;
+}
+
+static void refresh_list_free(refresh_list_t *list) {
+  for (int i = 0; i < list->count; i++) {
+    free(list->items[i].path);
+    free(list->items[i].rif);
+  }
+  free(list->items);
+  memset(list, 0, sizeof(refresh_list_t));
+}
+
+void app_enum_callback(void* data, const char* dir, const char* subdir) {
   if (strcasecmp(subdir, vitashell_titleid) == 0)
     return;
 
-  if (refresh_data->refresh_pass) {
-    snprintf(path, MAX_PATH_LENGTH, "%s/%s", dir, subdir);
-    if (refreshNeeded(path, "app")) {
-      // Move the directory to temp for installation
-      removePath(APP_TEMP, NULL);
-      sceIoRename(path, APP_TEMP);
-      if (refreshApp(APP_TEMP) == 1)
-        refresh_data->refreshed++;
-      else
-        // Restore folder on error
-        sceIoRename(APP_TEMP, path);
-    }
-    SetProgress(++refresh_data->processed, refresh_data->count);
-  } else {
-    refresh_data->count++;
-  }
+  refresh_list_add((refresh_list_t*)data, REFRESH_ITEM_APP, dir, subdir);
 }
 
-void dlc_callback_inner(void* data, const char* dir, const char* subdir) {
-  dlc_data_t *dlc_data = (dlc_data_t*)data;
-  char path[MAX_PATH_LENGTH];
+void dlc_enum_callback_inner(void* data, const char* dir, const char* subdir) {
+  refresh_list_t *list = (refresh_list_t*)data;
 
   // Ignore  "sce_sys" and "sce_pfs" directories
   if (strncasecmp(subdir, "sce_", 4) == 0)
     return;
 
-  if (dlc_data->refresh_data->refresh_pass) {
-    snprintf(path, MAX_PATH_LENGTH, "%s/%s", dir, subdir);
-    if (dlc_data->list_size < MAX_DLC_PER_TITLE)
-      dlc_data->list[dlc_data->list_size++] = strdup(path);
-  } else {
-    dlc_data->refresh_data->count++;
+  if (list->group_count < MAX_DLC_PER_TITLE) {
+    if (refresh_list_add(list, REFRESH_ITEM_DLC, dir, subdir) == 0)
+      list->group_count++;
   }
 }
 
-void dlc_callback_outer(void* data, const char* dir, const char* subdir) {
-  refresh_data_t *refresh_data = (refresh_data_t*)data;
-  dlc_data_t dlc_data;
-  dlc_data.refresh_data = refresh_data;
-  dlc_data.list_size = 0;
+void dlc_enum_callback_outer(void* data, const char* dir, const char* subdir) {
+  refresh_list_t *list = (refresh_list_t*)data;
   char path[MAX_PATH_LENGTH];
 
   // Get the title's dlc subdirectories
-  int len = snprintf(path, sizeof(path), "%s/%s", dir, subdir);
-  parse_dir_with_callback(SCE_S_IFDIR, path, dlc_callback_inner, &dlc_data);
-
-  if (refresh_data->refresh_pass) {
-    // For dlc, the process happens in two phases to avoid promotion errors:
-    // 1. Move all dlc that require refresh out of addcont/title_id
-    // 2. Refresh the moved dlc_data
-    for (int i = 0; i < dlc_data.list_size; i++) {
-      if (refreshNeeded(dlc_data.list[i], "dlc")) {
-        snprintf(path, MAX_PATH_LENGTH, DLC_TEMP "/%s", &dlc_data.list[i][len + 1]);
-        removePath(path, NULL);
-        sceIoRename(dlc_data.list[i], path);
-      } else {
-        free(dlc_data.list[i]);
-        dlc_data.list[i] = NULL;
-        SetProgress(++refresh_data->processed, refresh_data->count);
-      }
-    }
+  snprintf(path, MAX_PATH_LENGTH, "%s/%s", dir, subdir);
+  list->group++;
+  list->group_count = 0;
+  parse_dir_with_callback(SCE_S_IFDIR, path, dlc_enum_callback_inner, data);
+}
 
-    // Now that the dlc we need are out of addcont/title_id, refresh them
-    for (int i = 0; i < dlc_data.list_size; i++) {
-      if (dlc_data.list[i] != NULL) {
-        snprintf(path, MAX_PATH_LENGTH, DLC_TEMP "/%s", &dlc_data.list[i][len + 1]);
-        if (refreshApp(path) == 1)
-          refresh_data->refreshed++;
-        else
-          sceIoRename(path, dlc_data.list[i]);
-        SetProgress(++refresh_data->processed, refresh_data->count);
-        free(dlc_data.list[i]);
-      }
-    }
+void patch_enum_callback(void* data, const char* dir, const char* subdir) {
+  refresh_list_add((refresh_list_t*)data, REFRESH_ITEM_PATCH, dir, subdir);
+}
+
+void psm_enum_callback(void* data, const char* dir, const char* subdir) {
+  refresh_list_add((refresh_list_t*)data, REFRESH_ITEM_PSM, dir, subdir);
+}
+
+void psp_enum_callback(void* data, const char* dir, const char* subdir) {
+  refresh_list_add((refresh_list_t*)data, REFRESH_ITEM_PSP, dir, subdir);
+}
+
+// The rif refreshNeeded looks for, ux0:app/TITLEID has its licenses in
+// ux0:license/app/TITLEID and ux0:addcont/TITLEID/DLC in ux0:license/addcont/TITLEID/DLC
+static void refresh_item_license(const refresh_item_t *item, char *rif_path) {
+  char rif_name[48];
+  uint64_t aid = 0;
+
+  sceRegMgrGetKeyBin("/CONFIG/NP", "account_id", &aid, sizeof(uint64_t));
+
+  _sceNpDrmGetRifName(rif_name, aid);
+  snprintf(rif_path, MAX_PATH_LENGTH, "ux0:license/%s/%s", item->path + 4, rif_name);
+  if (checkFileExist(rif_path))
+    return;
+
+  _sceNpDrmGetFixedRifName(rif_name, 0);
+  snprintf(rif_path, MAX_PATH_LENGTH, "ux0:license/%s/%s", item->path + 4, rif_name);
+}
+
+// Check whether a title needs refreshing, skipping titles that were up to
+// date on the previous run and have not changed since
+static int refresh_item_needed(refresh_scan_t *scan, const refresh_item_t *item) {
+  char meta_path[MAX_PATH_LENGTH];
+  char license_path[MAX_PATH_LENGTH];
+  RefreshCacheEntry entry;
+  int cached;
+
+  if (item->type == REFRESH_ITEM_PSM)
+    snprintf(meta_path, MAX_PATH_LENGTH, "%s/RW/System/content_id", item->path);
+  else if (item->type == REFRESH_ITEM_PSP)
+    snprintf(meta_path, MAX_PATH_LENGTH, "%s/EBOOT.PBP", item->path);
+  else
+    snprintf(meta_path, MAX_PATH_LENGTH, "%s/sce_sys/param.sfo", item->path);
+
+  // Apps and dlc are up to date only as long as their license is there
+  int licensed = (item->type == REFRESH_ITEM_APP || item->type == REFRESH_ITEM_DLC);
+  if (licensed)
+    refresh_item_license(item, license_path);
+
+  sceKernelLockLwMutex(&scan->mutex, 1, NULL);
+  cached = refreshCacheLookup(item->path, meta_path, licensed ? license_path : NULL, &entry);
+  sceKernelUnlockLwMutex(&scan->mutex, 1);
+  if (cached)
+    return 0;
+
+  int needed = refreshNeeded(item->path, refresh_content_types[item->type]);
+  if (needed == 0) {
+    sceKernelLockLwMutex(&scan->mutex, 1, NULL);
+    refreshCacheAdd(&entry);
+    sceKernelUnlockLwMutex(&scan->mutex, 1);
   }
+
+  return needed != 0;
 }
 
-void patch_callback(void* data, const char* dir, const char* subdir) {
-  refresh_data_t *refresh_data = (refresh_data_t*)data;
-  char path[MAX_PATH_LENGTH];
+// Read everything promotion needs from the title's original location
+static void refresh_item_prepare(refresh_item_t *item) {
+  if (item->type == REFRESH_ITEM_PSM) {
+    char contentid_path[MAX_PATH_LENGTH];
+    void *cidFile = NULL;
 
-  if (refresh_data->refresh_pass) {
-    snprintf(path, MAX_PATH_LENGTH, "%s/%s", dir, subdir);
-    if (refreshNeeded(path, "patch")) {
-      // Move the directory to temp for installation
-      removePath(PATCH_TEMP, NULL);
-      sceIoRename(path, PATCH_TEMP);
-      if (refreshApp(PATCH_TEMP) == 1)
-        refresh_data->refreshed++;
-      else
-        // Restore folder on error
-        sceIoRename(PATCH_TEMP, path);
+    snprintf(contentid_path, MAX_PATH_LENGTH, "%s/RW/System/content_id", item->path);
+
+    // Get title id from content id
+    if (allocateReadFile(contentid_path, &cidFile) >= 0) {
+      strncpy(item->titleid, cidFile + 7, 9);
+      free(cidFile);
     }
-    SetProgress(++refresh_data->processed, refresh_data->count);
-  } else {
-    refresh_data->count++;
+  } else if (item->type != REFRESH_ITEM_PSP) {
+    item->rif = refreshAppPrepare(item->path, &item->custom_homebrew);
   }
 }
 
-void psp_callback(void* data, const char* dir, const char* subdir) {
-  refresh_data_t *refresh_data = (refresh_data_t*)data;
-  char path[MAX_PATH_LENGTH];
+static void refresh_scan_item(refresh_scan_t *scan, refresh_item_t *item) {
+  // Whether a dlc or patch is needed depends on its app, which this run may
+  // not have promoted yet. They are checked by the promoter instead.
+  int needed = 0;
+  if (item->type != REFRESH_ITEM_DLC && item->type != REFRESH_ITEM_PATCH) {
+    needed = refresh_item_needed(scan, item);
+    if (needed)
+      refresh_item_prepare(item);
+  }
 
-  if (refresh_data->refresh_pass) {
-      snprintf(path, MAX_PATH_LENGTH, "%s/%s", dir, subdir);
-      if (refreshNeeded(path, "psp")) {
-        char contentid[0x30];
-        
-        char sce_ebootpbp[MAX_PATH_LENGTH];
-        char eboot_pbp[MAX_PATH_LENGTH];
-        char license_rif[MAX_PATH_LENGTH];
-        
-        snprintf(eboot_pbp, MAX_PATH_LENGTH, "%s/EBOOT.PBP", path);
-        snprintf(sce_ebootpbp, MAX_PATH_LENGTH, "%s/__sce_ebootpbp", path);
-		
-		// get pbp type
-		int pbp_type = get_pbp_type(eboot_pbp);
-        if(pbp_type != PBP_TYPE_UNKNOWN) {
-		  
-          // cache current __sce_ebootpbp signature file
-          void* sce_ebootpbp_sig_data = NULL;
-          int sce_ebootpbp_sz = allocateReadFile(sce_ebootpbp, &sce_ebootpbp_sig_data);
-		  		  
-          
-          if(get_pbp_content_id(eboot_pbp, contentid)) {
-              // create directories
-              char promote_psp_folder[MAX_PATH_LENGTH];
-              char promote_psp_game_folder[MAX_PATH_LENGTH];
-              char promote_psp_license_folder[MAX_PATH_LENGTH];
-
-              char promote_license_rif[MAX_PATH_LENGTH];
-              char promote_game_folder[MAX_PATH_LENGTH];
-
-              snprintf(promote_psp_folder, MAX_PATH_LENGTH, "%s/PSP", PSP_TEMP);
-              snprintf(promote_psp_game_folder, MAX_PATH_LENGTH, "%s/PSP/GAME", PSP_TEMP);
-              snprintf(promote_psp_license_folder, MAX_PATH_LENGTH, "%s/PSP/LICENSE", PSP_TEMP);
-
-              snprintf(promote_license_rif, MAX_PATH_LENGTH, "%s/PSP/LICENSE/%s.rif", PSP_TEMP, contentid);
-
-              void *sfo_buffer = NULL;
-              int sfo_size = get_pbp_sfo(eboot_pbp, &sfo_buffer);
-
-            if(sfo_size >= 0) {
-
-              char discid[12];
-
-              getSfoString(sfo_buffer, "DISC_ID", discid, sizeof(discid));
-
-              // maintain compatiblity with psp bubble cloning, and other tricks
-              // use folder name as disc id, *only* on npumdimg
-              if(pbp_type == PBP_TYPE_NPUMDIMG)
-                strncpy(discid, subdir, sizeof(discid)-1);
-
-              // ensure its installing PS1 to the correct folder ..
-              // if ps1 installed to incorrect folder, will give
-              // 'cannot open the memory card' error message
-              snprintf(promote_game_folder, MAX_PATH_LENGTH, "%s/PSP/GAME/%s", PSP_TEMP, discid);
-              sceClibPrintf("promote_game_folder: %s\n", promote_game_folder);
-              sceClibPrintf("game_folder: %s\n", path);
-
-              // get current rif location
-              snprintf(license_rif, MAX_PATH_LENGTH, "ux0:/pspemu/PSP/LICENSE/%s.rif", contentid);
-
-              // create the promote directories with proper permissions for USB visibility
-
-              sceIoMkdir("ux0:pspemu", 0777);
-              sceIoMkdir("ux0:pspemu/temp", 0777);
-              sceIoMkdir(PSP_TEMP, 0777);
-              sceIoMkdir(promote_psp_folder, 0777);
-              sceIoMkdir(promote_psp_game_folder, 0777);
-              sceIoMkdir(promote_psp_license_folder, 0777);
-              
-              // copy the rif to the promote location
-              int res = copyFile(license_rif, promote_license_rif, NULL);
-              
-              if(res < 0) { // no rif found?
-                // generate fake psp license
-                SceNpDrmLicense license;
-                memset(&license, 0x00, sizeof(SceNpDrmLicense));
-                license.account_id = 0x0123456789ABCDEFLL;
-                memset(license.ecdsa_signature, 0xFF, 0x28);
-                strncpy(license.content_id, contentid, 0x30);
-                WriteFile(promote_license_rif, &license, offsetof(SceNpDrmLicense, flags));
-              }
-              
-              // promote will fail if __sce_ebootpbp signature file is invalid (or for another account)
-              // so we have to generate a new one ..
-              sceIoRemove(sce_ebootpbp);
-              
-              int eboot_gen = gen_sce_ebootpbp(path, discid);
-              
-              // move path to promote folder
-              sceIoRename(path, promote_game_folder);
-              
-              int promote = promoteCma(PSP_TEMP, discid, SCE_PKG_TYPE_PSP);
-              
-              sceClibPrintf("eboot_gen: %x, promote %x\n", eboot_gen, promote);
-              
-              if (promote == 0) {
-                refresh_data->refreshed++;
-              }
-              else {
-                sceIoRename(promote_game_folder, path); // Restore folder on error
-                removePath(PSP_TEMP, NULL); // delete what was created 
-              }
-              
-              // if eboot signature generation was unsuccessful, write original signature back
-              if(eboot_gen < 0) {
-                if(sce_ebootpbp_sz > 0)
-                  WriteFile(sce_ebootpbp, sce_ebootpbp_sig_data, sce_ebootpbp_sz); // Restore __sce_ebootpbp on error
-              }
-            }
-
-            if(sfo_buffer != NULL)
-              free(sfo_buffer);
-          
-          }
-          
-          if(sce_ebootpbp_sig_data != NULL)
-            free(sce_ebootpbp_sig_data);
-          
-         }
-	  }
-    SetProgress(++refresh_data->processed, refresh_data->count);
-  } else {
-    refresh_data->count++;
+  sceKernelLockLwMutex(&scan->mutex, 1, NULL);
+  item->needed = needed;
+  item->ready = 1;
+  sceKernelUnlockLwMutex(&scan->mutex, 1);
+}
+
+// Check a dlc or patch once the apps of this run have been promoted
+static void refresh_check_item(refresh_scan_t *scan, refresh_item_t *item) {
+  item->needed = refresh_item_needed(scan, item);
+  if (item->needed)
+    refresh_item_prepare(item);
+}
+
+static int refresh_scan_thread(SceSize args, void *argp) {
+  refresh_scan_t *scan = *(refresh_scan_t **)argp;
+
+  while (1) {
+    sceKernelLockLwMutex(&scan->mutex, 1, NULL);
+    int i = scan->next;
+    int done = scan->abort || (i >= scan->list->count);
+    if (!done)
+      scan->next++;
+    sceKernelUnlockLwMutex(&scan->mutex, 1);
+
+    if (done)
+      break;
+
+    refresh_scan_item(scan, &scan->list->items[i]);
+    sceKernelSignalSema(scan->ready_sema, 1);
   }
 
+  return sceKernelExitDeleteThread(0);
 }
 
-void psm_callback(void* data, const char* dir, const char* subdir) {
-  refresh_data_t *refresh_data = (refresh_data_t*)data;
+// Wait for the scanner threads to have prepared an item
+static void refresh_wait_item(refresh_scan_t *scan, refresh_item_t *item) {
+  // Without scanner threads, the promoter scans the item itself
+  if (scan->threads == 0) {
+    refresh_scan_item(scan, item);
+    return;
+  }
+
+  while (1) {
+    sceKernelLockLwMutex(&scan->mutex, 1, NULL);
+    int ready = item->ready;
+    sceKernelUnlockLwMutex(&scan->mutex, 1);
+
+    if (ready)
+      break;
+
+    sceKernelWaitSema(scan->ready_sema, 1, NULL);
+  }
+}
+
+static void refresh_app_item(refresh_data_t *refresh_data, const refresh_item_t *item, const char *temp_path) {
+  const char *path = item->path;
+
+  // Move the directory to temp for installation
+  if (refresh_stage(path, temp_path) < 0)
+    return;
+
+  if (refreshApp(temp_path, item->custom_homebrew, item->rif) == 1) {
+    refresh_data->refreshed++;
+    refresh_unstage(path, 0);
+  } else {
+    // Restore folder on error
+    refresh_unstage(path, 1);
+  }
+}
+
+static void refresh_dlc_group(refresh_data_t *refresh_data, refresh_item_t *items, int count) {
   char path[MAX_PATH_LENGTH];
 
-  if (refresh_data->refresh_pass) {
-    snprintf(path, MAX_PATH_LENGTH, "%s/%s", dir, subdir);
-    if (refreshNeeded(path, "psm")) {        
-      char contentid_path[MAX_PATH_LENGTH];
-      snprintf(contentid_path, MAX_PATH_LENGTH, "%s/RW/System/content_id", path);
-      
-      char titleid[12];
-      void *cidFile = NULL;
-      
-      // Initalize Bufer
-      memset(titleid,0,12);
-  
-      // Get content id
-      allocateReadFile(contentid_path, &cidFile);
-  
-      // Get title id from content id
-      strncpy(titleid,cidFile+7,9);
-      
-      //free buffers
-      free(cidFile);
-      
-      
-      // Get promote path
-      char promote_path[MAX_PATH_LENGTH];
-      snprintf(promote_path,MAX_PATH_LENGTH,"%s/%s",PSM_TEMP, titleid);
-  
-      // Move the directory to temp for installation
-      removePath(promote_path, NULL);
-      sceIoRename(path, promote_path);
-  
-      // Finally call promote
-      if (promoteCma(PSM_TEMP, titleid, SCE_PKG_TYPE_PSM) == 0) {
-        refresh_data->refreshed++;
+  // For dlc, the process happens in two phases to avoid promotion errors:
+  // 1. Move all dlc that require refresh out of addcont/title_id
+  // 2. Refresh the moved dlc_data
+  for (int i = 0; i < count; i++) {
+    if (items[i].needed) {
+      snprintf(path, MAX_PATH_LENGTH, DLC_TEMP "/%s", strrchr(items[i].path, '/') + 1);
+      if (refresh_stage(items[i].path, path) < 0) {
+        items[i].needed = 0;
+        SetProgress(++refresh_data->processed, refresh_data->count);
       }
-      else{
-        sceIoRename(promote_path, path); // Restore folder on error
+    } else {
+      SetProgress(++refresh_data->processed, refresh_data->count);
+    }
+  }
+
+  // Now that the dlc we need are out of addcont/title_id, refresh them
+  for (int i = 0; i < count; i++) {
+    if (items[i].needed) {
+      snprintf(path, MAX_PATH_LENGTH, DLC_TEMP "/%s", strrchr(items[i].path, '/') + 1);
+      if (refreshApp(path, items[i].custom_homebrew, items[i].rif) == 1) {
+        refresh_data->refreshed++;
+        refresh_unstage(items[i].path, 0);
+      } else {
+        refresh_unstage(items[i].path, 1);
       }
       SetProgress(++refresh_data->processed, refresh_data->count);
     }
-  } else {
-    refresh_data->count++;
+  }
+}
+
+static void refresh_psp_item(refresh_data_t *refresh_data, const char *path) {
+  const char *name = strrchr(path, '/') + 1;
+  char contentid[0x30];
+
+  char sce_ebootpbp[MAX_PATH_LENGTH];
+  char eboot_pbp[MAX_PATH_LENGTH];
+  char license_rif[MAX_PATH_LENGTH];
+
+  snprintf(eboot_pbp, MAX_PATH_LENGTH, "%s/EBOOT.PBP", path);
+  snprintf(sce_ebootpbp, MAX_PATH_LENGTH, "%s/__sce_ebootpbp", path);
+
+  // read header, pbp type and content id once
+  PbpHandle pbp;
+  if (pbp_open(&pbp, eboot_pbp) < 0)
+    return;
+
+  int pbp_type = pbp.type;
+  if (pbp_type == PBP_TYPE_UNKNOWN) {
+    pbp_close(&pbp);
+    return;
+  }
+
+  // hash the eboot while the promote folders and license are prepared
+  if (pbp.content_id_valid && (pbp_type == PBP_TYPE_PSISOIMG || pbp_type == PBP_TYPE_NPUMDIMG))
+    pbp_hash_start(&pbp);
+
+  // cache current __sce_ebootpbp signature file
+  void* sce_ebootpbp_sig_data = NULL;
+  int sce_ebootpbp_sz = allocateReadFile(sce_ebootpbp, &sce_ebootpbp_sig_data);
+
+  if (pbp.content_id_valid) {
+    strncpy(contentid, pbp.content_id, sizeof(contentid));
+
+    // create directories
+    char promote_psp_folder[MAX_PATH_LENGTH];
+    char promote_psp_game_folder[MAX_PATH_LENGTH];
+    char promote_psp_license_folder[MAX_PATH_LENGTH];
+
+    char promote_license_rif[MAX_PATH_LENGTH];
+    char promote_game_folder[MAX_PATH_LENGTH];
+
+    snprintf(promote_psp_folder, MAX_PATH_LENGTH, "%s/PSP", PSP_TEMP);
+    snprintf(promote_psp_game_folder, MAX_PATH_LENGTH, "%s/PSP/GAME", PSP_TEMP);
+    snprintf(promote_psp_license_folder, MAX_PATH_LENGTH, "%s/PSP/LICENSE", PSP_TEMP);
+
+    snprintf(promote_license_rif, MAX_PATH_LENGTH, "%s/PSP/LICENSE/%s.rif", PSP_TEMP, contentid);
+
+    void *sfo_buffer = NULL;
+    int sfo_size = pbp_read_sfo(&pbp, &sfo_buffer);
+
+    if (sfo_size >= 0) {
+      char discid[12];
+
+      getSfoString(sfo_buffer, "DISC_ID", discid, sizeof(discid));
+
+      // maintain compatiblity with psp bubble cloning, and other tricks
+      // use folder name as disc id, *only* on npumdimg
+      if (pbp_type == PBP_TYPE_NPUMDIMG)
+        strncpy(discid, name, sizeof(discid)-1);
+
+      // ensure its installing PS1 to the correct folder ..
+      // if ps1 installed to incorrect folder, will give
+      // 'cannot open the memory card' error message
+      snprintf(promote_game_folder, MAX_PATH_LENGTH, "%s/PSP/GAME/%s", PSP_TEMP, discid);
+      sceClibPrintf("promote_game_folder: %s\n", promote_game_folder);
+      sceClibPrintf("game_folder: %s\n", path);
+
+      // get current rif location
+      snprintf(license_rif, MAX_PATH_LENGTH, "ux0:/pspemu/PSP/LICENSE/%s.rif", contentid);
+
+      // create the promote directories with proper permissions for USB visibility
+      sceIoMkdir("ux0:pspemu", 0777);
+      sceIoMkdir("ux0:pspemu/temp", 0777);
+      sceIoMkdir(PSP_TEMP, 0777);
+      sceIoMkdir(promote_psp_folder, 0777);
+      sceIoMkdir(promote_psp_game_folder, 0777);
+      sceIoMkdir(promote_psp_license_folder, 0777);
+
+      // copy the rif to the promote location
+      int res = copyFile(license_rif, promote_license_rif, NULL);
+
+      if (res < 0) { // no rif found?
+        // generate fake psp license
+        SceNpDrmLicense license;
+        memset(&license, 0x00, sizeof(SceNpDrmLicense));
+        license.account_id = 0x0123456789ABCDEFLL;
+        memset(license.ecdsa_signature, 0xFF, 0x28);
+        strncpy(license.content_id, contentid, 0x30);
+        WriteFile(promote_license_rif, &license, offsetof(SceNpDrmLicense, flags));
+      }
+
+      // promote will fail if __sce_ebootpbp signature file is invalid (or for another account)
+      // so we have to generate a new one ..
+      sceIoRemove(sce_ebootpbp);
+
+      int eboot_gen = gen_sce_ebootpbp(&pbp, path, discid);
+
+      // the eboot must not be open while its folder is moved
+      pbp_close(&pbp);
+
+      // move path to promote folder
+      if (refresh_stage(path, promote_game_folder) >= 0) {
+        int promote = promoteCma(PSP_TEMP, discid, SCE_PKG_TYPE_PSP);
+
+        sceClibPrintf("eboot_gen: %x, promote %x\n", eboot_gen, promote);
+
+        if (promote == 0) {
+          refresh_data->refreshed++;
+          refresh_unstage(path, 0);
+        } else {
+          refresh_unstage(path, 1); // Restore folder on error
+          removePath(PSP_TEMP, NULL); // delete what was created
+        }
+      }
+
+      // if eboot signature generation was unsuccessful, write original signature back
+      if (eboot_gen < 0) {
+        if (sce_ebootpbp_sz > 0)
+          WriteFile(sce_ebootpbp, sce_ebootpbp_sig_data, sce_ebootpbp_sz); // Restore __sce_ebootpbp on error
+      }
+    }
+
+    if (sfo_buffer != NULL)
+      free(sfo_buffer);
+  }
+
+  pbp_close(&pbp);
+
+  if (sce_ebootpbp_sig_data != NULL)
+    free(sce_ebootpbp_sig_data);
+}
+
+static void refresh_psm_item(refresh_data_t *refresh_data, const refresh_item_t *item) {
+  const char *path = item->path;
+  const char *titleid = item->titleid;
+
+  if (titleid[0] == '\0')
+    return;
+
+  // Get promote path
+  char promote_path[MAX_PATH_LENGTH];
+  snprintf(promote_path,MAX_PATH_LENGTH,"%s/%s",PSM_TEMP, titleid);
+
+  // Move the directory to temp for installation
+  if (refresh_stage(path, promote_path) < 0)
+    return;
+
+  // Finally call promote
+  if (promoteCma(PSM_TEMP, titleid, SCE_PKG_TYPE_PSM) == 0) {
+    refresh_data->refreshed++;
+    refresh_unstage(path, 0);
+  }
+  else{
+    refresh_unstage(path, 1); // Restore folder on error
+  }
+}
+
+static void refresh_stop_scan(refresh_scan_t *scan, SceUID *thids) {
+  sceKernelLockLwMutex(&scan->mutex, 1, NULL);
+  scan->abort = 1;
+  sceKernelUnlockLwMutex(&scan->mutex, 1);
+
+  for (int i = 0; i < REFRESH_SCAN_THREADS; i++) {
+    if (thids[i] >= 0) {
+      sceKernelWaitThreadEnd(thids[i], NULL, NULL);
+      thids[i] = -1;
+    }
   }
 }
 
 int refresh_thread(SceSize args, void *argp)  {
   SceUID thid = -1;
-  refresh_data_t refresh_data = { 0, 0, 0, 0 };
-  
+  SceUID scan_thids[REFRESH_SCAN_THREADS];
+  int session = 0;
+  int rif_index = 0;
+  refresh_list_t list;
+  refresh_scan_t scan;
+  refresh_scan_t *scan_ptr = &scan;
+  refresh_data_t refresh_data = { 0, 0, 0 };
+
+  memset(&list, 0, sizeof(refresh_list_t));
+  memset(&scan, 0, sizeof(refresh_scan_t));
+  scan.list = &list;
+  scan.ready_sema = -1;
+  for (int i = 0; i < REFRESH_SCAN_THREADS; i++)
+    scan_thids[i] = -1;
+
+  sceKernelCreateLwMutex(&scan.mutex, "refresh_scan_mutex", 2, 0, NULL);
+  sceKernelCreateLwMutex(&appmeta_mutex, "appmeta_mutex", 2, 0, NULL);
+
   // Lock power timers
   powerLock();
 
@@ -633,26 +1000,20 @@ int refresh_thread(SceSize args, void *argp)  {
   sceMsgDialogProgressBarSetValue(SCE_MSG_DIALOG_PROGRESSBAR_TARGET_BAR_DEFAULT, 0);
   sceKernelDelayThread(DIALOG_WAIT); // Needed to see the percentage
 
-  // Get the app count
-  if (parse_dir_with_callback(SCE_S_IFDIR, "ux0:app", app_callback, &refresh_data) < 0)
+  // Enumerate apps, dlc, patches, psm and psp titles once
+  if (parse_dir_with_callback(SCE_S_IFDIR, "ux0:app", app_enum_callback, &list) < 0)
     goto EXIT;
-
-  // Get the dlc count
-  if (parse_dir_with_callback(SCE_S_IFDIR, "ux0:addcont", dlc_callback_outer, &refresh_data) < 0)
+  if (parse_dir_with_callback(SCE_S_IFDIR, "ux0:addcont", dlc_enum_callback_outer, &list) < 0)
     goto EXIT;
-
-  // Get the patch count
-  if (parse_dir_with_callback(SCE_S_IFDIR, "ux0:patch", patch_callback, &refresh_data) < 0)
+  if (parse_dir_with_callback(SCE_S_IFDIR, "ux0:patch", patch_enum_callback, &list) < 0)
     goto EXIT;
-
-  // Get the psm count
-  if (parse_dir_with_callback(SCE_S_IFDIR, "ux0:psm", psm_callback, &refresh_data) < 0)
+  if (parse_dir_with_callback(SCE_S_IFDIR, "ux0:psm", psm_enum_callback, &list) < 0)
     goto EXIT;
- 
-  // Get the psp count
-  if (parse_dir_with_callback(SCE_S_IFDIR, "ux0:pspemu/PSP/GAME", psp_callback, &refresh_data) < 0)
+  if (parse_dir_with_callback(SCE_S_IFDIR, "ux0:pspemu/PSP/GAME", psp_enum_callback, &list) < 0)
     goto EXIT;
 
+  refresh_data.count = list.count;
+
   // Update thread
   thid = createStartUpdateThread(refresh_data.count, 0);
 
@@ -664,33 +1025,110 @@ int refresh_thread(SceSize args, void *argp)  {
   sceIoMkdir(PATCH_TEMP, 0777);
   sceIoMkdir(PSM_TEMP, 0777);
   sceIoMkdir(PSP_TEMP, 0777);
-  refresh_data.refresh_pass = 1;
 
-  // Refresh apps
-  if (parse_dir_with_callback(SCE_S_IFDIR, "ux0:app", app_callback, &refresh_data) < 0)
-    goto EXIT;
+  // Load the results of the previous refresh
+  refreshCacheLoad();
+
+  // Serve work.bin restores from memory
+  if (checkFileExist(LICENSE_DB) && rif_index_open(LICENSE_DB) == 0)
+    rif_index = 1;
+
+  // Load the promoter once for all titles
+  if (promoterSessionOpen() >= 0)
+    session = 1;
+
+  // Start the scanners. They check and prepare titles ahead of us,
+  // while promotion itself stays on this thread. If none of them
+  // starts, this thread scans each title right before promoting it.
+  scan.ready_sema = sceKernelCreateSema("refresh_ready_sema", 0, 0, list.count + 1, NULL);
+  for (int i = 0; i < REFRESH_SCAN_THREADS && scan.ready_sema >= 0; i++) {
+    scan_thids[i] = sceKernelCreateThread("refresh_scan_thread", (SceKernelThreadEntry)refresh_scan_thread, 0x40, 0x40000, 0, 0, NULL);
+    if (scan_thids[i] < 0)
+      continue;
+
+    if (sceKernelStartThread(scan_thids[i], sizeof(refresh_scan_t *), &scan_ptr) < 0) {
+      sceKernelDeleteThread(scan_thids[i]);
+      scan_thids[i] = -1;
+      continue;
+    }
 
-  // Refresh dlc
-  if (parse_dir_with_callback(SCE_S_IFDIR, "ux0:addcont", dlc_callback_outer, &refresh_data) < 0)
-    goto EXIT;
-  
-  // Refresh patch
-  if (parse_dir_with_callback(SCE_S_IFDIR, "ux0:patch", patch_callback, &refresh_data) < 0)
-    goto EXIT;
+    scan.threads++;
+  }
 
-  // Refresh psm
-  if (parse_dir_with_callback(SCE_S_IFDIR, "ux0:psm", psm_callback, &refresh_data) < 0)
-    goto EXIT;
+  for (int i = 0; i < list.count; i++) {
+    refresh_item_t *item = &list.items[i];
+
+    if (item->type == REFRESH_ITEM_DLC) {
+      // Refresh all dlc of a title together
+      int n = 1;
+      while ((i + n) < list.count && list.items[i + n].type == REFRESH_ITEM_DLC &&
+             list.items[i + n].group == item->group)
+        n++;
+      // Apps are listed before dlc, so all of them have been promoted
+      for (int j = 0; j < n; j++) {
+        refresh_wait_item(&scan, &item[j]);
+        refresh_check_item(&scan, &item[j]);
+      }
+      refresh_dlc_group(&refresh_data, item, n);
+      i += n - 1;
+    } else {
+      refresh_wait_item(&scan, item);
+
+      // Apps are listed before patches, so all of them have been promoted
+      if (item->type == REFRESH_ITEM_PATCH)
+        refresh_check_item(&scan, item);
+
+      if (item->needed) {
+        switch (item->type) {
+          case REFRESH_ITEM_APP:
+            refresh_app_item(&refresh_data, item, APP_TEMP);
+            break;
+          case REFRESH_ITEM_PATCH:
+            refresh_app_item(&refresh_data, item, PATCH_TEMP);
+            break;
+          case REFRESH_ITEM_PSM:
+            refresh_psm_item(&refresh_data, item);
+            break;
+          case REFRESH_ITEM_PSP:
+            refresh_psp_item(&refresh_data, item->path);
+            break;
+        }
+      }
+      SetProgress(++refresh_data.processed, refresh_data.count);
+    }
 
-  // Refresh psp
-  if (parse_dir_with_callback(SCE_S_IFDIR, "ux0:pspemu/PSP/GAME", psp_callback, &refresh_data) < 0)
-    goto EXIT;
+    if (cancelHandler()) {
+      closeWaitDialog();
+      setDialogStep(DIALOG_STEP_CANCELED);
+      goto EXIT;
+    }
+  }
 
   sceIoRmdir(DLC_TEMP);
   sceIoRmdir(PATCH_TEMP);
   sceIoRmdir(PSM_TEMP);
   sceIoRmdir(PSP_TEMP);
-  
+
+  refresh_stop_scan(&scan, scan_thids);
+
+  if (session) {
+    PromoterStats stats;
+
+    promoterSessionClose();
+    session = 0;
+
+    promoterSessionGetStats(&stats);
+    debugPrintf("refresh: %d titles, promoter load %llu us, check %d/%llu us, promote %d/%llu us, delete %d/%llu us, unload %llu us\n",
+                refresh_data.count, stats.load_time,
+                stats.check_count, stats.check_time,
+                stats.promote_count, stats.promote_time,
+                stats.delete_count, stats.delete_time,
+                stats.unload_time);
+  }
+
+  // Remember which titles are up to date
+  refreshCacheSave();
+
   // Set progress to 100%
   sceMsgDialogProgressBarSetValue(SCE_MSG_DIALOG_PROGRESSBAR_TARGET_BAR_DEFAULT, 100);
   sceKernelDelayThread(COUNTUP_WAIT);
@@ -701,6 +1139,27 @@ int refresh_thread(SceSize args, void *argp)  {
   infoDialog(language_container[REFRESHED], refresh_data.refreshed);
 
 EXIT:
+  refresh_stop_scan(&scan, scan_thids);
+
+  if (scan.ready_sema >= 0)
+    sceKernelDeleteSema(scan.ready_sema);
+  sceKernelDeleteLwMutex(&scan.mutex);
+  sceKernelDeleteLwMutex(&appmeta_mutex);
+
+  if (session)
+    promoterSessionClose();
+
+  if (rif_index)
+    rif_index_close();
+
+  refreshCacheFree();
+  refresh_list_free(&list);
+
+  free(staged_titles);
+  staged_titles = NULL;
+  staged_count = 0;
+  staged_size = 0;
+
   if (thid >= 0)
     sceKernelWaitThreadEnd(thid, NULL, NULL);
 
@@ -711,9 +1170,6 @@ EXIT:
   return sceKernelExitDeleteThread(0);
 }
 
-// Note: This is currently not optimized AT ALL.
-// Ultimately, we want to use a single transaction and avoid trying to
-// re-insert rifs that are already present.
 void license_file_callback(void* data, const char* dir, const char* file) {
   license_data_t *license_data = (license_data_t*)data;
   char path[MAX_PATH_LENGTH];
@@ -727,8 +1183,7 @@ void license_file_callback(void* data, const char* dir, const char* file) {
     if (fd > 0) {
       int read = sceIoRead(fd, license_data->rif, RIF_SIZE);
       if (read == RIF_SIZE) {
-        if (insert_rif(LICENSE_DB, license_data->rif) == 0)
-          license_data->copied++;
+        rif_import_add(license_data->import, license_data->rif);
       }
       sceIoClose(fd);
     }
@@ -752,7 +1207,9 @@ void license_dir_callback(void* data, const char* dir, const char* subdir) {
 
 int license_thread(SceSize args, void *argp) {
   SceUID thid = -1;
-  license_data_t license_data = { 0, 0, 0, 0, 0, 1, malloc(RIF_SIZE) };
+  license_data_t license_data = { 0, 0, 0, 0, 1, malloc(RIF_SIZE), NULL };
+  rif_import_stats_t stats;
+  int rif_index = 0;
 
   if (license_data.rif == NULL)
     goto EXIT;
@@ -782,6 +1239,15 @@ int license_thread(SceSize args, void *argp) {
     goto EXIT;
   }
 
+  // Keep the existing licenses in memory to skip unchanged ones
+  if (rif_index_open(LICENSE_DB) == 0)
+    rif_index = 1;
+
+  // Open the DB once for the whole import
+  license_data.import = rif_import_begin(LICENSE_DB);
+  if (license_data.import == NULL)
+    goto EXIT;
+
   // Insert the licenses
   license_data.copy_pass = 1;
   license_data.max_depth = 1;
@@ -791,6 +1257,10 @@ int license_thread(SceSize args, void *argp) {
   if (parse_dir_with_callback(SCE_S_IFDIR, "ux0:license/addcont", license_dir_callback, &license_data) < 0)
     goto EXIT;
 
+  // Commit the last batch
+  rif_import_end(license_data.import, &stats);
+  license_data.import = NULL;
+
   // Set progress to 100%
   sceMsgDialogProgressBarSetValue(SCE_MSG_DIALOG_PROGRESSBAR_TARGET_BAR_DEFAULT, 100);
   sceKernelDelayThread(COUNTUP_WAIT);
@@ -798,9 +1268,15 @@ int license_thread(SceSize args, void *argp) {
   // Close
   closeWaitDialog();
 
-  infoDialog(language_container[IMPORTED_LICENSES], license_data.copied);
+  infoDialog(language_container[IMPORTED_LICENSES_DETAILS], stats.inserted, stats.updated, stats.skipped);
 
 EXIT:
+  if (license_data.import)
+    rif_import_end(license_data.import, NULL);
+
+  if (rif_index)
+    rif_index_close();
+
   if (thid >= 0)
     sceKernelWaitThreadEnd(thid, NULL, NULL);
 
@@ -19,6 +19,8 @@
 #ifndef __REFRESH_H__
 #define __REFRESH_H__
 
+void refreshRestoreJournal();
+
 int refresh_thread(SceSize args, void *argp);
 int license_thread(SceSize args, void *argp);
 
@@ -0,0 +1,202 @@
+/*
+  VitaShell
+  Copyright (C) 2015-2018, TheFloW
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "main.h"
+#include "refresh_cache.h"
+
+#define APP_DB "ur0:shell/db/app.db"
+
+// Entries from the previous refresh, sorted by path
+static RefreshCacheEntry *old_entries = NULL;
+static int old_count = 0;
+
+// Entries confirmed during this refresh
+static RefreshCacheEntry *new_entries = NULL;
+static int new_count = 0;
+static int new_size = 0;
+
+static int getCacheStamp(uint64_t *account_id, SceDateTime *appdb_mtime) {
+  SceIoStat stat;
+
+  *account_id = 0;
+  sceRegMgrGetKeyBin("/CONFIG/NP", "account_id", account_id, sizeof(uint64_t));
+
+  memset(appdb_mtime, 0, sizeof(SceDateTime));
+  int res = sceIoGetstat(APP_DB, &stat);
+  if (res < 0)
+    return res;
+
+  memcpy(appdb_mtime, &stat.st_mtime, sizeof(SceDateTime));
+  return 0;
+}
+
+static int entryCompare(const void *a, const void *b) {
+  return strcmp(((RefreshCacheEntry *)a)->path, ((RefreshCacheEntry *)b)->path);
+}
+
+void refreshCacheFree() {
+  free(old_entries);
+  old_entries = NULL;
+  old_count = 0;
+
+  free(new_entries);
+  new_entries = NULL;
+  new_count = 0;
+  new_size = 0;
+}
+
+void refreshCacheLoad() {
+  RefreshCacheHeader header;
+  uint64_t account_id;
+  SceDateTime appdb_mtime;
+
+  refreshCacheFree();
+
+  if (getCacheStamp(&account_id, &appdb_mtime) < 0)
+    return;
+
+  SceUID fd = sceIoOpen(REFRESH_CACHE_PATH, SCE_O_RDONLY, 0);
+  if (fd < 0)
+    return;
+
+  SceIoStat stat;
+  if (sceIoGetstatByFd(fd, &stat) < 0) {
+    sceIoClose(fd);
+    return;
+  }
+
+  // Any change to the account or to the app database invalidates everything
+  if (sceIoRead(fd, &header, sizeof(RefreshCacheHeader)) != sizeof(RefreshCacheHeader) ||
+      header.magic != REFRESH_CACHE_MAGIC ||
+      header.version != REFRESH_CACHE_VERSION ||
+      header.account_id != account_id ||
+      memcmp(&header.appdb_mtime, &appdb_mtime, sizeof(SceDateTime)) != 0 ||
+      header.count == 0) {
+    sceIoClose(fd);
+    return;
+  }
+
+  // The count must match the file, a damaged one must not size the allocation
+  if (header.count > (stat.st_size - sizeof(RefreshCacheHeader)) / sizeof(RefreshCacheEntry)) {
+    sceIoClose(fd);
+    return;
+  }
+
+  old_entries = malloc(header.count * sizeof(RefreshCacheEntry));
+  if (old_entries) {
+    int size = header.count * sizeof(RefreshCacheEntry);
+    if (sceIoRead(fd, old_entries, size) == size) {
+      old_count = header.count;
+      qsort(old_entries, old_count, sizeof(RefreshCacheEntry), entryCompare);
+    } else {
+      free(old_entries);
+      old_entries = NULL;
+    }
+  }
+
+  sceIoClose(fd);
+}
+
+void refreshCacheSave() {
+  RefreshCacheHeader header;
+
+  // Stamp with the app database as it is after our own promotions
+  memset(&header, 0, sizeof(RefreshCacheHeader));
+  if (getCacheStamp(&header.account_id, &header.appdb_mtime) < 0) {
+    sceIoRemove(REFRESH_CACHE_PATH);
+    return;
+  }
+
+  header.magic = REFRESH_CACHE_MAGIC;
+  header.version = REFRESH_CACHE_VERSION;
+  header.count = new_count;
+
+  sceIoMkdir("ux0:VitaShell/internal", 0777);
+
+  SceUID fd = sceIoOpen(REFRESH_CACHE_PATH, SCE_O_WRONLY | SCE_O_CREAT | SCE_O_TRUNC, 0777);
+  if (fd < 0)
+    return;
+
+  int size = new_count * sizeof(RefreshCacheEntry);
+  if (sceIoWrite(fd, &header, sizeof(RefreshCacheHeader)) != sizeof(RefreshCacheHeader) ||
+      (size > 0 && sceIoWrite(fd, new_entries, size) != size)) {
+    sceIoClose(fd);
+    sceIoRemove(REFRESH_CACHE_PATH);
+    return;
+  }
+
+  sceIoClose(fd);
+}
+
+// Fill in the current key of a title and check it against the previous refresh.
+// license_path is the title's rif, if it needs one; a missing rif is part of
+// the key too. Returns 1 if the title was up to date and has not changed since.
+int refreshCacheLookup(const char *path, const char *meta_path, const char *license_path, RefreshCacheEntry *entry) {
+  SceIoStat stat;
+
+  memset(entry, 0, sizeof(RefreshCacheEntry));
+
+  if (strlen(path) >= REFRESH_CACHE_PATH_SIZE)
+    return 0;
+  strcpy(entry->path, path);
+
+  if (sceIoGetstat(path, &stat) < 0)
+    goto NO_KEY;
+  memcpy(&entry->dir_mtime, &stat.st_mtime, sizeof(SceDateTime));
+
+  if (sceIoGetstat(meta_path, &stat) < 0)
+    goto NO_KEY;
+  memcpy(&entry->meta_mtime, &stat.st_mtime, sizeof(SceDateTime));
+  entry->meta_size = stat.st_size;
+
+  if (license_path && sceIoGetstat(license_path, &stat) >= 0) {
+    memcpy(&entry->license_mtime, &stat.st_mtime, sizeof(SceDateTime));
+    entry->license_size = stat.st_size;
+  }
+
+  if (old_count == 0)
+    return 0;
+
+  RefreshCacheEntry *old = bsearch(entry, old_entries, old_count, sizeof(RefreshCacheEntry), entryCompare);
+  if (old == NULL || memcmp(old, entry, sizeof(RefreshCacheEntry)) != 0)
+    return 0;
+
+  refreshCacheAdd(entry);
+  return 1;
+
+NO_KEY:
+  // Titles we cannot key are never cached
+  entry->path[0] = '\0';
+  return 0;
+}
+
+void refreshCacheAdd(const RefreshCacheEntry *entry) {
+  if (entry->path[0] == '\0')
+    return;
+
+  if (new_count == new_size) {
+    int size = new_size ? new_size * 2 : 64;
+    RefreshCacheEntry *entries = realloc(new_entries, size * sizeof(RefreshCacheEntry));
+    if (entries == NULL)
+      return;
+    new_entries = entries;
+    new_size = size;
+  }
+
+  memcpy(&new_entries[new_count++], entry, sizeof(RefreshCacheEntry));
+}
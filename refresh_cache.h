@@ -0,0 +1,53 @@
+/*
+  VitaShell
+  Copyright (C) 2015-2018, TheFloW
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __REFRESH_CACHE_H__
+#define __REFRESH_CACHE_H__
+
+#define REFRESH_CACHE_PATH "ux0:VitaShell/internal/refresh_cache.bin"
+#define REFRESH_CACHE_MAGIC 0x43525356 // VSRC
+#define REFRESH_CACHE_VERSION 2
+
+#define REFRESH_CACHE_PATH_SIZE 128
+
+// Per-title record, written for titles that were found up to date
+typedef struct {
+  char path[REFRESH_CACHE_PATH_SIZE];
+  SceDateTime dir_mtime;
+  SceDateTime meta_mtime;
+  SceOff meta_size;
+  SceDateTime license_mtime;
+  SceOff license_size;
+} RefreshCacheEntry;
+
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t account_id;
+  SceDateTime appdb_mtime;
+  uint32_t count;
+} RefreshCacheHeader;
+
+void refreshCacheLoad();
+void refreshCacheSave();
+void refreshCacheFree();
+
+int refreshCacheLookup(const char *path, const char *meta_path, const char *license_path, RefreshCacheEntry *entry);
+void refreshCacheAdd(const RefreshCacheEntry *entry);
+
+#endif
@@ -19,11 +19,196 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <psp2/io/stat.h>
+#include <psp2/kernel/threadmgr.h>
 
 #include "rif.h"
 #include "sqlite3.h"
 
 #define MAX_QUERY_LENGTH 128
+#define MAX_DB_PATH_LENGTH 256
+
+typedef struct rif_index_entry {
+  struct rif_index_entry *next;
+  char content_id[0x30];
+  uint8_t rif[RIF_SIZE];
+} rif_index_entry_t;
+
+// content_id -> RIF index, shared by every operation that holds it open
+static SceKernelLwMutexWork rif_index_mutex;
+static rif_index_entry_t *rif_index[RIF_INDEX_BUCKETS];
+static int rif_index_refs = 0;
+static int rif_index_loaded = 0;
+static int rif_index_writers = 0;
+static char rif_index_path[MAX_DB_PATH_LENGTH];
+static SceDateTime rif_index_mtime;
+
+static uint32_t rif_index_hash(const char* content_id)
+{
+  uint32_t hash = 2166136261u;
+  for (int i = 0; i < 0x30 && content_id[i] != '\0'; i++)
+    hash = (hash ^ (uint8_t)content_id[i]) * 16777619u;
+  return hash % RIF_INDEX_BUCKETS;
+}
+
+static rif_index_entry_t* rif_index_find(const char* content_id)
+{
+  rif_index_entry_t *entry = rif_index[rif_index_hash(content_id)];
+  while (entry != NULL) {
+    if (strncmp(entry->content_id, content_id, sizeof(entry->content_id)) == 0)
+      return entry;
+    entry = entry->next;
+  }
+  return NULL;
+}
+
+static void rif_index_put(const uint8_t* rif)
+{
+  const char *content_id = (const char *)&rif[0x10];
+  rif_index_entry_t *entry = rif_index_find(content_id);
+
+  if (entry == NULL) {
+    entry = malloc(sizeof(rif_index_entry_t));
+    if (entry == NULL)
+      return;
+    strncpy(entry->content_id, content_id, sizeof(entry->content_id));
+    uint32_t hash = rif_index_hash(content_id);
+    entry->next = rif_index[hash];
+    rif_index[hash] = entry;
+  }
+
+  memcpy(entry->rif, rif, RIF_SIZE);
+}
+
+static void rif_index_clear()
+{
+  for (int i = 0; i < RIF_INDEX_BUCKETS; i++) {
+    rif_index_entry_t *entry = rif_index[i];
+    while (entry != NULL) {
+      rif_index_entry_t *next = entry->next;
+      free(entry);
+      entry = next;
+    }
+    rif_index[i] = NULL;
+  }
+  rif_index_loaded = 0;
+}
+
+static int rif_index_stat(SceDateTime *mtime)
+{
+  SceIoStat stat;
+  int res = sceIoGetstat(rif_index_path, &stat);
+  if (res < 0)
+    return res;
+  memcpy(mtime, &stat.st_mtime, sizeof(SceDateTime));
+  return 0;
+}
+
+// Build the index with a single table scan
+static int rif_index_build()
+{
+  int rc;
+  sqlite3 *db = NULL;
+  sqlite3_stmt *stmt = NULL;
+
+  rif_index_clear();
+
+  if (rif_index_stat(&rif_index_mtime) < 0)
+    return SQLITE_CANTOPEN;
+
+  rc = sqlite3_open_v2(rif_index_path, &db, SQLITE_OPEN_READONLY, NULL);
+  if (rc != SQLITE_OK)
+    goto out;
+  rc = sqlite3_prepare_v2(db, "SELECT RIF FROM Licenses", -1, &stmt, NULL);
+  if (rc != SQLITE_OK)
+    goto out;
+
+  while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+    if (sqlite3_column_bytes(stmt, 0) == RIF_SIZE)
+      rif_index_put(sqlite3_column_blob(stmt, 0));
+  }
+  if (rc == SQLITE_DONE) {
+    rc = SQLITE_OK;
+    rif_index_loaded = 1;
+  }
+
+out:
+  sqlite3_finalize(stmt);
+  sqlite3_close(db);
+  return rc;
+}
+
+// Returns 1 if the index can serve lookups for db_path, rebuilding it if
+// license.db was modified behind our back. Must be called with the lock held.
+static int rif_index_usable(const char* db_path)
+{
+  SceDateTime mtime;
+
+  if (rif_index_refs == 0 || strcmp(db_path, rif_index_path) != 0)
+    return 0;
+
+  // While importing, the importer keeps the index in sync itself
+  if (!rif_index_loaded ||
+      (rif_index_writers == 0 &&
+       (rif_index_stat(&mtime) < 0 || memcmp(&mtime, &rif_index_mtime, sizeof(SceDateTime)) != 0)))
+    rif_index_build();
+
+  return rif_index_loaded;
+}
+
+// Our own writes change the mtime too, without making the index stale
+static void rif_index_restamp(const char* db_path)
+{
+  sceKernelLockLwMutex(&rif_index_mutex, 1, NULL);
+  if (rif_index_refs > 0 && rif_index_loaded && strcmp(db_path, rif_index_path) == 0)
+    rif_index_stat(&rif_index_mtime);
+  sceKernelUnlockLwMutex(&rif_index_mutex, 1);
+}
+
+void rif_index_init()
+{
+  sceKernelCreateLwMutex(&rif_index_mutex, "rif_index_mutex", 2, 0, NULL);
+}
+
+// Keep an index of db_path in memory until the matching rif_index_close()
+int rif_index_open(const char* db_path)
+{
+  int rc = SQLITE_OK;
+
+  sceKernelLockLwMutex(&rif_index_mutex, 1, NULL);
+
+  if (rif_index_refs > 0 && strcmp(db_path, rif_index_path) != 0) {
+    sceKernelUnlockLwMutex(&rif_index_mutex, 1);
+    return SQLITE_MISUSE;
+  }
+
+  if (rif_index_refs == 0) {
+    strncpy(rif_index_path, db_path, sizeof(rif_index_path) - 1);
+    rif_index_path[sizeof(rif_index_path) - 1] = '\0';
+    rc = rif_index_build();
+
+    // Callers only close what they opened successfully
+    if (rc != SQLITE_OK) {
+      rif_index_clear();
+      rif_index_path[0] = '\0';
+      sceKernelUnlockLwMutex(&rif_index_mutex, 1);
+      return rc;
+    }
+  }
+
+  rif_index_refs++;
+
+  sceKernelUnlockLwMutex(&rif_index_mutex, 1);
+  return rc;
+}
+
+void rif_index_close()
+{
+  sceKernelLockLwMutex(&rif_index_mutex, 1, NULL);
+  if (rif_index_refs > 0 && --rif_index_refs == 0)
+    rif_index_clear();
+  sceKernelUnlockLwMutex(&rif_index_mutex, 1);
+}
 
 int create_db(const char* db_path, const char* schema)
 {
@@ -67,8 +252,15 @@ int insert_rif(const char* db_path, const uint8_t* rif)
     goto out;
   rc = sqlite3_finalize(stmt);
 
+  sceKernelLockLwMutex(&rif_index_mutex, 1, NULL);
+  if (rif_index_usable(db_path))
+    rif_index_put(rif);
+  sceKernelUnlockLwMutex(&rif_index_mutex, 1);
+
 out:
   sqlite3_close(db);
+  if (rc == SQLITE_OK)
+    rif_index_restamp(db_path);
   return rc;
 }
 
@@ -82,6 +274,19 @@ uint8_t* query_rif(const char* db_path, const char* content_id)
   uint8_t *rif = NULL;
   const uint8_t *db_rif;
 
+  sceKernelLockLwMutex(&rif_index_mutex, 1, NULL);
+  if (rif_index_usable(db_path)) {
+    rif_index_entry_t *entry = rif_index_find(content_id);
+    if (entry != NULL) {
+      rif = malloc(RIF_SIZE);
+      if (rif != NULL)
+        memcpy(rif, entry->rif, RIF_SIZE);
+    }
+    sceKernelUnlockLwMutex(&rif_index_mutex, 1);
+    return rif;
+  }
+  sceKernelUnlockLwMutex(&rif_index_mutex, 1);
+
   rc = sqlite3_open_v2(db_path, &db, SQLITE_OPEN_READONLY, NULL);
   if (rc != SQLITE_OK)
     goto out;
@@ -109,3 +314,225 @@ out:
   sqlite3_close(db);
   return rif;
 }
+
+struct rif_import {
+  sqlite3 *db;
+  char db_path[MAX_DB_PATH_LENGTH];
+  sqlite3_stmt *select_stmt;
+  sqlite3_stmt *insert_stmt;
+  sqlite3_stmt *update_stmt;
+  int batch_count;
+  // RIFs of the open batch, only put into the index once it is committed
+  uint8_t *pending;
+  int n_pending;
+  rif_import_stats_t batch_stats;
+  rif_import_stats_t stats;
+};
+
+// Open the DB once and prepare the statements used for every imported RIF
+rif_import_t* rif_import_begin(const char* db_path)
+{
+  int rc;
+  rif_import_t *import = calloc(1, sizeof(rif_import_t));
+  if (import == NULL)
+    return NULL;
+  strncpy(import->db_path, db_path, sizeof(import->db_path) - 1);
+
+  import->pending = malloc(RIF_IMPORT_BATCH_SIZE * RIF_SIZE);
+  if (import->pending == NULL) {
+    free(import);
+    return NULL;
+  }
+
+  sceKernelLockLwMutex(&rif_index_mutex, 1, NULL);
+  rif_index_writers++;
+  sceKernelUnlockLwMutex(&rif_index_mutex, 1);
+
+  rc = sqlite3_open_v2(db_path, &import->db, SQLITE_OPEN_READWRITE, NULL);
+  if (rc != SQLITE_OK)
+    goto err;
+  rc = sqlite3_prepare_v2(import->db, "SELECT RIF FROM Licenses WHERE CONTENT_ID = ?", -1, &import->select_stmt, NULL);
+  if (rc != SQLITE_OK)
+    goto err;
+  rc = sqlite3_prepare_v2(import->db, "INSERT INTO Licenses VALUES(?, ?)", -1, &import->insert_stmt, NULL);
+  if (rc != SQLITE_OK)
+    goto err;
+  rc = sqlite3_prepare_v2(import->db, "UPDATE Licenses SET RIF = ? WHERE CONTENT_ID = ?", -1, &import->update_stmt, NULL);
+  if (rc != SQLITE_OK)
+    goto err;
+
+  return import;
+
+err:
+  sqlite3_finalize(import->select_stmt);
+  sqlite3_finalize(import->insert_stmt);
+  sqlite3_finalize(import->update_stmt);
+  sqlite3_close(import->db);
+  sceKernelLockLwMutex(&rif_index_mutex, 1, NULL);
+  rif_index_writers--;
+  sceKernelUnlockLwMutex(&rif_index_mutex, 1);
+  free(import->pending);
+  free(import);
+  return NULL;
+}
+
+// Drop the open batch, so that the next RIF starts a new transaction
+static void rif_import_rollback(rif_import_t* import)
+{
+  if (sqlite3_get_autocommit(import->db) == 0)
+    sqlite3_exec(import->db, "ROLLBACK", NULL, NULL, NULL);
+  import->stats.inserted -= import->batch_stats.inserted;
+  import->stats.updated -= import->batch_stats.updated;
+  memset(&import->batch_stats, 0, sizeof(rif_import_stats_t));
+  import->batch_count = 0;
+  import->n_pending = 0;
+}
+
+static int rif_import_commit(rif_import_t* import)
+{
+  int rc = sqlite3_exec(import->db, "COMMIT", NULL, NULL, NULL);
+  if (rc != SQLITE_OK) {
+    rif_import_rollback(import);
+    return rc;
+  }
+
+  sceKernelLockLwMutex(&rif_index_mutex, 1, NULL);
+  if (rif_index_usable(import->db_path)) {
+    for (int i = 0; i < import->n_pending; i++)
+      rif_index_put(&import->pending[i * RIF_SIZE]);
+  }
+  sceKernelUnlockLwMutex(&rif_index_mutex, 1);
+
+  memset(&import->batch_stats, 0, sizeof(rif_import_stats_t));
+  import->batch_count = 0;
+  import->n_pending = 0;
+  return SQLITE_OK;
+}
+
+static uint8_t* rif_import_find_pending(rif_import_t* import, const char* content_id)
+{
+  for (int i = 0; i < import->n_pending; i++) {
+    uint8_t *rif = &import->pending[i * RIF_SIZE];
+    if (strncmp((const char *)&rif[0x10], content_id, 0x30) == 0)
+      return rif;
+  }
+  return NULL;
+}
+
+// Insert or update a RIF, skipping it if an identical one is already present.
+// Rows are committed in batches of RIF_IMPORT_BATCH_SIZE, a failed row rolls
+// back the rows of its batch.
+int rif_import_add(rif_import_t* import, const uint8_t* rif)
+{
+  int rc, found, identical, indexed;
+  uint8_t *pending;
+  const char *content_id = (const char *)&rif[0x10];
+  int content_id_len = strnlen(content_id, 0x30);
+
+  // Skipped RIFs do not count, the batch may be open with no rows yet
+  if (sqlite3_get_autocommit(import->db)) {
+    rc = sqlite3_exec(import->db, "BEGIN TRANSACTION", NULL, NULL, NULL);
+    if (rc != SQLITE_OK)
+      return rc;
+  }
+
+  // Check the open batch and the index first, the DB only if no index is open
+  pending = rif_import_find_pending(import, content_id);
+  if (pending != NULL) {
+    indexed = 1;
+    found = 1;
+    identical = memcmp(pending, rif, RIF_SIZE) == 0;
+  } else {
+    sceKernelLockLwMutex(&rif_index_mutex, 1, NULL);
+    indexed = rif_index_usable(import->db_path);
+    if (indexed) {
+      rif_index_entry_t *entry = rif_index_find(content_id);
+      found = (entry != NULL);
+      identical = found && memcmp(entry->rif, rif, RIF_SIZE) == 0;
+    }
+    sceKernelUnlockLwMutex(&rif_index_mutex, 1);
+  }
+
+  if (!indexed) {
+    sqlite3_bind_text(import->select_stmt, 1, content_id, content_id_len, SQLITE_STATIC);
+    rc = sqlite3_step(import->select_stmt);
+    found = (rc == SQLITE_ROW);
+    identical = found &&
+                sqlite3_column_bytes(import->select_stmt, 0) == RIF_SIZE &&
+                memcmp(sqlite3_column_blob(import->select_stmt, 0), rif, RIF_SIZE) == 0;
+    sqlite3_reset(import->select_stmt);
+
+    if (rc != SQLITE_ROW && rc != SQLITE_DONE) {
+      rif_import_rollback(import);
+      return rc;
+    }
+  }
+
+  if (identical) {
+    import->stats.skipped++;
+    return SQLITE_OK;
+  }
+
+  if (found) {
+    sqlite3_bind_blob(import->update_stmt, 1, rif, RIF_SIZE, SQLITE_STATIC);
+    sqlite3_bind_text(import->update_stmt, 2, content_id, content_id_len, SQLITE_STATIC);
+    rc = sqlite3_step(import->update_stmt);
+    sqlite3_reset(import->update_stmt);
+  } else {
+    sqlite3_bind_text(import->insert_stmt, 1, content_id, content_id_len, SQLITE_STATIC);
+    sqlite3_bind_blob(import->insert_stmt, 2, rif, RIF_SIZE, SQLITE_STATIC);
+    rc = sqlite3_step(import->insert_stmt);
+    sqlite3_reset(import->insert_stmt);
+  }
+
+  if (rc != SQLITE_DONE) {
+    rif_import_rollback(import);
+    return rc;
+  }
+
+  if (found) {
+    import->stats.updated++;
+    import->batch_stats.updated++;
+  } else {
+    import->stats.inserted++;
+    import->batch_stats.inserted++;
+  }
+
+  if (pending == NULL)
+    pending = &import->pending[import->n_pending++ * RIF_SIZE];
+  memcpy(pending, rif, RIF_SIZE);
+
+  if (++import->batch_count >= RIF_IMPORT_BATCH_SIZE)
+    return rif_import_commit(import);
+
+  return SQLITE_OK;
+}
+
+// Commit the last batch and close the DB
+int rif_import_end(rif_import_t* import, rif_import_stats_t* stats)
+{
+  int rc = SQLITE_OK;
+
+  if (import == NULL)
+    return SQLITE_MISUSE;
+
+  if (sqlite3_get_autocommit(import->db) == 0)
+    rc = rif_import_commit(import);
+
+  if (stats != NULL)
+    memcpy(stats, &import->stats, sizeof(rif_import_stats_t));
+
+  sqlite3_finalize(import->select_stmt);
+  sqlite3_finalize(import->insert_stmt);
+  sqlite3_finalize(import->update_stmt);
+  sqlite3_close(import->db);
+  sceKernelLockLwMutex(&rif_index_mutex, 1, NULL);
+  rif_index_writers--;
+  sceKernelUnlockLwMutex(&rif_index_mutex, 1);
+  // If the last batch failed, let the next lookup check license.db again
+  if (rc == SQLITE_OK)
+    rif_index_restamp(import->db_path);
+  free(import->pending);
+  free(import);
+  return rc;
+}
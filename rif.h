@@ -28,10 +28,32 @@
     "PRIMARY KEY(CONTENT_ID)" \
   ")"
 
+// Number of rows inserted per transaction by the batched importer
+#define RIF_IMPORT_BATCH_SIZE 256
+
+// Buckets of the in-memory content_id -> RIF index
+#define RIF_INDEX_BUCKETS 1024
+
+typedef struct rif_import rif_import_t;
+
+typedef struct {
+  int inserted;
+  int updated;
+  int skipped;
+} rif_import_stats_t;
+
 int create_db(const char* db_path, const char* schema);
 int insert_rif(const char* db_path, const uint8_t* rif);
 uint8_t* query_rif(const char* db_path, const char* content_id);
 
+void rif_index_init();
+int rif_index_open(const char* db_path);
+void rif_index_close();
+
+rif_import_t* rif_import_begin(const char* db_path);
+int rif_import_add(rif_import_t* import, const uint8_t* rif);
+int rif_import_end(rif_import_t* import, rif_import_stats_t* stats);
+
 // From sqlite3.c
 int sqlite_init();
 int sqlite_exit();
@@ -26,6 +26,7 @@
 #include "ime_dialog.h"
 #include "utils.h"
 #include "network_update.h"
+#include "archive_cache.h"
 
 static void restartShell();
 static void rebootDevice();
@@ -81,6 +82,8 @@ static ConfigEntry settings_entries[] = {
   { "FOCUS_COLOR",        CONFIG_TYPE_DECIMAL, (int *)&vitashell_config.focus_color },
   { "FONT_SIZE",          CONFIG_TYPE_DECIMAL, (int *)&vitashell_config.font_size },
   { "ENABLE_TOUCH",       CONFIG_TYPE_BOOLEAN, (int *)&vitashell_config.enable_touch },
+  { "ARCHIVE_CACHE_SIZE", CONFIG_TYPE_DECIMAL, (int *)&vitashell_config.archive_cache_size },
+  { "THUMBNAIL_VIEW",     CONFIG_TYPE_BOOLEAN, (int *)&vitashell_config.thumbnail_view },
 };
 
 static ConfigEntry theme_entries[] = {
@@ -101,6 +104,7 @@ SettingsMenuOption main_settings[] = {
   { VITASHELL_SETTINGS_FOCUS_COLOR,     SETTINGS_OPTION_TYPE_OPTIONS, NULL, NULL, 0,
     focus_color_options_texts, 8, &vitashell_config.focus_color }, // 8 colors
   { VITASHELL_SETTINGS_ENABLE_TOUCH,    SETTINGS_OPTION_TYPE_BOOLEAN, NULL, NULL, 0, NULL, 0, &vitashell_config.enable_touch },
+  { VITASHELL_SETTINGS_THUMBNAIL_VIEW,  SETTINGS_OPTION_TYPE_BOOLEAN, NULL, NULL, 0, NULL, 0, &vitashell_config.thumbnail_view },
   { VITASHELL_SETTINGS_NO_AUTO_UPDATE,  SETTINGS_OPTION_TYPE_BOOLEAN, NULL, NULL, 0, NULL, 0, &vitashell_config.disable_autoupdate },
   { VITASHELL_SETTINGS_WARNING_MESSAGE, SETTINGS_OPTION_TYPE_BOOLEAN, NULL, NULL, 0, NULL, 0, &vitashell_config.disable_warning },
   { VITASHELL_SETTINGS_LOW_BATTERY_WARNING, SETTINGS_OPTION_TYPE_BOOLEAN, NULL, NULL, 0, NULL, 0, &vitashell_config.disable_low_battery_warning },
@@ -146,6 +150,8 @@ void loadSettingsConfig() {
   vitashell_config.font_size = 1;
   // Enable touch by default (enable_touch = 1)
   vitashell_config.enable_touch = 1;
+  // Archive entry cache budget in MB
+  vitashell_config.archive_cache_size = ARCHIVE_CACHE_DEFAULT_SIZE;
 
   readConfig("ux0:VitaShell/settings.txt", settings_entries, sizeof(settings_entries) / sizeof(ConfigEntry));
 
@@ -27,6 +27,7 @@
 */
 
 #include <stdlib.h>
+#include <stdint.h>
 #include <string.h>
 #include <psp2/io/fcntl.h>
 #include <psp2/sqlite.h>
@@ -43,8 +44,13 @@ extern int psvDebugScreenPrintf(const char *format, ...);
 
 #define IS_ERROR(x) ((unsigned)x & 0x80000000)
 
+// Size of the write-coalescing buffer attached to each R/W file
+#define WRITE_BUFFER_SIZE (256 * 1024)
+
 static sqlite3_io_methods* rw_methods = NULL;
+static const sqlite3_io_methods* org_methods = NULL;
 static sqlite3_vfs *rw_vfs = NULL;
+static int org_file_size = 0;
 
 // The file structure used by Sony
 typedef struct {
@@ -52,14 +58,67 @@ typedef struct {
   int* fd;
 } vfs_file;
 
-static int vita_xWrite(sqlite3_file *file, const void *buf, int count, sqlite_int64 offset)
+// Pending writes, merged into a single contiguous range
+typedef struct {
+  uint8_t *buf;
+  sqlite_int64 offset;
+  int size;
+} write_buffer;
+
+// Our buffer pointer is stored right after Sony's file structure,
+// in the extra space reserved through szOsFile
+static write_buffer **get_write_buffer(sqlite3_file *file)
+{
+  return (write_buffer**)((char*)file + org_file_size);
+}
+
+static int flush_write_buffer(sqlite3_file *file)
 {
   vfs_file *p = (vfs_file*)file;
-  int seek = sceIoLseek(*p->fd, offset, SCE_SEEK_SET);
-  LOG("seek %08x %x => %x\n", *p->fd, offset, seek);
-  if (seek != offset)
+  write_buffer *wb = *get_write_buffer(file);
+  if ((wb == NULL) || (wb->size == 0))
+    return SQLITE_OK;
+  int write = sceIoPwrite(*p->fd, wb->buf, wb->size, wb->offset);
+  LOG("flush %08x %x %x => %x\n", *p->fd, wb->offset, wb->size, write);
+  if (write != wb->size) {
+    LOG("write error %08x\n", write);
     return SQLITE_IOERR_WRITE;
-  int write = sceIoWrite(*p->fd, buf, count);
+  }
+  wb->offset = 0;
+  wb->size = 0;
+  return SQLITE_OK;
+}
+
+static int vita_xWrite(sqlite3_file *file, const void *buf, int count, sqlite_int64 offset)
+{
+  vfs_file *p = (vfs_file*)file;
+  write_buffer *wb = *get_write_buffer(file);
+
+  if (wb != NULL && count <= WRITE_BUFFER_SIZE) {
+    // Merge with the pending range if this write overlaps or extends it
+    if ((wb->size > 0) &&
+        (offset >= wb->offset) && (offset <= wb->offset + wb->size) &&
+        (offset + count <= wb->offset + WRITE_BUFFER_SIZE)) {
+      int pos = (int)(offset - wb->offset);
+      memcpy(wb->buf + pos, buf, count);
+      if (pos + count > wb->size)
+        wb->size = pos + count;
+      return SQLITE_OK;
+    }
+
+    int rc = flush_write_buffer(file);
+    if (rc != SQLITE_OK)
+      return rc;
+    memcpy(wb->buf, buf, count);
+    wb->offset = offset;
+    wb->size = count;
+    return SQLITE_OK;
+  }
+
+  int rc = flush_write_buffer(file);
+  if (rc != SQLITE_OK)
+    return rc;
+  int write = sceIoPwrite(*p->fd, buf, count, offset);
   LOG("write %08x %08x %x => %x\n", *p->fd, buf, count, write);
   if (write != count) {
     LOG("write error %08x\n", write);
@@ -68,9 +127,36 @@ static int vita_xWrite(sqlite3_file *file, const void *buf, int count, sqlite_in
   return SQLITE_OK;
 }
 
+static int vita_xRead(sqlite3_file *file, void *buf, int count, sqlite_int64 offset)
+{
+  vfs_file *p = (vfs_file*)file;
+  write_buffer *wb = *get_write_buffer(file);
+
+  // Reads must observe pending writes
+  if ((wb != NULL) && (wb->size > 0) &&
+      (offset < wb->offset + wb->size) && (offset + count > wb->offset)) {
+    int rc = flush_write_buffer(file);
+    if (rc != SQLITE_OK)
+      return rc;
+  }
+
+  int read = sceIoPread(*p->fd, buf, count, offset);
+  LOG("read %08x %08x %x => %x\n", *p->fd, buf, count, read);
+  if (read == count)
+    return SQLITE_OK;
+  if (read < 0)
+    return SQLITE_IOERR_READ;
+  // SQLite expects the rest of the buffer to be zeroed on short reads
+  memset((uint8_t*)buf + read, 0, count - read);
+  return SQLITE_IOERR_SHORT_READ;
+}
+
 static int vita_xSync(sqlite3_file *file, int flags)
 {
   vfs_file *p = (vfs_file*)file;
+  int rc = flush_write_buffer(file);
+  if (rc != SQLITE_OK)
+    return rc;
   int r = sceIoSyncByFd(*p->fd, flags);
   LOG("xSync %x, %x => %x\n", *p->fd, flags, r);
   if (IS_ERROR(r))
@@ -78,6 +164,46 @@ static int vita_xSync(sqlite3_file *file, int flags)
   return SQLITE_OK;
 }
 
+static int vita_xTruncate(sqlite3_file *file, sqlite_int64 size)
+{
+  int rc = flush_write_buffer(file);
+  if (rc != SQLITE_OK)
+    return rc;
+  return org_methods->xTruncate(file, size);
+}
+
+static int vita_xFileSize(sqlite3_file *file, sqlite_int64 *size)
+{
+  write_buffer *wb = *get_write_buffer(file);
+  int rc = org_methods->xFileSize(file, size);
+  // Only pending data counts, a flushed range may be past a later truncate
+  if ((rc == SQLITE_OK) && (wb != NULL) && (wb->size > 0) && (wb->offset + wb->size > *size))
+    *size = wb->offset + wb->size;
+  return rc;
+}
+
+static int vita_xUnlock(sqlite3_file *file, int lock)
+{
+  // Make our writes visible before another connection can read the file
+  int rc = flush_write_buffer(file);
+  if (rc != SQLITE_OK)
+    return rc;
+  return org_methods->xUnlock(file, lock);
+}
+
+static int vita_xClose(sqlite3_file *file)
+{
+  write_buffer **wb = get_write_buffer(file);
+  int rc = flush_write_buffer(file);
+  if (*wb != NULL) {
+    free((*wb)->buf);
+    free(*wb);
+    *wb = NULL;
+  }
+  int r = org_methods->xClose(file);
+  return (rc != SQLITE_OK) ? rc : r;
+}
+
 static int vita_xOpen(sqlite3_vfs *vfs, const char *name, sqlite3_file *file, int flags, int *out_flags)
 {
   sqlite3_vfs* org_vfs = (sqlite3_vfs*)vfs->pAppData;
@@ -96,6 +222,7 @@ static int vita_xOpen(sqlite3_vfs *vfs, const char *name, sqlite3_file *file, in
   }
 
   // Call the original xOpen()
+  *get_write_buffer(file) = NULL;
   int r = org_vfs->xOpen(org_vfs, name, file, flags, out_flags);
   vfs_file *p = (vfs_file*)file;
   LOG("fd = %08x, r = %d\n", (p == NULL) ? 0 : *p->fd, r);
@@ -110,17 +237,37 @@ static int vita_xOpen(sqlite3_vfs *vfs, const char *name, sqlite3_file *file, in
       if (IS_ERROR(*p->fd))
         return SQLITE_IOERR_WRITE;
     }
-    // Need to override xWrite() and xSync() as well
+    // Need to override xWrite() and xSync() as well, and buffer writes
+    // until the next sync, unlock or read of the same range
     if (rw_methods == NULL) {
       rw_methods = malloc(sizeof(sqlite3_io_methods));
       if (rw_methods != NULL) {
+        org_methods = file->pMethods;
         memcpy(rw_methods, file->pMethods, sizeof(sqlite3_io_methods));
+        rw_methods->xClose = vita_xClose;
+        rw_methods->xRead = vita_xRead;
         rw_methods->xWrite = vita_xWrite;
+        rw_methods->xTruncate = vita_xTruncate;
         rw_methods->xSync = vita_xSync;
+        rw_methods->xFileSize = vita_xFileSize;
+        rw_methods->xUnlock = vita_xUnlock;
       }
     }
-    if (rw_methods != NULL)
+    if (rw_methods != NULL) {
       file->pMethods = rw_methods;
+      write_buffer *wb = malloc(sizeof(write_buffer));
+      if (wb != NULL) {
+        wb->buf = malloc(WRITE_BUFFER_SIZE);
+        wb->offset = 0;
+        wb->size = 0;
+        if (wb->buf == NULL) {
+          free(wb);
+          wb = NULL;
+        }
+      }
+      // Without a buffer, writes simply go straight to the file
+      *get_write_buffer(file) = wb;
+    }
   }
   return r;
 }
@@ -154,6 +301,9 @@ int sqlite_init()
     // Override xOpen() and xDelete()
     memcpy(rw_vfs, vfs, sizeof(sqlite3_vfs));
     rw_vfs->zName = "psp2_rw";
+    // Reserve room for our write buffer pointer
+    org_file_size = (vfs->szOsFile + sizeof(void*) - 1) & ~(sizeof(void*) - 1);
+    rw_vfs->szOsFile = org_file_size + sizeof(write_buffer*);
     rw_vfs->xOpen = vita_xOpen;
     rw_vfs->xDelete = vita_xDelete;
     // Keep a copy of the original vfs pointer
@@ -172,6 +322,7 @@ int sqlite_exit()
   int rc = SQLITE_OK;
   free(rw_methods);
   rw_methods = NULL;
+  org_methods = NULL;
   if (rw_vfs != NULL) {
     rc = sqlite3_vfs_unregister(rw_vfs);
     if (rc != SQLITE_OK)
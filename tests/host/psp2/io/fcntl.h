@@ -0,0 +1,34 @@
+/*
+  VitaShell host tests - file I/O, implemented over POSIX in psp2_host.c
+*/
+
+#ifndef __HOST_PSP2_IO_FCNTL_H__
+#define __HOST_PSP2_IO_FCNTL_H__
+
+#include <psp2/types.h>
+
+#define SCE_O_RDONLY 0x0001
+#define SCE_O_WRONLY 0x0002
+#define SCE_O_RDWR   (SCE_O_RDONLY | SCE_O_WRONLY)
+#define SCE_O_APPEND 0x0100
+#define SCE_O_CREAT  0x0200
+#define SCE_O_TRUNC  0x0400
+#define SCE_O_EXCL   0x0800
+
+#define SCE_SEEK_SET 0
+#define SCE_SEEK_CUR 1
+#define SCE_SEEK_END 2
+
+SceUID sceIoOpen(const char *file, int flags, SceMode mode);
+int sceIoClose(SceUID fd);
+int sceIoRead(SceUID fd, void *data, SceSize size);
+int sceIoWrite(SceUID fd, const void *data, SceSize size);
+int sceIoPread(SceUID fd, void *data, SceSize size, SceOff offset);
+int sceIoPwrite(SceUID fd, const void *data, SceSize size, SceOff offset);
+SceOff sceIoLseek(SceUID fd, SceOff offset, int whence);
+int sceIoLseek32(SceUID fd, int offset, int whence);
+int sceIoRemove(const char *file);
+int sceIoRename(const char *old_name, const char *new_name);
+int sceIoSyncByFd(SceUID fd, int flags);
+
+#endif
@@ -0,0 +1,31 @@
+/*
+  VitaShell host tests - file status, implemented over POSIX in psp2_host.c
+*/
+
+#ifndef __HOST_PSP2_IO_STAT_H__
+#define __HOST_PSP2_IO_STAT_H__
+
+#include <psp2/types.h>
+
+#define SCE_S_IFMT  0xF000
+#define SCE_S_IFDIR 0x1000
+#define SCE_S_IFREG 0x2000
+
+#define SCE_S_ISDIR(m) (((m) & SCE_S_IFMT) == SCE_S_IFDIR)
+#define SCE_S_ISREG(m) (((m) & SCE_S_IFMT) == SCE_S_IFREG)
+
+typedef struct SceIoStat {
+  SceMode st_mode;
+  unsigned int st_attr;
+  SceOff st_size;
+  SceDateTime st_ctime;
+  SceDateTime st_atime;
+  SceDateTime st_mtime;
+  unsigned int st_private[6];
+} SceIoStat;
+
+int sceIoGetstat(const char *file, SceIoStat *stat);
+int sceIoGetstatByFd(SceUID fd, SceIoStat *stat);
+int sceIoMkdir(const char *dir, SceMode mode);
+
+#endif
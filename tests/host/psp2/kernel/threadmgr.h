@@ -0,0 +1,12 @@
+/*
+  VitaShell host tests - the thread manager calls used by the tested sources
+*/
+
+#ifndef __HOST_PSP2_KERNEL_THREADMGR_H__
+#define __HOST_PSP2_KERNEL_THREADMGR_H__
+
+#include <psp2/types.h>
+
+int sceKernelDelayThread(unsigned int delay);
+
+#endif
@@ -0,0 +1,16 @@
+/*
+  VitaShell host tests - the SceSqlite configuration call, a no-op on the host
+*/
+
+#ifndef __HOST_PSP2_SQLITE_H__
+#define __HOST_PSP2_SQLITE_H__
+
+typedef struct SceSqliteMallocMethods {
+  void *(*xMalloc)(int);
+  void *(*xRealloc)(void *, int);
+  void (*xFree)(void *);
+} SceSqliteMallocMethods;
+
+int sceSqliteConfigMallocMethods(SceSqliteMallocMethods *methods);
+
+#endif
@@ -0,0 +1,25 @@
+/*
+  VitaShell host tests - the VitaSDK types used by the tested sources
+*/
+
+#ifndef __HOST_PSP2_TYPES_H__
+#define __HOST_PSP2_TYPES_H__
+
+#include <stdint.h>
+
+typedef int SceUID;
+typedef int64_t SceOff;
+typedef unsigned int SceSize;
+typedef int SceMode;
+
+typedef struct SceDateTime {
+  unsigned short year;
+  unsigned short month;
+  unsigned short day;
+  unsigned short hour;
+  unsigned short minute;
+  unsigned short second;
+  unsigned int microsecond;
+} SceDateTime;
+
+#endif
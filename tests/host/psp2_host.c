@@ -0,0 +1,169 @@
+/*
+  VitaShell host tests - the VitaSDK calls used by the tested sources,
+  implemented over POSIX. Device paths like "ux0:dir/file" are mapped to
+  "ux0/dir/file" below the current directory.
+*/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+// glibc maps these to the timespec members, they clash with SceIoStat
+#undef st_atime
+#undef st_ctime
+#undef st_mtime
+
+#include <psp2/io/fcntl.h>
+#include <psp2/io/stat.h>
+#include <psp2/kernel/threadmgr.h>
+#include <psp2/sqlite.h>
+
+#define HOST_PATH_LENGTH 1024
+
+// SCE_ERROR_ERRNO_*
+#define HOST_ERROR(e) ((int)(0x80010000 | (e)))
+
+static const char *host_path(const char *file, char *path) {
+  const char *colon = strchr(file, ':');
+  const char *slash = strchr(file, '/');
+
+  snprintf(path, HOST_PATH_LENGTH, "%s", file);
+  if (colon && (!slash || colon < slash))
+    path[colon - file] = '/';
+
+  return path;
+}
+
+static void host_time(time_t t, SceDateTime *time) {
+  struct tm tm;
+  gmtime_r(&t, &tm);
+
+  memset(time, 0, sizeof(SceDateTime));
+  time->year = tm.tm_year + 1900;
+  time->month = tm.tm_mon + 1;
+  time->day = tm.tm_mday;
+  time->hour = tm.tm_hour;
+  time->minute = tm.tm_min;
+  time->second = tm.tm_sec;
+}
+
+static void host_stat(const struct stat *st, SceIoStat *stat) {
+  memset(stat, 0, sizeof(SceIoStat));
+  stat->st_mode = S_ISDIR(st->st_mode) ? SCE_S_IFDIR : SCE_S_IFREG;
+  stat->st_size = st->st_size;
+  host_time(st->st_ctim.tv_sec, &stat->st_ctime);
+  host_time(st->st_atim.tv_sec, &stat->st_atime);
+  host_time(st->st_mtim.tv_sec, &stat->st_mtime);
+  // Sub-second changes must show up in the tests, the Vita has microseconds
+  stat->st_mtime.microsecond = st->st_mtim.tv_nsec / 1000;
+}
+
+SceUID sceIoOpen(const char *file, int flags, SceMode mode) {
+  char path[HOST_PATH_LENGTH];
+  int oflags = 0;
+
+  if ((flags & SCE_O_RDWR) == SCE_O_RDWR)
+    oflags = O_RDWR;
+  else if (flags & SCE_O_WRONLY)
+    oflags = O_WRONLY;
+  else
+    oflags = O_RDONLY;
+
+  if (flags & SCE_O_APPEND)
+    oflags |= O_APPEND;
+  if (flags & SCE_O_CREAT)
+    oflags |= O_CREAT;
+  if (flags & SCE_O_TRUNC)
+    oflags |= O_TRUNC;
+  if (flags & SCE_O_EXCL)
+    oflags |= O_EXCL;
+
+  int fd = open(host_path(file, path), oflags, mode);
+  return fd < 0 ? HOST_ERROR(errno) : fd;
+}
+
+int sceIoClose(SceUID fd) {
+  return close(fd) < 0 ? HOST_ERROR(errno) : 0;
+}
+
+int sceIoRead(SceUID fd, void *data, SceSize size) {
+  ssize_t res = read(fd, data, size);
+  return res < 0 ? HOST_ERROR(errno) : (int)res;
+}
+
+int sceIoWrite(SceUID fd, const void *data, SceSize size) {
+  ssize_t res = write(fd, data, size);
+  return res < 0 ? HOST_ERROR(errno) : (int)res;
+}
+
+int sceIoPread(SceUID fd, void *data, SceSize size, SceOff offset) {
+  ssize_t res = pread(fd, data, size, offset);
+  return res < 0 ? HOST_ERROR(errno) : (int)res;
+}
+
+int sceIoPwrite(SceUID fd, const void *data, SceSize size, SceOff offset) {
+  ssize_t res = pwrite(fd, data, size, offset);
+  return res < 0 ? HOST_ERROR(errno) : (int)res;
+}
+
+SceOff sceIoLseek(SceUID fd, SceOff offset, int whence) {
+  off_t res = lseek(fd, offset, whence);
+  return res < 0 ? HOST_ERROR(errno) : res;
+}
+
+int sceIoLseek32(SceUID fd, int offset, int whence) {
+  return (int)sceIoLseek(fd, offset, whence);
+}
+
+int sceIoRemove(const char *file) {
+  char path[HOST_PATH_LENGTH];
+  return unlink(host_path(file, path)) < 0 ? HOST_ERROR(errno) : 0;
+}
+
+int sceIoRename(const char *old_name, const char *new_name) {
+  char old_path[HOST_PATH_LENGTH], new_path[HOST_PATH_LENGTH];
+  return rename(host_path(old_name, old_path), host_path(new_name, new_path)) < 0 ? HOST_ERROR(errno) : 0;
+}
+
+int sceIoSyncByFd(SceUID fd, int flags) {
+  return fsync(fd) < 0 ? HOST_ERROR(errno) : 0;
+}
+
+int sceIoGetstat(const char *file, SceIoStat *stat) {
+  char path[HOST_PATH_LENGTH];
+  struct stat st;
+
+  if (lstat(host_path(file, path), &st) < 0)
+    return HOST_ERROR(errno);
+
+  host_stat(&st, stat);
+  return 0;
+}
+
+int sceIoGetstatByFd(SceUID fd, SceIoStat *stat) {
+  struct stat st;
+
+  if (fstat(fd, &st) < 0)
+    return HOST_ERROR(errno);
+
+  host_stat(&st, stat);
+  return 0;
+}
+
+int sceIoMkdir(const char *dir, SceMode mode) {
+  char path[HOST_PATH_LENGTH];
+  return mkdir(host_path(dir, path), mode) < 0 ? HOST_ERROR(errno) : 0;
+}
+
+int sceKernelDelayThread(unsigned int delay) {
+  usleep(delay);
+  return 0;
+}
+
+int sceSqliteConfigMallocMethods(SceSqliteMallocMethods *methods) {
+  return 0;
+}
@@ -0,0 +1,33 @@
+/*
+  VitaShell host tests - minimal checks, every test is a plain program
+  that returns non-zero when a check failed.
+*/
+
+#ifndef __TEST_H__
+#define __TEST_H__
+
+#include <stdio.h>
+
+static int test_failures = 0;
+
+#define CHECK(cond) \
+  do { \
+    if (!(cond)) { \
+      fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+      test_failures++; \
+    } \
+  } while (0)
+
+#define CHECK_EQ(a, b) \
+  do { \
+    long long __a = (long long)(a), __b = (long long)(b); \
+    if (__a != __b) { \
+      fprintf(stderr, "%s:%d: check failed: %s == %s (%lld != %lld)\n", __FILE__, __LINE__, #a, #b, __a, __b); \
+      test_failures++; \
+    } \
+  } while (0)
+
+#define TEST_RESULT() \
+  (test_failures ? (fprintf(stderr, "%d check(s) failed\n", test_failures), 1) : 0)
+
+#endif
@@ -0,0 +1,212 @@
+/*
+  VitaShell host tests - streaming files through the file search
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "file_search_stream.h"
+#include "test.h"
+
+typedef struct {
+  int line;
+  SceOff offset;
+  char preview[FILE_SEARCH_PREVIEW_LENGTH];
+} Result;
+
+typedef struct {
+  Result results[16];
+  int n_results;
+} Results;
+
+// A stream of text handed out in reads of at most chunk bytes
+typedef struct {
+  const char *text;
+  int size;
+  int pos;
+  int chunk;
+} Source;
+
+static int source_read(void *context, char *data, int size) {
+  Source *source = (Source *)context;
+  int n = source->size - source->pos;
+  if (n > size)
+    n = size;
+  if (n > source->chunk)
+    n = source->chunk;
+
+  memcpy(data, source->text + source->pos, n);
+  source->pos += n;
+  return n;
+}
+
+// size bytes of lines with the term at the end, produced while reading
+typedef struct {
+  SceOff pos;
+  SceOff size;
+} BigSource;
+
+#define BIG_LINE 1024
+
+static int big_read(void *context, char *data, int size) {
+  BigSource *source = (BigSource *)context;
+  if (source->pos + size > source->size)
+    size = (int)(source->size - source->pos);
+
+  // Lines of BIG_LINE bytes
+  int i = 0;
+  while (i < size) {
+    int column = (int)((source->pos + i) % BIG_LINE);
+    int n = BIG_LINE - column;
+    if (n > size - i)
+      n = size - i;
+
+    memset(data + i, 'a', n);
+    if (column + n == BIG_LINE)
+      data[i + n - 1] = '\n';
+
+    i += n;
+  }
+
+  // The term in the last line
+  SceOff last = source->size - BIG_LINE;
+  for (i = 0; i < 6; i++) {
+    if (last + i >= source->pos && last + i < source->pos + size)
+      data[last + i - source->pos] = "needle"[i];
+  }
+
+  source->pos += size;
+  return size;
+}
+
+static int add_result(FileSearchStream *stream, const char *preview) {
+  Results *results = (Results *)stream->context;
+  if (results->n_results == 16)
+    return 0;
+
+  Result *result = &results->results[results->n_results++];
+  result->line = stream->line;
+  result->offset = stream->line_start;
+  strcpy(result->preview, preview);
+  return 1;
+}
+
+static int progress(FileSearchStream *stream, int read) {
+  return 1;
+}
+
+static void init_stream(FileSearchStream *stream, Results *results, const char *term, int flags) {
+  memset(stream, 0, sizeof(FileSearchStream));
+  memset(results, 0, sizeof(Results));
+
+  stream->buffer = malloc(FILE_SEARCH_READ_SIZE);
+  stream->result = add_result;
+  stream->progress = progress;
+  stream->context = results;
+  CHECK_EQ(textSearchCompile(&stream->search, term, flags), 0);
+}
+
+static void free_stream(FileSearchStream *stream) {
+  textSearchFree(&stream->search);
+  free(stream->buffer);
+}
+
+static int search_text(FileSearchStream *stream, const char *text, int size, int chunk) {
+  Source source = { text, size, 0, chunk };
+  return fileSearchStream(stream, source_read, &source);
+}
+
+// Blocks shorter than the term must be kept, not consumed
+static void test_short_blocks() {
+  FileSearchStream stream;
+  Results results;
+
+  init_stream(&stream, &results, "hello", 0);
+
+  // The whole file is shorter than the term
+  CHECK_EQ(search_text(&stream, "he", 2, 2), 1);
+  CHECK_EQ(results.n_results, 0);
+
+  // Two bytes per read, the term is put together from three reads
+  const char *text = "xx\n  say HeLLo\nhello";
+  CHECK_EQ(search_text(&stream, text, strlen(text), 2), 1);
+  CHECK_EQ(results.n_results, 2);
+  CHECK_EQ(results.results[0].line, 2);
+  CHECK_EQ(results.results[0].offset, 3);
+  CHECK(strcmp(results.results[0].preview, "say HeLLo") == 0);
+  CHECK_EQ(results.results[1].line, 3);
+  CHECK_EQ(results.results[1].offset, 15);
+
+  free_stream(&stream);
+}
+
+// The term crosses the end of a block in the middle of a long line
+static void test_long_line() {
+  FileSearchStream stream;
+  Results results;
+
+  int size = FILE_SEARCH_READ_SIZE * 2 + 100;
+  char *text = malloc(size);
+  memset(text, 'a', size);
+  memcpy(text + FILE_SEARCH_READ_SIZE - 3, "needle", 6);
+  text[size - 1] = '\n';
+
+  init_stream(&stream, &results, "NEEDLE", 0);
+  CHECK_EQ(search_text(&stream, text, size, FILE_SEARCH_READ_SIZE), 1);
+  CHECK_EQ(results.n_results, 1);
+  CHECK_EQ(results.results[0].line, 1);
+  CHECK_EQ(results.results[0].offset, 0);
+  free_stream(&stream);
+
+  // The same term twice in the line is still one result
+  memcpy(text + FILE_SEARCH_READ_SIZE + 1000, "needle", 6);
+  init_stream(&stream, &results, "needle", 0);
+  CHECK_EQ(search_text(&stream, text, size, FILE_SEARCH_READ_SIZE), 1);
+  CHECK_EQ(results.n_results, 1);
+  free_stream(&stream);
+
+  free(text);
+}
+
+// Regular expression matches crossing a block end are found through the overlap
+static void test_regex_long_line() {
+  FileSearchStream stream;
+  Results results;
+
+  int size = FILE_SEARCH_READ_SIZE * 2;
+  char *text = malloc(size);
+  memset(text, 'a', size);
+  memcpy(text + FILE_SEARCH_READ_SIZE - 5, "key=12345", 9);
+  text[size - 1] = '\n';
+
+  init_stream(&stream, &results, "KEY=[0-9]+", TEXT_SEARCH_REGEX);
+  CHECK_EQ(search_text(&stream, text, size, FILE_SEARCH_READ_SIZE), 1);
+  CHECK_EQ(results.n_results, 1);
+  free_stream(&stream);
+
+  free(text);
+}
+
+// Line offsets past 2 GB
+static void test_big_offsets() {
+  FileSearchStream stream;
+  Results results;
+
+  BigSource source = { 0, 0x90000000LL };
+
+  init_stream(&stream, &results, "needle", 0);
+  CHECK_EQ(fileSearchStream(&stream, big_read, &source), 1);
+  CHECK_EQ(results.n_results, 1);
+  CHECK_EQ(results.results[0].offset, source.size - BIG_LINE);
+  CHECK_EQ(results.results[0].line, source.size / BIG_LINE);
+  free_stream(&stream);
+}
+
+int main() {
+  test_short_blocks();
+  test_long_line();
+  test_regex_long_line();
+  test_big_offsets();
+
+  return TEST_RESULT();
+}
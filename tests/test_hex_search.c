@@ -0,0 +1,199 @@
+/*
+  VitaShell host tests - hex editor pattern search
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "hex_search.h"
+#include "test.h"
+
+typedef struct {
+  const uint8_t *data;
+} Source;
+
+static int source_read(HexSearchStream *stream, SceOff offset, uint8_t *data, int length) {
+  Source *source = (Source *)stream->context;
+  if (offset + length > stream->size)
+    length = (int)(stream->size - offset);
+
+  memcpy(data, source->data + offset, length);
+  return length;
+}
+
+static int source_progress(HexSearchStream *stream, SceOff done, SceOff total) {
+  return 1;
+}
+
+static SceOff search(HexPattern *pattern, const uint8_t *data, int size, int chunk, SceOff start, int backward) {
+  Source source = { data };
+
+  HexSearchStream stream;
+  stream.pattern = pattern;
+  stream.buffer = malloc(chunk);
+  stream.buffer_size = chunk;
+  stream.size = size;
+  stream.read = source_read;
+  stream.progress = source_progress;
+  stream.context = &source;
+
+  SceOff result = hexSearchStream(&stream, start, backward);
+
+  free(stream.buffer);
+  return result;
+}
+
+// Reference for hexPatternFind, compares every position
+static int brute_find(HexPattern *pattern, const uint8_t *data, int length, int find_last) {
+  int found = -1;
+
+  int i;
+  for (i = 0; i + pattern->length <= length; i++) {
+    int j = 0;
+    while (j < pattern->length && (data[i + j] & pattern->mask[j]) == pattern->bytes[j])
+      j++;
+
+    if (j == pattern->length) {
+      if (!find_last)
+        return i;
+
+      found = i;
+    }
+  }
+
+  return found;
+}
+
+static void test_compile() {
+  HexPattern pattern;
+
+  CHECK_EQ(hexPatternCompile(&pattern, HEX_SEARCH_BYTES, "DE AD ?f", NULL), 0);
+  CHECK_EQ(pattern.length, 3);
+  CHECK_EQ(pattern.bytes[0], 0xDE);
+  CHECK_EQ(pattern.mask[1], 0xFF);
+  CHECK_EQ(pattern.bytes[2], 0x0F);
+  CHECK_EQ(pattern.mask[2], 0x0F);
+
+  CHECK(hexPatternCompile(&pattern, HEX_SEARCH_BYTES, "DE A", NULL) < 0);
+  CHECK(hexPatternCompile(&pattern, HEX_SEARCH_BYTES, "XY", NULL) < 0);
+  CHECK(hexPatternCompile(&pattern, HEX_SEARCH_BYTES, "", NULL) < 0);
+
+  CHECK_EQ(hexPatternCompile(&pattern, HEX_SEARCH_INT_BE, "0x1234:2", NULL), 0);
+  CHECK_EQ(pattern.length, 2);
+  CHECK_EQ(pattern.bytes[0], 0x12);
+  CHECK_EQ(pattern.bytes[1], 0x34);
+
+  CHECK_EQ(hexPatternCompile(&pattern, HEX_SEARCH_INT_LE, "0x1234", NULL), 0);
+  CHECK_EQ(pattern.length, 4);
+  CHECK_EQ(pattern.bytes[0], 0x34);
+  CHECK_EQ(pattern.bytes[3], 0x00);
+  CHECK(hexPatternCompile(&pattern, HEX_SEARCH_INT_LE, "1:3", NULL) < 0);
+
+  const uint16_t utf16[] = { 'h', 0x263A, 0 };
+  CHECK_EQ(hexPatternCompile(&pattern, HEX_SEARCH_UTF16LE, "", utf16), 0);
+  CHECK_EQ(pattern.length, 4);
+  CHECK_EQ(pattern.bytes[2], 0x3A);
+  CHECK_EQ(pattern.bytes[3], 0x26);
+}
+
+// The shift table must not skip a match that only a wildcard nibble allows
+static void test_nibble_masks() {
+  HexPattern pattern;
+  uint8_t data[4096];
+
+  srand(1);
+
+  const char *patterns[] = { "?A", "A?", "1? ?2", "?? 34", "12 ?? 56", "A? A? A?", "?0 ?0 0? 00", "FF ?F F? FF" };
+
+  int p;
+  for (p = 0; p < (int)(sizeof(patterns) / sizeof(patterns[0])); p++) {
+    CHECK_EQ(hexPatternCompile(&pattern, HEX_SEARCH_BYTES, patterns[p], NULL), 0);
+
+    int round;
+    for (round = 0; round < 50; round++) {
+      // Few distinct bytes, so there are many near misses
+      int i;
+      for (i = 0; i < (int)sizeof(data); i++) {
+        static const uint8_t bytes[] = { 0x00, 0x02, 0x10, 0x12, 0x34, 0x56, 0xA0, 0xAA, 0xFF, 0xF0, 0x0F };
+        data[i] = bytes[rand() % sizeof(bytes)];
+      }
+
+      int length = 1 + rand() % sizeof(data);
+      CHECK_EQ(hexPatternFind(&pattern, data, length, 0), brute_find(&pattern, data, length, 0));
+      CHECK_EQ(hexPatternFind(&pattern, data, length, 1), brute_find(&pattern, data, length, 1));
+    }
+  }
+}
+
+// Matches across the end of a chunk, from every start in both directions
+static void test_chunk_overlap() {
+  HexPattern pattern;
+  uint8_t data[200];
+  memset(data, 0x11, sizeof(data));
+
+  CHECK_EQ(hexPatternCompile(&pattern, HEX_SEARCH_BYTES, "AB ?D EF", NULL), 0);
+
+  // A near miss at 30 right before the match at 31
+  int matches[] = { 14, 31, 100 };
+  int i;
+  for (i = 0; i < 3; i++) {
+    data[matches[i]] = 0xAB;
+    data[matches[i] + 1] = 0xCD;
+    data[matches[i] + 2] = 0xEF;
+  }
+
+  data[30] = 0xAB;
+
+  int chunk;
+  for (chunk = 3; chunk <= 64; chunk++) {
+    SceOff start;
+    for (start = 0; start <= (SceOff)sizeof(data); start++) {
+      SceOff expected = -1;
+      for (i = 0; i < 3; i++) {
+        if (matches[i] >= start) {
+          expected = matches[i];
+          break;
+        }
+      }
+
+      CHECK_EQ(search(&pattern, data, sizeof(data), chunk, start, 0), expected);
+
+      expected = -1;
+      for (i = 2; i >= 0; i--) {
+        if (matches[i] < start) {
+          expected = matches[i];
+          break;
+        }
+      }
+
+      CHECK_EQ(search(&pattern, data, sizeof(data), chunk, start, 1), expected);
+    }
+  }
+}
+
+// A pattern as long as the chunk, the chunks only move forward by one
+static void test_chunk_pattern_length() {
+  HexPattern pattern;
+  uint8_t data[64];
+  memset(data, 0, sizeof(data));
+  memcpy(data + 40, "\x01\x02\x03\x04", 4);
+
+  CHECK_EQ(hexPatternCompile(&pattern, HEX_SEARCH_BYTES, "01 02 03 04", NULL), 0);
+  CHECK_EQ(search(&pattern, data, sizeof(data), 4, 0, 0), 40);
+  CHECK_EQ(search(&pattern, data, sizeof(data), 4, 41, 0), -1);
+  CHECK_EQ(search(&pattern, data, sizeof(data), 4, sizeof(data), 1), 40);
+  CHECK_EQ(search(&pattern, data, sizeof(data), 4, 40, 1), -1);
+
+  // Shorter than the pattern
+  CHECK_EQ(search(&pattern, data, 3, 4, 0, 0), -1);
+  CHECK_EQ(search(&pattern, data, 3, 4, 3, 1), -1);
+}
+
+int main() {
+  test_compile();
+  test_nibble_masks();
+  test_chunk_overlap();
+  test_chunk_pattern_length();
+
+  return TEST_RESULT();
+}
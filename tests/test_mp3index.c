@@ -0,0 +1,452 @@
+/*
+  VitaShell host tests - MP3 frame headers, Xing/VBRI tables of contents
+  the seek index cache and the gapless trim
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <psp2/io/stat.h>
+
+#include "audio/mp3xing.h"
+#include "audio/mp3index.h"
+#include "test.h"
+
+// MPEG 1 layer III, 128 kbit/s, 44.1 kHz, joint stereo, 417 bytes
+static const unsigned char frame_header[4] = { 0xFF, 0xFB, 0x90, 0x44 };
+#define FRAME_LENGTH 417
+#define XING_OFFSET (4 + 32)
+
+static struct mp3Index mp3_index;
+
+static void put_long(unsigned char *p, unsigned int value) {
+  p[0] = value >> 24;
+  p[1] = value >> 16;
+  p[2] = value >> 8;
+  p[3] = value;
+}
+
+static void put_short(unsigned char *p, unsigned int value) {
+  p[0] = value >> 8;
+  p[1] = value;
+}
+
+static void put_frame(unsigned char *data, int frame) {
+  memcpy(data, frame_header, 4);
+  memset(data + 4, frame & 0x7F, FRAME_LENGTH - 4);
+}
+
+static void write_file(const char *path, const unsigned char *data, int size) {
+  FILE *file = fopen(path, "wb");
+  fwrite(data, 1, size, file);
+  fclose(file);
+}
+
+static void set_mtime(const char *path, long sec) {
+  struct timeval times[2] = { { sec, 0 }, { sec, 0 } };
+  utimes(path, times);
+}
+
+// A Xing frame with all fields and a LAME tag, followed by n frames
+static unsigned char *xing_file(int n, int delay, int padding, int *size) {
+  *size = (n + 1) * FRAME_LENGTH;
+  unsigned char *data = calloc(1, *size);
+
+  memcpy(data, frame_header, 4);
+
+  unsigned char *xing = data + XING_OFFSET;
+  memcpy(xing, "Xing", 4);
+  put_long(xing + 4, XING_FRAMES | XING_BYTES | XING_TOC | XING_SCALE);
+  put_long(xing + 8, n);
+  put_long(xing + 12, *size);
+
+  int i;
+  for (i = 0; i < 100; i++)
+    xing[16 + i] = i * 256 / 100;
+
+  put_long(xing + 116, 50);
+
+  unsigned char *lame = xing + 120;
+  memcpy(lame, "LAME3.100", 9);
+  lame[21] = delay >> 4;
+  lame[22] = ((delay & 0xF) << 4) | (padding >> 8);
+  lame[23] = padding & 0xFF;
+
+  for (i = 0; i < n; i++)
+    put_frame(data + (i + 1) * FRAME_LENGTH, i);
+
+  return data;
+}
+
+static void test_parse_header() {
+  struct mp3FrameHeader header;
+
+  CHECK_EQ(mp3ParseHeader(frame_header, &header), 1);
+  CHECK_EQ(header.version, 3);
+  CHECK_EQ(header.layer, 3);
+  CHECK_EQ(header.channels, 2);
+  CHECK_EQ(header.hz, 44100);
+  CHECK_EQ(header.kbit, 128);
+  CHECK_EQ(header.samples, 1152);
+  CHECK_EQ(header.length, 417);
+
+  // Padded
+  const unsigned char padded[4] = { 0xFF, 0xFB, 0x92, 0x44 };
+  CHECK_EQ(mp3ParseHeader(padded, &header), 1);
+  CHECK_EQ(header.length, 418);
+
+  // MPEG 2 layer III, 64 kbit/s, 22.05 kHz, mono
+  const unsigned char mpeg2[4] = { 0xFF, 0xF3, 0x80, 0xC0 };
+  CHECK_EQ(mp3ParseHeader(mpeg2, &header), 1);
+  CHECK_EQ(header.version, 2);
+  CHECK_EQ(header.channels, 1);
+  CHECK_EQ(header.hz, 22050);
+  CHECK_EQ(header.kbit, 64);
+  CHECK_EQ(header.samples, 576);
+  CHECK_EQ(header.length, 208);
+
+  // MPEG 2.5 layer III, 64 kbit/s, 11.025 kHz
+  const unsigned char mpeg25[4] = { 0xFF, 0xE3, 0x80, 0x00 };
+  CHECK_EQ(mp3ParseHeader(mpeg25, &header), 1);
+  CHECK_EQ(header.version, 0);
+  CHECK_EQ(header.hz, 11025);
+  CHECK_EQ(header.length, 417);
+
+  // MPEG 1 layer II, 256 kbit/s, 44.1 kHz, padded
+  const unsigned char layer2[4] = { 0xFF, 0xFD, 0xC2, 0x00 };
+  CHECK_EQ(mp3ParseHeader(layer2, &header), 1);
+  CHECK_EQ(header.layer, 2);
+  CHECK_EQ(header.samples, 1152);
+  CHECK_EQ(header.length, 836);
+
+  // MPEG 1 layer I, 288 kbit/s, 44.1 kHz, slots of 4 bytes
+  const unsigned char layer1[4] = { 0xFF, 0xFF, 0x92, 0x00 };
+  CHECK_EQ(mp3ParseHeader(layer1, &header), 1);
+  CHECK_EQ(header.layer, 1);
+  CHECK_EQ(header.samples, 384);
+  CHECK_EQ(header.length, 316);
+
+  const unsigned char invalid[][4] = {
+    { 0xFF, 0x7B, 0x90, 0x44 }, // No sync
+    { 0xFF, 0xEB, 0x90, 0x44 }, // Reserved version
+    { 0xFF, 0xF9, 0x90, 0x44 }, // Reserved layer
+    { 0xFF, 0xFB, 0x00, 0x44 }, // Free format
+    { 0xFF, 0xFB, 0xF0, 0x44 }, // Bad bitrate
+    { 0xFF, 0xFB, 0x9C, 0x44 }, // Reserved sample rate
+  };
+
+  int i;
+  for (i = 0; i < (int)(sizeof(invalid) / sizeof(invalid[0])); i++)
+    CHECK_EQ(mp3ParseHeader(invalid[i], &header), 0);
+}
+
+static void test_parse_xing() {
+  int size;
+  unsigned char *data = xing_file(1, 576, 1000, &size);
+  struct xing xing;
+
+  memset(&xing, 0, sizeof(struct xing));
+  CHECK_EQ(parse_xing(data, XING_OFFSET, &xing), 1);
+  CHECK_EQ(xing.flags, 0xF);
+  CHECK_EQ(xing.frames, 1);
+  CHECK_EQ(xing.bytes, size);
+  CHECK_EQ(xing.toc[0], 0);
+  CHECK_EQ(xing.toc[50], 128);
+  CHECK_EQ(xing.toc[99], 253);
+  CHECK_EQ(xing.scale, 50);
+  CHECK_EQ(xing.encoderDelay, 576);
+  CHECK_EQ(xing.encoderPadding, 1000);
+
+  // "Info" from a CBR file, only frames and bytes, no LAME tag
+  unsigned char *p = data + XING_OFFSET;
+  memcpy(p, "Info", 4);
+  put_long(p + 4, XING_FRAMES | XING_BYTES);
+  memset(p + 16, 0, 150);
+
+  memset(&xing, 0, sizeof(struct xing));
+  CHECK_EQ(parse_xing(data, XING_OFFSET, &xing), 1);
+  CHECK_EQ(xing.flags, XING_FRAMES | XING_BYTES);
+  CHECK_EQ(xing.bytes, size);
+  CHECK_EQ(xing.encoderDelay, -1);
+  CHECK_EQ(xing.encoderPadding, -1);
+
+  // A TOC past the end of the buffer
+  unsigned char buffer[XING_BUFFER_SIZE];
+  memset(buffer, 0, sizeof(buffer));
+  p = buffer + XING_BUFFER_SIZE - 60;
+  memcpy(p, "Xing", 4);
+  put_long(p + 4, XING_FRAMES | XING_TOC);
+  CHECK_EQ(parse_xing(buffer, XING_BUFFER_SIZE - 60, &xing), 0);
+
+  memset(buffer, 0, sizeof(buffer));
+  CHECK_EQ(parse_xing(buffer, XING_OFFSET, &xing), 0);
+
+  free(data);
+}
+
+static void test_parse_vbri() {
+  unsigned char buffer[XING_BUFFER_SIZE];
+  memset(buffer, 0, sizeof(buffer));
+
+  struct vbri vbri;
+  CHECK_EQ(parse_vbri(buffer, &vbri), 0);
+
+  unsigned char *header = buffer + VBRI_OFFSET;
+  memcpy(header, "VBRI", 4);
+  put_short(header + 4, 1);
+  put_short(header + 6, 1105);
+  put_long(header + 10, 123456);
+  put_long(header + 14, 300);
+  put_short(header + 18, 10);
+  put_short(header + 20, 2);
+  put_short(header + 22, 2);
+  put_short(header + 24, 30);
+
+  CHECK_EQ(parse_vbri(buffer, &vbri), 1);
+  CHECK_EQ(vbri.delay, 1105);
+  CHECK_EQ(vbri.bytes, 123456);
+  CHECK_EQ(vbri.frames, 300);
+  CHECK_EQ(vbri.tocEntries, 10);
+  CHECK_EQ(vbri.tocScale, 2);
+  CHECK_EQ(vbri.tocEntrySize, 2);
+  CHECK_EQ(vbri.tocFramesPerEntry, 30);
+}
+
+// Points from the Xing TOC, percent of the frames to 1/256 of the bytes
+static void test_xing_index() {
+  int size;
+  unsigned char *data = xing_file(50, 576, 1000, &size);
+  write_file("xing.mp3", data, size);
+
+  memset(&mp3_index, 0, sizeof(mp3_index));
+  CHECK_EQ(mp3IndexLoad(&mp3_index, "xing.mp3", 0), 0);
+  CHECK_EQ(mp3_index.source, MP3_INDEX_XING);
+  CHECK_EQ(mp3_index.firstFrame, FRAME_LENGTH);
+  CHECK_EQ(mp3_index.frames, 50);
+  CHECK_EQ(mp3_index.samplesPerFrame, 1152);
+  CHECK_EQ(mp3_index.hz, 44100);
+  CHECK_EQ(mp3_index.encoderDelay, 576);
+  CHECK_EQ(mp3_index.encoderPadding, 1000);
+
+  CHECK_EQ(mp3_index.points[0].frame, 0);
+  CHECK_EQ(mp3_index.points[0].offset, FRAME_LENGTH);
+  // TOC entries inside the Xing frame are dropped
+  CHECK_EQ(mp3_index.count, 98);
+
+  unsigned int i, half = 0;
+  for (i = 1; i < mp3_index.count; i++) {
+    CHECK(mp3_index.points[i].frame >= mp3_index.points[i - 1].frame);
+    CHECK(mp3_index.points[i].offset > mp3_index.points[i - 1].offset);
+
+    // toc[50] = 128, half of the bytes at half of the frames
+    if (mp3_index.points[i].offset == (unsigned int)size / 2)
+      half = mp3_index.points[i].frame;
+  }
+
+  CHECK_EQ(half, 25);
+  CHECK_EQ(mp3IndexFind(&mp3_index, 24)->frame, 24);
+
+  free(data);
+}
+
+// Points from the VBRI TOC, sizes of blocks of frames from the VBRI frame on
+static void test_vbri_index() {
+  int n = 50, entries = 10, per_entry = 5;
+  int size = (n + 1) * FRAME_LENGTH;
+  unsigned char *data = calloc(1, size);
+
+  memcpy(data, frame_header, 4);
+
+  unsigned char *header = data + VBRI_OFFSET;
+  memcpy(header, "VBRI", 4);
+  put_long(header + 10, size);
+  put_long(header + 14, n);
+  put_short(header + 18, entries);
+  put_short(header + 20, 3);
+  put_short(header + 22, 2);
+  put_short(header + 24, per_entry);
+
+  int i;
+  for (i = 0; i < entries; i++)
+    put_short(header + VBRI_HEADER_SIZE + i * 2, per_entry * FRAME_LENGTH / 3 + i);
+
+  for (i = 0; i < n; i++)
+    put_frame(data + (i + 1) * FRAME_LENGTH, i);
+
+  write_file("vbri.mp3", data, size);
+
+  memset(&mp3_index, 0, sizeof(mp3_index));
+  CHECK_EQ(mp3IndexLoad(&mp3_index, "vbri.mp3", 0), 0);
+  CHECK_EQ(mp3_index.source, MP3_INDEX_VBRI);
+  CHECK_EQ(mp3_index.firstFrame, FRAME_LENGTH);
+  CHECK_EQ(mp3_index.frames, n);
+  CHECK_EQ(mp3_index.encoderDelay, -1);
+
+  // The last entry would reach the end of the track
+  CHECK_EQ(mp3_index.count, entries);
+
+  unsigned int offset = 0;
+  for (i = 1; i < (int)mp3_index.count; i++) {
+    offset += (per_entry * FRAME_LENGTH / 3 + (i - 1)) * 3;
+    CHECK_EQ(mp3_index.points[i].frame, i * per_entry);
+    CHECK_EQ(mp3_index.points[i].offset, offset);
+  }
+
+  free(data);
+}
+
+// Without a TOC every frame header is read, garbage before the first frame
+// and a stray sync word in it are skipped
+static void test_scan_index() {
+  int n = 30, skip = 100;
+  int size = skip + n * FRAME_LENGTH;
+  unsigned char *data = calloc(1, size);
+
+  memset(data, 0x20, skip);
+  memcpy(data + 10, frame_header, 4);
+
+  int i;
+  for (i = 0; i < n; i++)
+    put_frame(data + skip + i * FRAME_LENGTH, i);
+
+  write_file("scan.mp3", data, size);
+
+  memset(&mp3_index, 0, sizeof(mp3_index));
+  CHECK_EQ(mp3IndexLoad(&mp3_index, "scan.mp3", 0), 0);
+  CHECK_EQ(mp3_index.source, MP3_INDEX_SCAN);
+  CHECK_EQ(mp3_index.firstFrame, skip);
+  CHECK_EQ(mp3_index.frames, n);
+  CHECK_EQ(mp3_index.count, n);
+  CHECK_EQ(mp3_index.points[7].frame, 7);
+  CHECK_EQ(mp3_index.points[7].offset, skip + 7 * FRAME_LENGTH);
+  CHECK_EQ(mp3IndexFrameAt(&mp3_index, skip + 7 * FRAME_LENGTH + 10), 7);
+
+  free(data);
+}
+
+// Cached indexes are keyed by the path, size and modification time
+static void test_cache_key() {
+  int size;
+  unsigned char *data = xing_file(50, 576, 1000, &size);
+  write_file("cached.mp3", data, size);
+  set_mtime("cached.mp3", 1000000000);
+
+  memset(&mp3_index, 0, sizeof(mp3_index));
+  CHECK_EQ(mp3IndexLoad(&mp3_index, "cached.mp3", 0), 0);
+  CHECK_EQ(mp3_index.encoderDelay, 576);
+
+  // Same size and time, the cached index is used
+  unsigned char *changed = xing_file(50, 1152, 1000, &size);
+  write_file("cached.mp3", changed, size);
+  set_mtime("cached.mp3", 1000000000);
+
+  memset(&mp3_index, 0, sizeof(mp3_index));
+  CHECK_EQ(mp3IndexLoad(&mp3_index, "cached.mp3", 0), 0);
+  CHECK_EQ(mp3_index.encoderDelay, 576);
+
+  // The same file elsewhere has its own entry
+  write_file("other.mp3", changed, size);
+  set_mtime("other.mp3", 1000000000);
+
+  memset(&mp3_index, 0, sizeof(mp3_index));
+  CHECK_EQ(mp3IndexLoad(&mp3_index, "other.mp3", 0), 0);
+  CHECK_EQ(mp3_index.encoderDelay, 1152);
+
+  // A new time
+  set_mtime("cached.mp3", 1000000001);
+
+  memset(&mp3_index, 0, sizeof(mp3_index));
+  CHECK_EQ(mp3IndexLoad(&mp3_index, "cached.mp3", 0), 0);
+  CHECK_EQ(mp3_index.encoderDelay, 1152);
+
+  // A new size, with the time of the cached entry
+  free(changed);
+  changed = xing_file(51, 2000, 1000, &size);
+  write_file("cached.mp3", changed, size);
+  set_mtime("cached.mp3", 1000000001);
+
+  memset(&mp3_index, 0, sizeof(mp3_index));
+  CHECK_EQ(mp3IndexLoad(&mp3_index, "cached.mp3", 0), 0);
+  CHECK_EQ(mp3_index.encoderDelay, 2000);
+  CHECK_EQ(mp3_index.frames, 51);
+
+  free(changed);
+  free(data);
+}
+
+// Samples played of frames of 1152, trimmed like the player does
+static unsigned int played(int frames, int delay, int padding, unsigned int *first_start, unsigned int *last_length) {
+  memset(&mp3_index, 0, sizeof(mp3_index));
+  mp3_index.frames = frames;
+  mp3_index.samplesPerFrame = 1152;
+  mp3_index.encoderDelay = delay;
+  mp3_index.encoderPadding = padding;
+
+  unsigned int total = 0;
+  *first_start = *last_length = 0;
+
+  int frame, first = 1;
+  for (frame = 0; frame < frames; frame++) {
+    unsigned int start = 0, length = 1152;
+    if (!mp3IndexTrim(&mp3_index, frame, &start, &length))
+      continue;
+
+    if (first)
+      *first_start = start;
+    first = 0;
+
+    *last_length = length;
+    total += length - start;
+  }
+
+  return total;
+}
+
+// The encoder delay plus the decoder delay is dropped at the start, the
+// padding less the decoder delay at the end
+static void test_gapless_trim() {
+  unsigned int start, length;
+
+  CHECK_EQ(played(10, 576, 1000, &start, &length), 11520 - 576 - 1000);
+  CHECK_EQ(start, 576 + MP3_DECODER_DELAY);
+  CHECK_EQ(length, 1152 - (1000 - MP3_DECODER_DELAY));
+  CHECK_EQ(mp3IndexSamples(&mp3_index), 11520 - 576 - 1000);
+
+  // The first frame is dropped whole
+  CHECK_EQ(played(10, 1200, 1000, &start, &length), 11520 - 1200 - 1000);
+  CHECK_EQ(start, 1200 + MP3_DECODER_DELAY - 1152);
+
+  // Padding ending on a frame boundary
+  CHECK_EQ(played(10, 576, 1152 + MP3_DECODER_DELAY, &start, &length), 11520 - 576 - 1152 - MP3_DECODER_DELAY);
+  CHECK_EQ(length, 1152);
+
+  // Less padding than the decoder delay, the end is played whole
+  CHECK_EQ(played(10, 576, 100, &start, &length), 11520 - 576 - MP3_DECODER_DELAY);
+  CHECK_EQ(length, 1152);
+
+  // No LAME tag, nothing is trimmed
+  CHECK_EQ(played(10, -1, -1, &start, &length), 11520);
+  CHECK_EQ(start, 0);
+
+  // More delay and padding than samples
+  CHECK_EQ(played(1, 1000, 1000, &start, &length), 0);
+  CHECK_EQ(mp3IndexSamples(&mp3_index), 0);
+}
+
+int main() {
+  sceIoMkdir("ux0:", 0777);
+  sceIoMkdir("ux0:VitaShell", 0777);
+  sceIoMkdir("ux0:VitaShell/internal", 0777);
+
+  test_parse_header();
+  test_parse_xing();
+  test_parse_vbri();
+  test_xing_index();
+  test_vbri_index();
+  test_scan_index();
+  test_cache_key();
+  test_gapless_trim();
+
+  return TEST_RESULT();
+}
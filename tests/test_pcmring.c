@@ -0,0 +1,192 @@
+/*
+  VitaShell host tests - the PCM ring between the audio decoders and
+  the audio output callback
+*/
+
+#include <psp2/kernel/threadmgr.h>
+#include <pthread.h>
+#include <string.h>
+
+#include "audio/pcmring.h"
+#include "test.h"
+
+#define FRAMES 16
+
+static short samples[FRAMES * 2];
+
+static void fill(short *frames, int first, int n) {
+  int i;
+  for (i = 0; i < n; i++) {
+    frames[i * 2] = first + i;
+    frames[i * 2 + 1] = -(first + i);
+  }
+}
+
+static int check_frames(const short *frames, int first, int n) {
+  int i;
+  for (i = 0; i < n; i++) {
+    if (frames[i * 2] != first + i || frames[i * 2 + 1] != -(first + i))
+      return 0;
+  }
+
+  return 1;
+}
+
+// Reads and writes of every length across the end of the buffer
+static void test_wraparound() {
+  PcmRing ring;
+  short frames[FRAMES * 2 * 2];
+
+  pcmRingInit(&ring, samples, FRAMES);
+
+  int written = 0, read = 0;
+
+  int round;
+  for (round = 0; round < 200; round++) {
+    int n = 1 + (round * 7) % FRAMES;
+
+    fill(frames, written, n);
+    int res = pcmRingWrite(&ring, frames, n);
+    CHECK_EQ(res, n < FRAMES - (written - read) ? n : FRAMES - (written - read));
+    written += res;
+
+    CHECK_EQ(pcmRingAvailable(&ring), written - read);
+    CHECK_EQ(pcmRingSpace(&ring), FRAMES - (written - read));
+
+    n = 1 + (round * 5) % FRAMES;
+    if (n > written - read)
+      n = written - read;
+
+    res = pcmRingRead(&ring, frames, n);
+    CHECK_EQ(res, n);
+    CHECK(check_frames(frames, read, res));
+    read += res;
+  }
+
+  // More than there is room for
+  fill(frames, written, FRAMES * 2);
+  CHECK_EQ(pcmRingWrite(&ring, frames, FRAMES * 2), FRAMES - (written - read));
+
+  CHECK_EQ(ring.underruns, 0);
+}
+
+// The positions overflow, the distance between them stays right
+static void test_position_overflow() {
+  PcmRing ring;
+  short frames[FRAMES * 2];
+
+  pcmRingInit(&ring, samples, FRAMES);
+  ring.read = ring.write = 0xFFFFFFFF - 5;
+
+  fill(frames, 0, 12);
+  CHECK_EQ(pcmRingWrite(&ring, frames, 12), 12);
+  CHECK_EQ(pcmRingAvailable(&ring), 12);
+  CHECK_EQ(pcmRingSpace(&ring), FRAMES - 12);
+
+  memset(frames, 0, sizeof(frames));
+  CHECK_EQ(pcmRingRead(&ring, frames, 12), 12);
+  CHECK(check_frames(frames, 0, 12));
+  CHECK_EQ(pcmRingAvailable(&ring), 0);
+}
+
+// Short reads count as underruns only once the ring has filled up, and
+// not at the end of the stream
+static void test_underruns() {
+  PcmRing ring;
+  short frames[FRAMES * 2];
+
+  pcmRingInit(&ring, samples, FRAMES);
+
+  // Starting up
+  CHECK_EQ(pcmRingRead(&ring, frames, 4), 0);
+  fill(frames, 0, 2);
+  pcmRingWrite(&ring, frames, 2);
+  CHECK_EQ(pcmRingRead(&ring, frames, 4), 2);
+  CHECK_EQ(ring.underruns, 0);
+
+  fill(frames, 0, 8);
+  pcmRingWrite(&ring, frames, 8);
+  CHECK_EQ(pcmRingRead(&ring, frames, 4), 4);
+
+  // Playing
+  CHECK_EQ(pcmRingRead(&ring, frames, 8), 4);
+  CHECK_EQ(ring.underruns, 1);
+
+  pcmRingSetEos(&ring, 1);
+  CHECK_EQ(pcmRingRead(&ring, frames, 4), 0);
+  CHECK_EQ(ring.underruns, 1);
+
+  pcmRingReset(&ring);
+  CHECK_EQ(pcmRingRead(&ring, frames, 4), 0);
+  CHECK_EQ(ring.underruns, 0);
+}
+
+typedef struct {
+  PcmRing *ring;
+  volatile int stop;
+  int paused;
+} Consumer;
+
+static void *consumer_thread(void *argp) {
+  Consumer *consumer = (Consumer *)argp;
+  short frames[4 * 2];
+
+  while (!consumer->stop) {
+    // Paused the callback still takes flushes
+    pcmRingRead(consumer->ring, frames, consumer->paused ? 0 : 4);
+    sceKernelDelayThread(100);
+  }
+
+  return NULL;
+}
+
+// A flush drops what was queued before it, keeps what comes after it and
+// doesn't count the empty ring as an underrun
+static void test_flush() {
+  PcmRing ring;
+  short frames[FRAMES * 2];
+
+  pcmRingInit(&ring, samples, FRAMES);
+
+  fill(frames, 0, 10);
+  pcmRingWrite(&ring, frames, 10);
+  CHECK_EQ(pcmRingRead(&ring, frames, 4), 4);
+  pcmRingSetEos(&ring, 1);
+
+  Consumer consumer = { &ring, 0, 1 };
+  pthread_t thread;
+  pthread_create(&thread, NULL, consumer_thread, &consumer);
+
+  CHECK_EQ(pcmRingFlush(&ring, NULL), 0);
+  CHECK_EQ(pcmRingAvailable(&ring), 0);
+  CHECK_EQ(ring.eos, 0);
+
+  consumer.stop = 1;
+  pthread_join(thread, NULL);
+
+  // Nothing has been written since, the decoder is seeking
+  CHECK_EQ(pcmRingRead(&ring, frames, 4), 0);
+  CHECK_EQ(ring.underruns, 0);
+
+  fill(frames, 100, 6);
+  pcmRingWrite(&ring, frames, 6);
+  memset(frames, 0, sizeof(frames));
+  CHECK_EQ(pcmRingRead(&ring, frames, 4), 4);
+  CHECK(check_frames(frames, 100, 4));
+
+  CHECK_EQ(pcmRingRead(&ring, frames, 4), 2);
+  CHECK_EQ(ring.underruns, 1);
+
+  // Canceled while nobody takes the flush
+  volatile int cancel = 1;
+  CHECK_EQ(pcmRingFlush(&ring, &cancel), -1);
+}
+
+int main() {
+  test_wraparound();
+  test_position_overflow();
+  test_underruns();
+  test_flush();
+
+  return TEST_RESULT();
+}
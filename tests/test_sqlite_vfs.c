@@ -0,0 +1,241 @@
+/*
+  VitaShell host tests - the write-coalescing psp2_rw SQLite VFS
+
+  sqlite3.c wraps Sony's read-only "psp2" VFS. Here that VFS is played by a
+  small one over POSIX with the same file structure, on top of the host
+  SQLite library.
+*/
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "sqlite3.h"
+#include "test.h"
+
+#ifndef SQLITE_OPEN_MAIN_DB
+#define SQLITE_OPEN_MAIN_DB 0x00000100
+#endif
+
+int sqlite_init();
+int sqlite_exit();
+
+// The file structure used by Sony
+typedef struct {
+  sqlite3_file file;
+  int *fd;
+  int fd_value;
+} psp2_file;
+
+static sqlite3_vfs psp2_vfs;
+
+static int psp2_close(sqlite3_file *file) {
+  psp2_file *p = (psp2_file *)file;
+  close(*p->fd);
+  return SQLITE_OK;
+}
+
+static int psp2_read(sqlite3_file *file, void *buf, int count, sqlite3_int64 offset) {
+  psp2_file *p = (psp2_file *)file;
+  int read = pread(*p->fd, buf, count, offset);
+  if (read == count)
+    return SQLITE_OK;
+  if (read < 0)
+    return SQLITE_IOERR_READ;
+  memset((char *)buf + read, 0, count - read);
+  return SQLITE_IOERR_SHORT_READ;
+}
+
+// Like Sony's, this one has no write access
+static int psp2_write(sqlite3_file *file, const void *buf, int count, sqlite3_int64 offset) {
+  return SQLITE_IOERR_WRITE;
+}
+
+static int psp2_truncate(sqlite3_file *file, sqlite3_int64 size) {
+  psp2_file *p = (psp2_file *)file;
+  return ftruncate(*p->fd, size) < 0 ? SQLITE_IOERR_TRUNCATE : SQLITE_OK;
+}
+
+static int psp2_sync(sqlite3_file *file, int flags) {
+  return SQLITE_OK;
+}
+
+static int psp2_file_size(sqlite3_file *file, sqlite3_int64 *size) {
+  psp2_file *p = (psp2_file *)file;
+  struct stat st;
+  if (fstat(*p->fd, &st) < 0)
+    return SQLITE_IOERR_FSTAT;
+  *size = st.st_size;
+  return SQLITE_OK;
+}
+
+static int psp2_lock(sqlite3_file *file, int lock) {
+  return SQLITE_OK;
+}
+
+static int psp2_check_reserved_lock(sqlite3_file *file, int *out) {
+  *out = 0;
+  return SQLITE_OK;
+}
+
+static int psp2_file_control(sqlite3_file *file, int op, void *arg) {
+  return SQLITE_NOTFOUND;
+}
+
+static int psp2_sector_size(sqlite3_file *file) {
+  return 512;
+}
+
+static int psp2_device_characteristics(sqlite3_file *file) {
+  return 0;
+}
+
+static const sqlite3_io_methods psp2_methods = {
+  1,
+  psp2_close,
+  psp2_read,
+  psp2_write,
+  psp2_truncate,
+  psp2_sync,
+  psp2_file_size,
+  psp2_lock,
+  psp2_lock,
+  psp2_check_reserved_lock,
+  psp2_file_control,
+  psp2_sector_size,
+  psp2_device_characteristics,
+};
+
+static int psp2_open(sqlite3_vfs *vfs, const char *name, sqlite3_file *file, int flags, int *out_flags) {
+  psp2_file *p = (psp2_file *)file;
+
+  file->pMethods = NULL;
+  p->fd = &p->fd_value;
+  p->fd_value = open(name, O_RDONLY);
+  if (p->fd_value < 0)
+    return SQLITE_CANTOPEN;
+
+  if (out_flags)
+    *out_flags = flags;
+  file->pMethods = &psp2_methods;
+  return SQLITE_OK;
+}
+
+static void register_psp2_vfs() {
+  memcpy(&psp2_vfs, sqlite3_vfs_find(NULL), sizeof(sqlite3_vfs));
+  psp2_vfs.zName = "psp2";
+  psp2_vfs.szOsFile = sizeof(psp2_file);
+  psp2_vfs.xOpen = psp2_open;
+  sqlite3_vfs_register(&psp2_vfs, 1);
+}
+
+static int count_callback(void *context, int n, char **values, char **names) {
+  *(int *)context = atoi(values[0]);
+  return 0;
+}
+
+static int check_callback(void *context, int n, char **values, char **names) {
+  strncpy((char *)context, values[0] ? values[0] : "", 63);
+  return 0;
+}
+
+static int exec(sqlite3 *db, const char *sql) {
+  int rc = sqlite3_exec(db, sql, NULL, NULL, NULL);
+  if (rc != SQLITE_OK)
+    fprintf(stderr, "%s: %s\n", sql, sqlite3_errmsg(db));
+  return rc;
+}
+
+// A flushed write range must not make the file look larger after a truncate
+static void test_file_size_after_truncate(const char *path) {
+  sqlite3_vfs *vfs = sqlite3_vfs_find("psp2_rw");
+  CHECK(vfs != NULL);
+  if (!vfs)
+    return;
+
+  sqlite3_file *file = calloc(1, vfs->szOsFile);
+  int flags = SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_MAIN_DB;
+  CHECK_EQ(vfs->xOpen(vfs, path, file, flags, NULL), SQLITE_OK);
+
+  char page[4096];
+  memset(page, 0xA5, sizeof(page));
+
+  sqlite3_int64 size = 0;
+  CHECK_EQ(file->pMethods->xWrite(file, page, sizeof(page), 0), SQLITE_OK);
+  CHECK_EQ(file->pMethods->xWrite(file, page, sizeof(page), 1024 * 1024), SQLITE_OK);
+
+  // Still pending, the size includes it
+  CHECK_EQ(file->pMethods->xFileSize(file, &size), SQLITE_OK);
+  CHECK_EQ(size, 1024 * 1024 + sizeof(page));
+
+  CHECK_EQ(file->pMethods->xSync(file, 0), SQLITE_OK);
+  CHECK_EQ(file->pMethods->xTruncate(file, sizeof(page)), SQLITE_OK);
+  CHECK_EQ(file->pMethods->xFileSize(file, &size), SQLITE_OK);
+  CHECK_EQ(size, sizeof(page));
+
+  // Reads see pending writes
+  char data[16];
+  CHECK_EQ(file->pMethods->xWrite(file, "coalesced", 9, 100), SQLITE_OK);
+  CHECK_EQ(file->pMethods->xRead(file, data, 9, 100), SQLITE_OK);
+  CHECK(memcmp(data, "coalesced", 9) == 0);
+
+  CHECK_EQ(file->pMethods->xClose(file), SQLITE_OK);
+  free(file);
+
+  struct stat st;
+  CHECK(stat(path, &st) == 0 && st.st_size == sizeof(page));
+
+  unlink(path);
+}
+
+// Grow the database well past the write buffer, shrink it through
+// auto_vacuum truncates, then check it after reopening
+static void test_integrity(const char *path) {
+  sqlite3 *db = NULL;
+  int i, count = -1;
+  char check[64] = "";
+
+  CHECK_EQ(sqlite3_open_v2(path, &db, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, NULL), SQLITE_OK);
+  CHECK_EQ(exec(db, "PRAGMA temp_store = MEMORY"), SQLITE_OK);
+  CHECK_EQ(exec(db, "PRAGMA auto_vacuum = FULL"), SQLITE_OK);
+  CHECK_EQ(exec(db, "CREATE TABLE Licenses (CONTENT_ID TEXT NOT NULL UNIQUE, RIF BLOB NOT NULL, PRIMARY KEY(CONTENT_ID))"), SQLITE_OK);
+
+  for (i = 0; i < 8; i++) {
+    char sql[256];
+    CHECK_EQ(exec(db, "BEGIN"), SQLITE_OK);
+    snprintf(sql, sizeof(sql),
+             "WITH RECURSIVE n(x) AS (SELECT 1 UNION ALL SELECT x + 1 FROM n WHERE x < 500) "
+             "INSERT INTO Licenses SELECT printf('UP0000-TEST%%05d_00-%%016d', %d * 500 + x, x), randomblob(512) FROM n", i);
+    CHECK_EQ(exec(db, sql), SQLITE_OK);
+    CHECK_EQ(exec(db, "COMMIT"), SQLITE_OK);
+  }
+
+  // Each delete truncates the file below ranges written earlier
+  CHECK_EQ(exec(db, "DELETE FROM Licenses WHERE rowid % 2 = 0"), SQLITE_OK);
+  CHECK_EQ(exec(db, "DELETE FROM Licenses WHERE rowid > 1000"), SQLITE_OK);
+  CHECK_EQ(exec(db, "UPDATE Licenses SET RIF = randomblob(512) WHERE rowid % 3 = 0"), SQLITE_OK);
+  CHECK_EQ(sqlite3_close(db), SQLITE_OK);
+
+  db = NULL;
+  CHECK_EQ(sqlite3_open_v2(path, &db, SQLITE_OPEN_READWRITE, NULL), SQLITE_OK);
+  CHECK_EQ(sqlite3_exec(db, "PRAGMA integrity_check", check_callback, check, NULL), SQLITE_OK);
+  CHECK(strcmp(check, "ok") == 0);
+  CHECK_EQ(sqlite3_exec(db, "SELECT COUNT(*) FROM Licenses", count_callback, &count, NULL), SQLITE_OK);
+  CHECK_EQ(count, 500);
+  CHECK_EQ(sqlite3_close(db), SQLITE_OK);
+
+  unlink(path);
+}
+
+int main() {
+  register_psp2_vfs();
+  CHECK_EQ(sqlite_init(), SQLITE_OK);
+
+  test_file_size_after_truncate("vfs_truncate.bin");
+  test_integrity("vfs_integrity.db");
+
+  CHECK_EQ(sqlite_exit(), SQLITE_OK);
+  return TEST_RESULT();
+}
@@ -22,6 +22,8 @@
 #include "archive.h"
 #include "file.h"
 #include "text.h"
+#include "text_buffer.h"
+#include "text_search.h"
 #include "hex.h"
 #include "theme.h"
 #include "utils.h"
@@ -29,6 +31,10 @@
 #include "ime_dialog.h"
 #include "message_dialog.h"
 
+#ifdef __ARM_NEON
+#include <arm_neon.h>
+#endif
+
 enum TextMenuEntrys {
   TEXT_MENU_ENTRY_MARK_UNMARK_ALL,
   TEXT_MENU_ENTRY_CUT,
@@ -37,7 +43,10 @@ enum TextMenuEntrys {
   TEXT_MENU_ENTRY_DELETE,
   TEXT_MENU_ENTRY_INSERT_EMPTY_LINE,
   TEXT_MENU_ENTRY_SEARCH,
+  TEXT_MENU_ENTRY_SEARCH_REGEX,
   TEXT_MENU_ENTRY_HEX_EDITOR,
+  TEXT_MENU_ENTRY_UNDO,
+  TEXT_MENU_ENTRY_REDO,
 };
 
 MenuEntry text_menu_entries[] = {
@@ -48,7 +57,10 @@ MenuEntry text_menu_entries[] = {
   { DELETE,      6, 0, CTX_VISIBLE },
   { INSERT_EMPTY_LINE, 7, 0, CTX_VISIBLE },
   { SEARCH,      9, 0, CTX_VISIBLE },
-  { OPEN_HEX_EDITOR,  11, 0, CTX_VISIBLE },
+  { SEARCH_REGEX, 10, 0, CTX_VISIBLE },
+  { OPEN_HEX_EDITOR,  12, 0, CTX_VISIBLE },
+  { UNDO,        14, 0, CTX_INVISIBLE },
+  { REDO,        15, 0, CTX_INVISIBLE },
 };
 
 #define N_TEXT_MENU_ENTRIES (sizeof(text_menu_entries) / sizeof(MenuEntry))
@@ -64,13 +76,36 @@ static ContextMenu context_menu_text = {
   .sel = -1,
 };
 
+enum TextPagerMenuEntrys {
+  TEXT_PAGER_MENU_ENTRY_GO_TO_LINE,
+  TEXT_PAGER_MENU_ENTRY_HEX_EDITOR,
+};
+
+MenuEntry text_pager_menu_entries[] = {
+  { GO_TO_LINE,  0, 0, CTX_VISIBLE },
+  { OPEN_HEX_EDITOR, 2, 0, CTX_VISIBLE },
+};
+
+#define N_TEXT_PAGER_MENU_ENTRIES (sizeof(text_pager_menu_entries) / sizeof(MenuEntry))
+
+static int pagerContextMenuEnterCallback(int pos, void *context);
+
+static ContextMenu context_menu_text_pager = {
+  .parent = NULL,
+  .entries = text_pager_menu_entries,
+  .n_entries = N_TEXT_PAGER_MENU_ENTRIES,
+  .max_width = 0.0f,
+  .callback = pagerContextMenuEnterCallback,
+  .sel = -1,
+};
+
 typedef struct TextEditorState {
   int running;
-  char *buffer;
-  int size;
+  TextBuffer tb;
   int base_pos;
   int rel_pos;
-  int offset_list[MAX_LINES];
+  int *offset_list;
+  int max_lines;
   int selection_list[MAX_SELECTION];
   int n_selections;
   int n_copied_lines;
@@ -81,6 +116,8 @@ typedef struct TextEditorState {
   int changed;
   int edit_line;
   char search_term[MAX_LINE_CHARACTERS];
+  TextSearch search;
+  int search_flags;
   int search_result_offsets[MAX_SEARCH_RESULTS];
   int search_term_input;
   int n_search_results;
@@ -88,13 +125,14 @@ typedef struct TextEditorState {
   int count_lines_thid;
   int hex_viewer;
   int count_lines_running;
+  int count_lines_full;
   int n_lines;
   int search_running;
+  int goto_offset;
 } TextEditorState;
 
 typedef struct SearchParams {
   TextEditorState *state;
-  char search_term[MAX_LINE_CHARACTERS];
 } SearchParams;
 
 typedef struct CountParams {
@@ -109,6 +147,13 @@ void initTextContextMenuWidth() {
 
   context_menu_text.max_width += 2.0f * CONTEXT_MENU_MARGIN;
   context_menu_text.max_width = MAX(context_menu_text.max_width, CONTEXT_MENU_MIN_WIDTH);
+
+  for (i = 0; i < N_TEXT_PAGER_MENU_ENTRIES; i++) {
+    context_menu_text_pager.max_width = MAX(context_menu_text_pager.max_width, pgf_text_width(language_container[text_pager_menu_entries[i].name]));
+  }
+
+  context_menu_text_pager.max_width += 2.0f * CONTEXT_MENU_MARGIN;
+  context_menu_text_pager.max_width = MAX(context_menu_text_pager.max_width, CONTEXT_MENU_MIN_WIDTH);
 }
 
 static void textListAddEntry(TextList *list, TextListEntry *entry) {
@@ -144,15 +189,95 @@ static void textListEmpty(TextList *list) {
 
 #define TAB_SIZE 4
 
-static int textReadLine(char *buffer, int offset, int size, char *line) {
+// Lines up to this length can not be wrapped, whatever characters they have
+static int short_line_length = 0;
+
+static void initShortLineLength() {
+  int max_width = TAB_SIZE * font_size_cache[' '];
+
+  int i;
+  for (i = 0; i < 256; i++) {
+    int width = font_size_cache[i] != 0 ? font_size_cache[i] : font_size_cache[' '];
+    max_width = MAX(max_width, width);
+  }
+
+  int length = MAX_LINE_CHARACTERS - 2;
+  if (max_width > 0) {
+    float max_line_width = MAX_WIDTH - TEXT_START_X + SHELL_MARGIN_X;
+    while (length > 0 && (length * max_width) >= max_line_width)
+      length--;
+  }
+
+  short_line_length = length;
+}
+
+// Find a newline 16 bytes at a time with NEON, else a word at a time
+static const char *findNewline(const char *p, int length) {
+  const char *end = p + length;
+
+  while (p < end && ((uintptr_t)p & 3)) {
+    if (*p == '\n')
+      return p;
+    p++;
+  }
+
+#ifdef __ARM_NEON
+  uint8x16_t newlines = vdupq_n_u8('\n');
+  while (end - p >= 16) {
+    uint8x16_t eq = vceqq_u8(vld1q_u8((const uint8_t *)p), newlines);
+    uint32x2_t folded = vreinterpret_u32_u8(vorr_u8(vget_low_u8(eq), vget_high_u8(eq)));
+    if (vget_lane_u32(vpmax_u32(folded, folded), 0))
+      break;
+    p += 16;
+  }
+#endif
+
+  // A byte of word ^ 0x0A0A0A0A is zero where there is a newline
+  while (end - p >= 4) {
+    uint32_t word;
+    memcpy(&word, p, sizeof(uint32_t));
+    word ^= 0x0A0A0A0A;
+    if ((word - 0x01010101) & ~word & 0x80808080)
+      break;
+    p += 4;
+  }
+
+  while (p < end) {
+    if (*p == '\n')
+      return p;
+    p++;
+  }
+
+  return NULL;
+}
+
+static int textReadLine(TextBuffer *tb, SceOff offset, char *line) {
+  // Only the length is wanted and the line is too short to wrap
+  if (!line && short_line_length > 0) {
+    int length;
+    const char *chunk = textBufferChunk(tb, offset, &length);
+    if (chunk) {
+      const char *newline = findNewline(chunk, MIN(length, short_line_length + 1));
+      if (newline)
+        return newline - chunk + 1;
+    }
+  }
+
   // Get line
   int line_width = 0;
   int count = 0;
 
+  const char *chunk = NULL;
+  int chunk_length = 0;
+
   int i;
-  for (i = 0; i < MIN(size, MIN(size - offset, MAX_LINE_CHARACTERS - 1)); i++) {
-    char ch = buffer[offset + i];
+  for (i = 0; i < MIN(tb->size - offset, MAX_LINE_CHARACTERS - 1); i++) {
+    if (chunk_length == 0)
+      chunk = textBufferChunk(tb, offset + i, &chunk_length);
+
+    char ch = *chunk++;
     char ch_width = 0;
+    chunk_length--;
 
     // Line break
     if (ch == '\n') {
@@ -190,6 +315,8 @@ static int textReadLine(char *buffer, int offset, int size, char *line) {
   return i;
 }
 
+static void set_line_offset(TextEditorState *state, int line, int offset);
+
 static void updateTextEntry(TextEditorState *state, TextListEntry* entry, int rel_pos) {
   entry->line_number = state->base_pos + rel_pos;
 
@@ -203,8 +330,8 @@ static void updateTextEntry(TextEditorState *state, TextListEntry* entry, int re
     }
   }
 
-  int length = textReadLine(state->buffer, state->offset_list[state->base_pos + rel_pos], state->size, entry->line);
-  state->offset_list[state->base_pos + rel_pos + 1] = state->offset_list[state->base_pos + rel_pos] + length;
+  int length = textReadLine(&state->tb, state->offset_list[state->base_pos + rel_pos], entry->line);
+  set_line_offset(state, state->base_pos + rel_pos + 1, state->offset_list[state->base_pos + rel_pos] + length);
 }
 
 static void updateTextEntries(TextEditorState *state) {
@@ -221,6 +348,239 @@ static void updateTextEntries(TextEditorState *state) {
   }
 }
 
+static int count_lines_thread(SceSize args, CountParams *params);
+
+static void start_count_lines(TextEditorState *state) {
+  if (state->count_lines_running)
+    return;
+
+  CountParams count_params;
+  count_params.state = state;
+
+  state->count_lines_running = 1;
+  state->count_lines_thid = sceKernelCreateThread("count_lines_thread", (SceKernelThreadEntry)count_lines_thread, 0x10000100, 0x10000, 0, 0x70000, NULL);
+  if (state->count_lines_thid >= 0)
+    sceKernelStartThread(state->count_lines_thid, sizeof(CountParams), &count_params);
+  else
+    state->count_lines_running = 0;
+}
+
+static void stop_count_lines(TextEditorState *state) {
+  if (state->count_lines_thid >= 0) {
+    state->count_lines_running = 0;
+    sceKernelWaitThreadEnd(state->count_lines_thid, NULL, NULL);
+    state->count_lines_thid = -1;
+  }
+}
+
+// Makes room for the offsets of lines lines, the counter must be stopped
+static int reserve_lines(TextEditorState *state, int lines) {
+  if (lines <= state->max_lines)
+    return 0;
+
+  int max_lines = state->max_lines;
+  while (max_lines < lines)
+    max_lines *= 2;
+
+  int *offset_list = realloc(state->offset_list, (max_lines + 1) * sizeof(int));
+  if (!offset_list)
+    return VITASHELL_ERROR_NO_MEMORY;
+
+  state->offset_list = offset_list;
+  state->max_lines = max_lines;
+
+  return 0;
+}
+
+static int ensure_lines(TextEditorState *state, int lines) {
+  if (lines <= state->max_lines)
+    return 0;
+
+  int restart = state->count_lines_running;
+  stop_count_lines(state);
+
+  int res = reserve_lines(state, lines);
+
+  if (restart)
+    start_count_lines(state);
+
+  return res;
+}
+
+// The counter may be writing the offsets behind the published lines as
+// well. Both get a line's offset from the line before it, so they store
+// the same value and the counter keeps running.
+static void set_line_offset(TextEditorState *state, int line, int offset) {
+  __atomic_store_n(&state->offset_list[line], offset, __ATOMIC_RELAXED);
+}
+
+// Line containing offset, among the lines counted so far
+static int find_line(TextEditorState *state, int offset) {
+  int low = 0, high = state->n_lines - 1;
+  if (high < 0)
+    return 0;
+
+  while (low < high) {
+    int mid = (low + high + 1) / 2;
+    if (state->offset_list[mid] <= offset)
+      low = mid;
+    else
+      high = mid - 1;
+  }
+
+  return low;
+}
+
+// [offset, offset + removed) was replaced by inserted bytes. Only the lines
+// from the edit up to the next line break after it are read again, the
+// offsets behind it are just moved.
+static void update_line_index(TextEditorState *state, int offset, int removed, int inserted) {
+  int *offset_list = state->offset_list;
+  int old_lines = state->n_lines;
+  int delta = inserted - removed;
+  int end = offset + inserted;
+
+  // A wrapped line may also take characters from the next one
+  int first = find_line(state, offset);
+  if (first > 0 && textBufferGetChar(&state->tb, offset_list[first] - 1) != '\n')
+    first--;
+
+  int *new_offsets = malloc(MAX_ENTRIES * sizeof(int));
+  int max_new = MAX_ENTRIES;
+  int n_new = 0;
+  int sync = -1;
+
+  int pos = offset_list[first];
+
+  while (new_offsets) {
+    if (pos >= end && (pos == 0 || textBufferGetChar(&state->tb, pos - 1) == '\n')) {
+      if (pos - delta > offset_list[old_lines])
+        break;
+
+      // Lines behind the edit start at the same place as before
+      int k = find_line(state, pos - delta);
+      if (old_lines > 0 && offset_list[k] != pos - delta)
+        k++;
+      if (k <= old_lines && offset_list[k] == pos - delta) {
+        sync = k;
+        break;
+      }
+    }
+
+    if (pos >= state->tb.size ||
+        reserve_lines(state, first + n_new + MAX_ENTRIES + 1) < 0)
+      break;
+    offset_list = state->offset_list;
+
+    if (n_new == max_new) {
+      max_new *= 2;
+      int *tmp = realloc(new_offsets, max_new * sizeof(int));
+      if (!tmp)
+        break;
+      new_offsets = tmp;
+    }
+
+    new_offsets[n_new++] = pos;
+    pos += textReadLine(&state->tb, pos, NULL);
+  }
+
+  if (sync >= 0) {
+    int n_tail = old_lines - sync;
+    if (reserve_lines(state, first + n_new + n_tail + MAX_ENTRIES) < 0)
+      n_tail = MAX(MIN(n_tail, state->max_lines - MAX_ENTRIES - first - n_new), 0);
+    offset_list = state->offset_list;
+
+    memmove(&offset_list[first + n_new], &offset_list[sync], (n_tail + 1) * sizeof(int));
+
+    int i;
+    for (i = 0; i <= n_tail; i++)
+      offset_list[first + n_new + i] += delta;
+
+    state->n_lines = first + n_new + n_tail;
+  } else {
+    // Lines behind are counted again
+    state->n_lines = first + n_new;
+    offset_list[state->n_lines] = pos;
+  }
+
+  if (new_offsets) {
+    memcpy(&offset_list[first], new_offsets, n_new * sizeof(int));
+    free(new_offsets);
+  }
+}
+
+static void update_cursor(TextEditorState *state) {
+  if (state->base_pos + state->rel_pos >= state->n_lines) {
+    state->rel_pos = state->n_lines - state->base_pos - 1;
+  }
+
+  if (state->rel_pos < 0) {
+    state->base_pos += state->rel_pos;
+    state->rel_pos = 0;
+  }
+
+  if (state->base_pos < 0)
+    state->base_pos = 0;
+}
+
+static int edit_text(TextEditorState *state, int offset, int length, const char *data, int new_length) {
+  // Results would point to old offsets
+  if (state->search_running) {
+    state->search_running = 0;
+    sceKernelWaitThreadEnd(state->search_thid, NULL, NULL);
+  }
+
+  state->goto_offset = 0;
+
+  stop_count_lines(state);
+
+  int res = textBufferReplace(&state->tb, offset, length, data, new_length);
+  if (res >= 0) {
+    update_line_index(state, offset, length, new_length);
+    state->changed = 1;
+  }
+
+  start_count_lines(state);
+
+  return res;
+}
+
+static void undo_redo(TextEditorState *state, int redo) {
+  TextEdit edit;
+
+  if (state->search_running) {
+    state->search_running = 0;
+    sceKernelWaitThreadEnd(state->search_thid, NULL, NULL);
+  }
+
+  state->goto_offset = 0;
+
+  stop_count_lines(state);
+
+  if (redo ? textBufferRedo(&state->tb, &edit) : textBufferUndo(&state->tb, &edit)) {
+    update_line_index(state, edit.offset, edit.removed, edit.inserted);
+
+    // Show the changed line
+    int line = find_line(state, edit.offset);
+    if (line < state->base_pos || line >= state->base_pos + MAX_POSITION) {
+      state->base_pos = line;
+      state->rel_pos = 0;
+    } else {
+      state->rel_pos = line - state->base_pos;
+    }
+
+    state->changed = 1;
+  }
+
+  start_count_lines(state);
+
+  update_cursor(state);
+
+  state->n_selections = 0;
+
+  // Update entries
+  updateTextEntries(state);
+}
 
 static CopyEntry *copy_line(TextEditorState *state, int line_number) {
   if (state->copy_reset) {
@@ -230,13 +590,12 @@ static CopyEntry *copy_line(TextEditorState *state, int line_number) {
 
   // Get current line
   int line_start = state->offset_list[line_number];
-  char line[MAX_LINE_CHARACTERS];
-  int length = textReadLine(state->buffer, line_start, state->size, line);
+  int length = textReadLine(&state->tb, line_start, NULL);
 
   CopyEntry *entry = &state->copy_buffer[state->n_copied_lines];
 
   // Copy line into copy_buffer
-  memcpy(entry->line, &state->buffer[line_start], length);
+  textBufferRead(&state->tb, line_start, entry->line, length);
 
   // Make sure line end with a newline
   if (entry->line[length - 1] != '\n') {
@@ -256,31 +615,17 @@ static CopyEntry *copy_line(TextEditorState *state, int line_number) {
 static void delete_line(TextEditorState *state, int line_number) {
   // Get current line
   int line_start = state->offset_list[line_number];
-  char line[MAX_LINE_CHARACTERS];
-  int length = textReadLine(state->buffer, line_start, state->size, line);
+  int length = textReadLine(&state->tb, line_start, NULL);
 
-  // Remove line
-  memmove(&state->buffer[line_start], &state->buffer[line_start + length], state->size - line_start);  
-  state->size -= length;
-  state->n_lines -= 1;
-
-  // Add empty line if resulting buffer is empty
-  if (state->size == 0) {
-    state->size = 1;
-    state->n_lines = 1;
-    state->buffer[0] = '\n';
-  } 
-
-  if (state->base_pos + state->rel_pos >= state->n_lines) {
-    state->rel_pos = state->n_lines - state->base_pos - 1;
+  // Remove line, leave an empty line if resulting buffer is empty
+  if (length == state->tb.size) {
+    edit_text(state, line_start, length, "\n", 1);
+  } else {
+    edit_text(state, line_start, length, NULL, 0);
   }
 
-  if (state->rel_pos < 0) {
-    state->base_pos += state->rel_pos;
-    state->rel_pos = 0;
-  }
+  update_cursor(state);
 
-  state->changed = 1;
   state->n_selections = 0;
   
   // Update entries
@@ -290,25 +635,10 @@ static void delete_line(TextEditorState *state, int line_number) {
 static void insert_line(TextEditorState *state, char *line, int pos) {
   int offset = state->offset_list[pos];
 
-  // calculated size of inserted line
-  int length = strlen(line);
-
-  // Make space for inserted line
-  memmove(&state->buffer[offset + length], &state->buffer[offset], state->size - offset);
-  state->size += length;
-
   // Insert the lines
-  memcpy(&state->buffer[offset], line, length);
-
-  int i;
-  for (i = 0; i < length; i++) {
-    if (line[i] == '\n') {
-      state->n_lines++;
-    }
-  }
+  edit_text(state, offset, 0, line, strlen(line));
   
   state->n_selections = 0;
-  state->changed = 1;
   state->copy_reset = 1;
 
   // Update entries
@@ -329,21 +659,23 @@ static void paste_lines(TextEditorState *state, int pos) {
     length += strlen(state->copy_buffer[i].line);
   }
 
-  // Make space for pasted lines
-  memmove(&state->buffer[line_start + length], &state->buffer[line_start], state->size - line_start);
-  state->size += length;
+  char *lines = malloc(length);
+  if (!lines)
+    return;
 
-  // Paste the lines
+  // Paste the lines at once
+  length = 0;
   for (i = 0; i < state->n_copied_lines; i++) {
     int line_length = strlen(state->copy_buffer[i].line);
 
-    memcpy(&state->buffer[line_start], state->copy_buffer[i].line, line_length);
-    line_start += line_length;
+    memcpy(&lines[length], state->copy_buffer[i].line, line_length);
+    length += line_length;
   }
 
-  state->n_lines += state->n_copied_lines;
+  edit_text(state, line_start, 0, lines, length);
+
+  free(lines);
   
-  state->changed = 1;
   state->copy_reset = 1;
   state->n_selections = 0;
 
@@ -351,6 +683,10 @@ static void paste_lines(TextEditorState *state, int pos) {
   updateTextEntries(state);
 }
 
+#define SEARCH_WINDOW_SIZE (256 * 1024)
+// Longest regular expression match found across two windows of one line
+#define SEARCH_REGEX_OVERLAP (4 * 1024)
+
 static int cmp (const void * a, const void * b) {
    return ( *(int*)a - *(int*)b );
 }
@@ -360,7 +696,9 @@ static int contextMenuEnterCallback(int sel, void *context) {
 
   switch (sel) {
     case TEXT_MENU_ENTRY_SEARCH:
+    case TEXT_MENU_ENTRY_SEARCH_REGEX:
       initImeDialog(language_container[ENTER_SEARCH_TERM], "", MAX_LINE_CHARACTERS, SCE_IME_TYPE_DEFAULT, 0, 0);
+      state->search_flags = (sel == TEXT_MENU_ENTRY_SEARCH_REGEX) ? TEXT_SEARCH_REGEX : 0;
       state->search_term_input = 1;
       break;
 
@@ -392,9 +730,11 @@ static int contextMenuEnterCallback(int sel, void *context) {
       qsort(state->selection_list, state->n_selections, sizeof(int), cmp);
 
       // Cut the lines in reversed order to not break the offsets
+      textBufferBeginGroup(&state->tb);
       for (i = state->n_selections - 1; i >= 0; i--) {
         cut_line(state, state->selection_list[i]);
       }
+      textBufferEndGroup(&state->tb);
 
       // Reverse the order of the copied lines
       int j;
@@ -423,6 +763,14 @@ static int contextMenuEnterCallback(int sel, void *context) {
       state->n_selections = 0;
       updateTextEntries(state);
       break;
+
+    case TEXT_MENU_ENTRY_UNDO:
+      undo_redo(state, 0);
+      break;
+
+    case TEXT_MENU_ENTRY_REDO:
+      undo_redo(state, 1);
+      break;
   }
 
   return CONTEXT_MENU_CLOSING;
@@ -436,6 +784,10 @@ static void setContextMenuVisibilities(TextEditorState *state) {
 
   // Paste only visible when at least one line is in copy buffer
   text_menu_entries[TEXT_MENU_ENTRY_PASTE].visibility = state->n_copied_lines == 0 ? CTX_INVISIBLE : CTX_VISIBLE;
+
+  // Undo & Redo only visible when there is a version to go back or forth to
+  text_menu_entries[TEXT_MENU_ENTRY_UNDO].visibility = (state->modify_allowed && state->tb.n_undo > 0) ? CTX_VISIBLE : CTX_INVISIBLE;
+  text_menu_entries[TEXT_MENU_ENTRY_REDO].visibility = (state->modify_allowed && state->tb.n_redo > 0) ? CTX_VISIBLE : CTX_INVISIBLE;
   
   // Go to first entry
   int i;
@@ -450,68 +802,607 @@ static void setContextMenuVisibilities(TextEditorState *state) {
     context_menu_text.sel = -1;
 }
 
+// Continues from the lines already counted. n_lines is the progress, the
+// offsets up to it are complete when it is published.
 static int count_lines_thread(SceSize args, CountParams *params) {
   TextEditorState *state = params->state;
 
-  state->count_lines_running = 1;
-  state->n_lines = 0;
+  int n_lines = state->n_lines;
+  int offset = state->offset_list[n_lines];
 
-  int offset = 0;
+  // Room for the lines on screen behind the last one is kept
+  int max_lines = state->max_lines - MAX_ENTRIES;
 
-  while (state->count_lines_running && offset < state->size && state->n_lines < MAX_LINES) {
-    offset += textReadLine(state->buffer, offset, state->size, NULL);
-    state->n_lines++;
+  while (state->count_lines_running && offset < state->tb.size && n_lines < max_lines) {
+    offset += textReadLine(&state->tb, offset, NULL);
+    __atomic_store_n(&state->offset_list[++n_lines], offset, __ATOMIC_RELAXED);
 
-    sceKernelDelayThread(1000);
+    if ((n_lines % TEXT_COUNT_PUBLISH_LINES) == 0)
+      __atomic_store_n(&state->n_lines, n_lines, __ATOMIC_RELEASE);
+
+    if ((n_lines % TEXT_INDEX_YIELD_LINES) == 0)
+      sceKernelDelayThread(100);
   }
 
+  __atomic_store_n(&state->n_lines, n_lines, __ATOMIC_RELEASE);
+
+  // The offset table is grown by the UI thread
+  if (offset < state->tb.size && n_lines >= max_lines)
+    state->count_lines_full = 1;
+
+  state->count_lines_running = 0;
+
   return sceKernelExitDeleteThread(0);
 }
 
+// One pass over the text with the compiled search, results are in order
 static int search_thread(SceSize args, SearchParams *argp) {
   TextEditorState *state = argp->state;
-  char *search_term = argp->search_term;
-  int search_term_length = strlen(search_term);
+  TextSearch *search = &state->search;
   int *search_result_offsets = state->search_result_offsets; 
+  int regex = search->flags & TEXT_SEARCH_REGEX;
 
-  state->search_running = 1;
-  state->n_search_results = 0;
+  int n_search_results = 0;
 
-  int offset = 0;
+  char *window = malloc(SEARCH_WINDOW_SIZE);
+  if (!window) {
+    state->search_running = 0;
+    return sceKernelExitDeleteThread(0);
+  }
 
-  // make sure buffer is null-terminated
-  state->buffer[state->size] = '\0';
+  int offset = 0;
 
-  char *r;
-  while (state->search_running && offset < state->size && state->n_search_results < MAX_SEARCH_RESULTS) {
-    r = strcasestr(state->buffer+offset, search_term);
+  // The line continued from the last window already has a result
+  int line_found = 0;
+
+  while (state->search_running && offset < state->tb.size && n_search_results < MAX_SEARCH_RESULTS) {
+    int length = textBufferRead(&state->tb, offset, window, SEARCH_WINDOW_SIZE);
+    int end = length;
+
+    // Matches starting in the overlap are found by the next window
+    if (offset + length < state->tb.size) {
+      if (regex) {
+        // Regular expressions see whole lines, unless a line is longer
+        // than the window
+        int last = length;
+        while (last > 0 && window[last - 1] != '\n')
+          last--;
+        if (last > 0)
+          length = end = last;
+        else
+          end = length - SEARCH_REGEX_OVERLAP;
+      } else {
+        end = length - (search->length - 1);
+      }
+    }
 
-    if (r == NULL) {
-      state->search_running = 0;
-      continue;
+    int pos = 0;
+    if (line_found) {
+      char *newline = memchr(window, '\n', end);
+      if (newline) {
+        pos = newline - window + 1;
+        line_found = 0;
+      } else {
+        pos = end;
+      }
     }
 
-    int index = r - state->buffer;
+    while (state->search_running && n_search_results < MAX_SEARCH_RESULTS) {
+      int match_length = 0;
+      int match = textSearchFind(search, window + pos, length - pos, &match_length);
+      if (match < 0 || pos + match >= end)
+        break;
+
+      search_result_offsets[n_search_results] = offset + pos + match;
+      __atomic_store_n(&state->n_search_results, ++n_search_results, __ATOMIC_RELEASE);
 
-    search_result_offsets[state->n_search_results++] = index;
-    offset = index + 1;
+      if (regex) {
+        // One result per line, the next search starts at a line start
+        char *newline = memchr(window + pos + match, '\n', length - pos - match);
+        if (!newline) {
+          line_found = 1;
+          break;
+        }
+        pos = newline - window + 1;
+      } else {
+        pos += match + 1;
+      }
+    }
 
-    sceKernelDelayThread(1000);
+    offset += end;
+
+    sceKernelDelayThread(100);
   }
 
+  free(window);
+
   state->search_running = 0;
 
   return sceKernelExitDeleteThread(0);
 }
 
+// Index of the first search result at or after offset
+static int find_search_result(TextEditorState *state, int offset) {
+  int low = 0, high = state->n_search_results;
+  while (low < high) {
+    int mid = (low + high) / 2;
+    if (state->search_result_offsets[mid] < offset)
+      low = mid + 1;
+    else
+      high = mid;
+  }
+
+  return low;
+}
+
+typedef struct TextPagerState {
+  TextBuffer tb;
+  const char *file;
+  SceOff file_offset;
+  SceOff size;
+  int running;
+  int goto_input;
+  int hex_viewer;
+  int index_thid;
+  int index_running;
+  int n_checkpoints;
+  int n_indexed_lines;
+  SceOff *checkpoints[TEXT_MAX_CHECKPOINT_PAGES];
+  int block;
+  int block_lines;
+  SceOff block_offsets[TEXT_CHECKPOINT_STEP + 1];
+  SceOff top_offset;
+  int top_line;
+  SceOff view_offsets[MAX_ENTRIES + 1];
+  char view_lines[MAX_ENTRIES][MAX_LINE_CHARACTERS];
+} TextPagerState;
+
+typedef struct IndexParams {
+  TextPagerState *state;
+} IndexParams;
+
+// Record where every TEXT_CHECKPOINT_STEP-th line starts. It has its own
+// pages, so it can read far ahead of the viewer without a lock.
+static int text_index_thread(SceSize args, IndexParams *params) {
+  TextPagerState *state = params->state;
+
+  TextBuffer tb;
+  if (textBufferOpenFile(&tb, state->file, state->file_offset, state->size, TEXT_INDEX_PAGES, TEXT_INDEX_PAGE_SIZE) < 0) {
+    state->index_running = 0;
+    return sceKernelExitDeleteThread(0);
+  }
+
+  SceOff offset = 0;
+  int n_lines = 0;
+
+  while (state->index_running && offset < state->size) {
+    if ((n_lines % TEXT_CHECKPOINT_STEP) == 0) {
+      int checkpoint = n_lines / TEXT_CHECKPOINT_STEP;
+      int page = checkpoint / TEXT_CHECKPOINTS_PER_PAGE;
+      if (page >= TEXT_MAX_CHECKPOINT_PAGES)
+        break;
+
+      if (!state->checkpoints[page]) {
+        state->checkpoints[page] = malloc(TEXT_CHECKPOINTS_PER_PAGE * sizeof(SceOff));
+        if (!state->checkpoints[page])
+          break;
+      }
+
+      // The entry must be visible before the count that covers it
+      state->checkpoints[page][checkpoint % TEXT_CHECKPOINTS_PER_PAGE] = offset;
+      __atomic_store_n(&state->n_checkpoints, checkpoint + 1, __ATOMIC_RELEASE);
+      __atomic_store_n(&state->n_indexed_lines, n_lines, __ATOMIC_RELEASE);
+    }
+
+    offset += textReadLine(&tb, offset, NULL);
+    n_lines++;
+
+    // Let the viewer read its pages in between
+    if ((n_lines % TEXT_INDEX_YIELD_LINES) == 0)
+      sceKernelDelayThread(100);
+  }
+
+  if (offset >= state->size)
+    __atomic_store_n(&state->n_indexed_lines, n_lines, __ATOMIC_RELEASE);
+
+  textBufferFree(&tb);
+
+  state->index_running = 0;
+
+  return sceKernelExitDeleteThread(0);
+}
+
+static SceOff get_checkpoint(TextPagerState *state, int checkpoint) {
+  if (checkpoint == 0)
+    return 0;
+
+  return state->checkpoints[checkpoint / TEXT_CHECKPOINTS_PER_PAGE][checkpoint % TEXT_CHECKPOINTS_PER_PAGE];
+}
+
+// Read the lines between two checkpoints
+static int decode_block(TextPagerState *state, int block) {
+  if (block == state->block)
+    return 1;
+
+  int n_checkpoints = __atomic_load_n(&state->n_checkpoints, __ATOMIC_ACQUIRE);
+  if (block < 0 || block >= MAX(n_checkpoints, 1))
+    return 0;
+
+  SceOff offset = get_checkpoint(state, block);
+
+  int i;
+  for (i = 0; i < TEXT_CHECKPOINT_STEP && offset < state->size; i++) {
+    state->block_offsets[i] = offset;
+    offset += textReadLine(&state->tb, offset, NULL);
+  }
+
+  state->block_offsets[i] = offset;
+  state->block_lines = i;
+  state->block = block;
+
+  return 1;
+}
+
+static SceOff pager_line_offset(TextPagerState *state, int line) {
+  if (!decode_block(state, line / TEXT_CHECKPOINT_STEP))
+    return -1;
+
+  if ((line % TEXT_CHECKPOINT_STEP) >= state->block_lines)
+    return -1;
+
+  return state->block_offsets[line % TEXT_CHECKPOINT_STEP];
+}
+
+// Line starting at offset, or -1 if the index has not got there yet
+static int pager_find_line(TextPagerState *state, SceOff offset) {
+  int n_checkpoints = __atomic_load_n(&state->n_checkpoints, __ATOMIC_ACQUIRE);
+  int low = 0, high = MAX(n_checkpoints, 1) - 1;
+  while (low < high) {
+    int mid = (low + high + 1) / 2;
+    if (get_checkpoint(state, mid) <= offset)
+      low = mid;
+    else
+      high = mid - 1;
+  }
+
+  if (!decode_block(state, low) || offset >= state->block_offsets[state->block_lines])
+    return -1;
+
+  int i;
+  for (i = 0; i < state->block_lines; i++) {
+    if (state->block_offsets[i] == offset)
+      return low * TEXT_CHECKPOINT_STEP + i;
+  }
+
+  return -1;
+}
+
+static void pager_update_view(TextPagerState *state) {
+  SceOff offset = state->top_offset;
+
+  int i;
+  for (i = 0; i < MAX_ENTRIES; i++) {
+    state->view_offsets[i] = offset;
+    offset += textReadLine(&state->tb, offset, state->view_lines[i]);
+  }
+
+  state->view_offsets[MAX_ENTRIES] = offset;
+}
+
+static void pager_line_down(TextPagerState *state) {
+  if (state->view_offsets[1] >= state->size)
+    return;
+
+  state->top_offset = state->view_offsets[1];
+  if (state->top_line >= 0)
+    state->top_line++;
+
+  pager_update_view(state);
+}
+
+static void pager_line_up(TextPagerState *state) {
+  if (state->top_offset == 0)
+    return;
+
+  if (state->top_line < 0)
+    state->top_line = pager_find_line(state, state->top_offset);
+
+  if (state->top_line > 0) {
+    state->top_line--;
+    state->top_offset = pager_line_offset(state, state->top_line);
+  } else {
+    // Not indexed yet, read again from the start of the paragraph
+    SceOff start = state->top_offset - 1;
+    SceOff limit = MAX(state->top_offset - TEXT_PAGER_MAX_BACKTRACK, 0);
+    while (start > limit && textBufferGetChar(&state->tb, start - 1) != '\n')
+      start--;
+
+    if (start == limit && limit > 0)
+      start = MAX(state->top_offset - (MAX_LINE_CHARACTERS - 1), 0);
+
+    SceOff offset = start;
+    while (offset < state->top_offset) {
+      start = offset;
+      offset += textReadLine(&state->tb, offset, NULL);
+    }
+
+    state->top_offset = start;
+  }
+
+  pager_update_view(state);
+}
+
+static void pager_goto(TextPagerState *state, const char *input) {
+  char *end = NULL;
+  long long value = strtoll(input, &end, 10);
+  if (end == input || value < 0)
+    return;
+
+  if (*end == '%') {
+    // Start at the first line from there
+    SceOff offset = MIN(value, 100) * (state->size - 1) / 100;
+
+    if (offset > 0) {
+      int length;
+      const char *chunk;
+      while ((chunk = textBufferChunk(&state->tb, offset - 1, &length)) != NULL) {
+        const char *newline = memchr(chunk, '\n', length);
+        if (newline) {
+          offset += newline - chunk;
+          break;
+        }
+
+        offset += length;
+      }
+    }
+
+    if (offset >= state->size) {
+      state->top_offset = state->size;
+      state->top_line = -1;
+      pager_line_up(state);
+      return;
+    }
+
+    state->top_offset = offset;
+    state->top_line = pager_find_line(state, offset);
+  } else {
+    // Go as far as the index reaches
+    int line = (int)MIN(value, 0x7FFFFFFF);
+    SceOff offset = pager_line_offset(state, line);
+
+    if (offset < 0) {
+      line = MAX(__atomic_load_n(&state->n_indexed_lines, __ATOMIC_ACQUIRE) - 1, 0);
+      offset = pager_line_offset(state, line);
+    }
+
+    if (offset < 0)
+      return;
+
+    state->top_offset = offset;
+    state->top_line = line;
+  }
+
+  pager_update_view(state);
+}
+
+static int pagerContextMenuEnterCallback(int sel, void *context) {
+  TextPagerState *state = (TextPagerState *)context;
+
+  switch (sel) {
+    case TEXT_PAGER_MENU_ENTRY_GO_TO_LINE:
+      initImeDialog(language_container[ENTER_LINE_OR_PERCENTAGE], "", 16, SCE_IME_TYPE_DEFAULT, 0, 0);
+      state->goto_input = 1;
+      break;
+
+    case TEXT_PAGER_MENU_ENTRY_HEX_EDITOR:
+      state->hex_viewer = 1;
+      state->running = 0;
+      break;
+  }
+
+  return CONTEXT_MENU_CLOSING;
+}
+
+static int textPagerViewer(const char *file, SceOff size, SceOff offset) {
+  TextPagerState *s = malloc(sizeof(TextPagerState));
+  if (!s)
+    return VITASHELL_ERROR_NO_MEMORY;
+
+  memset(s, 0, sizeof(TextPagerState));
+  s->file = file;
+  s->block = -1;
+  s->index_thid = -1;
+
+  char utf8_bom[3] = {0xEF, 0xBB, 0xBF};
+  char bom[3];
+  if (ReadFile(file, bom, sizeof(bom)) == sizeof(bom) && memcmp(bom, utf8_bom, sizeof(utf8_bom)) == 0)
+    s->file_offset = sizeof(utf8_bom);
+
+  s->size = size - s->file_offset;
+
+  int res = textBufferOpenFile(&s->tb, file, s->file_offset, s->size, TEXT_PAGER_PAGES, TEXT_PAGER_PAGE_SIZE);
+  if (res < 0) {
+    free(s);
+    return res;
+  }
+
+  // Init context menu param
+  context_menu_text_pager.context = s;
+
+  IndexParams index_params;
+  index_params.state = s;
+
+  s->index_running = 1;
+  s->index_thid = sceKernelCreateThread("text_index_thread", (SceKernelThreadEntry)text_index_thread, 0x10000100, 0x10000, 0, 0x70000, NULL);
+  if (s->index_thid >= 0)
+    sceKernelStartThread(s->index_thid, sizeof(IndexParams), &index_params);
+  else
+    s->index_running = 0;
+
+  s->running = 1;
+  s->top_offset = 0;
+  s->top_line = 0;
+
+  // Start at the line beginning at offset
+  offset -= s->file_offset;
+  if (offset > 0 && offset < s->size) {
+    s->top_offset = offset;
+    s->top_line = -1;
+  }
+
+  pager_update_view(s);
+
+  while (s->running) {
+    readPad();
+
+    if (!isImeDialogRunning()) {
+      if (getContextMenuMode() != CONTEXT_MENU_CLOSED) {
+        contextMenuCtrl();
+      } else {
+        // Context menu trigger
+        if (pressed_pad[PAD_TRIANGLE]) {
+          setContextMenu(&context_menu_text_pager);
+          context_menu_text_pager.sel = 0;
+          setContextMenuMode(CONTEXT_MENU_OPENING);
+        }
+
+        if (hold_pad[PAD_UP] || hold2_pad[PAD_LEFT_ANALOG_UP]) {
+          pager_line_up(s);
+        } else if (hold_pad[PAD_DOWN] || hold2_pad[PAD_LEFT_ANALOG_DOWN]) {
+          pager_line_down(s);
+        }
+
+        // Page skip
+        int i;
+        if (hold_pad[PAD_LTRIGGER]) {
+          for (i = 0; i < MAX_POSITION; i++)
+            pager_line_up(s);
+        } else if (hold_pad[PAD_RTRIGGER]) {
+          for (i = 0; i < MAX_POSITION; i++)
+            pager_line_down(s);
+        }
+
+        // Cancel
+        if (pressed_pad[PAD_CANCEL]) {
+          break;
+        }
+      }
+    } else {
+      int ime_result = updateImeDialog();
+
+      if (s->goto_input) {
+        if (ime_result == IME_DIALOG_RESULT_FINISHED) {
+          pager_goto(s, (char *)getImeDialogInputTextUTF8());
+          s->goto_input = 0;
+        } else if (ime_result == IME_DIALOG_RESULT_CANCELED) {
+          s->goto_input = 0;
+        }
+      }
+    }
+
+    // Line numbers are known once the index has got there
+    if (s->top_line < 0 && __atomic_load_n(&s->n_checkpoints, __ATOMIC_ACQUIRE) > 0)
+      s->top_line = pager_find_line(s, s->top_offset);
+
+    // Start drawing
+    startDrawing(bg_text_image);
+
+    // Draw shell info
+    drawShellInfo(file);
+
+    // Draw scroll bar
+    drawScrollBar((int)(s->top_offset / 1024), (int)(s->size / 1024));
+
+    int i;
+    for (i = 0; i < MAX_ENTRIES; i++) {
+      if (s->view_offsets[i] >= s->size)
+        break;
+
+      if (s->top_line >= 0) {
+        char line_str[12];
+        snprintf(line_str, sizeof(line_str), "%04i", s->top_line + i);
+        pgf_draw_text(SHELL_MARGIN_X, START_Y + (i * FONT_Y_SPACE), TEXT_LINE_NUMBER_COLOR, line_str);
+      }
+
+      float x = TEXT_START_X;
+      char *line = s->view_lines[i];
+
+      while (*line) {
+        char *p = strchr(line, '\t');
+        if (p)
+          *p = '\0';
+
+        int width = pgf_draw_text(x, START_Y + (i * FONT_Y_SPACE), TEXT_COLOR, line);
+        line += strlen(line);
+
+        if (p) {
+          *p = '\t';
+          x += width + TAB_SIZE * font_size_cache[' '];
+          line++;
+        }
+      }
+    }
+
+    // Draw context menu
+    drawContextMenu();
+
+    // End drawing
+    endDrawing();
+  }
+
+  if (s->index_thid >= 0) {
+    s->index_running = 0;
+    sceKernelWaitThreadEnd(s->index_thid, NULL, NULL);
+  }
+
+  int i;
+  for (i = 0; i < TEXT_MAX_CHECKPOINT_PAGES; i++)
+    free(s->checkpoints[i]);
+
+  int hex_viewer = s->hex_viewer;
+
+  textBufferFree(&s->tb);
+  free(s);
+
+  if (hex_viewer)
+    hexViewer(file);
+
+  return 0;
+}
+
 int textViewer(const char *file) {
+  return textViewerAt(file, 0);
+}
+
+// Opens the file at the line starting at the given file offset
+int textViewerAt(const char *file, SceOff offset) {
+  initShortLineLength();
+
+  // Files that do not fit into the buffer are paged in
+  if (!isInArchive()) {
+    SceIoStat stat;
+    if (sceIoGetstat(file, &stat) >= 0 && stat.st_size > BIG_BUFFER_SIZE)
+      return textPagerViewer(file, stat.st_size, offset);
+  }
+
   TextEditorState *s = malloc(sizeof(TextEditorState));
   if (!s) 
     return VITASHELL_ERROR_NO_MEMORY;
 
   char *buffer_base = memalign(4096, BIG_BUFFER_SIZE);
-  if (!buffer_base)
+  if (!buffer_base) {
+    free(s);
+    return VITASHELL_ERROR_NO_MEMORY;
+  }
+
+  // Grows with the number of lines counted
+  s->max_lines = TEXT_INITIAL_LINES;
+  s->offset_list = malloc((s->max_lines + 1) * sizeof(int));
+  if (!s->offset_list) {
+    free(buffer_base);
+    free(s);
     return VITASHELL_ERROR_NO_MEMORY;
+  }
 
   s->running = 1;
   s->hex_viewer = 0; 
@@ -520,39 +1411,49 @@ int textViewer(const char *file) {
   s->modify_allowed = 1;
   s->offset_list[0] = 0;
   s->count_lines_running = 0;
+  s->count_lines_full = 0;
   s->n_lines = 0;
   s->search_running = 0;
+  s->search.flags = 0;
+  s->search.length = 0;
   s->edit_line = -1;
+  s->count_lines_thid = -1;
 
+  int size;
   if (isInArchive()) {
-    s->size = ReadArchiveFile(file, buffer_base, BIG_BUFFER_SIZE);
+    size = ReadArchiveFile(file, buffer_base, BIG_BUFFER_SIZE);
     s->modify_allowed = 0;
   } else {
-    s->size = ReadFile(file, buffer_base, BIG_BUFFER_SIZE);
+    size = ReadFile(file, buffer_base, BIG_BUFFER_SIZE);
   }
 
-  if (s->size < 0) {
+  if (size < 0) {
     free(buffer_base);
-    return s->size;
+    free(s->offset_list);
+    free(s);
+    return size;
   }
 
-  s->buffer = buffer_base;
+  char *buffer = buffer_base;
 
   int has_utf8_bom = 0;
   char utf8_bom[3] = {0xEF, 0xBB, 0xBF};
-  if (s->size >= 3 && memcmp(buffer_base, utf8_bom, 3) == 0) {
-    s->buffer += 3;
+  if (size >= 3 && memcmp(buffer_base, utf8_bom, 3) == 0) {
+    buffer += 3;
     has_utf8_bom = 1;
-    s->size -= 3;
+    size -= 3;
   }
 
-  if (s->size == 0) {
-    s->size = 1;
-    s->buffer[0] = '\n';
+  if (textBufferInit(&s->tb, buffer, size) < 0) {
+    free(buffer_base);
+    free(s->offset_list);
+    free(s);
+    return VITASHELL_ERROR_NO_MEMORY;
   }
 
-  if (s->buffer[s->size - 1] != '\n') {
-    s->buffer[s->size++] = '\n';
+  // Always end with a newline
+  if (size == 0 || buffer[size - 1] != '\n') {
+    textBufferAppend(&s->tb, "\n", 1);
   }
 
   s->base_pos = 0;
@@ -569,18 +1470,13 @@ int textViewer(const char *file) {
     entry->line_number = i;
     entry->selected = 0;
 
-    int length = textReadLine(s->buffer, s->offset_list[i], s->size, entry->line);
+    int length = textReadLine(&s->tb, s->offset_list[i], entry->line);
     s->offset_list[i + 1] = s->offset_list[i] + length;
     
     textListAddEntry(&s->list, entry);
   }
 
-  CountParams count_params;
-  count_params.state = s;
-
-  s->count_lines_thid = sceKernelCreateThread("count_lines_thread", (SceKernelThreadEntry)count_lines_thread, 0x10000100, 0x10000, 0, 0x70000, NULL);
-  if (s->count_lines_thid >= 0)
-    sceKernelStartThread(s->count_lines_thid, sizeof(CountParams), &count_params);
+  start_count_lines(s);
 
   s->edit_line = -1;
   s->changed = 0;
@@ -589,7 +1485,17 @@ int textViewer(const char *file) {
   s->search_thid = 0;
   s->n_search_results = 0;
 
+  s->goto_offset = offset - (has_utf8_bom ? 3 : 0);
+
   while (s->running) {
+    // The counter ran out of room for offsets
+    if (s->count_lines_full) {
+      stop_count_lines(s);
+      s->count_lines_full = 0;
+      if (reserve_lines(s, s->max_lines * 2) >= 0)
+        start_count_lines(s);
+    }
+
     readPad();
 
     if (!isImeDialogRunning() && !isMessageDialogRunning()) {
@@ -631,7 +1537,7 @@ int textViewer(const char *file) {
               s->list.head->line_number = s->base_pos;
 
               // Read
-              textReadLine(s->buffer, s->offset_list[s->base_pos], s->size, s->list.head->line);
+              textReadLine(&s->tb, s->offset_list[s->base_pos], s->list.head->line);
 
               // Update the entry
               updateTextEntry(s, s->list.head, 0);
@@ -639,12 +1545,13 @@ int textViewer(const char *file) {
           }
           s->copy_reset = 1;
         } else if (hold_pad[PAD_DOWN] || hold2_pad[PAD_LEFT_ANALOG_DOWN]) {
-          if (s->offset_list[s->rel_pos + 1] < s->size) {
+          if (s->offset_list[s->rel_pos + 1] < s->tb.size) {
             if ((s->rel_pos + 1) < MAX_POSITION) {
               if (s->base_pos + s->rel_pos < s->n_lines - 1) 
                 s->rel_pos++;
             } else {
-              if (s->offset_list[s->base_pos + s->rel_pos + 1] < s->size) {
+              if (s->offset_list[s->base_pos + s->rel_pos + 1] < s->tb.size &&
+                  ensure_lines(s, s->base_pos + MAX_ENTRIES + 1) >= 0) {
                 s->base_pos++;
 
                 // Head to tail
@@ -663,8 +1570,8 @@ int textViewer(const char *file) {
                 s->list.tail->line_number = s->base_pos + MAX_ENTRIES - 1;
 
                 // Read
-                int length = textReadLine(s->buffer, s->offset_list[s->base_pos + MAX_ENTRIES - 1], s->size, s->list.tail->line);
-                s->offset_list[s->base_pos + MAX_ENTRIES] = s->offset_list[s->base_pos + MAX_ENTRIES - 1] + length;
+                int length = textReadLine(&s->tb, s->offset_list[s->base_pos + MAX_ENTRIES - 1], s->list.tail->line);
+                set_line_offset(s, s->base_pos + MAX_ENTRIES, s->offset_list[s->base_pos + MAX_ENTRIES - 1] + length);
 
                 // Update the entry
                 updateTextEntry(s, s->list.tail, MAX_ENTRIES - 1);
@@ -685,51 +1592,26 @@ int textViewer(const char *file) {
           int entry_start_offset = s->offset_list[entry->line_number];
           int entry_end_offset = s->offset_list[entry->line_number + 1]; 
 
-          int target_offset = 0;
+          int target_offset = -1;
 
           // Skip to next search result
           if (pressed_pad[PAD_RTRIGGER]) {
-            for (i = 0; i < s->n_search_results; i++) {
-              if (s->search_result_offsets[i] > entry_end_offset) {
-                target_offset = s->search_result_offsets[i] - entry_start_offset;
-                break;
-              }
-            }
+            i = find_search_result(s, entry_end_offset + 1);
+            if (i < s->n_search_results)
+              target_offset = s->search_result_offsets[i];
           } // Skip to next last result
           else if (pressed_pad[PAD_LTRIGGER]) {
-            for (i = s->n_search_results - 1; i >= 0; i--) {
-              if (s->search_result_offsets[i] < entry_start_offset) {
-                target_offset = s->search_result_offsets[i] - entry_start_offset;
-                break;
-              }
-            }
+            i = find_search_result(s, entry_start_offset) - 1;
+            if (i >= 0)
+              target_offset = s->search_result_offsets[i];
           }
 
-          if (target_offset != 0) {
-            int dir = target_offset > 0 ? 1 : -1;
-            int line = s->base_pos + s->rel_pos;
-            int offset = s->offset_list[line];
-
-            while (offset < s->size && offset >= 0 && target_offset != 0) {
-              offset += dir;
-              target_offset -= dir;
-
-              if (s->buffer[offset] == '\n') {
-                line += dir;
-                if (dir > 0) {
-                  s->offset_list[line] = offset + 1;
-                } else {
-                  s->offset_list[line + 1] = offset + 1;
-                }
-              }
-            }
-
-            if (target_offset == 0) {
-              s->base_pos = line;
-              s->rel_pos = 0;
+          // Only jump to lines that have been counted
+          if (target_offset >= 0 && target_offset < s->offset_list[s->n_lines]) {
+            s->base_pos = find_line(s, target_offset);
+            s->rel_pos = 0;
 
-              updateTextEntries(s);
-            }
+            updateTextEntries(s);
           }
         } else {
           // Page skip
@@ -759,7 +1641,7 @@ int textViewer(const char *file) {
             int line_start = s->offset_list[s->base_pos + s->rel_pos];
             
             char line[MAX_LINE_CHARACTERS];
-            textReadLine(s->buffer, line_start, s->size, line);
+            textReadLine(&s->tb, line_start, line);
 
             initImeDialog(language_container[EDIT_LINE], line, MAX_LINE_CHARACTERS, SCE_IME_TYPE_DEFAULT, SCE_IME_OPTION_MULTILINE, 0);
 
@@ -824,12 +1706,26 @@ int textViewer(const char *file) {
       int msg_result = updateMessageDialog();
       if (msg_result == MESSAGE_DIALOG_RESULT_YES) {
         SceUID fd = sceIoOpen(file, SCE_O_WRONLY | SCE_O_TRUNC, 0777);
+        int res = fd;
         if (fd >= 0) {
-          sceIoWrite(fd, buffer_base, has_utf8_bom ? s->size + sizeof(utf8_bom) : s->size);
+          res = 0;
+          if (has_utf8_bom) {
+            int written = sceIoWrite(fd, utf8_bom, sizeof(utf8_bom));
+            if (written != sizeof(utf8_bom))
+              res = written < 0 ? written : VITASHELL_ERROR_SHORT_WRITE;
+          }
+
+          if (res >= 0)
+            res = textBufferSave(&s->tb, fd);
           sceIoClose(fd);
         }
 
-        break;
+        // Stay in the editor with the changes when they could not be written
+        if (res < 0) {
+          errorDialog(res);
+        } else {
+          break;
+        }
       } else if (msg_result == MESSAGE_DIALOG_RESULT_NO) {
         break;
       }
@@ -852,13 +1748,21 @@ int textViewer(const char *file) {
             
             SearchParams search_params;
             search_params.state = s;
-            strcpy(search_params.search_term, search_term);
 
             strcpy(s->search_term, search_term);
 
-            s->search_thid = sceKernelCreateThread("search_thread", (SceKernelThreadEntry)search_thread, 0x10000100, 0x10000, 0, 0x70000, NULL);
-            if (s->search_thid >= 0)
-              sceKernelStartThread(s->search_thid, sizeof(SearchParams), &search_params);
+            // Compile once for the whole search
+            textSearchFree(&s->search);
+            s->n_search_results = 0;
+
+            if (textSearchCompile(&s->search, search_term, s->search_flags) >= 0) {
+              s->search_running = 1;
+              s->search_thid = sceKernelCreateThread("search_thread", (SceKernelThreadEntry)search_thread, 0x10000100, 0x10000, 0, 0x70000, NULL);
+              if (s->search_thid >= 0)
+                sceKernelStartThread(s->search_thid, sizeof(SearchParams), &search_params);
+              else
+                s->search_running = 0;
+            }
           }
 
           s->search_term_input = 0;
@@ -872,39 +1776,23 @@ int textViewer(const char *file) {
         if (ime_result == IME_DIALOG_RESULT_FINISHED) {
           int line_start = s->offset_list[s->edit_line];
           
-          char line[MAX_LINE_CHARACTERS];
-          int length = textReadLine(s->buffer, line_start, s->size, line);
+          int length = textReadLine(&s->tb, line_start, NULL);
 
           // Don't count newline 
-          if (s->buffer[line_start + length - 1] == '\n') {
+          if (textBufferGetChar(&s->tb, line_start + length - 1) == '\n') {
             length--;
           }
 
           char *new_line = (char *)getImeDialogInputTextUTF8();
           int new_length = strlen(new_line);
 
-          // Move data if size has changed
-          if (new_length != length) {
-            memmove(&s->buffer[line_start + new_length], &s->buffer[line_start + length], s->size - line_start - length);
-            s->size += (new_length-length);
-          }
-
-          // Copy new line into buffer
-          memcpy(&s->buffer[line_start], new_line, new_length);
-
-          // Add new lines to n_lines
-          int i;
-          for (i = 0; i < new_length; i++) {
-            if (new_line[i] == '\n') {
-              s->n_lines++;
-            }
-          }
+          // Replace the line
+          edit_text(s, line_start, length, new_line, new_length);
           
           // Update entries
           updateTextEntries(s);
 
           s->edit_line = -1;
-          s->changed = 1;
 
         } else if (ime_result == IME_DIALOG_RESULT_CANCELED) {
           s->edit_line = -1;
@@ -912,6 +1800,20 @@ int textViewer(const char *file) {
       }
     }
 
+    // Jump to the requested line once it has been counted
+    if (s->goto_offset > 0) {
+      int n_lines = __atomic_load_n(&s->n_lines, __ATOMIC_ACQUIRE);
+      if (s->goto_offset < s->offset_list[n_lines]) {
+        s->base_pos = find_line(s, s->goto_offset);
+        s->rel_pos = 0;
+        s->goto_offset = 0;
+
+        updateTextEntries(s);
+      } else if (!s->count_lines_running) {
+        s->goto_offset = 0;
+      }
+    }
+
     // Start drawing
     startDrawing(bg_text_image);
 
@@ -935,12 +1837,9 @@ int textViewer(const char *file) {
       int entry_end_offset = entry_start_offset + line_lenght; 
 
       if (s->n_search_results > 0) {
-        int j; 
-        for (j = 0; j < s->n_search_results; j++) {
-          int search_offset = s->search_result_offsets[j];
-          if (entry_start_offset <= search_offset && entry_end_offset >= search_offset) {
-            search_result_on_line = 1;
-          }
+        int j = find_search_result(s, entry_start_offset);
+        if (j < s->n_search_results && s->search_result_offsets[j] <= entry_end_offset) {
+          search_result_on_line = 1;
         }
       }
 
@@ -965,8 +1864,11 @@ int textViewer(const char *file) {
           *p = '\0';
 
         char *search_highlight = NULL;
+        int search_highlight_length = 0;
         if (search_result_on_line) {
-          search_highlight = strcasestr(line, s->search_term);
+          int match = textSearchFind(&s->search, line, strlen(line), &search_highlight_length);
+          if (match >= 0 && search_highlight_length > 0)
+            search_highlight = line + match;
         }
 
         char tmp = '\0';
@@ -988,7 +1890,7 @@ int textViewer(const char *file) {
         if (search_highlight) {
           *search_highlight = tmp;
 
-          int search_term_length = strlen(s->search_term);
+          int search_term_length = search_highlight_length;
           tmp = search_highlight[search_term_length];
           search_highlight[search_term_length] = '\0';
 
@@ -996,7 +1898,7 @@ int textViewer(const char *file) {
           x += pgf_draw_text(x, START_Y + (i * FONT_Y_SPACE), TEXT_HIGHLIGHT_COLOR, line);
           
           search_highlight[search_term_length] = tmp;
-          line += strlen(s->search_term); 
+          line += search_term_length;
         }
       }
 
@@ -1011,18 +1913,21 @@ int textViewer(const char *file) {
     endDrawing();
   }
 
-  s->count_lines_running = 0;
-  sceKernelWaitThreadEnd(s->count_lines_thid, NULL, NULL);
+  stop_count_lines(s);
 
   if (s->search_running) {
     s->search_running = 0;
     sceKernelWaitThreadEnd(s->search_thid, NULL, NULL);
   }
 
+  textSearchFree(&s->search);
+
   textListEmpty(&s->list);
 
   int hex_viewer = s->hex_viewer;
 
+  textBufferFree(&s->tb);
+  free(s->offset_list);
   free(s);
 
   free(buffer_base); 
@@ -19,7 +19,8 @@
 #ifndef __TEXT_H__
 #define __TEXT_H__
 
-#define MAX_LINES 0x10000
+// The line offset table starts this big and doubles when full
+#define TEXT_INITIAL_LINES 0x10000
 #define MAX_LINE_CHARACTERS 1024
 #define MAX_COPY_BUFFER_SIZE 1024
 
@@ -30,6 +31,21 @@
 #define MAX_SEARCH_RESULTS 1024 * 1024
 #define MIN_SEARCH_TERM_LENGTH 1
 
+// Files larger than BIG_BUFFER_SIZE are paged in and shown read-only
+#define TEXT_PAGER_PAGE_SIZE (256 * 1024)
+#define TEXT_PAGER_PAGES 8
+#define TEXT_INDEX_PAGE_SIZE (1 * 1024 * 1024)
+#define TEXT_INDEX_PAGES 2
+#define TEXT_PAGER_MAX_BACKTRACK (64 * 1024)
+
+#define TEXT_COUNT_PUBLISH_LINES 256
+#define TEXT_INDEX_YIELD_LINES 4096
+
+// Only the offset of every TEXT_CHECKPOINT_STEP-th line is kept
+#define TEXT_CHECKPOINT_STEP 1024
+#define TEXT_CHECKPOINTS_PER_PAGE 4096
+#define TEXT_MAX_CHECKPOINT_PAGES 1024
+
 typedef struct TextListEntry {
   struct TextListEntry *next;
   struct TextListEntry *previous;
@@ -51,5 +67,6 @@ typedef struct CopyEntry {
 void initTextContextMenuWidth();
 
 int textViewer(const char *file);
+int textViewerAt(const char *file, SceOff offset);
 
 #endif
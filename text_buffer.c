@@ -0,0 +1,553 @@
+/*
+  VitaShell
+  Copyright (C) 2015-2018, TheFloW
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "main.h"
+#include "text_buffer.h"
+
+#define TEXT_PIECES_STEP 64
+#define TEXT_ADD_BUFFER_STEP (16 * 1024)
+#define TEXT_SAVE_BUFFER_SIZE (64 * 1024)
+
+// Least recently used page is replaced
+static TextPage *getPage(TextBuffer *tb, SceOff offset) {
+  SceOff page_offset = offset - (offset % tb->page_size);
+  TextPage *page = &tb->pages[0];
+
+  int i;
+  for (i = 0; i < tb->n_pages; i++) {
+    if (tb->pages[i].offset == page_offset) {
+      page = &tb->pages[i];
+      page->last_used = ++tb->page_clock;
+      return page;
+    }
+
+    if (tb->pages[i].last_used < page->last_used)
+      page = &tb->pages[i];
+  }
+
+  page->offset = page_offset;
+  page->last_used = ++tb->page_clock;
+  page->length = sceIoPread(tb->fd, page->data, tb->page_size, tb->file_offset + page_offset);
+
+  // Show unreadable parts as blanks rather than failing every reader
+  if (page->length < MIN(tb->page_size, tb->original_size - page_offset)) {
+    page->length = MIN(tb->page_size, tb->original_size - page_offset);
+    memset(page->data, 0, page->length);
+  }
+
+  return page;
+}
+
+static const char *pieceData(TextBuffer *tb, TextPiece *piece, SceOff skip, int *length) {
+  // A paged piece may be longer than any chunk handed out
+  *length = (int)MIN(piece->length - skip, 0x7FFFFFFF);
+
+  if (piece->source == TEXT_PIECE_ADD)
+    return tb->add + piece->start + skip;
+
+  if (tb->fd < 0)
+    return tb->original + piece->start + skip;
+
+  TextPage *page = getPage(tb, piece->start + skip);
+  int page_skip = piece->start + skip - page->offset;
+
+  *length = MIN(*length, page->length - page_skip);
+  return page->data + page_skip;
+}
+
+static void updatePieceOffsets(TextBuffer *tb, int from) {
+  SceOff offset = from > 0 ? tb->piece_offsets[from - 1] + tb->pieces[from - 1].length : 0;
+
+  int i;
+  for (i = from; i < tb->n_pieces; i++) {
+    tb->piece_offsets[i] = offset;
+    offset += tb->pieces[i].length;
+  }
+
+  tb->size = offset;
+  tb->last_piece = 0;
+}
+
+static int reservePieces(TextBuffer *tb, int n_pieces) {
+  if (n_pieces <= tb->max_pieces)
+    return 0;
+
+  int max_pieces = ALIGN(n_pieces, TEXT_PIECES_STEP);
+
+  TextPiece *pieces = realloc(tb->pieces, max_pieces * sizeof(TextPiece));
+  if (!pieces)
+    return VITASHELL_ERROR_NO_MEMORY;
+  tb->pieces = pieces;
+
+  SceOff *piece_offsets = realloc(tb->piece_offsets, max_pieces * sizeof(SceOff));
+  if (!piece_offsets)
+    return VITASHELL_ERROR_NO_MEMORY;
+  tb->piece_offsets = piece_offsets;
+
+  tb->max_pieces = max_pieces;
+  return 0;
+}
+
+// Index of the piece containing offset, sequential access hits the cache
+static int findPiece(TextBuffer *tb, SceOff offset) {
+  int i = tb->last_piece;
+  if (i < tb->n_pieces && offset >= tb->piece_offsets[i]) {
+    if (offset < tb->piece_offsets[i] + tb->pieces[i].length)
+      return i;
+    if (i + 1 < tb->n_pieces && offset < tb->piece_offsets[i + 1] + tb->pieces[i + 1].length)
+      return (tb->last_piece = i + 1);
+  }
+
+  int low = 0, high = tb->n_pieces - 1;
+  while (low < high) {
+    int mid = (low + high + 1) / 2;
+    if (tb->piece_offsets[mid] <= offset)
+      low = mid;
+    else
+      high = mid - 1;
+  }
+
+  tb->last_piece = low;
+  return low;
+}
+
+// Make sure a piece starts at offset and return its index
+static int splitPieces(TextBuffer *tb, SceOff offset) {
+  if (offset >= tb->size)
+    return tb->n_pieces;
+
+  int i = findPiece(tb, offset);
+  SceOff split = offset - tb->piece_offsets[i];
+  if (split == 0)
+    return i;
+
+  if (reservePieces(tb, tb->n_pieces + 1) < 0)
+    return VITASHELL_ERROR_NO_MEMORY;
+
+  memmove(&tb->pieces[i + 2], &tb->pieces[i + 1], (tb->n_pieces - i - 1) * sizeof(TextPiece));
+  memmove(&tb->piece_offsets[i + 2], &tb->piece_offsets[i + 1], (tb->n_pieces - i - 1) * sizeof(SceOff));
+  tb->n_pieces++;
+
+  tb->pieces[i + 1].source = tb->pieces[i].source;
+  tb->pieces[i + 1].start = tb->pieces[i].start + split;
+  tb->pieces[i + 1].length = tb->pieces[i].length - split;
+  tb->pieces[i].length = split;
+  tb->piece_offsets[i + 1] = offset;
+
+  return i + 1;
+}
+
+static int appendAddBuffer(TextBuffer *tb, const char *data, int length) {
+  if (tb->add_size + length > tb->add_capacity) {
+    int add_capacity = ALIGN(tb->add_size + length, TEXT_ADD_BUFFER_STEP);
+    if (add_capacity < tb->add_capacity * 2)
+      add_capacity = tb->add_capacity * 2;
+
+    char *add = realloc(tb->add, add_capacity);
+    if (!add)
+      return VITASHELL_ERROR_NO_MEMORY;
+
+    tb->add = add;
+    tb->add_capacity = add_capacity;
+  }
+
+  int start = tb->add_size;
+  memcpy(tb->add + start, data, length);
+  tb->add_size += length;
+
+  return start;
+}
+
+static int replacePieces(TextBuffer *tb, int offset, int length, const char *data, int new_length) {
+  if (offset < 0 || length < 0 || offset + length > tb->size)
+    return -1;
+
+  int start = 0;
+  if (new_length > 0) {
+    start = appendAddBuffer(tb, data, new_length);
+    if (start < 0)
+      return start;
+  }
+
+  int first = splitPieces(tb, offset);
+  if (first < 0)
+    return first;
+
+  int last = splitPieces(tb, offset + length);
+  if (last < 0)
+    return last;
+
+  // Typing at the end of the last insertion just grows that piece
+  if (length == 0 && new_length > 0 && first > 0) {
+    TextPiece *prev = &tb->pieces[first - 1];
+    if (prev->source == TEXT_PIECE_ADD && prev->start + prev->length == start) {
+      prev->length += new_length;
+      updatePieceOffsets(tb, first - 1);
+      return 0;
+    }
+  }
+
+  int n_new = new_length > 0 ? 1 : 0;
+  int n_pieces = tb->n_pieces - (last - first) + n_new;
+
+  if (reservePieces(tb, n_pieces) < 0)
+    return VITASHELL_ERROR_NO_MEMORY;
+
+  memmove(&tb->pieces[first + n_new], &tb->pieces[last], (tb->n_pieces - last) * sizeof(TextPiece));
+  tb->n_pieces = n_pieces;
+
+  if (n_new) {
+    tb->pieces[first].source = TEXT_PIECE_ADD;
+    tb->pieces[first].start = start;
+    tb->pieces[first].length = new_length;
+  }
+
+  updatePieceOffsets(tb, first);
+  return 0;
+}
+
+static int saveVersion(TextBuffer *tb, TextVersion *version) {
+  version->pieces = malloc(MAX(tb->n_pieces, 1) * sizeof(TextPiece));
+  if (!version->pieces)
+    return VITASHELL_ERROR_NO_MEMORY;
+
+  memcpy(version->pieces, tb->pieces, tb->n_pieces * sizeof(TextPiece));
+  version->n_pieces = tb->n_pieces;
+  return 0;
+}
+
+static int restoreVersion(TextBuffer *tb, TextVersion *version) {
+  if (reservePieces(tb, version->n_pieces) < 0)
+    return VITASHELL_ERROR_NO_MEMORY;
+
+  memcpy(tb->pieces, version->pieces, version->n_pieces * sizeof(TextPiece));
+  tb->n_pieces = version->n_pieces;
+  updatePieceOffsets(tb, 0);
+
+  free(version->pieces);
+  version->pieces = NULL;
+  return 0;
+}
+
+static void clearVersions(TextVersion *versions, int *n_versions) {
+  int i;
+  for (i = 0; i < *n_versions; i++)
+    free(versions[i].pieces);
+  *n_versions = 0;
+}
+
+static void addVersion(TextVersion *versions, int *n_versions, const TextVersion *version) {
+  // Forget the oldest version when full
+  if (*n_versions == TEXT_BUFFER_MAX_UNDO) {
+    free(versions[0].pieces);
+    memmove(&versions[0], &versions[1], (TEXT_BUFFER_MAX_UNDO - 1) * sizeof(TextVersion));
+    (*n_versions)--;
+  }
+
+  versions[(*n_versions)++] = *version;
+}
+
+static int pushVersion(TextBuffer *tb, TextVersion *versions, int *n_versions, TextEdit *edit) {
+  TextVersion version;
+  if (saveVersion(tb, &version) < 0)
+    return VITASHELL_ERROR_NO_MEMORY;
+
+  version.edit = *edit;
+  addVersion(versions, n_versions, &version);
+  return 0;
+}
+
+// Grow the changed region of a group by one more edit
+static void mergeEdit(TextEdit *group, int offset, int removed, int inserted) {
+  if (group->offset < 0) {
+    group->offset = offset;
+    group->removed = removed;
+    group->inserted = inserted;
+    return;
+  }
+
+  int old_end = group->offset + group->removed;
+  int cur_end = group->offset + group->inserted;
+  int end = MAX(cur_end, offset + removed);
+
+  group->offset = MIN(group->offset, offset);
+  group->removed = end - (cur_end - old_end) - group->offset;
+  group->inserted = end + (inserted - removed) - group->offset;
+}
+
+int textBufferInit(TextBuffer *tb, char *original, SceOff size) {
+  memset(tb, 0, sizeof(TextBuffer));
+
+  tb->original = original;
+  tb->original_size = size;
+  tb->fd = -1;
+
+  if (reservePieces(tb, 1) < 0)
+    return VITASHELL_ERROR_NO_MEMORY;
+
+  if (size > 0) {
+    tb->pieces[0].source = TEXT_PIECE_ORIGINAL;
+    tb->pieces[0].start = 0;
+    tb->pieces[0].length = size;
+    tb->n_pieces = 1;
+  }
+
+  updatePieceOffsets(tb, 0);
+  return 0;
+}
+
+// Read the text starting at offset of file on demand, with n_pages pages kept
+int textBufferOpenFile(TextBuffer *tb, const char *file, SceOff offset, SceOff size, int n_pages, int page_size) {
+  int res = textBufferInit(tb, NULL, size);
+  if (res < 0)
+    return res;
+
+  tb->file_offset = offset;
+  tb->page_size = page_size;
+
+  int i;
+  for (i = 0; i < MIN(n_pages, TEXT_BUFFER_MAX_PAGES); i++) {
+    tb->pages[i].data = memalign(4096, page_size);
+    if (!tb->pages[i].data) {
+      textBufferFree(tb);
+      return VITASHELL_ERROR_NO_MEMORY;
+    }
+
+    tb->pages[i].offset = -1;
+    tb->n_pages++;
+  }
+
+  tb->fd = sceIoOpen(file, SCE_O_RDONLY, 0);
+  if (tb->fd < 0) {
+    res = tb->fd;
+    textBufferFree(tb);
+    return res;
+  }
+
+  return 0;
+}
+
+void textBufferFree(TextBuffer *tb) {
+  clearVersions(tb->undo, &tb->n_undo);
+  clearVersions(tb->redo, &tb->n_redo);
+
+  if (tb->fd >= 0) {
+    sceIoClose(tb->fd);
+    tb->fd = -1;
+  }
+
+  int i;
+  for (i = 0; i < tb->n_pages; i++)
+    free(tb->pages[i].data);
+  tb->n_pages = 0;
+
+  free(tb->pieces);
+  free(tb->piece_offsets);
+  free(tb->add);
+
+  tb->pieces = NULL;
+  tb->piece_offsets = NULL;
+  tb->add = NULL;
+}
+
+const char *textBufferChunk(TextBuffer *tb, SceOff offset, int *length) {
+  if (offset < 0 || offset >= tb->size) {
+    *length = 0;
+    return NULL;
+  }
+
+  int i = findPiece(tb, offset);
+  return pieceData(tb, &tb->pieces[i], offset - tb->piece_offsets[i], length);
+}
+
+int textBufferRead(TextBuffer *tb, SceOff offset, char *dst, int length) {
+  int read = 0;
+
+  while (read < length) {
+    int chunk_length;
+    const char *chunk = textBufferChunk(tb, offset + read, &chunk_length);
+    if (!chunk)
+      break;
+
+    chunk_length = MIN(chunk_length, length - read);
+    memcpy(dst + read, chunk, chunk_length);
+    read += chunk_length;
+  }
+
+  return read;
+}
+
+int textBufferGetChar(TextBuffer *tb, SceOff offset) {
+  int length;
+  const char *chunk = textBufferChunk(tb, offset, &length);
+  return chunk ? (unsigned char)chunk[0] : -1;
+}
+
+// Append without an undo step, e.g. the terminating newline
+int textBufferAppend(TextBuffer *tb, const char *data, int length) {
+  return replacePieces(tb, tb->size, 0, data, length);
+}
+
+int textBufferReplace(TextBuffer *tb, int offset, int length, const char *data, int new_length) {
+  if (offset < 0 || length < 0 || offset + length > tb->size)
+    return -1;
+
+  if (length == 0 && new_length == 0)
+    return 0;
+
+  // The version before the edit is only recorded once the edit is done
+  TextVersion version;
+  int group = (tb->group_level > 0 && tb->n_undo > 0);
+  if (!group && saveVersion(tb, &version) < 0)
+    return VITASHELL_ERROR_NO_MEMORY;
+
+  int res = replacePieces(tb, offset, length, data, new_length);
+  if (res < 0) {
+    if (!group)
+      free(version.pieces);
+    return res;
+  }
+
+  if (group) {
+    mergeEdit(&tb->undo[tb->n_undo - 1].edit, offset, length, new_length);
+  } else {
+    version.edit.offset = offset;
+    version.edit.removed = length;
+    version.edit.inserted = new_length;
+    addVersion(tb->undo, &tb->n_undo, &version);
+  }
+
+  clearVersions(tb->redo, &tb->n_redo);
+
+  return 0;
+}
+
+int textBufferInsert(TextBuffer *tb, int offset, const char *data, int length) {
+  return textBufferReplace(tb, offset, 0, data, length);
+}
+
+int textBufferDelete(TextBuffer *tb, int offset, int length) {
+  return textBufferReplace(tb, offset, length, NULL, 0);
+}
+
+// Edits between begin and end are undone as one step
+void textBufferBeginGroup(TextBuffer *tb) {
+  if (tb->group_level++ > 0)
+    return;
+
+  TextEdit edit = { -1, 0, 0 };
+  if (pushVersion(tb, tb->undo, &tb->n_undo, &edit) < 0)
+    tb->group_level = 0;
+}
+
+void textBufferEndGroup(TextBuffer *tb) {
+  if (tb->group_level == 0 || --tb->group_level > 0)
+    return;
+
+  // Nothing changed
+  if (tb->n_undo > 0 && tb->undo[tb->n_undo - 1].edit.offset < 0) {
+    free(tb->undo[tb->n_undo - 1].pieces);
+    tb->n_undo--;
+  }
+}
+
+// Returns 1 and the changed region if there was something to undo
+int textBufferUndo(TextBuffer *tb, TextEdit *edit) {
+  if (tb->n_undo == 0 || tb->group_level > 0)
+    return 0;
+
+  TextVersion *version = &tb->undo[tb->n_undo - 1];
+  if (pushVersion(tb, tb->redo, &tb->n_redo, &version->edit) < 0)
+    return 0;
+
+  if (restoreVersion(tb, version) < 0)
+    return 0;
+
+  edit->offset = version->edit.offset;
+  edit->removed = version->edit.inserted;
+  edit->inserted = version->edit.removed;
+
+  tb->n_undo--;
+  return 1;
+}
+
+int textBufferRedo(TextBuffer *tb, TextEdit *edit) {
+  if (tb->n_redo == 0 || tb->group_level > 0)
+    return 0;
+
+  TextVersion *version = &tb->redo[tb->n_redo - 1];
+  if (pushVersion(tb, tb->undo, &tb->n_undo, &version->edit) < 0)
+    return 0;
+
+  if (restoreVersion(tb, version) < 0)
+    return 0;
+
+  *edit = version->edit;
+
+  tb->n_redo--;
+  return 1;
+}
+
+// Writing less than asked, e.g. on a full memory card, fails the save
+static int writeAll(SceUID fd, const void *data, int size) {
+  int res = sceIoWrite(fd, data, size);
+  if (res >= 0 && res != size)
+    return VITASHELL_ERROR_SHORT_WRITE;
+  return res;
+}
+
+// Stream the pieces to fd, small pieces are gathered to save syscalls
+int textBufferSave(TextBuffer *tb, SceUID fd) {
+  char *buf = malloc(TEXT_SAVE_BUFFER_SIZE);
+  int buf_size = 0;
+  int res = 0;
+
+  SceOff offset = 0;
+  while (offset < tb->size && res >= 0) {
+    int length;
+    const char *data = textBufferChunk(tb, offset, &length);
+    offset += length;
+
+    if (buf && length < TEXT_SAVE_BUFFER_SIZE / 4) {
+      if (buf_size + length > TEXT_SAVE_BUFFER_SIZE) {
+        res = writeAll(fd, buf, buf_size);
+        buf_size = 0;
+      }
+
+      memcpy(buf + buf_size, data, length);
+      buf_size += length;
+      continue;
+    }
+
+    if (buf_size > 0) {
+      res = writeAll(fd, buf, buf_size);
+      buf_size = 0;
+      if (res < 0)
+        break;
+    }
+
+    res = writeAll(fd, data, length);
+  }
+
+  if (res >= 0 && buf_size > 0)
+    res = writeAll(fd, buf, buf_size);
+
+  free(buf);
+
+  return res < 0 ? res : 0;
+}
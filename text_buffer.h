@@ -0,0 +1,107 @@
+/*
+  VitaShell
+  Copyright (C) 2015-2018, TheFloW
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __TEXT_BUFFER_H__
+#define __TEXT_BUFFER_H__
+
+#define TEXT_BUFFER_MAX_UNDO 64
+#define TEXT_BUFFER_MAX_PAGES 16
+
+enum TextPieceSources {
+  TEXT_PIECE_ORIGINAL,
+  TEXT_PIECE_ADD,
+};
+
+// Positions are 64-bit, a paged file may be larger than 2 GB
+typedef struct TextPiece {
+  int source;
+  SceOff start;
+  SceOff length;
+} TextPiece;
+
+// A region that differs between two versions of the document:
+// [offset, offset + removed) of the old one became [offset, offset + inserted)
+typedef struct TextEdit {
+  int offset;
+  int removed;
+  int inserted;
+} TextEdit;
+
+typedef struct TextVersion {
+  TextPiece *pieces;
+  int n_pieces;
+  TextEdit edit;
+} TextVersion;
+
+// A window of a file that is too large to be loaded at once
+typedef struct TextPage {
+  char *data;
+  SceOff offset;
+  int length;
+  int last_used;
+} TextPage;
+
+// Piece table: the original text is never modified, inserted text is
+// appended to the add buffer and the document is a list of pieces of both.
+// The original text is either in memory or paged in from a file.
+typedef struct TextBuffer {
+  char *original;
+  SceOff original_size;
+  char *add;
+  int add_size;
+  int add_capacity;
+  TextPiece *pieces;
+  SceOff *piece_offsets;
+  int n_pieces;
+  int max_pieces;
+  SceOff size;
+  int last_piece;
+  TextVersion undo[TEXT_BUFFER_MAX_UNDO];
+  int n_undo;
+  TextVersion redo[TEXT_BUFFER_MAX_UNDO];
+  int n_redo;
+  int group_level;
+  SceUID fd;
+  SceOff file_offset;
+  TextPage pages[TEXT_BUFFER_MAX_PAGES];
+  int n_pages;
+  int page_size;
+  int page_clock;
+} TextBuffer;
+
+int textBufferInit(TextBuffer *tb, char *original, SceOff size);
+int textBufferOpenFile(TextBuffer *tb, const char *file, SceOff offset, SceOff size, int n_pages, int page_size);
+void textBufferFree(TextBuffer *tb);
+
+const char *textBufferChunk(TextBuffer *tb, SceOff offset, int *length);
+int textBufferRead(TextBuffer *tb, SceOff offset, char *dst, int length);
+int textBufferGetChar(TextBuffer *tb, SceOff offset);
+
+int textBufferAppend(TextBuffer *tb, const char *data, int length);
+int textBufferInsert(TextBuffer *tb, int offset, const char *data, int length);
+int textBufferDelete(TextBuffer *tb, int offset, int length);
+int textBufferReplace(TextBuffer *tb, int offset, int length, const char *data, int new_length);
+
+void textBufferBeginGroup(TextBuffer *tb);
+void textBufferEndGroup(TextBuffer *tb);
+int textBufferUndo(TextBuffer *tb, TextEdit *edit);
+int textBufferRedo(TextBuffer *tb, TextEdit *edit);
+
+int textBufferSave(TextBuffer *tb, SceUID fd);
+
+#endif
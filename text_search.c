@@ -0,0 +1,133 @@
+/*
+  VitaShell
+  Copyright (C) 2015-2018, TheFloW
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+
+#include "text_search.h"
+
+static unsigned char fold[256];
+static int fold_ready = 0;
+
+static void initFold() {
+  int i;
+  for (i = 0; i < 256; i++)
+    fold[i] = (i >= 'A' && i <= 'Z') ? (i - 'A' + 'a') : i;
+
+  fold_ready = 1;
+}
+
+int textSearchCompile(TextSearch *search, const char *pattern, int flags) {
+  if (!fold_ready)
+    initFold();
+
+  memset(search, 0, sizeof(TextSearch));
+  search->flags = flags;
+
+  int length = strlen(pattern);
+  if (length == 0 || length >= TEXT_SEARCH_MAX_PATTERN)
+    return -1;
+
+  search->length = length;
+
+  if (flags & TEXT_SEARCH_REGEX) {
+    // POSIX extended syntax on bytes, '.' and '^' '$' stop at line breaks
+    OnigErrorInfo einfo;
+    const OnigUChar *start = (const OnigUChar *)pattern;
+    if (onig_new(&search->regex, start, start + length,
+                 ONIG_OPTION_IGNORECASE | ONIG_OPTION_NEGATE_SINGLELINE,
+                 ONIG_ENCODING_ASCII, ONIG_SYNTAX_POSIX_EXTENDED, &einfo) != ONIG_NORMAL) {
+      search->regex = NULL;
+      search->length = 0;
+      return -1;
+    }
+
+    return 0;
+  }
+
+  // Horspool shift table, indexed by the folded byte under the pattern end
+  int i;
+  for (i = 0; i < length; i++)
+    search->pattern[i] = fold[(unsigned char)pattern[i]];
+
+  for (i = 0; i < 256; i++)
+    search->skip[i] = length;
+
+  for (i = 0; i < length - 1; i++)
+    search->skip[search->pattern[i]] = length - 1 - i;
+
+  return 0;
+}
+
+void textSearchFree(TextSearch *search) {
+  if ((search->flags & TEXT_SEARCH_REGEX) && search->regex) {
+    onig_free(search->regex);
+    search->regex = NULL;
+  }
+
+  search->length = 0;
+}
+
+// Offset of the first match in buffer, or -1. The buffer is not
+// terminated, NUL bytes in it are searched like any other byte.
+int textSearchFind(TextSearch *search, const char *buffer, int length, int *match_length) {
+  if (search->length == 0)
+    return -1;
+
+  if (search->flags & TEXT_SEARCH_REGEX) {
+    // A region of its own, the editor and the file search may search at once
+    OnigRegion region;
+    onig_region_init(&region);
+
+    const OnigUChar *start = (const OnigUChar *)buffer;
+    const OnigUChar *end = start + length;
+    OnigPosition res = onig_search(search->regex, start, end, start, end, &region, ONIG_OPTION_NONE);
+
+    if (res >= 0 && match_length)
+      *match_length = region.end[0] - region.beg[0];
+
+    onig_region_free(&region, 0);
+
+    return res >= 0 ? (int)res : -1;
+  }
+
+  const unsigned char *p = (const unsigned char *)buffer;
+  const unsigned char *pattern = search->pattern;
+  int last = search->length - 1;
+  unsigned char last_char = pattern[last];
+
+  int i = 0;
+  while (i + last < length) {
+    unsigned char c = fold[p[i + last]];
+
+    if (c == last_char) {
+      int j = 0;
+      while (j < last && fold[p[i + j]] == pattern[j])
+        j++;
+
+      if (j == last) {
+        if (match_length)
+          *match_length = search->length;
+        return i;
+      }
+    }
+
+    i += search->skip[c];
+  }
+
+  return -1;
+}
@@ -0,0 +1,44 @@
+/*
+  VitaShell
+  Copyright (C) 2015-2018, TheFloW
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __TEXT_SEARCH_H__
+#define __TEXT_SEARCH_H__
+
+#include <onigmo.h>
+
+#define TEXT_SEARCH_MAX_PATTERN 1024
+
+enum TextSearchFlags {
+  TEXT_SEARCH_REGEX = 0x1,
+};
+
+// A case-insensitive search compiled once per query. Plain terms use
+// Horspool on case-folded bytes, regular expressions use onigmo.
+typedef struct TextSearch {
+  int flags;
+  int length;
+  unsigned char pattern[TEXT_SEARCH_MAX_PATTERN];
+  int skip[256];
+  OnigRegex regex;
+} TextSearch;
+
+int textSearchCompile(TextSearch *search, const char *pattern, int flags);
+void textSearchFree(TextSearch *search);
+int textSearchFind(TextSearch *search, const char *buffer, int length, int *match_length);
+
+#endif
@@ -0,0 +1,570 @@
+/*
+  VitaShell
+  Copyright (C) 2015-2018, TheFloW
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "main.h"
+#include "file.h"
+#include "image.h"
+#include "thumbnail.h"
+
+enum ThumbnailStates {
+  THUMBNAIL_EMPTY,
+  THUMBNAIL_PENDING,
+  THUMBNAIL_LOADING,
+  THUMBNAIL_READY,
+  THUMBNAIL_FAILED,
+};
+
+// A texture slot. The browser owns EMPTY, PENDING, READY and FAILED
+// slots, the generator thread owns LOADING ones until it is done.
+typedef struct Thumbnail {
+  ThumbnailKey key;
+  int state;
+  int type;
+  char path[MAX_PATH_LENGTH];
+  vita2d_texture *tex;
+  uint32_t last_frame;
+  uint32_t seq;
+} Thumbnail;
+
+static Thumbnail thumbnails[THUMBNAIL_TEXTURES];
+
+// Evicted textures, freed at the start of the next frame
+static vita2d_texture *release_list[THUMBNAIL_TEXTURES];
+static int release_count = 0;
+
+static SceKernelLwMutexWork thumbnail_mutex;
+static SceUID work_sema = -1;
+static uint32_t frame = 0;
+static uint32_t seq = 0;
+static int initialized = 0;
+
+// Cache file, only touched by the generator thread
+static ThumbnailCacheHeader cache_header;
+static ThumbnailCacheEntry cache_entries[THUMBNAIL_CACHE_ENTRIES];
+static SceUID cache_fd = -1;
+static int cache_dirty = 0;
+
+static uint8_t *exif_buffer = NULL;
+static uint16_t pixels[THUMBNAIL_WIDTH * THUMBNAIL_HEIGHT];
+
+static uint64_t hash_path(const char *path) {
+  uint64_t hash = 0xCBF29CE484222325ULL;
+
+  while (*path) {
+    hash ^= (uint8_t)*path++;
+    hash *= 0x100000001B3ULL;
+  }
+
+  return hash;
+}
+
+static SceOff cache_slot_offset(int index) {
+  return sizeof(ThumbnailCacheHeader) + sizeof(cache_entries) + (SceOff)index * THUMBNAIL_SLOT_SIZE;
+}
+
+static void cache_open() {
+  sceIoMkdir("ux0:VitaShell/internal", 0777);
+
+  cache_fd = sceIoOpen(THUMBNAIL_CACHE_PATH, SCE_O_RDWR | SCE_O_CREAT, 0777);
+  if (cache_fd < 0)
+    return;
+
+  if (sceIoRead(cache_fd, &cache_header, sizeof(ThumbnailCacheHeader)) == sizeof(ThumbnailCacheHeader) &&
+      cache_header.magic == THUMBNAIL_CACHE_MAGIC &&
+      cache_header.version == THUMBNAIL_CACHE_VERSION &&
+      cache_header.count == THUMBNAIL_CACHE_ENTRIES &&
+      sceIoRead(cache_fd, cache_entries, sizeof(cache_entries)) == sizeof(cache_entries))
+    return;
+
+  // Missing or from another version, start with an empty table
+  memset(&cache_header, 0, sizeof(ThumbnailCacheHeader));
+  memset(cache_entries, 0, sizeof(cache_entries));
+  cache_header.magic = THUMBNAIL_CACHE_MAGIC;
+  cache_header.version = THUMBNAIL_CACHE_VERSION;
+  cache_header.count = THUMBNAIL_CACHE_ENTRIES;
+  cache_dirty = 1;
+}
+
+static void cache_flush() {
+  if (cache_fd < 0 || !cache_dirty)
+    return;
+
+  if (sceIoPwrite(cache_fd, &cache_header, sizeof(ThumbnailCacheHeader), 0) == sizeof(ThumbnailCacheHeader) &&
+      sceIoPwrite(cache_fd, cache_entries, sizeof(cache_entries), sizeof(ThumbnailCacheHeader)) == sizeof(cache_entries))
+    cache_dirty = 0;
+}
+
+static int cache_write_entry(int index) {
+  SceOff offset = sizeof(ThumbnailCacheHeader) + index * sizeof(ThumbnailCacheEntry);
+  return sceIoPwrite(cache_fd, &cache_entries[index], sizeof(ThumbnailCacheEntry), offset);
+}
+
+static int cache_find(const ThumbnailKey *key) {
+  int i;
+  for (i = 0; i < THUMBNAIL_CACHE_ENTRIES; i++) {
+    if (cache_entries[i].width != 0 && memcmp(&cache_entries[i].key, key, sizeof(ThumbnailKey)) == 0)
+      return i;
+  }
+
+  return -1;
+}
+
+// Reads the pixels of an entry, returns 1 on success
+static int cache_read(int index) {
+  ThumbnailCacheEntry *entry = &cache_entries[index];
+  int size = entry->width * entry->height * 2;
+
+  if (sceIoPread(cache_fd, pixels, size, cache_slot_offset(index)) != size)
+    return 0;
+
+  entry->last_used = ++cache_header.clock;
+  cache_dirty = 1;
+
+  return 1;
+}
+
+// Stores the pixels in the least recently used slot
+static void cache_store(const ThumbnailKey *key, int width, int height) {
+  if (cache_fd < 0)
+    return;
+
+  int i, index = 0;
+  for (i = 0; i < THUMBNAIL_CACHE_ENTRIES; i++) {
+    if (cache_entries[i].width == 0) {
+      index = i;
+      break;
+    }
+
+    if (cache_entries[i].last_used < cache_entries[index].last_used)
+      index = i;
+  }
+
+  ThumbnailCacheEntry *entry = &cache_entries[index];
+
+  // Drop the old key on disk first, an interrupted write must not
+  // leave it pointing at the new pixels
+  if (entry->width != 0) {
+    entry->width = 0;
+    cache_dirty = 1;
+    if (cache_write_entry(index) != sizeof(ThumbnailCacheEntry))
+      return;
+  }
+
+  int size = width * height * 2;
+  if (sceIoPwrite(cache_fd, pixels, size, cache_slot_offset(index)) != size)
+    return;
+
+  memcpy(&entry->key, key, sizeof(ThumbnailKey));
+  entry->last_used = ++cache_header.clock;
+  entry->width = width;
+  entry->height = height;
+  cache_write_entry(index);
+  cache_dirty = 1;
+}
+
+static uint32_t exif_read16(const uint8_t *p, int big_endian) {
+  return big_endian ? ((p[0] << 8) | p[1]) : (p[0] | (p[1] << 8));
+}
+
+static uint32_t exif_read32(const uint8_t *p, int big_endian) {
+  return big_endian ? ((p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3]) :
+                      (p[0] | (p[1] << 8) | (p[2] << 16) | (p[3] << 24));
+}
+
+// IFD1 of the TIFF structure describes the thumbnail, returns its offset
+// from the start of the TIFF header or -1
+static int exif_parse_tiff(const uint8_t *tiff, uint32_t size, int *length) {
+  if (size < 8)
+    return -1;
+
+  int big_endian;
+  if (tiff[0] == 'I' && tiff[1] == 'I') {
+    big_endian = 0;
+  } else if (tiff[0] == 'M' && tiff[1] == 'M') {
+    big_endian = 1;
+  } else {
+    return -1;
+  }
+
+  if (exif_read16(tiff + 2, big_endian) != 42)
+    return -1;
+
+  // Skip IFD0, the offset of IFD1 follows its entries
+  uint32_t ifd = exif_read32(tiff + 4, big_endian);
+  if (ifd > size - 2)
+    return -1;
+
+  uint32_t next = ifd + 2 + exif_read16(tiff + ifd, big_endian) * 12;
+  if (next > size - 4)
+    return -1;
+
+  ifd = exif_read32(tiff + next, big_endian);
+  if (ifd == 0 || ifd > size - 2)
+    return -1;
+
+  uint32_t count = exif_read16(tiff + ifd, big_endian);
+  if (ifd + 2 + count * 12 > size)
+    return -1;
+
+  uint32_t offset = 0, len = 0;
+
+  uint32_t i;
+  for (i = 0; i < count; i++) {
+    const uint8_t *entry = tiff + ifd + 2 + i * 12;
+    uint32_t tag = exif_read16(entry, big_endian);
+
+    if (tag == 0x0201) // JPEGInterchangeFormat
+      offset = exif_read32(entry + 8, big_endian);
+    else if (tag == 0x0202) // JPEGInterchangeFormatLength
+      len = exif_read32(entry + 8, big_endian);
+  }
+
+  if (offset == 0 || len == 0 || offset > size || len > size - offset)
+    return -1;
+
+  *length = len;
+  return offset;
+}
+
+// Finds the JPEG thumbnail of the APP1 EXIF segment, returns its offset
+// in buffer or -1
+static int exif_find_thumbnail(const uint8_t *buffer, int size, int *length) {
+  if (size < 4 || buffer[0] != 0xFF || buffer[1] != 0xD8)
+    return -1;
+
+  int pos = 2;
+  while (pos + 4 <= size) {
+    if (buffer[pos] != 0xFF)
+      return -1;
+
+    int marker = buffer[pos + 1];
+    int segment_length = (buffer[pos + 2] << 8) | buffer[pos + 3];
+
+    // Metadata is over once the image data starts
+    if (marker == 0xDA || segment_length < 2)
+      return -1;
+
+    if (marker == 0xE1 && pos + 10 <= size && memcmp(buffer + pos + 4, "Exif\0\0", 6) == 0) {
+      int tiff = pos + 10;
+      int end = MIN(pos + 2 + segment_length, size);
+
+      int offset = exif_parse_tiff(buffer + tiff, end - tiff, length);
+      return offset < 0 ? -1 : tiff + offset;
+    }
+
+    pos += 2 + segment_length;
+  }
+
+  return -1;
+}
+
+static vita2d_texture *load_exif_thumbnail(const char *path) {
+  if (!exif_buffer)
+    return NULL;
+
+  SceUID fd = sceIoOpen(path, SCE_O_RDONLY, 0);
+  if (fd < 0)
+    return NULL;
+
+  int size = sceIoRead(fd, exif_buffer, THUMBNAIL_EXIF_READ_SIZE);
+  sceIoClose(fd);
+
+  if (size <= 0)
+    return NULL;
+
+  int length;
+  int offset = exif_find_thumbnail(exif_buffer, size, &length);
+  if (offset < 0)
+    return NULL;
+
+  int width, height;
+  vita2d_texture *tex = imageLoadBuffer(exif_buffer + offset, length, FILE_TYPE_JPEG,
+                                        THUMBNAIL_WIDTH, THUMBNAIL_HEIGHT, &width, &height, NULL);
+
+  // Tiny thumbnails look worse than decoding the image itself
+  if (tex && width < THUMBNAIL_WIDTH / 2) {
+    vita2d_free_texture(tex);
+    tex = NULL;
+  }
+
+  return tex;
+}
+
+// Box filters an RGBA texture into pixels, fitting it in the thumbnail size
+static void fit_texture(vita2d_texture *tex, int *width, int *height) {
+  int src_width = vita2d_texture_get_width(tex);
+  int src_height = vita2d_texture_get_height(tex);
+  int stride = vita2d_texture_get_stride(tex);
+  const uint8_t *data = vita2d_texture_get_datap(tex);
+
+  int w = src_width, h = src_height;
+  if (w > THUMBNAIL_WIDTH || h > THUMBNAIL_HEIGHT) {
+    w = THUMBNAIL_WIDTH;
+    h = src_height * THUMBNAIL_WIDTH / src_width;
+    if (h > THUMBNAIL_HEIGHT) {
+      h = THUMBNAIL_HEIGHT;
+      w = src_width * THUMBNAIL_HEIGHT / src_height;
+    }
+
+    w = MAX(w, 1);
+    h = MAX(h, 1);
+  }
+
+  int x, y;
+  for (y = 0; y < h; y++) {
+    int y0 = y * src_height / h;
+    int y1 = MAX((y + 1) * src_height / h, y0 + 1);
+
+    for (x = 0; x < w; x++) {
+      int x0 = x * src_width / w;
+      int x1 = MAX((x + 1) * src_width / w, x0 + 1);
+      uint32_t r = 0, g = 0, b = 0;
+
+      int sx, sy;
+      for (sy = y0; sy < y1; sy++) {
+        const uint8_t *p = data + sy * stride + x0 * 4;
+        for (sx = x0; sx < x1; sx++, p += 4) {
+          r += p[0];
+          g += p[1];
+          b += p[2];
+        }
+      }
+
+      uint32_t n = (x1 - x0) * (y1 - y0);
+      pixels[y * w + x] = (((b / n) >> 3) << 11) | (((g / n) >> 2) << 5) | ((r / n) >> 3);
+    }
+  }
+
+  *width = w;
+  *height = h;
+}
+
+static int generate_thumbnail(const char *path, int type, int *width, int *height) {
+  vita2d_texture *tex = NULL;
+
+  if (type == FILE_TYPE_JPEG)
+    tex = load_exif_thumbnail(path);
+
+  if (!tex) {
+    int image_width, image_height;
+    tex = imageLoadFile(path, type, THUMBNAIL_WIDTH, THUMBNAIL_HEIGHT, &image_width, &image_height, NULL);
+    if (!tex)
+      return -1;
+  }
+
+  fit_texture(tex, width, height);
+  vita2d_free_texture(tex);
+
+  return 0;
+}
+
+static vita2d_texture *load_thumbnail(const ThumbnailKey *key, const char *path, int type) {
+  int width, height;
+
+  int index = cache_find(key);
+  if (index >= 0 && cache_read(index)) {
+    width = cache_entries[index].width;
+    height = cache_entries[index].height;
+  } else {
+    if (generate_thumbnail(path, type, &width, &height) < 0)
+      return NULL;
+
+    cache_store(key, width, height);
+  }
+
+  vita2d_texture *tex = vita2d_create_empty_texture_format(width, height, SCE_GXM_TEXTURE_FORMAT_U5U6U5_BGR);
+  if (!tex)
+    return NULL;
+
+  uint8_t *data = vita2d_texture_get_datap(tex);
+  int stride = vita2d_texture_get_stride(tex);
+
+  int y;
+  for (y = 0; y < height; y++)
+    memcpy(data + y * stride, pixels + y * width, width * 2);
+
+  vita2d_texture_set_filters(tex, SCE_GXM_TEXTURE_FILTER_LINEAR, SCE_GXM_TEXTURE_FILTER_LINEAR);
+
+  return tex;
+}
+
+// Picks the next slot to generate: the one most recently on screen,
+// and of those the one asked for first. Slots that scrolled out of
+// view are dropped without any work.
+static Thumbnail *next_pending() {
+  Thumbnail *next = NULL;
+
+  int i;
+  for (i = 0; i < THUMBNAIL_TEXTURES; i++) {
+    Thumbnail *t = &thumbnails[i];
+    if (t->state != THUMBNAIL_PENDING)
+      continue;
+
+    if (t->last_frame + 1 < frame) {
+      t->state = THUMBNAIL_EMPTY;
+      continue;
+    }
+
+    if (!next || t->last_frame > next->last_frame ||
+        (t->last_frame == next->last_frame && t->seq < next->seq))
+      next = t;
+  }
+
+  return next;
+}
+
+static int thumbnail_thread(SceSize args, void *argp) {
+  ThumbnailKey key;
+  char path[MAX_PATH_LENGTH];
+  int type;
+
+  exif_buffer = malloc(THUMBNAIL_EXIF_READ_SIZE);
+  cache_open();
+
+  while (1) {
+    sceKernelWaitSema(work_sema, 1, NULL);
+
+    while (1) {
+      sceKernelLockLwMutex(&thumbnail_mutex, 1, NULL);
+
+      Thumbnail *t = next_pending();
+      if (t) {
+        t->state = THUMBNAIL_LOADING;
+        memcpy(&key, &t->key, sizeof(ThumbnailKey));
+        strcpy(path, t->path);
+        type = t->type;
+      }
+
+      sceKernelUnlockLwMutex(&thumbnail_mutex, 1);
+
+      if (!t)
+        break;
+
+      vita2d_texture *tex = load_thumbnail(&key, path, type);
+
+      sceKernelLockLwMutex(&thumbnail_mutex, 1, NULL);
+      t->tex = tex;
+      t->state = tex ? THUMBNAIL_READY : THUMBNAIL_FAILED;
+      sceKernelUnlockLwMutex(&thumbnail_mutex, 1);
+    }
+
+    // Idle, write back the recency of the entries that were used
+    cache_flush();
+  }
+
+  return sceKernelExitDeleteThread(0);
+}
+
+void initThumbnails() {
+  memset(thumbnails, 0, sizeof(thumbnails));
+
+  sceKernelCreateLwMutex(&thumbnail_mutex, "thumbnail_mutex", 2, 0, NULL);
+  work_sema = sceKernelCreateSema("thumbnail_work_sema", 0, 0, 0x7FFFFFFF, NULL);
+
+  SceUID thid = sceKernelCreateThread("thumbnail_thread", (SceKernelThreadEntry)thumbnail_thread, 0x10000100, 0x40000, 0, 0x70000, NULL);
+  if (thid < 0)
+    return;
+
+  sceKernelStartThread(thid, 0, NULL);
+  initialized = 1;
+}
+
+// Called once per browser frame before drawing
+void thumbnailBeginFrame() {
+  vita2d_texture *release[THUMBNAIL_TEXTURES];
+  int n;
+
+  if (!initialized)
+    return;
+
+  sceKernelLockLwMutex(&thumbnail_mutex, 1, NULL);
+  frame++;
+  n = release_count;
+  memcpy(release, release_list, n * sizeof(vita2d_texture *));
+  release_count = 0;
+  sceKernelUnlockLwMutex(&thumbnail_mutex, 1);
+
+  if (n > 0) {
+    vita2d_wait_rendering_done();
+
+    int i;
+    for (i = 0; i < n; i++)
+      vita2d_free_texture(release[i]);
+  }
+}
+
+// Returns the thumbnail of an image, or NULL while it is being generated.
+// Never blocks: misses are queued for the generator thread.
+vita2d_texture *thumbnailGet(const char *path, int type, SceOff size, SceDateTime *mtime) {
+  if (!initialized || strlen(path) >= MAX_PATH_LENGTH)
+    return NULL;
+
+  ThumbnailKey key;
+  memset(&key, 0, sizeof(ThumbnailKey));
+  key.path_hash = hash_path(path);
+  key.size = size;
+  memcpy(&key.mtime, mtime, sizeof(SceDateTime));
+
+  vita2d_texture *tex = NULL;
+  int queued = 0;
+
+  sceKernelLockLwMutex(&thumbnail_mutex, 1, NULL);
+
+  Thumbnail *victim = NULL;
+
+  int i;
+  for (i = 0; i < THUMBNAIL_TEXTURES; i++) {
+    Thumbnail *t = &thumbnails[i];
+
+    if (t->state != THUMBNAIL_EMPTY && memcmp(&t->key, &key, sizeof(ThumbnailKey)) == 0) {
+      t->last_frame = frame;
+      tex = (t->state == THUMBNAIL_READY) ? t->tex : NULL;
+      sceKernelUnlockLwMutex(&thumbnail_mutex, 1);
+      return tex;
+    }
+
+    // Never evict what is being generated or already drawn this frame
+    if (t->state == THUMBNAIL_LOADING || (t->state != THUMBNAIL_EMPTY && t->last_frame == frame))
+      continue;
+
+    if (!victim || (victim->state != THUMBNAIL_EMPTY &&
+                    (t->state == THUMBNAIL_EMPTY || t->last_frame < victim->last_frame)))
+      victim = t;
+  }
+
+  if (victim && !(victim->tex && release_count == THUMBNAIL_TEXTURES)) {
+    if (victim->tex)
+      release_list[release_count++] = victim->tex;
+
+    memcpy(&victim->key, &key, sizeof(ThumbnailKey));
+    strcpy(victim->path, path);
+    victim->type = type;
+    victim->tex = NULL;
+    victim->state = THUMBNAIL_PENDING;
+    victim->last_frame = frame;
+    victim->seq = seq++;
+    queued = 1;
+  }
+
+  sceKernelUnlockLwMutex(&thumbnail_mutex, 1);
+
+  if (queued)
+    sceKernelSignalSema(work_sema, 1);
+
+  return NULL;
+}
@@ -0,0 +1,65 @@
+/*
+  VitaShell
+  Copyright (C) 2015-2018, TheFloW
+
+  This program is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __THUMBNAIL_H__
+#define __THUMBNAIL_H__
+
+#define THUMBNAIL_CACHE_PATH "ux0:VitaShell/internal/thumbnails.bin"
+#define THUMBNAIL_CACHE_MAGIC 0x4E484254 // "TBHN"
+#define THUMBNAIL_CACHE_VERSION 1
+
+// Thumbnails are RGB565 and fit in this box, each has a fixed slot in the
+// cache file, so at most THUMBNAIL_CACHE_ENTRIES * THUMBNAIL_SLOT_SIZE bytes
+#define THUMBNAIL_WIDTH 160
+#define THUMBNAIL_HEIGHT 90
+#define THUMBNAIL_SLOT_SIZE (THUMBNAIL_WIDTH * THUMBNAIL_HEIGHT * 2)
+#define THUMBNAIL_CACHE_ENTRIES 1024
+
+// Textures kept in memory, enough for a page of the grid and the ones around it
+#define THUMBNAIL_TEXTURES 48
+
+// The EXIF segment is at most 64KB and always near the start of the file
+#define THUMBNAIL_EXIF_READ_SIZE (64 * 1024)
+
+typedef struct ThumbnailKey {
+  uint64_t path_hash;
+  SceOff size;
+  SceDateTime mtime;
+} ThumbnailKey;
+
+typedef struct ThumbnailCacheHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t count;
+  uint32_t clock;
+} ThumbnailCacheHeader;
+
+// An entry with a width of 0 is free, last_used orders the others for eviction
+typedef struct ThumbnailCacheEntry {
+  ThumbnailKey key;
+  uint32_t last_used;
+  uint16_t width;
+  uint16_t height;
+} ThumbnailCacheEntry;
+
+void initThumbnails();
+
+void thumbnailBeginFrame();
+vita2d_texture *thumbnailGet(const char *path, int type, SceOff size, SceDateTime *mtime);
+
+#endif
@@ -42,6 +42,8 @@ typedef struct {
   int audio_repeat; // New for audio repeat mode
   int font_size; // New for font size setting
   int enable_touch; // New for touch input toggle
+  int archive_cache_size; // Archive entry cache budget in MB
+  int thumbnail_view; // Show folders as a thumbnail grid
 } VitaShellConfig;
 
 // QR functionality always available - no usage restrictions
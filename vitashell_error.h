@@ -29,9 +29,11 @@ enum VitaShellErrors {
   VITASHELL_ERROR_ILLEGAL_ADDR            = 0xF0010006,
   VITASHELL_ERROR_ALREADY_RUNNING         = 0xF0010007,
   VITASHELL_ERROR_NOT_RUNNING             = 0xF0010008,
+  VITASHELL_ERROR_SHORT_WRITE             = 0xF0010009,
 
   VITASHELL_ERROR_SRC_AND_DST_IDENTICAL   = 0xF0020000,
   VITASHELL_ERROR_DST_IS_SUBFOLDER_OF_SRC = 0xF0020001,
+  VITASHELL_ERROR_NOT_SAME_PARTITION      = 0xF0020002,
 
   VITASHELL_ERROR_INVALID_TITLEID         = 0xF0030000,
 
@@ -42,6 +44,8 @@ enum VitaShellErrors {
 
   VITASHELL_ERROR_NAVIGATION = 0xF0050000,
 
+  VITASHELL_ERROR_ARCHIVE_TOO_DEEP = 0xF0060000,
+
 
 
 